@@ -1,5 +1,7 @@
 rm -rf moc/
 rm -rf obj/
-rm Makefile
-rm .qmake.stash
-rm jetsonCamApp
\ No newline at end of file
+rm -rf src/moc/ src/obj/
+rm -rf tools/*/moc/ tools/*/obj/
+rm -f Makefile src/Makefile tools/*/Makefile
+rm -f .qmake.stash src/.qmake.stash tools/*/.qmake.stash
+rm -f jetsonCamApp jetsonCamDaemon jetsonCamBench jetsonCamRawExport jetsonCamLog2Csv jetsonCamCodecCheck
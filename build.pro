@@ -1,32 +1,21 @@
-TEMPLATE = app
-TARGET = jetsonCamApp
-QT += widgets concurrent charts
-OBJECTS_DIR = obj
-MOC_DIR = moc
-SOURCES += src/main.cpp
-HEADERS += src/appwindow.h src/camerahandler.h src/cpu_process.h
-# CUDA_DIR = /usr/local/cuda
-# INCLUDEPATH += $$CUDA_DIR/include
-CONFIG += c++17
+TEMPLATE = subdirs
 
-# Linux用の設定
-unix:!macx {
-    # 64ビットx86アーキテクチャの場合
-    contains(QT_ARCH, "x86_64") {
-        message("Configuring for x86_64 Linux")
-        INCLUDEPATH += /opt/spinnaker/include/
-        LIBS += -L/opt/spinnaker/lib -lSpinnaker -L./obj #-lcuda_functions -L$$CUDA_DIR/lib64 -lcudart
-    }
-
-    # 64ビットARMアーキテクチャの場合
-    contains(QT_ARCH, "arm64") {
-        message("Configuring for arm64 Linux")
-        INCLUDEPATH += /opt/spinnaker/include/
-        LIBS += -L/opt/spinnaker/lib -lSpinnaker -L./obj #-lcuda_functions -L$$CUDA_DIR/lib64 -lcudart
-    }
-}
-
-# Windows用の設定
-win32 {
-    # Windows特有の設定
-}
+# jetsonCamApp: GUIアプリ本体 (Spinnaker SDKが必要)
+# jetsonCamDaemon: 画面なしで取得・解析・記録を行うデーモン (Spinnaker SDKが必要)
+# jetsonCamBench: 合成フレームでパイプライン全体の処理能力を測るヘッドレスベンチマーク (Spinnaker不要)
+# jetsonCamRawExport: 記録コンテナ (.jcr) を連番BMPに書き出す
+# jetsonCamLog2Csv: 解析結果のバイナリログ (.jtl) をCSVに変換する
+# jetsonCamCodecCheck: 可逆圧縮の往復検証と速度測定
+# jetsonCamReprocess: 記録済みのフレーム (連番BMP/.jcr) から解析結果のログを作り直す
+# jetsonCamShmReader: 共有メモリに書き出したフレームを別プロセスから読む例 (Qt不要)
+# jetsonCamTests: ヘッダだけの部分 (圧縮、画素形式の展開、記録とログの読み直し) のテスト (Qt不要、make check で実行)
+SUBDIRS += app daemon bench rawexport log2csv codeccheck reprocess shmreader tests
+app.file = src/app.pro
+daemon.file = daemon/daemon.pro
+bench.file = tools/bench/bench.pro
+rawexport.file = tools/rawexport/rawexport.pro
+log2csv.file = tools/log2csv/log2csv.pro
+codeccheck.file = tools/codeccheck/codeccheck.pro
+reprocess.file = tools/reprocess/reprocess.pro
+shmreader.file = tools/shmreader/shmreader.pro
+tests.file = tests/tests.pro
@@ -0,0 +1,8 @@
+# アプリとツールで共通の設定
+CONFIG += c++17
+OBJECTS_DIR = obj
+MOC_DIR = moc
+INCLUDEPATH += $$PWD/src
+DESTDIR = $$PWD
+# 共有メモリ (shm_open) は glibc 2.34 より前では librt にある
+unix: LIBS += -lrt
@@ -0,0 +1,9 @@
+TEMPLATE = app
+TARGET = jetsonCamDaemon
+QT += concurrent gui
+QT -= widgets
+CONFIG += console
+include(../common.pri)
+SOURCES += main.cpp
+HEADERS += $$PWD/../src/framepipeline.h
+include(../src/spinnaker.pri)
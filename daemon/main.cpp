@@ -0,0 +1,301 @@
+// 画面なしで取得→統計→記録→ログを動かすデーモン。ウィジェットもグラフも作らず、プレビューも作らない。
+// 設定は ini ファイル (--config) から読み、コマンドラインで上書きできる。SIGINT/SIGTERM で
+// 取得を止め、キューに残った分を書き切ってから終了する。
+#include "camerarig.h"
+#include "daemonconfig.h"
+#include "metricsexporter.h"
+#include "sourcefactory.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+int signalFds[2] = {-1, -1};
+
+// シグナルハンドラではソケットに1バイト書くだけにして、終了処理はイベントループで行う
+void onSignal(int) {
+    const char byte = 1;
+    const ssize_t ignored = ::write(signalFds[0], &byte, sizeof(byte));
+    (void)ignored;
+}
+
+bool installSignalHandlers() {
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFds) != 0) {
+        return false;
+    }
+    struct sigaction action {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    return sigaction(SIGINT, &action, nullptr) == 0 && sigaction(SIGTERM, &action, nullptr) == 0;
+}
+
+// コマンドラインで指定された項目だけ設定を上書きする
+bool applyOverrides(const QCommandLineParser& parser, DaemonConfig& config) {
+    if (parser.isSet("synthetic")) {
+        config.source.synthetic = parser.value("synthetic");
+    }
+    if (parser.isSet("noise")) {
+        config.source.noise = parser.value("noise").toDouble();
+    }
+    if (parser.isSet("cameras")) {
+        config.source.cameras = parser.value("cameras").toInt();
+    }
+    if (parser.isSet("replay")) {
+        config.source.replay = parser.values("replay");
+    }
+    if (parser.isSet("capture-cores") && !parseCoreList(parser.value("capture-cores"), config.captureCores)) {
+        std::cerr << "Invalid --capture-cores value." << std::endl;
+        return false;
+    }
+    if (parser.isSet("format") && !parseSensorFormat(parser.value("format"), config.source.format)) {
+        std::cerr << "Invalid --format value. Use mono8, mono10, mono10p, mono10packed, mono12, mono12p, "
+                     "mono12packed, mono14 or mono16." << std::endl;
+        return false;
+    }
+    if (parser.isSet("tone-map") && !parseToneMap(parser.value("tone-map"), config.source.toneMap)) {
+        std::cerr << "Invalid --tone-map value. Use black,white." << std::endl;
+        return false;
+    }
+    if (parser.isSet("record-dir")) {
+        config.recordDirectory = parser.value("record-dir");
+        config.recording = !config.recordDirectory.isEmpty();
+    }
+    if (parser.isSet("no-record")) {
+        config.recording = false;
+    }
+    if (parser.isSet("record-format") && !parseRecordFormat(parser.value("record-format"), config.recordFormat)) {
+        std::cerr << "Invalid --record-format value. Use raw, lossless, bmp or event." << std::endl;
+        return false;
+    }
+    if (parser.isSet("image-interval")) {
+        config.saveImageInterval = parser.value("image-interval").toInt();
+    }
+    if (parser.isSet("trigger")) {
+        config.trigger = parser.value("trigger");
+    }
+    if (parser.isSet("log-dir")) {
+        config.graphDirectory = parser.value("log-dir");
+    }
+    if (parser.isSet("sync-interval")) {
+        config.saveGraphInterval = parser.value("sync-interval").toInt();
+    }
+    if (parser.isSet("grid")) {
+        config.grid = parser.value("grid").toInt();
+    }
+    if (parser.isSet("rois")) {
+        config.rois = parser.value("rois");
+    }
+    if (parser.isSet("overload") && !parseOverloadPolicy(parser.value("overload"), config.overload)) {
+        std::cerr << "Invalid --overload value. Use block or drop." << std::endl;
+        return false;
+    }
+    if (parser.isSet("metrics-file")) {
+        config.metricsFile = parser.value("metrics-file");
+    }
+    if (parser.isSet("metrics-interval")) {
+        config.metricsInterval = parser.value("metrics-interval").toInt();
+    }
+    if (parser.isSet("correction") && !parseCorrectionMode(parser.value("correction"), config.correction)) {
+        std::cerr << "Invalid --correction value. Use off, flat or background." << std::endl;
+        return false;
+    }
+    if (parser.isSet("calibration-dir")) {
+        config.calibrationDirectory = parser.value("calibration-dir");
+    }
+    if (parser.isSet("capture-reference")) {
+        config.captureReference = parser.value("capture-reference").trimmed().toLower();
+    }
+    if (parser.isSet("shm")) {
+        config.shmName = parser.value("shm");
+    }
+    if (parser.isSet("print-interval")) {
+        config.printInterval = parser.value("print-interval").toInt();
+    }
+    return true;
+}
+
+// 1行でカメラごとのfpsと捨てた数、記録とログの状態を出す
+void printStatus(const CameraRig& rig, std::vector<uint64_t>& lastCaptured, std::vector<uint64_t>& lastProcessed,
+                 double elapsed) {
+    for (int i = 0; i < rig.size(); ++i) {
+        const FramePipeline& pipeline = rig.pipeline(i);
+        const uint64_t captured = pipeline.acquisition().capturedCount();
+        const uint64_t processed = pipeline.processedCount();
+        std::printf("camera %d%s: %.1f fps, processed %.1f fps, dropped stats %llu overload %llu record %llu, "
+                    "recorded %llu frames (%llu errors), events %llu, reconnects %llu, shm published %llu dropped %llu\n",
+                    i, pipeline.frameSource().connected() ? "" : " (connecting)",
+                    (captured - lastCaptured[i]) / elapsed, (processed - lastProcessed[i]) / elapsed,
+                    static_cast<unsigned long long>(pipeline.statsQueue().droppedCount()),
+                    static_cast<unsigned long long>(pipeline.overloadDroppedCount()),
+                    static_cast<unsigned long long>(pipeline.recordQueue().droppedCount()),
+                    static_cast<unsigned long long>(pipeline.recorder().framesWritten()),
+                    static_cast<unsigned long long>(pipeline.recorder().writeErrors()),
+                    static_cast<unsigned long long>(pipeline.events().eventsWritten()),
+                    static_cast<unsigned long long>(pipeline.frameSource().reconnectCount()),
+                    static_cast<unsigned long long>(pipeline.publisher().publishedCount()),
+                    static_cast<unsigned long long>(pipeline.publisher().queue().droppedCount()));
+        // 遅れの原因を見るための起動からのp99
+        const PipelineTimings& timings = pipeline.timings();
+        std::printf("camera %d p99 [ms]: capture wait %.2f, copy %.2f, correct %.2f, queue wait %.2f, stats %.2f, "
+                    "disk write %.2f\n",
+                    i, timings.captureWait.percentileMs(0.99), timings.copy.percentileMs(0.99),
+                    timings.correct.percentileMs(0.99), timings.queueWait.percentileMs(0.99), timings.stats.percentileMs(0.99),
+                    timings.record.percentileMs(0.99));
+        lastCaptured[i] = captured;
+        lastProcessed[i] = processed;
+    }
+    std::printf("log: %llu rows (dropped %llu, errors %llu)\n",
+                static_cast<unsigned long long>(rig.logger().recordsWritten()),
+                static_cast<unsigned long long>(rig.logger().droppedRecords()),
+                static_cast<unsigned long long>(rig.logger().writeErrors()));
+    std::fflush(stdout);
+}
+
+// カメラごとに directory/temporal_cam<番号>_<日時>.jcr に書き出す
+void exportTemporalMaps(const CameraRig& rig, const QString& directory) {
+    const QString stamp = QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss");
+    for (int i = 0; i < rig.size(); ++i) {
+        TemporalMaps maps;
+        if (rig.pipeline(i).temporal().snapshot(maps)) {
+            TemporalStats::exportMaps(maps, QDir(directory).filePath(QString("temporal_cam%1_%2.jcr").arg(i).arg(stamp)));
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless acquisition, statistics, recording and logging.");
+    parser.addHelpOption();
+    parser.addOption({"config", "ini file with [source], [record], [log], [analysis], [metrics], [correction], [temporal] and [shm] sections.", "file"});
+    parser.addOption({"synthetic", "Use synthetic frame sources instead of the cameras.", "WxH[@fps]"});
+    parser.addOption({"noise", "Noise standard deviation of the synthetic source.", "sigma"});
+    parser.addOption({"cameras", "Number of cameras or synthetic sources (0 = all connected cameras).", "n"});
+    parser.addOption({"replay", "Replay a BMP directory or .jcr recording (repeat for several cameras).", "path"});
+    parser.addOption({"capture-cores", "Comma separated CPU cores for the capture thread of each camera.", "list"});
+    parser.addOption({"format", "Pixel format of the synthetic source (mono8, mono12p, mono16, ...).", "format"});
+    parser.addOption({"tone-map", "Range of 10-16 bit pixel values mapped to the 8-bit plane.", "black,white"});
+    parser.addOption({"record-dir", "Record into this directory.", "dir"});
+    parser.addOption({"no-record", "Do not record even if the config file enables it."});
+    parser.addOption({"record-format", "raw, lossless, bmp or event.", "format"});
+    parser.addOption({"image-interval", "Save every n-th frame in BMP recording.", "n"});
+    parser.addOption({"trigger", "Event trigger, e.g. \"cv>0.05 pre=2 post=2\".", "rule"});
+    parser.addOption({"log-dir", "Write graph_data.jtl / tile_data.jtl into this directory.", "dir"});
+    parser.addOption({"sync-interval", "Flush the telemetry log to disk every ms.", "ms"});
+    parser.addOption({"grid", "Tile grid size (0 = off).", "n"});
+    parser.addOption({"rois", "ROIs as \"x,y,w,h; x,y,w,h\".", "list"});
+    parser.addOption({"overload", "What to do when statistics fall behind: block or drop.", "policy"});
+    parser.addOption({"metrics-file", "Write metrics in Prometheus text format to this file.", "file"});
+    parser.addOption({"metrics-interval", "Rewrite the metrics file every n seconds.", "seconds"});
+    parser.addOption({"correction", "Frame correction: off, flat or background.", "mode"});
+    parser.addOption({"calibration-dir", "Load and save dark/flat references in this directory.", "dir"});
+    parser.addOption({"capture-reference", "Capture a dark or flat reference right after start.", "dark|flat"});
+    parser.addOption({"shm", "Publish frames and statistics to this POSIX shared-memory ring (/dev/shm/<name>).", "name"});
+    parser.addOption({"print-interval", "Print a status line every n seconds (0 = never).", "seconds"});
+    parser.addOption({"duration", "Stop after this many seconds (0 = until SIGINT/SIGTERM).", "seconds", "0"});
+    parser.process(app);
+
+    DaemonConfig config;
+    try {
+        if (parser.isSet("config")) {
+            loadDaemonConfig(parser.value("config"), config);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (!applyOverrides(parser, config)) {
+        return 1;
+    }
+    if (!installSignalHandlers()) {
+        std::cerr << "Failed to install signal handlers." << std::endl;
+        return 1;
+    }
+
+    try {
+        CameraRig rig(createFrameSources(config.source), config.captureCores);
+        rig.disablePreview();
+        applyDaemonConfig(config, rig);
+
+        QSocketNotifier signalNotifier(signalFds[1], QSocketNotifier::Read);
+        QObject::connect(&signalNotifier, &QSocketNotifier::activated, [&]() {
+            char byte;
+            const ssize_t ignored = ::read(signalFds[1], &byte, sizeof(byte));
+            (void)ignored;
+            std::cout << "Stopping..." << std::endl;
+            app.quit();
+        });
+
+        std::vector<uint64_t> lastCaptured(rig.size(), 0);
+        std::vector<uint64_t> lastProcessed(rig.size(), 0);
+        QTimer statusTimer;
+        QObject::connect(&statusTimer, &QTimer::timeout, [&]() {
+            printStatus(rig, lastCaptured, lastProcessed, config.printInterval);
+        });
+        if (config.printInterval > 0) {
+            statusTimer.start(config.printInterval * 1000);
+        }
+        MetricsExporter metrics(rig);
+        metrics.setFile(config.metricsFile);
+        QTimer metricsTimer;
+        QObject::connect(&metricsTimer, &QTimer::timeout, [&]() {
+            metrics.update();
+        });
+        if (!config.metricsFile.isEmpty() && config.metricsInterval > 0) {
+            metricsTimer.start(config.metricsInterval * 1000);
+        }
+        QTimer temporalTimer;
+        QObject::connect(&temporalTimer, &QTimer::timeout, [&]() {
+            exportTemporalMaps(rig, config.temporalDirectory);
+        });
+        if (config.temporalExportInterval > 0) {
+            if (!QDir().mkpath(config.temporalDirectory)) {
+                std::cerr << "Failed to create " << config.temporalDirectory.toStdString() << std::endl;
+            }
+            temporalTimer.start(config.temporalExportInterval * 1000);
+        }
+        const double duration = parser.value("duration").toDouble();
+        if (duration > 0) {
+            QTimer::singleShot(static_cast<int>(duration * 1000), &app, &QCoreApplication::quit);
+        }
+
+        std::cout << "Statistics kernel: " << momentsKernelName() << ", correction kernel: "
+                  << FrameCorrector::kernelName() << std::endl;
+        if (!config.shmName.isEmpty()) {
+            std::cout << "Shared memory: " << rig.pipeline(0).publisher().name().toStdString()
+                      << (rig.size() > 1 ? " ..." : "") << ", " << config.shmSlots << " slots" << std::endl;
+        }
+        std::cout << rig.size() << " camera(s), recording " << (config.recording ? config.recordDirectory.toStdString() : "off")
+                  << ", log " << (config.graphDirectory.isEmpty() ? "off" : config.graphDirectory.toStdString()) << std::endl;
+        rig.start();
+        const int result = app.exec();
+        // rig のデストラクタで取得を止め、統計・記録・ログを書き切る
+        statusTimer.stop();
+        metricsTimer.stop();
+        temporalTimer.stop();
+        return result;
+    } catch (const Spinnaker::Exception& e) {
+        std::cerr << "Spinnaker error: " << e.what() << std::endl;
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
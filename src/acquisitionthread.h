@@ -0,0 +1,104 @@
+#ifndef ACQUISITIONTHREAD_H
+#define ACQUISITIONTHREAD_H
+
+#include "cpuaffinity.h"
+#include "framecorrector.h"
+#include "framesource.h"
+#include "framequeue.h"
+#include "reductionpool.h"
+#include "stagestats.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// カメラからの取得だけを行う専用スレッド。取得したフレームに通し番号を振り、登録された全キューへ配る。
+// GUIや解析が詰まってもここは止まらず、あふれた分は各キューで捨てて数える。
+class AcquisitionThread : public QThread {
+public:
+    // timings の capture / captureWait / copy / correct に記録する
+    AcquisitionThread(FrameSource& source, PipelineTimings& timings, QObject *parent = nullptr)
+        : QThread(parent), source(source), timings(timings) {}
+
+    ~AcquisitionThread() override {
+        requestInterruption();
+        wait();
+    }
+
+    // start() より前に呼ぶこと
+    void addQueue(FrameQueue* queue) {
+        queues.push_back(queue);
+    }
+
+    void removeQueue(FrameQueue* queue) {
+        queues.erase(std::remove(queues.begin(), queues.end(), queue), queues.end());
+    }
+
+    // 配る前に補正をかける (nullptr なら補正しない)。行ストライプは pool のワーカーと分けて処理する。
+    // start() より前に呼ぶこと
+    void setCorrector(FrameCorrector* value, ReductionPool* pool) {
+        corrector = value;
+        correctionPool = pool;
+    }
+
+    // 取得スレッドを動かすコア (負なら固定しない)。start() より前に呼ぶこと
+    void setCpuCore(int core) {
+        cpuCore = core;
+    }
+
+    uint64_t capturedCount() const {
+        return captured.load(std::memory_order_relaxed);
+    }
+
+    uint64_t failedCount() const {
+        return failed.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void run() override {
+        pinCurrentThread(cpuCore);
+        while (!isInterruptionRequested()) {
+            const uint64_t start = monotonicNs();
+            FrameRef frame = source.captureImage();
+            if (!frame) {
+                failed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            frame->captureTimeNs = monotonicNs();
+            // 書き込み時間はフレーム源が測る。残りはフレームが届くまでの待ち
+            const uint64_t total = frame->captureTimeNs - start;
+            const uint64_t copy = std::min(frame->copyNs, total);
+            timings.capture.record(total);
+            timings.captureWait.record(total - copy);
+            timings.copy.record(copy);
+            frame->frameNumber = nextFrameNumber++;
+            // 補正はプールのバッファをその場で書き換えるので、統計・プレビュー・記録へは補正済みが渡る
+            if (corrector) {
+                const uint64_t correctStart = monotonicNs();
+                if (corrector->apply(*frame, *correctionPool)) {
+                    timings.correct.record(monotonicNs() - correctStart);
+                }
+            }
+            for (FrameQueue* queue : queues) {
+                queue->push(frame);
+            }
+            captured.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    FrameSource& source;
+    PipelineTimings& timings;
+    std::vector<FrameQueue*> queues;
+    FrameCorrector* corrector = nullptr;
+    ReductionPool* correctionPool = nullptr;
+    int cpuCore = -1;
+    int nextFrameNumber = 0;
+    std::atomic<uint64_t> captured{0};
+    std::atomic<uint64_t> failed{0};
+};
+
+#endif // ACQUISITIONTHREAD_H
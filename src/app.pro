@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = jetsonCamApp
+QT += widgets concurrent charts
+include(../common.pri)
+SOURCES += main.cpp
+HEADERS += appwindow.h camerahandler.h cpu_process.h histogram.h framestats.h tilestats.h heatmapwidget.h framepool.h ringbuffer.h framequeue.h acquisitionthread.h frameworker.h framepipeline.h framesource.h stagestats.h syntheticsource.h replaysource.h rawcontainer.h framerecorder.h telemetrylog.h telemetrylogger.h resultsequencer.h chartbuffer.h downsample.h previewrenderer.h devicetelemetry.h eventrecorder.h losslesscodec.h cpuaffinity.h camerarig.h sourcefactory.h metricsexporter.h trendstore.h reductionpool.h statsplan.h framecorrector.h temporalstats.h pixelformat.h pixelunpack.h shmframes.h shmpublisher.h
+include(spinnaker.pri)
@@ -1,9 +1,17 @@
 #ifndef APPWINDOW_H
 #define APPWINDOW_H
 
-#include "camerahandler.h"
+#include "camerarig.h"
+#include "framesource.h"
 // #include "cuda_functions.h"
 #include "cpu_process.h"
+#include "framestats.h"
+#include "tilestats.h"
+#include "heatmapwidget.h"
+#include "chartbuffer.h"
+#include "framepipeline.h"
+#include "metricsexporter.h"
+#include "trendstore.h"
 
 #include <QWidget>
 #include <QPushButton>
@@ -13,9 +21,13 @@
 #include <QHBoxLayout>
 #include <QDebug>
 #include <QLabel>
+#include <QComboBox>
+#include <QMouseEvent>
+#include <QResizeEvent>
 #include <QTimer>
 #include <QtConcurrent>
 #include <QMessageBox>
+#include <QtCharts/QAreaSeries>
 #include <QtCharts/QChartView>
 #include <QtCharts/QLineSeries>
 #include <QtCharts/QValueAxis>
@@ -23,11 +35,17 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QCoreApplication>
+#include <QFontDatabase>
+#include <QDateTime>
+#include <QDir>
 
 #include <iostream>
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <iomanip>
+#include <limits>
+#include <memory>
 #include <tuple>
 #include <vector>
 
@@ -37,69 +55,65 @@ class AppWindow : public QWidget {
     Q_OBJECT
 
 public:
-    AppWindow(CameraHandler& cameraHandler, QWidget *parent = nullptr)
-        : QWidget(parent), cameraHandler(cameraHandler) {
+    AppWindow(CameraRig& rig, QWidget *parent = nullptr)
+        : QWidget(parent), rig(rig), metrics(rig),
+          lastCapturedCount(rig.size(), 0), lastProcessedCount(rig.size(), 0), lastRecordedBytes(rig.size(), 0),
+          trendStores(rig.size()) {
         QThreadPool::globalInstance()->setMaxThreadCount(4);
+        std::cout << "Statistics kernel: " << momentsKernelName() << std::endl;
+        std::cout << "Preview kernel: " << downsampleKernelName() << std::endl;
+        std::cout << "Correction kernel: " << FrameCorrector::kernelName() << std::endl;
+        std::cout << "Temporal statistics kernel: " << TemporalStats::kernelName() << std::endl;
         setupUI();
         // if (!wrap_cudaSetDevice(0)) {
         //     QMessageBox::critical(this, "Error", "Failed to set CUDA device.");
         // }
-        startCamera();
 
-        // シグナルとスロットの接続
-        connect(this, &AppWindow::graphDataReady, this, &AppWindow::onGraphDataReady);
-    }
+        // シグナルとスロットの接続。グラフとヒートマップには選択中のカメラの結果だけを出す
+        // (トレンドは切り替えても続きが見えるように全カメラ分を集計する)
+        for (int i = 0; i < rig.size(); ++i) {
+            FramePipeline& cameraPipeline = rig.pipeline(i);
+            connect(&cameraPipeline, &FramePipeline::graphDataReady, this, [this, i](const FrameStats& stats) {
+                trendStores[i].add(stats.timestamp, {stats.mean / 255.0f, stats.stddev / 255.0f, stats.cv});
+                if (i == currentCamera) {
+                    onGraphDataReady(stats);
+                }
+            });
+            connect(&cameraPipeline, &FramePipeline::tileDataReady, this, [this, i](const TileMap& map) {
+                if (i == currentCamera) {
+                    onTileDataReady(map);
+                }
+            });
+            connect(&cameraPipeline, &FramePipeline::errorOccurred, this, &AppWindow::onPipelineError);
+            cameraPipeline.preview().setInterval(i == currentCamera ? displayInterval : backgroundPreviewInterval);
+            cameraPipeline.preview().setTargetSize(imageView->minimumSize());
+        }
 
-    ~AppWindow() {
-        QThreadPool::globalInstance()->waitForDone();
-        QMutexLocker locker(&dataMutex);
-        saveGraphData(frameCountData, meanData, stddevData, kData, timestampData, tempData);
+        onTriggerChanged();
+        rig.start();
+        startCamera();
     }
 
-signals:
-    void graphDataReady(int frameNumber, double timestamp, double temp, float mean, float stddev, float cv);
+    // 計測値を1秒ごとに Prometheus のテキスト形式で書き出す先。空なら書かない
+    void setMetricsFile(const QString& path) {
+        metrics.setFile(path);
+    }
 
 private slots:
     void onBrowseButtonClicked() {
-        try {
-            timer->stop();
-            cameraHandler.stopAcquisition();
-        } catch(const std::exception& e) {
-            QMessageBox::critical(this, "Error", e.what());
-        }
-
+        // ダイアログを開いている間も取得・解析・記録は続ける
         QString directory = QFileDialog::getExistingDirectory(this, "Select Directory");
         if (!directory.isEmpty()) {
             pathLineEdit->setText(directory);
         }
-
-        try {
-            startCamera();
-            cameraHandler.startAcquisition();
-        } catch(const std::exception& e) {
-            QMessageBox::critical(this, "Error", e.what());
-        }
     }
 
     void onBrowseGraphButtonClicked() {
-        try {
-            timer->stop();
-            cameraHandler.stopAcquisition();
-        } catch(const std::exception& e) {
-            QMessageBox::critical(this, "Error", e.what());
-        }
-
+        // ダイアログを開いている間も取得・解析・記録は続ける
         QString directory = QFileDialog::getExistingDirectory(this, "Select Directory");
         if (!directory.isEmpty()) {
             pathLineEditforGraph->setText(directory);
         }
-
-        try {
-            startCamera();
-            cameraHandler.startAcquisition();
-        } catch(const std::exception& e) {
-            QMessageBox::critical(this, "Error", e.what());
-        }
     }
 
     void onRecordButtonToggled(bool checked) {
@@ -116,95 +130,410 @@ private slots:
             recordButton->setText("🔴REC");
             recording = false;
         }
+        rig.setRecording(recording, pathLineEdit->text());
     }
 
+    // プレビュースレッドが縮小済みの最新画像を作っていれば表示する。時間方向のCVを表示中はそのマップを出す
     void updateImage() {
-        auto now = std::chrono::high_resolution_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - lastUpdateTime).count();
+        const bool temporalView = temporalComboBox->currentData().toInt() > 0;
+        PreviewFrame preview;
+        if (pipeline().preview().takeLatest(preview)) {
+            timestampLabel->setText(QString("Timestamp: %1").arg(preview.timestamp, 0, 'f', 2));
+            tempLabel->setText(QString("Temperature: %1").arg(preview.temp, 0, 'f', 2));
+            if (!temporalView) {
+                const uint64_t displayStart = monotonicNs();
+                imageView->setPixmap(QPixmap::fromImage(preview.image));
+                pipeline().recordDisplayTime(monotonicNs() - displayStart);
+                previewSourceRect = preview.sourceRect;
+                previewFactor = preview.factor;
+                previewSize = preview.image.size();
+            }
+        }
+        TemporalMapImage map;
+        if (temporalView && pipeline().temporal().takeLatestMap(map)) {
+            imageView->setPixmap(QPixmap::fromImage(map.image));
+            temporalMaxCv = map.maxCv;
+            previewSize = QSize(); // マップの上ではクリックで拡大しない
+        }
 
-        QImage image;
-        double timestamp;
-        double temp;
-        std::tie(image, timestamp, temp) = cameraHandler.captureImage();
+        auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - lastRateUpdate).count();
+        if (elapsed < 1.0) {
+            return;
+        }
+
+        // 全カメラのレートを更新し、詳細は選択中のカメラについて表示する
+        std::vector<double> cameraFpsList(rig.size());
+        std::vector<double> processedFpsList(rig.size());
+        std::vector<double> recordMBpsList(rig.size());
+        for (int i = 0; i < rig.size(); ++i) {
+            const FramePipeline& cameraPipeline = rig.pipeline(i);
+            const uint64_t captured = cameraPipeline.acquisition().capturedCount();
+            const uint64_t processed = cameraPipeline.processedCount();
+            const uint64_t recordedBytes = cameraPipeline.recorder().bytesWritten();
+            cameraFpsList[i] = (captured - lastCapturedCount[i]) / elapsed;
+            processedFpsList[i] = (processed - lastProcessedCount[i]) / elapsed;
+            recordMBpsList[i] = (recordedBytes - lastRecordedBytes[i]) / elapsed / 1e6;
+            lastCapturedCount[i] = captured;
+            lastProcessedCount[i] = processed;
+            lastRecordedBytes[i] = recordedBytes;
+        }
+        lastRateUpdate = now;
+
+        updateTrend();
+        updateCorrectionStatus();
+
+        metrics.update();
+        if (metricsOverlay->isVisible()) {
+            metricsOverlay->setText(metrics.overlayText(currentCamera));
+            metricsOverlay->adjustSize();
+        }
+
+        const FramePipeline& pipeline = this->pipeline();
+        const AcquisitionThread& acquisition = pipeline.acquisition();
+        const double cameraFps = cameraFpsList[currentCamera];
+        const double processedFps = processedFpsList[currentCamera];
+        const double recordMBps = recordMBpsList[currentCamera];
+        const FrameRecorder& recorder = pipeline.recorder();
+        const FrameSource& cameraHandler = pipeline.frameSource();
+        const FramePool& pool = cameraHandler.framePool();
+        const EventRecorder& events = pipeline.events();
+        const FrameQueue& statsQueue = pipeline.statsQueue();
+        const FrameQueue& recordQueue = pipeline.recordQueue();
+        fpsLabel->setText(camerasStatusText(cameraFpsList, processedFpsList)
+                          + QString("Processed FPS: %1\n").arg(processedFps, 0, 'f', 2)
+                          + QString("Camera FPS: %1\n").arg(cameraFps, 0, 'f', 2)
+                          + QString("Stats queue: %1/%2 (dropped %3)\n").arg(statsQueue.depth()).arg(statsQueue.capacity()).arg(statsQueue.droppedCount())
+                          + QString("In flight: %1/%2, reorder window %3 (peak %4), overload dropped %5\n").arg(pipeline.inFlightCount()).arg(pipeline.inFlightCapacity()).arg(pipeline.reorderOccupancy()).arg(pipeline.reorderPeak()).arg(pipeline.overloadDroppedCount())
+                          + QString("Record queue: %1/%2 (dropped %3)\n").arg(recordQueue.depth()).arg(recordQueue.capacity()).arg(recordQueue.droppedCount())
+                          + QString("Recording: %1 MB/s, write errors %2\n").arg(recordMBps, 0, 'f', 1).arg(recorder.writeErrors())
+                          + compressionStatusText(recorder)
+                          + QString("Events: %1 triggered, %2 written (%3 frames), ring %4/%5, dropped %6\n").arg(events.eventsTriggered()).arg(events.eventsWritten()).arg(events.framesWritten()).arg(events.ringFrames()).arg(events.ringCapacity()).arg(events.droppedFrames())
+                          + temporalStatusText(pipeline.temporal())
+                          + shmStatusText(pipeline)
+                          + QString("Log: %1 rows (dropped %2, errors %3)\n").arg(rig.logger().recordsWritten()).arg(rig.logger().droppedRecords()).arg(rig.logger().writeErrors())
+                          + QString("Incomplete: %1, Failed: %2\n").arg(cameraHandler.incompleteFrameCount()).arg(acquisition.failedCount())
+                          + QString("Buffers: %1/%2 free, exhausted %3").arg(pool.available()).arg(pool.size()).arg(pool.exhaustedCount())
+                          + deviceStatusText(cameraHandler));
+    }
 
-        lastUpdateTime = now;
-        sumProcTime += elapsed;
+    void updateCorrectionStatus() {
+        const FrameCorrector& corrector = pipeline().corrector();
+        const int progress = corrector.captureProgress();
+        QString text = QString("Dark: %1, Flat: %2")
+                           .arg(corrector.hasReference(FrameCorrector::Reference::Dark) ? "yes" : "no")
+                           .arg(corrector.hasReference(FrameCorrector::Reference::Flat) ? "yes" : "no");
+        if (progress >= 0) {
+            text += QString(" (capturing %1/%2)").arg(progress).arg(referenceFrames);
+        }
+        correctionLabel->setText(text);
+    }
 
-        if (frameCount % FrameRate == 0) {
-            currentProcTime = sumProcTime / FrameRate;
-            sumProcTime = 0.0;
+    QString temporalStatusText(const TemporalStats& temporal) const {
+        if (temporal.window() == 0) {
+            return QString();
         }
+        return QString("Temporal: %1/%2 frames, %3 MB, CV colour range 0-%4\n")
+            .arg(temporal.filledFrames()).arg(temporal.window())
+            .arg(temporal.memoryBytes() / 1e6, 0, 'f', 1).arg(temporalMaxCv, 0, 'f', 4);
+    }
 
-        double fps = 1000000.0 / currentProcTime;
-        fpsLabel->setText(QString("Processed FPS: %1\n").arg(fps, 0, 'f', 2) + QString("Camera FPS: %3").arg(1.0/(timestamp-latestCameraTimeStamp), 0, 'f', 2));
-        latestCameraTimeStamp = timestamp;
-        timestampLabel->setText(QString("Timestamp: %1").arg(timestamp, 0, 'f', 2));
-        tempLabel->setText(QString("Temperature: %1").arg(temp, 0, 'f', 2));
+    // 2台以上のときだけ、全カメラのfpsを1行ずつ出す
+    QString camerasStatusText(const std::vector<double>& cameraFps, const std::vector<double>& processedFps) const {
+        if (rig.size() < 2) {
+            return QString();
+        }
+        QString text;
+        for (int i = 0; i < rig.size(); ++i) {
+            text += QString("Camera %1: %2 fps, processed %3 fps, dropped %4\n")
+                        .arg(i).arg(cameraFps[i], 0, 'f', 2).arg(processedFps[i], 0, 'f', 2)
+                        .arg(rig.pipeline(i).statsQueue().droppedCount() + rig.pipeline(i).overloadDroppedCount());
+        }
+        return text + "\n";
+    }
 
-        if (!image.isNull()) {
-            imageView->setPixmap(QPixmap::fromImage(image));
-            QImage imageCopy = image.copy();
-            QtConcurrent::run(this, &AppWindow::resultProcessing, imageCopy, std::make_tuple(frameCount, timestamp, temp), pathLineEdit->text(), recording);
-            QCoreApplication::processEvents();
-            frameCount++;
+    // 可逆圧縮で記録したことがあれば、圧縮率とコア1つあたりの圧縮速度
+    static QString compressionStatusText(const FrameRecorder& recorder) {
+        const uint64_t raw = recorder.rawBytesCompressed();
+        const uint64_t encoded = recorder.encodedBytesCompressed();
+        if (raw == 0 || encoded == 0) {
+            return QString();
         }
+        const double cpuSeconds = recorder.encodeCpuNs() / 1e9;
+        return QString("Lossless: ratio %1, %2 MB/s per core (%3 threads)\n")
+            .arg(static_cast<double>(raw) / encoded, 0, 'f', 2)
+            .arg(cpuSeconds > 0 ? raw / cpuSeconds / 1e6 : 0.0, 0, 'f', 1)
+            .arg(recorder.codecThreads());
     }
 
-    void onGraphDataReady(int frameNumber, double timestamp, double temp, float mean, float stddev, float cv) {
-        UpdateGraph(frameNumber, timestamp, temp, mean, stddev, cv);
+    // 共有メモリへ書き出しているときだけ
+    static QString shmStatusText(const FramePipeline& pipeline) {
+        if (!pipeline.sharedMemoryEnabled()) {
+            return QString();
+        }
+        const ShmPublisher& publisher = pipeline.publisher();
+        return QString("Shared memory: %1, published %2 (dropped %3)\n")
+            .arg(publisher.name()).arg(publisher.publishedCount()).arg(publisher.queue().droppedCount());
+    }
+
+    // サンプラーが最後に読んだデバイスの状態
+    static QString deviceStatusText(const FrameSource& cameraHandler) {
+        const DeviceTelemetry* telemetry = cameraHandler.deviceTelemetry();
+        if (!telemetry) {
+            return QString();
+        }
+        QStringList items;
+        for (const DeviceTelemetry::Reading& reading : telemetry->latest()) {
+            items << QString("%1: %2 %3").arg(reading.name).arg(reading.value, 0, 'f', 1).arg(reading.unit).trimmed();
+        }
+        return QString("\nDevice: %1 (read errors %2)").arg(items.join(", ")).arg(telemetry->readErrors())
+               + QString("\nCamera: %1, reconnects %2")
+                     .arg(cameraHandler.connected() ? "connected" : "connecting").arg(cameraHandler.reconnectCount());
+    }
+
+    // フレームごとにはバッファへ積むだけで、描画は chartInterval ごとに UpdateGraph でまとめて行う
+    void onGraphDataReady(const FrameStats& stats) {
+        AppendGraphData(stats);
+    }
+
+    void onTileDataReady(const TileMap& map) {
+        heatmapView->setTileMap(map);
+    }
+
+    void onPipelineError(const QString& message) {
+        QMessageBox::critical(this, "Error", message);
+    }
+
+    void onGraphPathChanged(const QString& directory) {
+        rig.setGraphDirectory(directory);
+    }
+
+    void onSavePathChanged(const QString& directory) {
+        rig.setRecording(recording, directory);
+    }
+
+    void onRecordFormatChanged(int index) {
+        rig.setRecordFormat(static_cast<FramePipeline::RecordFormat>(recordFormatComboBox->itemData(index).toInt()));
+    }
+
+    void onTriggerChanged() {
+        EventRule rule;
+        if (!parseEventRule(triggerLineEdit->text(), rule)) {
+            QMessageBox::warning(this, "Error", "Invalid trigger. Example: cv>0.05 pre=2 post=2");
+            return;
+        }
+        rig.setEventRule(rule);
+    }
+
+    void onMetricsToggled(bool checked) {
+        metricsOverlay->setText(metrics.overlayText(currentCamera));
+        metricsOverlay->adjustSize();
+        metricsOverlay->setVisible(checked);
+    }
+
+    void onCorrectionModeChanged(int index) {
+        rig.setCorrectionMode(static_cast<FrameCorrector::Mode>(correctionComboBox->itemData(index).toInt()));
+    }
+
+    // 参照は表示中のカメラについて撮る (ダークはレンズを塞いで、フラットは一様な光を当てて)
+    void onCaptureDarkClicked() {
+        pipeline().corrector().captureReference(FrameCorrector::Reference::Dark, referenceFrames);
+        updateCorrectionStatus();
+    }
+
+    void onCaptureFlatClicked() {
+        pipeline().corrector().captureReference(FrameCorrector::Reference::Flat, referenceFrames);
+        updateCorrectionStatus();
+    }
+
+    // 時間方向の統計は表示中のカメラだけで行う (窓の履歴にフレーム数分のメモリを使うため)
+    void onTemporalWindowChanged() {
+        const int window = temporalComboBox->currentData().toInt();
+        for (int i = 0; i < rig.size(); ++i) {
+            TemporalStats& temporal = rig.pipeline(i).temporal();
+            if (temporal.window() != (i == currentCamera ? window : 0)) {
+                temporal.setWindow(i == currentCamera ? window : 0);
+            }
+        }
+        pipeline().temporal().setMapTargetSize(imageView->contentsRect().size());
+        temporalMaxCv = 0.0f;
+        exportTemporalButton->setEnabled(window > 0);
+    }
+
+    void onExportTemporalClicked() {
+        TemporalMaps maps;
+        if (!pipeline().temporal().snapshot(maps)) {
+            QMessageBox::warning(this, "Error", "The temporal window is still empty.");
+            return;
+        }
+        const QString name = QString("temporal_cam%1_%2.jcr").arg(currentCamera)
+                                  .arg(QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss"));
+        const QString path = QFileDialog::getSaveFileName(this, "Export temporal maps",
+                                                          QDir(pathLineEdit->text()).filePath(name),
+                                                          "Frame container (*.jcr)");
+        if (path.isEmpty()) {
+            return;
+        }
+        if (!TemporalStats::exportMaps(maps, path)) {
+            QMessageBox::critical(this, "Error", "Failed to write " + path);
+        }
+    }
+
+    void onZoomToggled(bool checked) {
+        pipeline().preview().setZoom(checked, zoomCenter);
+    }
+
+    void onOverloadPolicyChanged(int index) {
+        rig.setOverloadPolicy(static_cast<FramePipeline::OverloadPolicy>(overloadComboBox->itemData(index).toInt()));
+    }
+
+    void onTileLayoutChanged() {
+        auto layout = std::make_shared<TileLayout>();
+        const int gridSize = gridComboBox->currentData().toInt();
+        layout->columns = gridSize;
+        layout->rows = gridSize;
+        layout->rois = parseRoiList(roiLineEdit->text());
+        if (!layout->enabled()) {
+            heatmapView->clear();
+            rig.setTileLayout(nullptr);
+            return;
+        }
+        if (!layout->gridEnabled()) {
+            heatmapView->clear();
+        }
+        rig.setTileLayout(layout);
+    }
+
+    // 表示するカメラを切り替える。他のカメラのプレビューは間隔を空けて作らせ、グラフは描き直す
+    void onCameraChanged(int index) {
+        if (index < 0 || index >= rig.size() || index == currentCamera) {
+            return;
+        }
+        pipeline().preview().setInterval(backgroundPreviewInterval);
+        pipeline().preview().setZoom(false, zoomCenter);
+        currentCamera = index;
+        pipeline().preview().setInterval(displayInterval);
+        pipeline().preview().setTargetSize(imageView->contentsRect().size());
+        pipeline().preview().setZoom(zoomButton->isChecked(), zoomCenter);
+        meanPoints.clear();
+        stddevPoints.clear();
+        kPoints.clear();
+        saturatedPoints.clear();
+        chartDirty = true;
+        heatmapView->clear();
+        trendDrawnSamples = std::numeric_limits<uint64_t>::max();
+        updateTrend();
+        updateCorrectionStatus();
+        onTemporalWindowChanged();
+    }
+
+    void onTrendTierChanged(int) {
+        trendDrawnSamples = std::numeric_limits<uint64_t>::max();
+        updateTrend();
+    }
+
+protected:
+    // プレビューの大きさを表示領域に合わせる
+    void resizeEvent(QResizeEvent *event) override {
+        QWidget::resizeEvent(event);
+        pipeline().preview().setTargetSize(imageView->contentsRect().size());
+        pipeline().temporal().setMapTargetSize(imageView->contentsRect().size());
+    }
+
+    // プレビューをクリックした点を中心にフル解像度で拡大する
+    bool eventFilter(QObject *watched, QEvent *event) override {
+        if (watched == imageView && event->type() == QEvent::MouseButtonPress && !previewSize.isEmpty()) {
+            const QPoint position = static_cast<QMouseEvent*>(event)->pos() - imageView->contentsRect().topLeft();
+            const QPoint offset((imageView->contentsRect().width() - previewSize.width()) / 2,
+                                (imageView->contentsRect().height() - previewSize.height()) / 2);
+            zoomCenter = previewSourceRect.topLeft() + (position - offset) * previewFactor;
+            pipeline().preview().setZoom(true, zoomCenter);
+            zoomButton->setChecked(true);
+            return true;
+        }
+        return QWidget::eventFilter(watched, event);
     }
 
 private:
     QPushButton *recordButton;
+    QPushButton *zoomButton;
+    QComboBox *recordFormatComboBox;
+    QComboBox *cameraComboBox;
+    QLineEdit *triggerLineEdit;
     QLineEdit *pathLineEdit;
     QLineEdit *pathLineEditforGraph;
     QLabel *imageView;
-    CameraHandler& cameraHandler;
+    CameraRig& rig;
+    int currentCamera = 0; // 表示中のカメラ
+    MetricsExporter metrics;
+    QPushButton *metricsButton;
+    QLabel *metricsOverlay; // プレビューに重ねる各段のレイテンシと捨てた数
+    QComboBox *correctionComboBox;
+    QPushButton *captureDarkButton;
+    QPushButton *captureFlatButton;
+    QLabel *correctionLabel; // 表示中のカメラの参照の有無と撮影の進み具合
+    static constexpr int referenceFrames = 32; // 参照1枚を平均するフレーム数
+    QComboBox *temporalComboBox; // 時間方向のCVの窓の長さ (Off なら通常のプレビュー)
+    QPushButton *exportTemporalButton;
+    float temporalMaxCv = 0.0f;
+
+    FramePipeline& pipeline() {
+        return rig.pipeline(currentCamera);
+    }
     QTimer *timer;
+    QRect previewSourceRect; // 表示中のプレビューの元画像上の範囲
+    int previewFactor = 1;
+    QSize previewSize;
+    QPoint zoomCenter{-1, -1};
     QLabel *fpsLabel;
     QLabel *timestampLabel;
     QLabel *tempLabel;
-    std::chrono::high_resolution_clock::time_point lastUpdateTime = std::chrono::high_resolution_clock::now();
-    uint8_t* imageData;
+    std::chrono::steady_clock::time_point lastRateUpdate = std::chrono::steady_clock::now();
+    std::vector<uint64_t> lastCapturedCount; // 以下はカメラごと
+    std::vector<uint64_t> lastProcessedCount;
+    std::vector<uint64_t> lastRecordedBytes;
     QChartView *chartView;
     QLineSeries *meanSeries;
     QLineSeries *stddevSeries;
     QLineSeries *kSeries;
+    QLineSeries *saturatedSeries;
     QValueAxis *axisX;
     QValueAxis *axisY;
-    std::vector<int> frameCountData;
-    std::vector<float> meanData;
-    std::vector<float> stddevData;
-    std::vector<float> kData;
-    std::vector<double> timestampData;
-    std::vector<double> tempData;
+    QTimer *chartTimer;
+    ChartBuffer meanPoints{chartWindow};
+    ChartBuffer stddevPoints{chartWindow};
+    ChartBuffer kPoints{chartWindow};
+    ChartBuffer saturatedPoints{chartWindow};
+    QVector<QPointF> chartPoints; // replace() に渡す作業領域
+    bool chartDirty = false;
+
+    QComboBox *gridComboBox;
+    QComboBox *overloadComboBox;
+    QLineEdit *roiLineEdit;
+    HeatmapWidget *heatmapView;
 
     QChartView *trendChartView;
+    QComboBox *trendComboBox; // 表示するトレンドの段 (1秒/1分/1時間ごと)
     QLineSeries *trendMeanSeries;
     QLineSeries *trendStddevSeries;
     QLineSeries *trendKSeries;
+    QLineSeries *trendMeanUpper;
+    QLineSeries *trendMeanLower;
+    QAreaSeries *trendMeanBand; // 区間内の平均の最小〜最大
     QValueAxis *trendAxisX;
     QValueAxis *trendAxisY;
-    float trendMean = 0;
-    float trendStddev = 0;
-    float trendK = 0;
-    double latestCameraTimeStamp = 0.0;
-    double sumProcTime = 0.0;
-    double currentProcTime = 0.0;
-
-    const int trendInterval = 30;
-    const int saveImageInterval = 600;
-    const int saveGraphInterval = 6000;
-
-    int Width = cameraHandler.getWidth();
-    int Height = cameraHandler.getHeight();
-    int FrameRate = cameraHandler.getFrameRate();
-    int frameCount = 0;
+    std::vector<TrendStore> trendStores; // カメラごと
+    uint64_t trendDrawnSamples = 0; // 最後に描いたときの sampleCount()
+    std::vector<TrendStore::Bucket> trendBuckets; // 描画用の作業領域
 
-    bool recording = false;
-    int imageCount = 0;
+    const int displayInterval = 33; // 表示の更新間隔 [ms]
+    const int backgroundPreviewInterval = 1000; // 表示していないカメラのプレビューの間隔 [ms]
+    const int chartInterval = 50; // グラフの再描画間隔 [ms] (20 Hz)
+    static constexpr size_t chartWindow = 3000; // グラフに表示するフレーム数
+    static constexpr size_t chartMaxPoints = 600; // 1系列あたりの描画点数の上限
+    static constexpr size_t trendMaxPoints = 720; // トレンドの描画点数の上限
 
-    QMutex dataMutex; // データ保護用のMutex
+    bool recording = false;
 
     void setupUI() {
         recordButton = new QPushButton("🔴REC");
@@ -215,27 +544,111 @@ private:
 
         QPushButton *browseButton = new QPushButton("Browse");
 
+        recordFormatComboBox = new QComboBox();
+        recordFormatComboBox->addItem("RAW (all frames)", static_cast<int>(FramePipeline::RecordFormat::Container));
+        recordFormatComboBox->addItem("RAW lossless (all frames)", static_cast<int>(FramePipeline::RecordFormat::Lossless));
+        recordFormatComboBox->addItem("BMP (every 600th)", static_cast<int>(FramePipeline::RecordFormat::Bmp));
+        recordFormatComboBox->addItem("Event (trigger)", static_cast<int>(FramePipeline::RecordFormat::Event));
+
+        triggerLineEdit = new QLineEdit("cv>0.05 pre=2 post=2");
+        triggerLineEdit->setToolTip("Event trigger: mean|stddev|cv|saturated|dark (prefix d = change per frame) > or < threshold, "
+                                    "pre/post seconds, mem = ring buffer MB");
+
         imageView = new QLabel();
         imageView->setMinimumSize(640, 480);
         imageView->setAlignment(Qt::AlignCenter);
         imageView->setStyleSheet("QLabel { background-color: white; }");
+        imageView->installEventFilter(this);
+
+        zoomButton = new QPushButton("Zoom 1:1");
+        zoomButton->setCheckable(true);
+        zoomButton->setToolTip("Show the full-resolution region around the last clicked point.");
+
+        metricsButton = new QPushButton("Metrics");
+        metricsButton->setCheckable(true);
+        metricsButton->setToolTip("Overlay per-stage latency (p50/p99/max over the last second), drops and queue depths.");
+
+        metricsOverlay = new QLabel(imageView);
+        metricsOverlay->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        metricsOverlay->setStyleSheet("QLabel { background-color: rgba(0, 0, 0, 160); color: white; padding: 4px; }");
+        metricsOverlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+        metricsOverlay->move(4, 4);
+        metricsOverlay->hide();
+
+        cameraComboBox = new QComboBox();
+        for (int i = 0; i < rig.size(); ++i) {
+            cameraComboBox->addItem(QString("Camera %1").arg(i), i);
+        }
+        cameraComboBox->setVisible(rig.size() > 1);
 
         QHBoxLayout *topLayout = new QHBoxLayout;
         topLayout->addWidget(recordButton);
+        topLayout->addWidget(recordFormatComboBox);
+        topLayout->addWidget(triggerLineEdit);
         topLayout->addWidget(pathLineEdit);
         topLayout->addWidget(browseButton);
+        topLayout->addWidget(zoomButton);
+        topLayout->addWidget(metricsButton);
+        topLayout->addWidget(cameraComboBox);
+
+        // ダーク/フラット補正と背景差分。統計・プレビュー・記録のすべてに補正済みの画像が渡る
+        correctionComboBox = new QComboBox();
+        correctionComboBox->addItem("Correction: Off", static_cast<int>(FrameCorrector::Mode::Off));
+        correctionComboBox->addItem("Correction: Dark/Flat", static_cast<int>(FrameCorrector::Mode::Flat));
+        correctionComboBox->addItem("Correction: Dark/Flat + Background", static_cast<int>(FrameCorrector::Mode::FlatBackground));
+        correctionComboBox->setToolTip("Background subtracts a running average of recent frames (plus a pedestal).");
+        captureDarkButton = new QPushButton("Capture Dark");
+        captureDarkButton->setToolTip("Average the next frames of the current camera as the dark reference (cover the lens).");
+        captureFlatButton = new QPushButton("Capture Flat");
+        captureFlatButton->setToolTip("Average the next frames of the current camera as the flat reference (uniform illumination).");
+        correctionLabel = new QLabel();
+
+        // 画素ごとの時間方向の統計。選ぶとプレビューの代わりに時間方向のCVのマップを出す
+        temporalComboBox = new QComboBox();
+        temporalComboBox->addItem("Temporal CV: Off", 0);
+        for (int window : {32, 64, 128, 256}) {
+            temporalComboBox->addItem(QString("Temporal CV: %1 frames").arg(window), window);
+        }
+        temporalComboBox->setToolTip("Per-pixel temporal CV over the last frames of the current camera (uses 6 + N bytes per pixel).");
+        exportTemporalButton = new QPushButton("Export Maps");
+        exportTemporalButton->setToolTip("Write the per-pixel mean, variance and CV of the window as float planes in a .jcr file.");
+        exportTemporalButton->setEnabled(false);
+
+        QHBoxLayout *correctionLayout = new QHBoxLayout;
+        correctionLayout->addWidget(correctionComboBox);
+        correctionLayout->addWidget(captureDarkButton);
+        correctionLayout->addWidget(captureFlatButton);
+        correctionLayout->addWidget(correctionLabel);
+        correctionLayout->addWidget(temporalComboBox);
+        correctionLayout->addWidget(exportTemporalButton);
+        correctionLayout->addStretch();
 
         QVBoxLayout *mainLayout = new QVBoxLayout;
         mainLayout->addLayout(topLayout);
+        mainLayout->addLayout(correctionLayout);
         mainLayout->addWidget(imageView);
 
         connect(browseButton, &QPushButton::clicked, this, &AppWindow::onBrowseButtonClicked);
         connect(recordButton, &QPushButton::toggled, this, &AppWindow::onRecordButtonToggled);
+        connect(zoomButton, &QPushButton::toggled, this, &AppWindow::onZoomToggled);
+        connect(metricsButton, &QPushButton::toggled, this, &AppWindow::onMetricsToggled);
+        connect(correctionComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onCorrectionModeChanged);
+        connect(captureDarkButton, &QPushButton::clicked, this, &AppWindow::onCaptureDarkClicked);
+        connect(captureFlatButton, &QPushButton::clicked, this, &AppWindow::onCaptureFlatClicked);
+        connect(temporalComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onTemporalWindowChanged);
+        connect(exportTemporalButton, &QPushButton::clicked, this, &AppWindow::onExportTemporalClicked);
+        connect(cameraComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onCameraChanged);
+        connect(pathLineEdit, &QLineEdit::textChanged, this, &AppWindow::onSavePathChanged);
+        connect(recordFormatComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onRecordFormatChanged);
+        connect(triggerLineEdit, &QLineEdit::editingFinished, this, &AppWindow::onTriggerChanged);
 
         // 画像更新用のタイマーを設定
         timer = new QTimer(this);
         connect(timer, &QTimer::timeout, this, &AppWindow::updateImage);
 
+        chartTimer = new QTimer(this);
+        connect(chartTimer, &QTimer::timeout, this, &AppWindow::UpdateGraph);
+
         fpsLabel = new QLabel(this);
         fpsLabel->setAlignment(Qt::AlignCenter);
         mainLayout->addWidget(fpsLabel);
@@ -248,8 +661,6 @@ private:
         tempLabel->setAlignment(Qt::AlignCenter);
         mainLayout->addWidget(tempLabel);
 
-        imageData = new uint8_t[Width * Height];
-
         // グラフの初期化
         chartView = new QChartView();
         chartView->setMinimumSize(400, 300);
@@ -259,17 +670,21 @@ private:
         meanSeries = new QLineSeries();
         stddevSeries = new QLineSeries();
         kSeries = new QLineSeries();
+        saturatedSeries = new QLineSeries();
 
         meanSeries->setName("Mean");
         stddevSeries->setName("StdDev");
         kSeries->setName("K = StdDev/Mean");
+        saturatedSeries->setName("Saturated");
 
         chart->addSeries(meanSeries);
         chart->addSeries(stddevSeries);
         chart->addSeries(kSeries);
+        chart->addSeries(saturatedSeries);
 
         axisX = new QValueAxis();
         axisY = new QValueAxis();
+        axisY->setRange(0, 1.0);
         chart->addAxis(axisX, Qt::AlignBottom);
         chart->addAxis(axisY, Qt::AlignLeft);
 
@@ -279,6 +694,8 @@ private:
         stddevSeries->attachAxis(axisY);
         kSeries->attachAxis(axisX);
         kSeries->attachAxis(axisY);
+        saturatedSeries->attachAxis(axisX);
+        saturatedSeries->attachAxis(axisY);
 
         QVBoxLayout *graphLayout = new QVBoxLayout();
         pathLineEditforGraph = new QLineEdit();
@@ -289,14 +706,44 @@ private:
         graphTopLayout->addWidget(pathLineEditforGraph);
         graphTopLayout->addWidget(browseButtonforGraph);
 
+        // タイル統計の設定
+        gridComboBox = new QComboBox();
+        gridComboBox->addItem("Grid: Off", 0);
+        gridComboBox->addItem("Grid: 8x8", 8);
+        gridComboBox->addItem("Grid: 16x16", 16);
+        roiLineEdit = new QLineEdit();
+        roiLineEdit->setPlaceholderText("ROIs: x,y,w,h; x,y,w,h");
+
+        // 統計処理が追いつかないときの扱い
+        overloadComboBox = new QComboBox();
+        overloadComboBox->addItem("Overload: Block", static_cast<int>(FramePipeline::OverloadPolicy::Block));
+        overloadComboBox->addItem("Overload: Drop", static_cast<int>(FramePipeline::OverloadPolicy::Drop));
+
+        QHBoxLayout *tileSettingsLayout = new QHBoxLayout();
+        tileSettingsLayout->addWidget(gridComboBox);
+        tileSettingsLayout->addWidget(roiLineEdit);
+        tileSettingsLayout->addWidget(overloadComboBox);
+
+        heatmapView = new HeatmapWidget();
+
+        QHBoxLayout *chartLayout = new QHBoxLayout();
+        chartLayout->addWidget(chartView);
+        chartLayout->addWidget(heatmapView);
+
         graphLayout->addLayout(graphTopLayout);
-        graphLayout->addWidget(chartView);
+        graphLayout->addLayout(tileSettingsLayout);
+        graphLayout->addLayout(chartLayout);
+
+        connect(gridComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onTileLayoutChanged);
+        connect(roiLineEdit, &QLineEdit::editingFinished, this, &AppWindow::onTileLayoutChanged);
+        connect(overloadComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onOverloadPolicyChanged);
 
         QHBoxLayout *windowLayout = new QHBoxLayout(this);
         windowLayout->addLayout(mainLayout);
         windowLayout->addLayout(graphLayout);
 
         connect(browseButtonforGraph, &QPushButton::clicked, this, &AppWindow::onBrowseGraphButtonClicked);
+        connect(pathLineEditforGraph, &QLineEdit::textChanged, this, &AppWindow::onGraphPathChanged);
 
         // トレンドグラフの初期化
         trendChartView = new QChartView();
@@ -307,20 +754,30 @@ private:
         trendMeanSeries = new QLineSeries();
         trendStddevSeries = new QLineSeries();
         trendKSeries = new QLineSeries();
+        trendMeanUpper = new QLineSeries();
+        trendMeanLower = new QLineSeries();
+        trendMeanBand = new QAreaSeries(trendMeanUpper, trendMeanLower);
 
         trendMeanSeries->setName("Mean");
         trendStddevSeries->setName("StdDev");
         trendKSeries->setName("K = StdDev/Mean");
+        trendMeanBand->setName("Mean min/max");
+        trendMeanBand->setPen(Qt::NoPen);
+        trendMeanBand->setColor(QColor(32, 159, 223, 60));
 
+        trendChart->addSeries(trendMeanBand);
         trendChart->addSeries(trendMeanSeries);
         trendChart->addSeries(trendStddevSeries);
         trendChart->addSeries(trendKSeries);
 
         trendAxisX = new QValueAxis();
         trendAxisY = new QValueAxis();
+        trendAxisY->setRange(0, 1.0);
         trendChart->addAxis(trendAxisX, Qt::AlignBottom);
         trendChart->addAxis(trendAxisY, Qt::AlignLeft);
 
+        trendMeanBand->attachAxis(trendAxisX);
+        trendMeanBand->attachAxis(trendAxisY);
         trendMeanSeries->attachAxis(trendAxisX);
         trendMeanSeries->attachAxis(trendAxisY);
         trendStddevSeries->attachAxis(trendAxisX);
@@ -328,131 +785,90 @@ private:
         trendKSeries->attachAxis(trendAxisX);
         trendKSeries->attachAxis(trendAxisY);
 
-        windowLayout->addWidget(trendChartView);
+        trendComboBox = new QComboBox();
+        trendComboBox->addItem("Trend: 1 s bins (1 h)", 0);
+        trendComboBox->addItem("Trend: 1 min bins (24 h)", 1);
+        trendComboBox->addItem("Trend: 1 h bins (30 days)", 2);
+        trendComboBox->setCurrentIndex(1);
+        connect(trendComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &AppWindow::onTrendTierChanged);
+
+        QVBoxLayout *trendLayout = new QVBoxLayout();
+        trendLayout->addWidget(trendComboBox);
+        trendLayout->addWidget(trendChartView);
+        windowLayout->addLayout(trendLayout);
     }
 
     void startCamera() {
-        double frameRate = cameraHandler.getFrameRate()*1.5; // QTimerは処理が遅延したらその分後ろにズレてトリガーされるためなるだけはやくしておいてよい。
-        int interval = static_cast<int>(1000.0 / frameRate); // フレームレートをミリ秒に変換
-        timer->start(interval);
-    }
-
-    void UpdateGraph(int frameNumber, double timestamp, double temp, float mean, float stddev, float cv) {
-        QMutexLocker locker(&dataMutex);
-
-        // データを更新
-        frameCountData.push_back(frameNumber);
-        meanData.push_back(mean / 255.0f);
-        stddevData.push_back(stddev / 255.0f);
-        kData.push_back(cv);
-        timestampData.push_back(timestamp);
-        tempData.push_back(temp);
-
-        // グラフを更新
-        meanSeries->append(frameNumber, mean / 255.0f);
-        stddevSeries->append(frameNumber, stddev / 255.0f);
-        kSeries->append(frameNumber, cv);
-        axisX->setRange(frameNumber - 500, frameNumber);
-        axisY->setRange(0, 1.0);
-
-        if (frameNumber > 500) {
-            meanSeries->remove(0);
-            stddevSeries->remove(0);
-            kSeries->remove(0);
-        }
-
-        // // トレンドデータの更新
-        // if (frameNumber % trendInterval != 0) {
-        //     trendMean += mean / 255.0f;
-        //     trendStddev += stddev / 255.0f;
-        //     trendK += cv;
-        // } else {
-        //     trendMeanSeries->append(frameNumber, trendMean / trendInterval);
-        //     trendStddevSeries->append(frameNumber, trendStddev / trendInterval);
-        //     trendKSeries->append(frameNumber, trendK / trendInterval);
-        //     trendAxisX->setRange(0, frameNumber);
-        //     trendAxisY->setRange(0, 1.0);
-        //     trendMean = 0;
-        //     trendStddev = 0;
-        //     trendK = 0;
-        // }
+        // 取得は専用スレッドで行うので、タイマーは表示の更新だけを担当する
+        timer->start(displayInterval);
+        chartTimer->start(chartInterval);
     }
 
-    void saveGraphData(const std::vector<int>& saveframeCountData, const std::vector<float>& savemeanData,
-                       const std::vector<float>& savestddevData, const std::vector<float>& savekData,
-                       const std::vector<double>& savetimestampData, const std::vector<double>& savetempData) {
-        QString filePath = pathLineEditforGraph->text() + "/graph_data.csv";
-        QFile file(filePath);
-
-        bool fileExists = file.exists();
+    void AppendGraphData(const FrameStats& stats) {
+        const int frameNumber = stats.frameNumber;
+        const float mean = stats.mean;
+        const float stddev = stats.stddev;
+        const float cv = stats.cv;
+
+        meanPoints.append(frameNumber, mean / 255.0f);
+        stddevPoints.append(frameNumber, stddev / 255.0f);
+        kPoints.append(frameNumber, cv);
+        saturatedPoints.append(frameNumber, stats.saturatedFraction);
+        chartDirty = true;
+    }
 
-        if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
-            QMessageBox::critical(this, "Error", "Failed to open graph data file for writing.");
+    // 選択中のカメラと段のトレンドを描き直す (1秒ごと。新しい結果がなければ何もしない)
+    void updateTrend() {
+        const TrendStore& store = trendStores[currentCamera];
+        if (store.sampleCount() == trendDrawnSamples) {
             return;
         }
-
-        QTextStream stream(&file);
-
-        // 新規ファイルの場合はヘッダーを書き込む
-        if (!fileExists) {
-            stream << "Frame,TimeStamp,Temperature,Mean,StdDev,CV\n";
+        trendDrawnSamples = store.sampleCount();
+        const int tierIndex = std::clamp(trendComboBox->currentData().toInt(), 0, store.tierCount() - 1);
+        const TrendStore::Tier& tier = store.tier(tierIndex);
+        TrendStore::decimate(tier, trendMaxPoints, trendBuckets);
+
+        // 横軸の単位は段の粒度に合わせる (1秒→分, 1分→時間, 1時間→日)
+        const double width = tier.bucketWidth();
+        const double unit = width < 60.0 ? 60.0 : (width < 3600.0 ? 3600.0 : 86400.0);
+        QVector<QPointF> mean, stddev, k, upper, lower;
+        for (const TrendStore::Bucket& bucket : trendBuckets) {
+            const double x = bucket.start / unit;
+            mean.append(QPointF(x, bucket.mean(0)));
+            stddev.append(QPointF(x, bucket.mean(1)));
+            k.append(QPointF(x, bucket.mean(2)));
+            upper.append(QPointF(x, bucket.max[0]));
+            lower.append(QPointF(x, bucket.min[0]));
         }
-
-        stream.setRealNumberPrecision(15);
-        // データを追記
-        for (size_t i = 0; i < saveframeCountData.size(); ++i) {
-            stream << saveframeCountData[i] << ","
-                   << savetimestampData[i] << ","
-                   << savetempData[i] << ","
-                   << savemeanData[i] << ","
-                   << savestddevData[i] << ","
-                   << savekData[i] << "\n";
+        trendMeanSeries->replace(mean);
+        trendStddevSeries->replace(stddev);
+        trendKSeries->replace(k);
+        trendMeanUpper->replace(upper);
+        trendMeanLower->replace(lower);
+        trendAxisX->setTitleText(unit == 60.0 ? "Time [min]" : (unit == 3600.0 ? "Time [h]" : "Time [day]"));
+        if (!mean.isEmpty()) {
+            trendAxisX->setRange(mean.first().x(), std::max(mean.last().x(), mean.first().x() + width / unit));
         }
-
-        file.close();
-
-        // データベクターをクリア
-        frameCountData.clear();
-        meanData.clear();
-        stddevData.clear();
-        kData.clear();
-        timestampData.clear();
-        tempData.clear();
     }
 
-    void resultProcessing(QImage image, std::tuple<int, double, double>(tuple), const QString& directory, bool recording) {
-        try {
-            int frameNumber;
-            double timestamp;
-            double temp;
-            std::tie(frameNumber, timestamp, temp) = tuple;
-            const uint8_t* data = image.bits();
-            auto [mean, stddev, cv] = calculateMeanStdDevK(data, Width * Height);
-
-            if (!std::isfinite(mean) || !std::isfinite(stddev) || !std::isfinite(cv)) {
-                mean = 0.0f;
-                stddev = 0.0f;
-                cv = 0.0f;
-                std::cerr << "Invalid value detected at frame " << frameNumber << std::endl;
-            }
-
-            // シグナルを発行してメインスレッドにデータを送信
-            emit graphDataReady(frameNumber, timestamp, temp, mean, stddev, cv);
-
-            // 画像の保存
-            if (recording && frameNumber % saveImageInterval == 0) {
-                cameraHandler.saveImage(std::move(image), directory, frameNumber);
-            }
-
-            // グラフデータの保存
-            if (!pathLineEditforGraph->text().isEmpty() && frameNumber % saveGraphInterval == 0) {
-                QMutexLocker locker(&dataMutex);
-                saveGraphData(frameCountData, meanData, stddevData, kData, timestampData, tempData);
-            }
-        } catch(const std::exception& e) {
-            // ワーカースレッドから直接GUI要素を操作しない
-            std::cerr << e.what() << std::endl;
+    // 新しい点があれば、系列ごとに1回の replace() で描き直す
+    void UpdateGraph() {
+        if (!chartDirty || meanPoints.empty()) {
+            return;
         }
+        chartDirty = false;
+
+        meanPoints.decimate(chartMaxPoints, chartPoints);
+        meanSeries->replace(chartPoints);
+        stddevPoints.decimate(chartMaxPoints, chartPoints);
+        stddevSeries->replace(chartPoints);
+        kPoints.decimate(chartMaxPoints, chartPoints);
+        kSeries->replace(chartPoints);
+        saturatedPoints.decimate(chartMaxPoints, chartPoints);
+        saturatedSeries->replace(chartPoints);
+
+        const double last = meanPoints.x(meanPoints.size() - 1);
+        axisX->setRange(last - static_cast<double>(chartWindow), last);
     }
 };
 
@@ -2,70 +2,170 @@
 #define CAMERAHANDLER_H
 
 #include "Spinnaker.h"
+#include "framesource.h"
+#include "pixelformat.h"
+#include "reductionpool.h"
+#include "devicetelemetry.h"
+#include "stagestats.h"
 #include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
 #include <tuple>
 
-class CameraHandler {
+// Spinnakerカメラのフレーム源。コンストラクタはカメラを開いて設定を読むだけで、取得の開始と
+// 最初のフレームを待つのは取得スレッドの captureImage で行う (起動時に画面を待たせない)。
+// USBの瞬断などでカメラが外れたら、取得スレッドがシリアル番号で探し直して再接続する。
+// フレーム番号は取得スレッドが振るので途切れず、時刻は再接続後の最初のフレームで対応をとり直す。
+class CameraHandler : public FrameSource {
 public:
-    CameraHandler() {
+    // デバイス状態の読み取り間隔 [ms]
+    struct TelemetryRates {
+        int temperatureMs = 1000;
+        int statusMs = 1000; // 転送量・アンダーラン・露光時間
+    };
+
+    // 切断されたときの再接続。待ち時間は initialDelayMs から倍々に maxDelayMs まで延ばす
+    struct ReconnectPolicy {
+        int maxAttempts = 360; // 続けて失敗したらあきらめる回数 (0 = あきらめない)
+        int initialDelayMs = 500;
+        int maxDelayMs = 10000;
+    };
+
+    // index は接続されているカメラの番号 (0 から cameraCount() - 1)
+    explicit CameraHandler(int index = 0, const TelemetryRates& rates = TelemetryRates(),
+                           const ReconnectPolicy& reconnect = ReconnectPolicy())
+        : reconnectPolicy(reconnect) {
         system = Spinnaker::System::GetInstance();
         camList = system->GetCameras();
-        if (camList.GetSize() == 0) {
+        if (index < 0 || index >= static_cast<int>(camList.GetSize())) {
+            const unsigned int found = camList.GetSize();
             camList.Clear();
             system->ReleaseInstance();
-            throw std::runtime_error("No cameras found.");
+            throw std::runtime_error(found == 0 ? "No cameras found."
+                                                : "Camera " + std::to_string(index) + " not found (" + std::to_string(found) + " connected).");
         }
-        pCam = camList.GetByIndex(0);
+        pCam = camList.GetByIndex(index);
         pCam->Init();
-        pCam->BeginAcquisition();
-        Spinnaker::ImagePtr pResultImage = pCam->GetNextImage();
-        inittimestamp = pResultImage->GetTimeStamp();
-        pResultImage->Release();
-        pCam->EndAcquisition();
-        pCam->BeginAcquisition();
+        serialNumber = pCam->TLDevice.DeviceSerialNumber.GetValue().c_str();
+        spinnakerFormat = pCam->PixelFormat.GetValue();
+        unpacker = std::make_unique<PixelUnpacker>(sensorFormatOf(spinnakerFormat));
+
+        // フレームバッファは起動時に確保し、以後は使い回す (再接続しても同じ大きさと形式であること)
+        width = static_cast<int>(pCam->Width.GetValue());
+        height = static_cast<int>(pCam->Height.GetValue());
+        frameRate = pCam->AcquisitionFrameRate.GetValue();
+        pool = std::make_unique<FramePool>(framePoolSize, width, height, width, unpacker->bitDepth());
+
+        startTelemetry(rates);
+    }
+
+    static int cameraCount() {
+        Spinnaker::SystemPtr system = Spinnaker::System::GetInstance();
+        Spinnaker::CameraList cameras = system->GetCameras();
+        const int count = static_cast<int>(cameras.GetSize());
+        cameras.Clear();
+        system->ReleaseInstance();
+        return count;
     }
 
-    ~CameraHandler() {
-        pCam->EndAcquisition();
+    ~CameraHandler() override {
+        // サンプラーがカメラに触れなくなってから解放する
+        telemetry.requestInterruption();
+        telemetry.wait();
+        if (streaming) {
+            try {
+                pCam->EndAcquisition();
+            } catch (const Spinnaker::Exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        }
         pCam = nullptr;
         camList.Clear();
         system->ReleaseInstance();
     }
 
-    std::tuple<QImage, double, double> captureImage() {
+    // 取得したフレームをプールのバッファへ1回だけコピーし、Spinnaker側のバッファはすぐに返却する
+    FrameRef captureImage() override {
+        if (!streaming && !connect()) {
+            return FrameRef();
+        }
         Spinnaker::ImagePtr pResultImage = nullptr;
         try
         {
             pResultImage = pCam->GetNextImage(1000);
+            errorsInRow = 0;
             if (pResultImage->IsIncomplete())
             {
                 std::cerr << "Image incomplete with image status " << pResultImage->GetImageStatus() << std::endl;
                 std::cerr << "Image time stamp: " << pResultImage->GetTimeStamp() << std::endl;
-                std::cerr << "Device temperature: " << pCam->DeviceTemperature.GetValue() << std::endl;
+                std::cerr << "Device temperature: " << telemetry.valueAt(temperatureChannel, monotonicNs()) << std::endl;
                 std::cout << std::endl << std::endl;
                 pResultImage->Release();
-                return std::make_tuple(QImage(), 0, 0);
+                incompleteFrames.fetch_add(1, std::memory_order_relaxed);
+                return FrameRef();
             }
-            double temp = pCam->DeviceTemperature.GetValue();
+            // 温度はサンプラーが読んだ値を受信時刻で補間して使う (取得ループではレジスタを読まない)
+            const double temp = telemetry.valueAt(temperatureChannel, monotonicNs());
             const size_t width = pResultImage->GetWidth();
             const size_t height = pResultImage->GetHeight();
             const size_t stride = pResultImage->GetStride();
-            const double timestamp = (pResultImage->GetTimeStamp() - inittimestamp)/1000000000.0;
+            // カメラの時刻とホストの時刻 (monotonicNs) の対応は取得開始後の最初のフレームでとる。
+            // 受信までの遅れの分だけホスト側が遅れる。再接続でカメラの時刻が戻っても続いた時刻になる
+            const uint64_t deviceTimestamp = pResultImage->GetTimeStamp();
+            if (rebaseTime)
+            {
+                inittimestamp = deviceTimestamp;
+                initHostNs = monotonicNs();
+                rebaseTime = false;
+            }
+            // カメラの時刻を共通の基準時刻からの秒に直す
+            const double timestamp = secondsSinceEpoch(initHostNs + (deviceTimestamp - inittimestamp));
             Spinnaker::PixelFormatEnums pixelFormat = pResultImage->GetPixelFormat();
             const unsigned char *imageData = static_cast<const unsigned char*>(pResultImage->GetData());
 
-            QImage image;
-            if (pixelFormat == Spinnaker::PixelFormat_Mono8)
+            if (pixelFormat != spinnakerFormat)
+            {
+                return skipMismatchedFrame(pResultImage, "Pixel format");
+            }
+
+            if (static_cast<int>(width) != this->width || static_cast<int>(height) != this->height)
+            {
+                return skipMismatchedFrame(pResultImage, "Image size");
+            }
+
+            FrameRef frame = pool->acquire();
+            if (!frame)
             {
-                image = QImage(imageData, width, height, stride, QImage::Format_Grayscale8);
+                // 全バッファが処理中。コピーせずに捨てる
                 pResultImage->Release();
-                return std::make_tuple(image, timestamp, temp);
+                return FrameRef();
+            }
+
+            const uint64_t copyStart = monotonicNs();
+            if (pixelFormat == Spinnaker::PixelFormat_Mono8)
+            {
+                for (size_t y = 0; y < height; ++y)
+                {
+                    std::memcpy(frame->data + y * frame->stride, imageData + y * stride, width);
+                }
             }
             else
             {
-                pResultImage->Release();
-                throw std::runtime_error("Unsupported pixel format. Only Mono8 is supported. Please change the pixel format in SpinView.");
+                // 16bitの面への展開と8bitの面へのトーンマップを1回で行う
+                unpacker->unpack(imageData, stride, *frame, toneMap(), unpackStripes, ReductionPool::global());
             }
+            frame->copyNs = monotonicNs() - copyStart;
+            frame->timestamp = timestamp;
+            frame->temp = temp;
+            pResultImage->Release();
+            return frame;
         }
         catch (Spinnaker::Exception& e)
         {
@@ -73,8 +173,19 @@ public:
             {
                 pResultImage->Release();
             }
-            std::cerr << "Error: " << e.what() << std::endl;
-            return std::make_tuple(QImage(), 0, 0);
+            // タイムアウトはトリガー待ちなどでも起きるので、それだけでは切断とみなさない
+            bool lost = !pCam->IsValid();
+            if (e.GetError() != Spinnaker::SPINNAKER_ERR_TIMEOUT)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+                lost = lost || ++errorsInRow >= maxErrorsInRow || !pCam->IsStreaming();
+            }
+            if (lost)
+            {
+                std::cerr << "Camera " << serialNumber << " lost. Reconnecting." << std::endl;
+                closeCamera();
+            }
+            return FrameRef();
         }
         catch (std::exception& e)
         {
@@ -83,7 +194,7 @@ public:
                 pResultImage->Release();
             }
             std::cerr << "Error: " << e.what() << std::endl;
-            return std::make_tuple(QImage(), 0, 0);
+            return FrameRef();
         }
         catch (...)
         {
@@ -92,40 +203,259 @@ public:
                 pResultImage->Release();
             }
             std::cerr << "Unknown error." << std::endl;
-            return std::make_tuple(QImage(), 0, 0);
+            return FrameRef();
         }
     }
 
-    double getFrameRate() {
-        return pCam->AcquisitionFrameRate.GetValue();
+    double getFrameRate() override {
+        return frameRate;
     }
 
-    int getWidth() {
-        return pCam->Width.GetValue();
+    int getWidth() override {
+        return width;
+    }
+
+    int getHeight() override {
+        return height;
+    }
+
+    const FramePool& framePool() const override {
+        return *pool;
+    }
+
+    uint64_t incompleteFrameCount() const override {
+        return incompleteFrames.load(std::memory_order_relaxed);
+    }
+
+    // 取得スレッドを止めてから呼ぶ。再開は取得スレッドの次の captureImage で行う
+    void stopAcquisition() override {
+        if (streaming) {
+            streaming = false;
+            pCam->EndAcquisition();
+        }
     }
 
-    int getHeight() {
-        return pCam->Height.GetValue();
+    bool connected() const override {
+        return online.load(std::memory_order_relaxed);
     }
 
-    void saveImage(const QImage& image, const QString& directory, int imageCount) {
-        QString filename = QString("%1/%2.bmp").arg(directory).arg(imageCount, 6, 10, QLatin1Char('0'));
-        image.save(filename);
+    uint64_t reconnectCount() const override {
+        return reconnects.load(std::memory_order_relaxed);
     }
 
-    void stopAcquisition() {
-        pCam->EndAcquisition();
+    const DeviceTelemetry* deviceTelemetry() const override {
+        return &telemetry;
     }
 
-    void startAcquisition() {
-        pCam->BeginAcquisition();
+    SensorFormat sensorFormat() const override {
+        return unpacker->sensorFormat();
     }
 
 private:
+    // 取得を始める。カメラが外れていればシリアル番号で探し直して開く。
+    // 失敗したら待ち時間を延ばしながら再試行し、reconnectPolicy.maxAttempts 回続けて失敗したらあきらめる
+    bool connect() {
+        const uint64_t now = monotonicNs();
+        if (gaveUp || now < nextAttemptNs) {
+            // 取得スレッドを空回りさせず、停止要求にはすぐ応えられるように短く区切って待つ
+            const uint64_t waitMs = gaveUp ? idleWaitMs : (nextAttemptNs - now) / 1000000 + 1;
+            QThread::msleep(std::min<uint64_t>(waitMs, idleWaitMs));
+            return false;
+        }
+        const bool reopen = !pCam.IsValid();
+        try {
+            if (reopen && !openCamera()) {
+                return retryLater("not found");
+            }
+            pCam->BeginAcquisition();
+        } catch (const Spinnaker::Exception& e) {
+            closeCamera();
+            return retryLater(e.what());
+        } catch (const std::exception& e) {
+            // 大きさや画素形式が変わった。バッファを作り直せないので再接続をやめる
+            closeCamera();
+            std::cerr << "Camera " << serialNumber << ": " << e.what() << " Giving up reconnecting." << std::endl;
+            gaveUp = true;
+            return false;
+        }
+        streaming = true;
+        rebaseTime = true;
+        errorsInRow = 0;
+        if (reopen && everStreamed) {
+            reconnects.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "Camera " << serialNumber << " reconnected." << std::endl;
+        }
+        failedAttempts = 0;
+        everStreamed = true;
+        online.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool retryLater(const char* reason) {
+        ++failedAttempts;
+        if (reconnectPolicy.maxAttempts > 0 && failedAttempts >= reconnectPolicy.maxAttempts) {
+            std::cerr << "Camera " << serialNumber << ": " << reason << ". Giving up after " << failedAttempts
+                      << " attempts." << std::endl;
+            gaveUp = true;
+            return false;
+        }
+        const int shift = std::min(failedAttempts - 1, 16);
+        const int64_t delayMs = std::min<int64_t>(static_cast<int64_t>(reconnectPolicy.initialDelayMs) << shift,
+                                                  reconnectPolicy.maxDelayMs);
+        if (failedAttempts == 1 || delayMs == reconnectPolicy.maxDelayMs) {
+            std::cerr << "Camera " << serialNumber << ": " << reason << ". Retrying in " << delayMs << " ms (attempt "
+                      << failedAttempts << ")." << std::endl;
+        }
+        nextAttemptNs = monotonicNs() + static_cast<uint64_t>(std::max<int64_t>(0, delayMs)) * 1000000ull;
+        return false;
+    }
+
+    // カメラの一覧を取り直してシリアル番号で探す。見つからなければ false。
+    // 起動時と大きさか画素形式が違えば std::runtime_error
+    bool openCamera() {
+        camList = system->GetCameras();
+        Spinnaker::CameraPtr camera = camList.GetBySerial(serialNumber);
+        if (!camera.IsValid()) {
+            return false;
+        }
+        camera->Init();
+        if (static_cast<int>(camera->Width.GetValue()) != width || static_cast<int>(camera->Height.GetValue()) != height
+            || camera->PixelFormat.GetValue() != spinnakerFormat) {
+            camera->DeInit();
+            throw std::runtime_error("Image size or pixel format changed.");
+        }
+        QMutexLocker locker(&cameraMutex);
+        pCam = camera;
+        return true;
+    }
+
+    // 開いたときと形式や大きさが違うフレーム (取得中にSpinViewで変えたなど) は捨てて数える。
+    // 画像はここで返すので、呼び出し側の例外処理で二重に返さない
+    FrameRef skipMismatchedFrame(Spinnaker::ImagePtr& image, const char* what) {
+        image->Release();
+        image = nullptr;
+        if (mismatchedFrames++ % 1000 == 0) {
+            std::cerr << "Camera " << serialNumber << ": " << what << " changed during acquisition. Skipped "
+                      << mismatchedFrames << " frame(s)." << std::endl;
+        }
+        return FrameRef();
+    }
+
+    // 外れたカメラを手放す。サンプラーが読み終わるのを待ってから差し替える
+    void closeCamera() {
+        online.store(false, std::memory_order_relaxed);
+        streaming = false;
+        Spinnaker::CameraPtr camera;
+        {
+            QMutexLocker locker(&cameraMutex);
+            camera = pCam;
+            pCam = nullptr;
+        }
+        if (camera.IsValid()) {
+            try {
+                if (camera->IsStreaming()) {
+                    camera->EndAcquisition();
+                }
+                camera->DeInit();
+            } catch (const Spinnaker::Exception&) {
+                // 外れたカメラには何をしても失敗するので無視する
+            }
+        }
+        camera = nullptr;
+        camList.Clear();
+    }
+
+    // SpinView で選んだ画素形式。対応しない形式なら例外
+    static SensorFormat sensorFormatOf(Spinnaker::PixelFormatEnums format) {
+        switch (format) {
+        case Spinnaker::PixelFormat_Mono8:
+            return SensorFormat::Mono8;
+        case Spinnaker::PixelFormat_Mono10:
+            return SensorFormat::Mono10;
+        case Spinnaker::PixelFormat_Mono10p:
+            return SensorFormat::Mono10p;
+        case Spinnaker::PixelFormat_Mono10Packed:
+            return SensorFormat::Mono10Packed;
+        case Spinnaker::PixelFormat_Mono12:
+            return SensorFormat::Mono12;
+        case Spinnaker::PixelFormat_Mono12p:
+            return SensorFormat::Mono12p;
+        case Spinnaker::PixelFormat_Mono12Packed:
+            return SensorFormat::Mono12Packed;
+        case Spinnaker::PixelFormat_Mono14:
+            return SensorFormat::Mono14;
+        case Spinnaker::PixelFormat_Mono16:
+            return SensorFormat::Mono16;
+        default:
+            throw std::runtime_error("Unsupported pixel format. Use Mono8, Mono10, Mono10p, Mono10Packed, Mono12, "
+                                     "Mono12p, Mono12Packed, Mono14 or Mono16 in SpinView.");
+        }
+    }
+
+    // 読めるノードだけを登録する (機種やインターフェースによって無いものがある)。
+    // 再接続中はカメラがないので読まない (NaN は記録されない)
+    void startTelemetry(const TelemetryRates& rates) {
+        using Spinnaker::GenApi::IsReadable;
+        auto guarded = [this](double (*read)(Spinnaker::CameraPtr&)) {
+            return [this, read]() {
+                QMutexLocker locker(&cameraMutex);
+                return pCam.IsValid() ? read(pCam) : std::numeric_limits<double>::quiet_NaN();
+            };
+        };
+        if (IsReadable(pCam->DeviceTemperature)) {
+            temperatureChannel = telemetry.addChannel("Temperature", "C", rates.temperatureMs, guarded(
+                [](Spinnaker::CameraPtr& camera) { return static_cast<double>(camera->DeviceTemperature.GetValue()); }));
+        }
+        if (IsReadable(pCam->DeviceLinkCurrentThroughput)) {
+            telemetry.addChannel("Link throughput", "MB/s", rates.statusMs, guarded(
+                [](Spinnaker::CameraPtr& camera) { return camera->DeviceLinkCurrentThroughput.GetValue() / 1e6; }));
+        }
+        if (IsReadable(pCam->TLStream.StreamBufferUnderrunCount)) {
+            telemetry.addChannel("Buffer underruns", "", rates.statusMs, guarded(
+                [](Spinnaker::CameraPtr& camera) { return static_cast<double>(camera->TLStream.StreamBufferUnderrunCount.GetValue()); }));
+        }
+        if (IsReadable(pCam->ExposureTime)) {
+            telemetry.addChannel("Exposure", "us", rates.statusMs, guarded(
+                [](Spinnaker::CameraPtr& camera) { return static_cast<double>(camera->ExposureTime.GetValue()); }));
+        }
+        telemetry.start(QThread::LowPriority);
+    }
+
     Spinnaker::SystemPtr system;
     Spinnaker::CameraList camList;
-    Spinnaker::CameraPtr pCam;
-    uint64_t inittimestamp;
+    Spinnaker::CameraPtr pCam; // 差し替えは取得スレッドが cameraMutex の中で行う
+    QMutex cameraMutex;        // サンプラーと再接続の間で pCam を守る
+    std::string serialNumber;
+    const ReconnectPolicy reconnectPolicy;
+    uint64_t inittimestamp = 0;
+    uint64_t initHostNs = 0;
+    Spinnaker::PixelFormatEnums spinnakerFormat;
+    std::unique_ptr<PixelUnpacker> unpacker;
+    int width = 0;
+    int height = 0;
+    double frameRate = 0.0;
+
+    // 以下は取得スレッドだけが触る
+    bool streaming = false;
+    bool rebaseTime = true;
+    bool everStreamed = false;
+    bool gaveUp = false;
+    int failedAttempts = 0;
+    int errorsInRow = 0;
+    uint64_t mismatchedFrames = 0;
+    uint64_t nextAttemptNs = 0;
+
+    static constexpr int maxErrorsInRow = 5;   // タイムアウト以外のエラーがこれだけ続いたら切断とみなす
+    static constexpr uint64_t idleWaitMs = 100;
+
+    static constexpr size_t framePoolSize = 24;
+    std::unique_ptr<FramePool> pool;
+    std::atomic<uint64_t> incompleteFrames{0};
+    std::atomic<bool> online{false};
+    std::atomic<uint64_t> reconnects{0};
+
+    DeviceTelemetry telemetry;
+    int temperatureChannel = -1;
 };
 
 #endif // CAMERAHANDLER_H
\ No newline at end of file
@@ -0,0 +1,225 @@
+#ifndef CAMERARIG_H
+#define CAMERARIG_H
+
+#include "framepipeline.h"
+#include "framesource.h"
+#include "reductionpool.h"
+#include "stagestats.h"
+#include "telemetrylogger.h"
+
+#include <QDir>
+#include <QString>
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// 複数台のカメラ (フレーム源) をまとめて動かす。
+// カメラごとに取得スレッド・バッファプール・統計パイプラインを持ち、
+// タイムスタンプは共通の基準時刻からの秒にそろえ、解析結果は1つのログにまとめる。
+// 記録はカメラが2台以上なら保存先の下の cam<番号> フォルダに分ける。
+class CameraRig {
+public:
+    // captureCores[i] はカメラ i の取得スレッドを固定するコア (足りない分と負の値は固定しない)
+    explicit CameraRig(std::vector<std::unique_ptr<FrameSource>> frameSources,
+                       const std::vector<int>& captureCores = std::vector<int>())
+        : sources(std::move(frameSources)), telemetryLogger(logStats) {
+        if (sources.empty()) {
+            throw std::runtime_error("No frame sources.");
+        }
+        epochNs = monotonicNs();
+        // 1フレーム内の並列集計に使うスレッドは取得スレッドのコアを避けて固定する
+        ReductionPool::configureGlobal(ReductionPool::defaultCores(captureCores));
+        for (size_t i = 0; i < sources.size(); ++i) {
+            sources[i]->setEpoch(epochNs);
+            pipelines.push_back(std::make_unique<FramePipeline>(*sources[i], &telemetryLogger, static_cast<int>(i)));
+            if (i < captureCores.size()) {
+                pipelines[i]->setCaptureCore(captureCores[i]);
+            }
+        }
+    }
+
+    ~CameraRig() {
+        stop();
+    }
+
+    void start() {
+        telemetryLogger.start();
+        for (auto& pipeline : pipelines) {
+            pipeline->start();
+        }
+    }
+
+    // 全パイプラインが行を積み終えてからログを閉じる
+    void stop() {
+        for (auto& pipeline : pipelines) {
+            pipeline->stop();
+        }
+        telemetryLogger.requestInterruption();
+        telemetryLogger.wait();
+    }
+
+    void stopAcquisition() {
+        for (auto& pipeline : pipelines) {
+            pipeline->stopAcquisition();
+            pipeline->frameSource().stopAcquisition();
+        }
+    }
+
+    void startAcquisition() {
+        for (auto& pipeline : pipelines) {
+            pipeline->frameSource().startAcquisition();
+            pipeline->startAcquisition();
+        }
+    }
+
+    int size() const {
+        return static_cast<int>(pipelines.size());
+    }
+
+    FramePipeline& pipeline(int camera) {
+        return *pipelines.at(camera);
+    }
+
+    const FramePipeline& pipeline(int camera) const {
+        return *pipelines.at(camera);
+    }
+
+    FrameSource& source(int camera) {
+        return *sources.at(camera);
+    }
+
+    const TelemetryLogger& logger() const {
+        return telemetryLogger;
+    }
+
+    const StageStats& logTimings() const {
+        return logStats;
+    }
+
+    // 全カメラ共通のタイムスタンプの基準 (monotonicNs)
+    uint64_t epoch() const {
+        return epochNs;
+    }
+
+    void setGraphDirectory(const QString& directory) {
+        telemetryLogger.setDirectory(directory);
+    }
+
+    void setLogSyncInterval(int milliseconds) {
+        telemetryLogger.setSyncInterval(milliseconds);
+    }
+
+    // start() より前に呼ぶ
+    void disablePreview() {
+        for (auto& pipeline : pipelines) {
+            pipeline->disablePreview();
+        }
+    }
+
+    void setSaveImageInterval(int interval) {
+        for (auto& pipeline : pipelines) {
+            pipeline->setSaveImageInterval(interval);
+        }
+    }
+
+    void setRecording(bool enabled, const QString& directory) {
+        for (auto& pipeline : pipelines) {
+            QString target = directory;
+            if (size() > 1 && !directory.isEmpty()) {
+                target = QDir(directory).filePath(QString("cam%1").arg(pipeline->cameraIndex()));
+                if (enabled && !QDir().mkpath(target)) {
+                    std::cerr << "Failed to create " << target.toStdString() << std::endl;
+                }
+            }
+            pipeline->setRecording(enabled, target);
+        }
+    }
+
+    void setRecordFormat(FramePipeline::RecordFormat format) {
+        for (auto& pipeline : pipelines) {
+            pipeline->setRecordFormat(format);
+        }
+    }
+
+    void setEventRule(const EventRule& rule) {
+        for (auto& pipeline : pipelines) {
+            pipeline->setEventRule(rule);
+        }
+    }
+
+    void setTileLayout(std::shared_ptr<const TileLayout> layout) {
+        for (auto& pipeline : pipelines) {
+            pipeline->setTileLayout(layout);
+        }
+    }
+
+    void setOverloadPolicy(FramePipeline::OverloadPolicy policy) {
+        for (auto& pipeline : pipelines) {
+            pipeline->setOverloadPolicy(policy);
+        }
+    }
+
+    void setCorrectionMode(FrameCorrector::Mode mode) {
+        for (auto& pipeline : pipelines) {
+            pipeline->corrector().setMode(mode);
+        }
+    }
+
+    void setBackgroundShift(int shift) {
+        for (auto& pipeline : pipelines) {
+            pipeline->corrector().setBackgroundShift(shift);
+        }
+    }
+
+    void setCorrectionPedestal(int pedestal) {
+        for (auto& pipeline : pipelines) {
+            pipeline->corrector().setPedestal(pedestal);
+        }
+    }
+
+    // ダーク/フラットの参照を directory/calibration_cam<番号>.jcr に保存し、あれば読み込む。空なら保存しない
+    void setCalibrationDirectory(const QString& directory) {
+        if (!directory.isEmpty() && !QDir().mkpath(directory)) {
+            std::cerr << "Failed to create " << directory.toStdString() << std::endl;
+        }
+        for (auto& pipeline : pipelines) {
+            pipeline->corrector().setCalibrationFile(
+                directory.isEmpty() ? QString()
+                                    : QDir(directory).filePath(QString("calibration_cam%1.jcr").arg(pipeline->cameraIndex())));
+        }
+    }
+
+    // フレームを共有メモリ /dev/shm/<name> に書き出す。カメラが2台以上なら <name>_cam<番号> に分ける。
+    // start() より前に呼ぶ。作れなかったらstd::runtime_errorを投げる
+    void enableSharedMemory(const QString& name, int slots) {
+        for (auto& pipeline : pipelines) {
+            pipeline->enableSharedMemory(size() > 1 ? name + QString("_cam%1").arg(pipeline->cameraIndex()) : name,
+                                         slots);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<FrameSource>> sources;
+    StageStats logStats;
+    TelemetryLogger telemetryLogger;
+    std::vector<std::unique_ptr<FramePipeline>> pipelines; // sources とログより先に破棄される
+    uint64_t epochNs = 0;
+};
+
+// "0,1,-1" のようなコア番号の並び。空なら固定しない
+inline bool parseCoreList(const QString& text, std::vector<int>& cores) {
+    cores.clear();
+    for (const QString& item : text.split(',', QString::SkipEmptyParts)) {
+        bool ok = false;
+        const int core = item.trimmed().toInt(&ok);
+        if (!ok) {
+            return false;
+        }
+        cores.push_back(core);
+    }
+    return true;
+}
+
+#endif // CAMERARIG_H
@@ -0,0 +1,102 @@
+#ifndef CHARTBUFFER_H
+#define CHARTBUFFER_H
+
+#include <QPointF>
+#include <QVector>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// グラフ1系列分の固定長リングバッファ。古い点は上書きされる (remove(0) のような詰め直しはしない)。
+// decimate() は区間ごとの最小値と最大値だけを残して点数を抑える。スパイクは間引いても消えない。
+class ChartBuffer {
+public:
+    explicit ChartBuffer(size_t capacity) : xs(capacity), ys(capacity) {}
+
+    void append(double x, double y) {
+        xs[head] = x;
+        ys[head] = y;
+        head = (head + 1) % xs.size();
+        count = std::min(count + 1, xs.size());
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return xs.size();
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // i = 0 が最も古い点
+    double x(size_t i) const {
+        return xs[index(i)];
+    }
+
+    double y(size_t i) const {
+        return ys[index(i)];
+    }
+
+    // 最大 maxPoints 点に間引いて out に詰める (out の確保済み領域は使い回す)
+    void decimate(size_t maxPoints, QVector<QPointF>& out) const {
+        out.clear();
+        if (count == 0) {
+            return;
+        }
+        if (count <= maxPoints || maxPoints < 2) {
+            out.reserve(static_cast<int>(count));
+            for (size_t i = 0; i < count; ++i) {
+                out.append(QPointF(x(i), y(i)));
+            }
+            return;
+        }
+
+        // 1区間あたり最小と最大の2点を出す
+        const size_t buckets = maxPoints / 2;
+        const size_t bucketSize = (count + buckets - 1) / buckets;
+        out.reserve(static_cast<int>(buckets * 2));
+        for (size_t begin = 0; begin < count; begin += bucketSize) {
+            const size_t end = std::min(begin + bucketSize, count);
+            size_t minIndex = begin;
+            size_t maxIndex = begin;
+            for (size_t i = begin + 1; i < end; ++i) {
+                const double value = y(i);
+                if (value < y(minIndex)) {
+                    minIndex = i;
+                }
+                if (value > y(maxIndex)) {
+                    maxIndex = i;
+                }
+            }
+            // 時間順を保つ
+            const size_t first = std::min(minIndex, maxIndex);
+            const size_t second = std::max(minIndex, maxIndex);
+            out.append(QPointF(x(first), y(first)));
+            if (second != first) {
+                out.append(QPointF(x(second), y(second)));
+            }
+        }
+    }
+
+private:
+    size_t index(size_t i) const {
+        return (head + xs.size() - count + i) % xs.size();
+    }
+
+    std::vector<double> xs;
+    std::vector<double> ys;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif // CHARTBUFFER_H
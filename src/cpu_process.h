@@ -4,30 +4,324 @@
 #include <tuple>
 #include <cmath>
 #include <cstdint>
+#include <cstddef>
 
-inline std::tuple<float, float, float> calculateMeanStdDevK(const uint8_t* data, int size) {
-    // Calculate the mean
-    float sum = 0.0f;
-    for (int i = 0; i < size; ++i) {
-        sum += static_cast<float>(data[i]);
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CPU_PROCESS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CPU_PROCESS_NEON 1
+#endif
+
+// 画素値の総和と二乗和。整数で保持するので5MP以上のフレームでも誤差が出ない。
+struct PixelMoments {
+    uint64_t sum = 0;
+    uint64_t sumSq = 0;
+    uint64_t count = 0;
+
+    PixelMoments& operator+=(const PixelMoments& other) {
+        sum += other.sum;
+        sumSq += other.sumSq;
+        count += other.count;
+        return *this;
+    }
+
+    double mean() const {
+        return count ? static_cast<double>(sum) / count : 0.0;
     }
-    float mean = sum / size;
 
-    // Calculate the variance
-    float sumSqDiff = 0.0f;
-    for (int i = 0; i < size; ++i) {
-        float diff = static_cast<float>(data[i]) - mean;
-        sumSqDiff += diff * diff;
+    double variance() const {
+        if (count == 0) {
+            return 0.0;
+        }
+        // n*Σx² - (Σx)² を128bit整数で厳密に計算してから浮動小数点に変換する
+        const unsigned __int128 n = count;
+        const unsigned __int128 s = sum;
+        const unsigned __int128 num = n * sumSq - s * s;
+        return static_cast<double>(num) / (static_cast<double>(count) * static_cast<double>(count));
     }
-    float variance = sumSqDiff / size;
+};
+
+namespace cpu_process_detail {
 
-    // Calculate the standard deviation
-    float stdDev = std::sqrt(variance);
+inline PixelMoments momentsScalar(const uint8_t* data, size_t size) {
+    PixelMoments m;
+    uint64_t sum = 0;
+    uint64_t sumSq = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const uint32_t v = data[i];
+        sum += v;
+        sumSq += v * v;
+    }
+    m.sum = sum;
+    m.sumSq = sumSq;
+    m.count = size;
+    return m;
+}
+
+// 10〜16bitの画素 (階調値そのまま)
+inline PixelMoments moments16Scalar(const uint16_t* data, size_t size) {
+    PixelMoments m;
+    uint64_t sum = 0;
+    uint64_t sumSq = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const uint64_t v = data[i];
+        sum += v;
+        sumSq += v * v;
+    }
+    m.sum = sum;
+    m.sumSq = sumSq;
+    m.count = size;
+    return m;
+}
+
+// 16bitの総和を32bitのアキュムレータに足すとき、1イテレーションで各レーンは最大 2*65535 増えるので、この回数ごとに64bitへ退避する
+constexpr size_t kFlushBlocks16 = 16384;
+
+#ifdef CPU_PROCESS_X86
+// 32bitの二乗和アキュムレータは1イテレーションで最大 2*2*255^2 増えるので、この回数ごとに64bitへ退避する
+constexpr size_t kFlushBlocks = 4096;
+
+__attribute__((target("avx2")))
+inline PixelMoments momentsAvx2(const uint8_t* data, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum64 = _mm256_setzero_si256();
+    __m256i sq64 = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i + 32 <= size) {
+        __m256i sq32 = _mm256_setzero_si256();
+        const size_t blockEnd = i + kFlushBlocks * 32 < size ? i + kFlushBlocks * 32 : size;
+        for (; i + 32 <= blockEnd; i += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            sum64 = _mm256_add_epi64(sum64, _mm256_sad_epu8(v, zero));
+            const __m256i lo = _mm256_unpacklo_epi8(v, zero);
+            const __m256i hi = _mm256_unpackhi_epi8(v, zero);
+            sq32 = _mm256_add_epi32(sq32, _mm256_madd_epi16(lo, lo));
+            sq32 = _mm256_add_epi32(sq32, _mm256_madd_epi16(hi, hi));
+        }
+        sq64 = _mm256_add_epi64(sq64, _mm256_unpacklo_epi32(sq32, zero));
+        sq64 = _mm256_add_epi64(sq64, _mm256_unpackhi_epi32(sq32, zero));
+    }
+    alignas(32) uint64_t s[4];
+    alignas(32) uint64_t q[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s), sum64);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(q), sq64);
+    PixelMoments m = momentsScalar(data + i, size - i);
+    m.sum += s[0] + s[1] + s[2] + s[3];
+    m.sumSq += q[0] + q[1] + q[2] + q[3];
+    m.count = size;
+    return m;
+}
+
+__attribute__((target("sse4.1")))
+inline PixelMoments momentsSse41(const uint8_t* data, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum64 = _mm_setzero_si128();
+    __m128i sq64 = _mm_setzero_si128();
+    size_t i = 0;
+    while (i + 16 <= size) {
+        __m128i sq32 = _mm_setzero_si128();
+        const size_t blockEnd = i + kFlushBlocks * 16 < size ? i + kFlushBlocks * 16 : size;
+        for (; i + 16 <= blockEnd; i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            sum64 = _mm_add_epi64(sum64, _mm_sad_epu8(v, zero));
+            const __m128i lo = _mm_cvtepu8_epi16(v);
+            const __m128i hi = _mm_unpackhi_epi8(v, zero);
+            sq32 = _mm_add_epi32(sq32, _mm_madd_epi16(lo, lo));
+            sq32 = _mm_add_epi32(sq32, _mm_madd_epi16(hi, hi));
+        }
+        sq64 = _mm_add_epi64(sq64, _mm_unpacklo_epi32(sq32, zero));
+        sq64 = _mm_add_epi64(sq64, _mm_unpackhi_epi32(sq32, zero));
+    }
+    alignas(16) uint64_t s[2];
+    alignas(16) uint64_t q[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(s), sum64);
+    _mm_store_si128(reinterpret_cast<__m128i*>(q), sq64);
+    PixelMoments m = momentsScalar(data + i, size - i);
+    m.sum += s[0] + s[1];
+    m.sumSq += q[0] + q[1];
+    m.count = size;
+    return m;
+}
+
+// 二乗は65535^2でも32bitに収まるが、足すと溢れるので偶数/奇数レーンごとに64bitの積 (mul_epu32) にして足す
+__attribute__((target("avx2")))
+inline PixelMoments moments16Avx2(const uint16_t* data, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum64 = _mm256_setzero_si256();
+    __m256i sq64 = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i + 16 <= size) {
+        __m256i sum32 = _mm256_setzero_si256();
+        const size_t blockEnd = i + kFlushBlocks16 * 16 < size ? i + kFlushBlocks16 * 16 : size;
+        for (; i + 16 <= blockEnd; i += 16) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const __m256i lo = _mm256_unpacklo_epi16(v, zero);
+            const __m256i hi = _mm256_unpackhi_epi16(v, zero);
+            sum32 = _mm256_add_epi32(sum32, _mm256_add_epi32(lo, hi));
+            const __m256i loOdd = _mm256_srli_epi64(lo, 32);
+            const __m256i hiOdd = _mm256_srli_epi64(hi, 32);
+            sq64 = _mm256_add_epi64(sq64, _mm256_mul_epu32(lo, lo));
+            sq64 = _mm256_add_epi64(sq64, _mm256_mul_epu32(loOdd, loOdd));
+            sq64 = _mm256_add_epi64(sq64, _mm256_mul_epu32(hi, hi));
+            sq64 = _mm256_add_epi64(sq64, _mm256_mul_epu32(hiOdd, hiOdd));
+        }
+        sum64 = _mm256_add_epi64(sum64, _mm256_unpacklo_epi32(sum32, zero));
+        sum64 = _mm256_add_epi64(sum64, _mm256_unpackhi_epi32(sum32, zero));
+    }
+    alignas(32) uint64_t s[4];
+    alignas(32) uint64_t q[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s), sum64);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(q), sq64);
+    PixelMoments m = moments16Scalar(data + i, size - i);
+    m.sum += s[0] + s[1] + s[2] + s[3];
+    m.sumSq += q[0] + q[1] + q[2] + q[3];
+    m.count = size;
+    return m;
+}
+#endif // CPU_PROCESS_X86
+
+#ifdef CPU_PROCESS_NEON
+constexpr size_t kFlushBlocks = 4096;
+
+inline PixelMoments momentsNeon(const uint8_t* data, size_t size) {
+    uint64x2_t sum64 = vdupq_n_u64(0);
+    uint64x2_t sq64 = vdupq_n_u64(0);
+    size_t i = 0;
+    while (i + 16 <= size) {
+        uint32x4_t sum32 = vdupq_n_u32(0);
+        uint32x4_t sq32 = vdupq_n_u32(0);
+        const size_t blockEnd = i + kFlushBlocks * 16 < size ? i + kFlushBlocks * 16 : size;
+        for (; i + 16 <= blockEnd; i += 16) {
+            const uint8x16_t v = vld1q_u8(data + i);
+            sum32 = vpadalq_u16(sum32, vpaddlq_u8(v));
+            const uint16x8_t lo = vmull_u8(vget_low_u8(v), vget_low_u8(v));
+            const uint16x8_t hi = vmull_u8(vget_high_u8(v), vget_high_u8(v));
+            sq32 = vpadalq_u16(sq32, lo);
+            sq32 = vpadalq_u16(sq32, hi);
+        }
+        sum64 = vpadalq_u32(sum64, sum32);
+        sq64 = vpadalq_u32(sq64, sq32);
+    }
+    PixelMoments m = momentsScalar(data + i, size - i);
+    m.sum += vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1);
+    m.sumSq += vgetq_lane_u64(sq64, 0) + vgetq_lane_u64(sq64, 1);
+    m.count = size;
+    return m;
+}
+
+inline PixelMoments moments16Neon(const uint16_t* data, size_t size) {
+    uint64x2_t sum64 = vdupq_n_u64(0);
+    uint64x2_t sq64 = vdupq_n_u64(0);
+    size_t i = 0;
+    while (i + 8 <= size) {
+        uint32x4_t sum32 = vdupq_n_u32(0);
+        const size_t blockEnd = i + kFlushBlocks16 * 8 < size ? i + kFlushBlocks16 * 8 : size;
+        for (; i + 8 <= blockEnd; i += 8) {
+            const uint16x8_t v = vld1q_u16(data + i);
+            sum32 = vpadalq_u16(sum32, v);
+            sq64 = vpadalq_u32(sq64, vmull_u16(vget_low_u16(v), vget_low_u16(v)));
+            sq64 = vpadalq_u32(sq64, vmull_u16(vget_high_u16(v), vget_high_u16(v)));
+        }
+        sum64 = vpadalq_u32(sum64, sum32);
+    }
+    PixelMoments m = moments16Scalar(data + i, size - i);
+    m.sum += vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1);
+    m.sumSq += vgetq_lane_u64(sq64, 0) + vgetq_lane_u64(sq64, 1);
+    m.count = size;
+    return m;
+}
+#endif // CPU_PROCESS_NEON
+
+using MomentsKernel = PixelMoments (*)(const uint8_t*, size_t);
+
+struct MomentsKernelEntry {
+    MomentsKernel kernel;
+    const char* name;
+};
+
+// 実行時にCPUの機能を調べて一度だけカーネルを選ぶ
+inline MomentsKernelEntry selectMomentsKernel() {
+#ifdef CPU_PROCESS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {momentsAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return {momentsSse41, "sse4.1"};
+    }
+#endif
+#ifdef CPU_PROCESS_NEON
+    // AArch64ではAdvanced SIMDは必須機能
+    return {momentsNeon, "neon"};
+#endif
+    return {momentsScalar, "scalar"};
+}
+
+inline const MomentsKernelEntry& momentsKernel() {
+    static const MomentsKernelEntry entry = selectMomentsKernel();
+    return entry;
+}
+
+using Moments16Kernel = PixelMoments (*)(const uint16_t*, size_t);
+
+struct Moments16KernelEntry {
+    Moments16Kernel kernel;
+    const char* name;
+};
+
+inline Moments16KernelEntry selectMoments16Kernel() {
+#ifdef CPU_PROCESS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {moments16Avx2, "avx2"};
+    }
+#endif
+#ifdef CPU_PROCESS_NEON
+    return {moments16Neon, "neon"};
+#endif
+    return {moments16Scalar, "scalar"};
+}
+
+inline const Moments16KernelEntry& moments16Kernel() {
+    static const Moments16KernelEntry entry = selectMoments16Kernel();
+    return entry;
+}
+
+} // namespace cpu_process_detail
+
+// 1パスで総和と二乗和を求める (SIMDは実行時に選択)
+inline PixelMoments calculateMoments(const uint8_t* data, size_t size) {
+    return cpu_process_detail::momentsKernel().kernel(data, size);
+}
+
+inline PixelMoments calculateMoments(const uint16_t* data, size_t size) {
+    return cpu_process_detail::moments16Kernel().kernel(data, size);
+}
+
+// 選択されたカーネル名 (ログ用)
+inline const char* momentsKernelName() {
+    return cpu_process_detail::momentsKernel().name;
+}
+
+inline const char* moments16KernelName() {
+    return cpu_process_detail::moments16Kernel().name;
+}
+
+// scale は平均と標準偏差に掛ける係数 (10〜16bitの階調値を0〜255に直すときに使う。CVは変わらない)
+inline std::tuple<float, float, float> momentsToMeanStdDevK(const PixelMoments& moments, double scale = 1.0) {
+    const double mean = moments.mean() * scale;
+    const double stdDev = std::sqrt(moments.variance()) * scale;
 
     // Calculate the coefficient of variation (k)
-    float k = stdDev / mean;
+    const double k = stdDev / mean;
 
-    return std::make_tuple(mean, stdDev, k);
+    return std::make_tuple(static_cast<float>(mean), static_cast<float>(stdDev), static_cast<float>(k));
+}
+
+inline std::tuple<float, float, float> calculateMeanStdDevK(const uint8_t* data, int size) {
+    return momentsToMeanStdDevK(calculateMoments(data, static_cast<size_t>(size)));
 }
 
-#endif // CPU_PROCESS_H
\ No newline at end of file
+#endif // CPU_PROCESS_H
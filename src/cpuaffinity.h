@@ -0,0 +1,31 @@
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstring>
+#include <iostream>
+
+// 呼び出したスレッドを指定したコアだけで動くようにする。core < 0 なら何もしない。
+// 失敗してもそのまま動き続けられるので、警告だけ出して false を返す。
+inline bool pinCurrentThread(int core) {
+    if (core < 0) {
+        return true;
+    }
+    if (core >= CPU_SETSIZE) {
+        std::cerr << "Cannot pin thread to core " << core << ": out of range" << std::endl;
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+        std::cerr << "Cannot pin thread to core " << core << ": " << std::strerror(result) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif // CPUAFFINITY_H
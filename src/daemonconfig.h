@@ -0,0 +1,266 @@
+#ifndef DAEMONCONFIG_H
+#define DAEMONCONFIG_H
+
+#include "camerarig.h"
+#include "eventrecorder.h"
+#include "framepipeline.h"
+#include "sourcefactory.h"
+#include "tilestats.h"
+
+#include <QFileInfo>
+#include <QSettings>
+#include <QString>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ヘッドレス動作 (jetsonCamDaemon) の設定。ini ファイルから読み、コマンドラインで上書きする。
+//
+// [source]   synthetic, noise, drift, cameras, capture_cores, replay, replay_fps, loop,
+//            temperature_interval, status_interval,
+//            format (合成フレーム源の画素形式 mono8|mono10|mono10p|...|mono16),
+//            tone_map (black,white: 10〜16bitを8bitの面にする範囲 [階調値]。空なら全範囲)
+//            reconnect_attempts (外れたカメラへの再接続を続けて失敗したらあきらめる回数。0であきらめない),
+//            reconnect_max_delay (ms, 再接続の間隔の上限)
+// [record]   enabled, directory, format (raw|lossless|bmp|event), image_interval, trigger
+// [log]      directory, sync_interval (ms), print_interval (s, 標準出力への状態表示。0で出さない)
+// [analysis] grid, rois, overload (block|drop)
+// [metrics]  file (Prometheus テキスト形式で書き出す先。空なら書かない), interval (s)
+// [correction] mode (off|flat|background), directory (参照の保存先), background_shift, pedestal,
+//            capture (dark|flat, 起動直後に参照を撮る), capture_frames
+// [temporal] window (画素ごとの時間方向の統計の窓 [フレーム]、0で使わない), every (間引き),
+//            directory, export_interval (s, 平均・分散・CVのマップを書き出す間隔。0で書かない)
+// [shm]      name (フレームを書き出す共有メモリ /dev/shm/<name>。空なら書き出さない), slots (リングのフレーム数)
+struct DaemonConfig {
+    SourceConfig source;
+    std::vector<int> captureCores;
+
+    bool recording = false;
+    QString recordDirectory;
+    FramePipeline::RecordFormat recordFormat = FramePipeline::RecordFormat::Container;
+    int saveImageInterval = 600;
+    QString trigger = "cv>0.05 pre=2 post=2";
+
+    QString graphDirectory;
+    int saveGraphInterval = 1000;  // ログをディスクへ同期する間隔 [ms]
+    int printInterval = 10; // 標準出力に状態を出す間隔 [s]
+
+    int grid = 0;
+    QString rois;
+    FramePipeline::OverloadPolicy overload = FramePipeline::OverloadPolicy::Block;
+
+    QString metricsFile;
+    int metricsInterval = 5; // 計測値を書き出す間隔 [s]
+
+    FrameCorrector::Mode correction = FrameCorrector::Mode::Off;
+    QString calibrationDirectory;
+    int backgroundShift = 6;
+    int pedestal = 32;
+    QString captureReference; // 空, "dark" または "flat"
+    int captureFrames = 32;
+
+    int temporalWindow = 0;
+    int temporalEvery = 1;
+    QString temporalDirectory;
+    int temporalExportInterval = 0;
+
+    QString shmName;
+    int shmSlots = 8;
+};
+
+inline bool parseRecordFormat(const QString& name, FramePipeline::RecordFormat& format) {
+    const QString key = name.trimmed().toLower();
+    if (key == "raw") {
+        format = FramePipeline::RecordFormat::Container;
+    } else if (key == "lossless") {
+        format = FramePipeline::RecordFormat::Lossless;
+    } else if (key == "bmp") {
+        format = FramePipeline::RecordFormat::Bmp;
+    } else if (key == "event") {
+        format = FramePipeline::RecordFormat::Event;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline bool parseOverloadPolicy(const QString& name, FramePipeline::OverloadPolicy& policy) {
+    const QString key = name.trimmed().toLower();
+    if (key == "block") {
+        policy = FramePipeline::OverloadPolicy::Block;
+    } else if (key == "drop") {
+        policy = FramePipeline::OverloadPolicy::Drop;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline bool parseCorrectionMode(const QString& name, FrameCorrector::Mode& mode) {
+    const QString key = name.trimmed().toLower();
+    if (key == "off") {
+        mode = FrameCorrector::Mode::Off;
+    } else if (key == "flat") {
+        mode = FrameCorrector::Mode::Flat;
+    } else if (key == "background") {
+        mode = FrameCorrector::Mode::FlatBackground;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 書かれていないキーは config の値のまま。値が不正なら例外
+inline void loadDaemonConfig(const QString& path, DaemonConfig& config) {
+    if (!QFileInfo(path).isReadable()) {
+        throw std::runtime_error("Cannot read config file " + path.toStdString());
+    }
+    QSettings settings(path, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError) {
+        throw std::runtime_error("Invalid config file " + path.toStdString());
+    }
+
+    SourceConfig& source = config.source;
+    settings.beginGroup("source");
+    source.synthetic = settings.value("synthetic", source.synthetic).toString();
+    source.noise = settings.value("noise", source.noise).toDouble();
+    source.drift = settings.value("drift", source.drift).toDouble();
+    source.cameras = settings.value("cameras", source.cameras).toInt();
+    source.replay = settings.value("replay", source.replay).toStringList();
+    source.replayFps = settings.value("replay_fps", source.replayFps).toDouble();
+    source.loop = settings.value("loop", source.loop).toBool();
+    source.rates.temperatureMs = settings.value("temperature_interval", source.rates.temperatureMs).toInt();
+    source.rates.statusMs = settings.value("status_interval", source.rates.statusMs).toInt();
+    source.reconnect.maxAttempts = settings.value("reconnect_attempts", source.reconnect.maxAttempts).toInt();
+    source.reconnect.maxDelayMs = settings.value("reconnect_max_delay", source.reconnect.maxDelayMs).toInt();
+    if (settings.contains("capture_cores")
+        && !parseCoreList(settings.value("capture_cores").toStringList().join(','), config.captureCores)) {
+        throw std::runtime_error("Invalid source/capture_cores");
+    }
+    if (settings.contains("format") && !parseSensorFormat(settings.value("format").toString(), source.format)) {
+        throw std::runtime_error("Invalid source/format");
+    }
+    if (settings.contains("tone_map")
+        && !parseToneMap(settings.value("tone_map").toStringList().join(','), source.toneMap)) {
+        throw std::runtime_error("Invalid source/tone_map (black,white)");
+    }
+    settings.endGroup();
+
+    settings.beginGroup("record");
+    config.recording = settings.value("enabled", config.recording).toBool();
+    config.recordDirectory = settings.value("directory", config.recordDirectory).toString();
+    if (settings.contains("format") && !parseRecordFormat(settings.value("format").toString(), config.recordFormat)) {
+        throw std::runtime_error("Invalid record/format (raw, lossless, bmp or event)");
+    }
+    config.saveImageInterval = settings.value("image_interval", config.saveImageInterval).toInt();
+    // カンマを含むのでリストとして読まれることがある
+    if (settings.contains("trigger")) {
+        config.trigger = settings.value("trigger").toStringList().join(',');
+    }
+    settings.endGroup();
+
+    settings.beginGroup("log");
+    config.graphDirectory = settings.value("directory", config.graphDirectory).toString();
+    config.saveGraphInterval = settings.value("sync_interval", config.saveGraphInterval).toInt();
+    config.printInterval = settings.value("print_interval", config.printInterval).toInt();
+    settings.endGroup();
+
+    settings.beginGroup("analysis");
+    config.grid = settings.value("grid", config.grid).toInt();
+    if (settings.contains("rois")) {
+        config.rois = settings.value("rois").toStringList().join(',');
+    }
+    if (settings.contains("overload") && !parseOverloadPolicy(settings.value("overload").toString(), config.overload)) {
+        throw std::runtime_error("Invalid analysis/overload (block or drop)");
+    }
+    settings.endGroup();
+
+    settings.beginGroup("metrics");
+    config.metricsFile = settings.value("file", config.metricsFile).toString();
+    config.metricsInterval = settings.value("interval", config.metricsInterval).toInt();
+    settings.endGroup();
+
+    settings.beginGroup("correction");
+    if (settings.contains("mode") && !parseCorrectionMode(settings.value("mode").toString(), config.correction)) {
+        throw std::runtime_error("Invalid correction/mode (off, flat or background)");
+    }
+    config.calibrationDirectory = settings.value("directory", config.calibrationDirectory).toString();
+    config.backgroundShift = settings.value("background_shift", config.backgroundShift).toInt();
+    config.pedestal = settings.value("pedestal", config.pedestal).toInt();
+    config.captureReference = settings.value("capture", config.captureReference).toString().trimmed().toLower();
+    config.captureFrames = settings.value("capture_frames", config.captureFrames).toInt();
+    settings.endGroup();
+
+    settings.beginGroup("temporal");
+    config.temporalWindow = settings.value("window", config.temporalWindow).toInt();
+    config.temporalEvery = settings.value("every", config.temporalEvery).toInt();
+    config.temporalDirectory = settings.value("directory", config.temporalDirectory).toString();
+    config.temporalExportInterval = settings.value("export_interval", config.temporalExportInterval).toInt();
+    settings.endGroup();
+
+    settings.beginGroup("shm");
+    config.shmName = settings.value("name", config.shmName).toString();
+    config.shmSlots = settings.value("slots", config.shmSlots).toInt();
+    settings.endGroup();
+}
+
+// 読み込んだ設定をカメラ群に反映する。start() の前に呼ぶ
+inline void applyDaemonConfig(const DaemonConfig& config, CameraRig& rig) {
+    if (config.recording && config.recordDirectory.isEmpty()) {
+        throw std::runtime_error("record/directory is required for recording");
+    }
+    EventRule rule;
+    if (!parseEventRule(config.trigger, rule)) {
+        throw std::runtime_error("Invalid trigger: " + config.trigger.toStdString());
+    }
+    rig.setEventRule(rule);
+    rig.setSaveImageInterval(config.saveImageInterval);
+    rig.setRecordFormat(config.recordFormat);
+    rig.setRecording(config.recording, config.recordDirectory);
+    rig.setGraphDirectory(config.graphDirectory);
+    rig.setLogSyncInterval(config.saveGraphInterval);
+    rig.setOverloadPolicy(config.overload);
+
+    if (!config.captureReference.isEmpty() && config.captureReference != "dark" && config.captureReference != "flat") {
+        throw std::runtime_error("Invalid correction/capture (dark or flat)");
+    }
+    rig.setCalibrationDirectory(config.calibrationDirectory);
+    rig.setBackgroundShift(config.backgroundShift);
+    rig.setCorrectionPedestal(config.pedestal);
+    rig.setCorrectionMode(config.correction);
+    if (!config.captureReference.isEmpty()) {
+        const FrameCorrector::Reference kind =
+            config.captureReference == "dark" ? FrameCorrector::Reference::Dark : FrameCorrector::Reference::Flat;
+        for (int i = 0; i < rig.size(); ++i) {
+            rig.pipeline(i).corrector().captureReference(kind, config.captureFrames);
+        }
+    }
+
+    if (config.temporalWindow < 0 || config.temporalWindow > TemporalStats::kMaxWindow) {
+        throw std::runtime_error("temporal/window must be 0-" + std::to_string(TemporalStats::kMaxWindow));
+    }
+    if (config.temporalExportInterval > 0 && (config.temporalWindow == 0 || config.temporalDirectory.isEmpty())) {
+        throw std::runtime_error("temporal/window and temporal/directory are required for temporal/export_interval");
+    }
+    for (int i = 0; i < rig.size(); ++i) {
+        rig.pipeline(i).temporal().setDecimation(config.temporalEvery);
+        rig.pipeline(i).temporal().setWindow(config.temporalWindow);
+    }
+
+    if (!config.shmName.isEmpty()) {
+        if (config.shmSlots < 2) {
+            throw std::runtime_error("shm/slots must be 2 or more");
+        }
+        rig.enableSharedMemory(config.shmName, config.shmSlots);
+    }
+
+    auto layout = std::make_shared<TileLayout>();
+    layout->columns = config.grid;
+    layout->rows = config.grid;
+    layout->rois = parseRoiList(config.rois);
+    rig.setTileLayout(layout->enabled() ? layout : nullptr);
+}
+
+#endif // DAEMONCONFIG_H
@@ -0,0 +1,198 @@
+#ifndef DEVICETELEMETRY_H
+#define DEVICETELEMETRY_H
+
+#include "stagestats.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QString>
+#include <QThread>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// デバイスの状態 (温度、転送量など) を取得スレッドとは別のスレッドで低頻度に読み取る。
+// チャンネルごとに読み取り間隔を持ち、直近の数サンプルを読み取った時刻 (monotonicNs) とともに保持する。
+// フレームには valueAt() で受信時刻に対応する値 (サンプル間は線形補間、最新より後は最新値) を付ける。
+class DeviceTelemetry : public QThread {
+public:
+    struct Reading {
+        QString name;
+        QString unit;
+        double value = std::numeric_limits<double>::quiet_NaN();
+        uint64_t timeNs = 0;
+    };
+
+    explicit DeviceTelemetry(QObject *parent = nullptr) : QThread(parent) {}
+
+    ~DeviceTelemetry() override {
+        requestInterruption();
+        wait();
+    }
+
+    // start() の前に登録する。返り値はチャンネル番号
+    int addChannel(const QString& name, const QString& unit, int intervalMs, std::function<double()> read) {
+        QMutexLocker locker(&mutex);
+        Channel channel;
+        channel.name = name;
+        channel.unit = unit;
+        channel.intervalMs = std::max(1, intervalMs);
+        channel.read = std::move(read);
+        channels.push_back(std::move(channel));
+        return static_cast<int>(channels.size()) - 1;
+    }
+
+    void setInterval(int channel, int intervalMs) {
+        QMutexLocker locker(&mutex);
+        if (channel >= 0 && channel < static_cast<int>(channels.size())) {
+            channels[channel].intervalMs = std::max(1, intervalMs);
+        }
+    }
+
+    // timeNs 時点の値。まだ1度も読めていなければNaN
+    double valueAt(int channel, uint64_t timeNs) const {
+        QMutexLocker locker(&mutex);
+        if (channel < 0 || channel >= static_cast<int>(channels.size())) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        const Channel& c = channels[channel];
+        if (c.count == 0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        // 新しい順に見て、timeNs をはさむ2点を探す
+        const Sample* newer = &c.sample(0);
+        if (timeNs >= newer->timeNs) {
+            return newer->value;
+        }
+        for (size_t i = 1; i < c.count; ++i) {
+            const Sample* older = &c.sample(i);
+            if (timeNs >= older->timeNs) {
+                const double t = static_cast<double>(timeNs - older->timeNs) / (newer->timeNs - older->timeNs);
+                return older->value + (newer->value - older->value) * t;
+            }
+            newer = older;
+        }
+        return newer->value;
+    }
+
+    std::vector<Reading> latest() const {
+        QMutexLocker locker(&mutex);
+        std::vector<Reading> readings;
+        for (const Channel& c : channels) {
+            Reading reading;
+            reading.name = c.name;
+            reading.unit = c.unit;
+            if (c.count > 0) {
+                reading.value = c.sample(0).value;
+                reading.timeNs = c.sample(0).timeNs;
+            }
+            readings.push_back(reading);
+        }
+        return readings;
+    }
+
+    uint64_t readErrors() const {
+        return errors.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void run() override {
+        while (!isInterruptionRequested()) {
+            const uint64_t now = monotonicNs();
+            uint64_t nextDueNs = now + maxSleepMs * 1000000ull;
+            const int channelCount = channelSize();
+            for (int i = 0; i < channelCount; ++i) {
+                std::function<double()> read;
+                uint64_t dueNs;
+                int intervalMs;
+                {
+                    QMutexLocker locker(&mutex);
+                    dueNs = channels[i].nextDueNs;
+                    intervalMs = channels[i].intervalMs;
+                    if (dueNs <= now) {
+                        read = channels[i].read;
+                        channels[i].nextDueNs = now + intervalMs * 1000000ull;
+                    }
+                }
+                if (read) {
+                    sample(i, read);
+                    dueNs = now + intervalMs * 1000000ull;
+                }
+                nextDueNs = std::min(nextDueNs, dueNs);
+            }
+            const uint64_t after = monotonicNs();
+            if (nextDueNs > after) {
+                QThread::msleep((nextDueNs - after) / 1000000 + 1);
+            }
+        }
+    }
+
+private:
+    struct Sample {
+        uint64_t timeNs = 0;
+        double value = 0.0;
+    };
+
+    static constexpr size_t historySize = 8;
+    static constexpr int maxSleepMs = 50; // 停止要求と間隔変更に反応するまでの最大待ち
+
+    struct Channel {
+        QString name;
+        QString unit;
+        int intervalMs = 1000;
+        std::function<double()> read;
+        uint64_t nextDueNs = 0;
+        std::array<Sample, historySize> history;
+        size_t head = 0;
+        size_t count = 0;
+
+        // i = 0 が最新
+        const Sample& sample(size_t i) const {
+            return history[(head + historySize - 1 - i) % historySize];
+        }
+
+        void push(const Sample& s) {
+            history[head] = s;
+            head = (head + 1) % historySize;
+            count = std::min(count + 1, historySize);
+        }
+    };
+
+    int channelSize() const {
+        QMutexLocker locker(&mutex);
+        return static_cast<int>(channels.size());
+    }
+
+    // 読み取りは時間がかかることがあるのでロックの外で行い、前後の時刻の中点をサンプル時刻とする
+    void sample(int channel, const std::function<double()>& read) {
+        const uint64_t before = monotonicNs();
+        double value;
+        try {
+            value = read();
+        } catch (const std::exception& e) {
+            if (errors.fetch_add(1, std::memory_order_relaxed) == 0) {
+                std::cerr << "Device telemetry read failed: " << e.what() << std::endl;
+            }
+            return;
+        }
+        const uint64_t after = monotonicNs();
+        if (!std::isfinite(value)) {
+            return;
+        }
+        QMutexLocker locker(&mutex);
+        channels[channel].push(Sample{before + (after - before) / 2, value});
+    }
+
+    mutable QMutex mutex;
+    std::vector<Channel> channels;
+    std::atomic<uint64_t> errors{0};
+};
+
+#endif // DEVICETELEMETRY_H
@@ -0,0 +1,154 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define DOWNSAMPLE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define DOWNSAMPLE_NEON 1
+#endif
+
+// プレビュー用の整数ボックス縮小。factor x factor 画素の平均を1画素にする。
+// 縦方向は factor 行を16bitで足し込み (SIMD)、横方向は足し込んだ行を factor 個ずつまとめる。
+// 16bitに収まるように factor は kMaxDownsampleFactor (255 * 16 * 16 < 65536) までとする。
+constexpr int kMaxDownsampleFactor = 16;
+
+namespace downsample_detail {
+
+inline void accumulateRowScalar(const uint8_t* src, uint16_t* acc, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        acc[i] = static_cast<uint16_t>(acc[i] + src[i]);
+    }
+}
+
+#ifdef DOWNSAMPLE_X86
+__attribute__((target("avx2")))
+inline void accumulateRowAvx2(const uint8_t* src, uint16_t* acc, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+        const __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+        __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+        _mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), lo));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi16(_mm256_loadu_si256(a + 1), hi));
+    }
+    accumulateRowScalar(src + i, acc + i, size - i);
+}
+
+__attribute__((target("sse4.1")))
+inline void accumulateRowSse41(const uint8_t* src, uint16_t* acc, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i lo = _mm_cvtepu8_epi16(v);
+        const __m128i hi = _mm_cvtepu8_epi16(_mm_srli_si128(v, 8));
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1), hi));
+    }
+    accumulateRowScalar(src + i, acc + i, size - i);
+}
+#endif // DOWNSAMPLE_X86
+
+#ifdef DOWNSAMPLE_NEON
+inline void accumulateRowNeon(const uint8_t* src, uint16_t* acc, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const uint8x16_t v = vld1q_u8(src + i);
+        vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(v)));
+        vst1q_u16(acc + i + 8, vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(v)));
+    }
+    accumulateRowScalar(src + i, acc + i, size - i);
+}
+#endif // DOWNSAMPLE_NEON
+
+using AccumulateKernel = void (*)(const uint8_t*, uint16_t*, size_t);
+
+struct AccumulateKernelEntry {
+    AccumulateKernel kernel;
+    const char* name;
+};
+
+inline AccumulateKernelEntry selectAccumulateKernel() {
+#ifdef DOWNSAMPLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {accumulateRowAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return {accumulateRowSse41, "sse4.1"};
+    }
+#endif
+#ifdef DOWNSAMPLE_NEON
+    return {accumulateRowNeon, "neon"};
+#endif
+    return {accumulateRowScalar, "scalar"};
+}
+
+inline const AccumulateKernelEntry& accumulateKernel() {
+    static const AccumulateKernelEntry entry = selectAccumulateKernel();
+    return entry;
+}
+
+} // namespace downsample_detail
+
+// width x height の画像を targetWidth x targetHeight に収めるための最小の縮小率
+inline int downsampleFactor(int width, int height, int targetWidth, int targetHeight) {
+    if (targetWidth <= 0 || targetHeight <= 0) {
+        return 1;
+    }
+    const int fx = (width + targetWidth - 1) / targetWidth;
+    const int fy = (height + targetHeight - 1) / targetHeight;
+    return std::clamp(std::max(fx, fy), 1, kMaxDownsampleFactor);
+}
+
+// src から (dstWidth * factor) x (dstHeight * factor) の範囲を読み、dst に縮小して書く。
+// scratch は行の足し込み用の作業領域で、呼び出し側が使い回す。
+inline void boxDownsample(const uint8_t* src, int srcStride, int factor,
+                          uint8_t* dst, int dstWidth, int dstHeight, int dstStride,
+                          std::vector<uint16_t>& scratch) {
+    if (factor <= 1) {
+        for (int y = 0; y < dstHeight; ++y) {
+            std::memcpy(dst + static_cast<size_t>(y) * dstStride, src + static_cast<size_t>(y) * srcStride, dstWidth);
+        }
+        return;
+    }
+
+    const size_t rowWidth = static_cast<size_t>(dstWidth) * factor;
+    scratch.resize(rowWidth);
+    const downsample_detail::AccumulateKernel accumulate = downsample_detail::accumulateKernel().kernel;
+    // 除算の代わりに 2^16 / (factor^2) を掛けて丸める
+    const uint32_t reciprocal = (65536u + factor * factor / 2) / (factor * factor);
+
+    for (int y = 0; y < dstHeight; ++y) {
+        std::fill(scratch.begin(), scratch.end(), 0);
+        const uint8_t* rows = src + static_cast<size_t>(y) * factor * srcStride;
+        for (int r = 0; r < factor; ++r) {
+            accumulate(rows + static_cast<size_t>(r) * srcStride, scratch.data(), rowWidth);
+        }
+        uint8_t* out = dst + static_cast<size_t>(y) * dstStride;
+        const uint16_t* acc = scratch.data();
+        for (int x = 0; x < dstWidth; ++x, acc += factor) {
+            uint32_t sum = 0;
+            for (int i = 0; i < factor; ++i) {
+                sum += acc[i];
+            }
+            out[x] = static_cast<uint8_t>(std::min<uint32_t>((sum * reciprocal + 32768u) >> 16, 255u));
+        }
+    }
+}
+
+// 選択されたカーネル名 (ログ用)
+inline const char* downsampleKernelName() {
+    return downsample_detail::accumulateKernel().name;
+}
+
+#endif // DOWNSAMPLE_H
@@ -0,0 +1,470 @@
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include "framequeue.h"
+#include "framestats.h"
+#include "rawcontainer.h"
+#include "stagestats.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// イベント記録のトリガー条件。"cv>0.05 pre=2 post=2 mem=1024" のような文字列で指定する。
+// 指標は mean / stddev (階調値), cv, saturated / dark (割合)。先頭に d を付けると前フレームとの差の絶対値。
+// 条件が偽から真に変わったフレームで発火する。
+struct EventRule {
+    enum Metric {
+        Mean,
+        StdDev,
+        Cv,
+        Saturated,
+        Dark,
+    };
+
+    Metric metric = Cv;
+    bool derivative = false;
+    bool below = false;
+    double threshold = 0.05;
+    double preSeconds = 2.0;
+    double postSeconds = 2.0;
+    int memoryMB = 1024; // リングバッファに使うメモリの上限
+
+    double value(const FrameStats& stats) const {
+        switch (metric) {
+        case Mean: return stats.mean;
+        case StdDev: return stats.stddev;
+        case Cv: return stats.cv;
+        case Saturated: return stats.saturatedFraction;
+        case Dark: return stats.darkFraction;
+        }
+        return 0.0;
+    }
+
+    // previous が無ければ微分条件は偽
+    bool matches(const FrameStats& stats, const FrameStats* previous) const {
+        double x;
+        if (derivative) {
+            if (!previous) {
+                return false;
+            }
+            x = std::fabs(value(stats) - value(*previous));
+        } else {
+            x = value(stats);
+        }
+        return below ? x < threshold : x > threshold;
+    }
+};
+
+inline bool parseEventRule(const QString& text, EventRule& rule) {
+    EventRule parsed;
+    bool hasCondition = false;
+    const QStringList tokens = text.simplified().split(' ', QString::SkipEmptyParts);
+    for (const QString& token : tokens) {
+        bool ok = true;
+        if (token.startsWith("pre=")) {
+            parsed.preSeconds = token.mid(4).toDouble(&ok);
+        } else if (token.startsWith("post=")) {
+            parsed.postSeconds = token.mid(5).toDouble(&ok);
+        } else if (token.startsWith("mem=")) {
+            parsed.memoryMB = token.mid(4).toInt(&ok);
+        } else {
+            const int op = token.indexOf(QRegExp("[<>]"));
+            if (op <= 0) {
+                return false;
+            }
+            QString name = token.left(op).toLower();
+            parsed.below = token[op] == '<';
+            parsed.threshold = token.mid(op + 1).toDouble(&ok);
+            parsed.derivative = name.startsWith('d') && name != "dark";
+            if (parsed.derivative) {
+                name = name.mid(1);
+            }
+            if (name == "mean") {
+                parsed.metric = EventRule::Mean;
+            } else if (name == "stddev") {
+                parsed.metric = EventRule::StdDev;
+            } else if (name == "cv" || name == "k") {
+                parsed.metric = EventRule::Cv;
+            } else if (name == "saturated") {
+                parsed.metric = EventRule::Saturated;
+            } else if (name == "dark") {
+                parsed.metric = EventRule::Dark;
+            } else {
+                return false;
+            }
+            hasCondition = true;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    if (!hasCondition || parsed.preSeconds < 0 || parsed.postSeconds < 0 || parsed.memoryMB <= 0) {
+        return false;
+    }
+    rule = parsed;
+    return true;
+}
+
+// 直近のフレームをメモリ上のリングに複製して持ち、トリガーがかかったら前後のフレームを
+// 別スレッドで .jcr に書き出す。リングの枚数はメモリ上限から決まり、足りないときは新しいフレームを捨てて数える。
+// 統計はフレームより遅れて届くので、発火した時点でリングにはトリガー後のフレームも入っている。
+// その遅れの分 (statsLag: 統計キューと処理中のフレーム数) だけリングを長く持ち、トリガー前のフレームを欠かさない。
+class EventRecorder : public QThread {
+public:
+    EventRecorder(double frameRate, int statsLag, StageStats& writeStats, QObject *parent = nullptr)
+        : QThread(parent), frameRate(frameRate > 0.0 ? frameRate : 30.0),
+          maxStatsLag(static_cast<size_t>(std::max(0, statsLag)) + queueCapacity), frames(queueCapacity),
+          writer(writeStats) {}
+
+    ~EventRecorder() override {
+        requestInterruption();
+        wait();
+    }
+
+    FrameQueue& queue() {
+        return frames;
+    }
+
+    const FrameQueue& queue() const {
+        return frames;
+    }
+
+    void setRecording(bool enabled, const QString& directory) {
+        QMutexLocker locker(&settingsMutex);
+        settings.enabled = enabled;
+        settings.directory = directory;
+        ++settingsGeneration;
+    }
+
+    void setRule(const EventRule& rule) {
+        QMutexLocker locker(&settingsMutex);
+        settings.rule = rule;
+        ++settingsGeneration;
+    }
+
+    // 並べ替え済みの統計をフレーム順に渡す (同時に複数のスレッドから呼ばないこと)
+    void onStats(const FrameStats& stats) {
+        EventRule rule;
+        bool enabled;
+        {
+            QMutexLocker locker(&settingsMutex);
+            rule = settings.rule;
+            enabled = settings.enabled;
+        }
+        const bool match = enabled && rule.matches(stats, hasPrevious ? &previous : nullptr);
+        previous = stats;
+        hasPrevious = true;
+        if (match && !lastMatch) {
+            QMutexLocker locker(&triggerMutex);
+            triggers.push_back(stats.frameNumber);
+        }
+        lastMatch = match;
+    }
+
+    uint64_t eventsTriggered() const { return triggered.load(std::memory_order_relaxed); }
+    uint64_t eventsWritten() const { return writer.eventsWritten(); }
+    uint64_t framesWritten() const { return writer.framesWritten(); }
+    uint64_t writeErrors() const { return writer.writeErrors(); }
+    uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+    size_t ringFrames() const { return ringSize.load(std::memory_order_relaxed); }
+    size_t ringCapacity() const { return ringLimit.load(std::memory_order_relaxed); }
+
+protected:
+    void run() override {
+        writer.start();
+        while (!isInterruptionRequested()) {
+            FrameRef frame;
+            const bool popped = frames.pop(frame, 100);
+            applySettings(frame);
+            if (!active.enabled) {
+                continue;
+            }
+            if (popped && frame) {
+                store(frame);
+            }
+            handleTriggers();
+        }
+        finishEvent();
+        ring.clear();
+        writer.requestInterruption();
+        writer.wait();
+    }
+
+private:
+    struct Settings {
+        bool enabled = false;
+        QString directory;
+        EventRule rule;
+    };
+
+    // 書き出し待ちのフレームと、イベントの区切り (frame が空なら直前のファイルを閉じる)
+    struct WriteItem {
+        FrameRef frame;
+        QString path;
+    };
+
+    class Writer : public QThread {
+    public:
+        explicit Writer(StageStats& writeStats) : writeStats(writeStats) {}
+
+        ~Writer() override {
+            requestInterruption();
+            wake.wakeAll();
+            wait();
+        }
+
+        void push(WriteItem item) {
+            QMutexLocker locker(&mutex);
+            items.push_back(std::move(item));
+            wake.wakeOne();
+        }
+
+        bool idle() const {
+            QMutexLocker locker(&mutex);
+            return items.empty() && !busy;
+        }
+
+        uint64_t eventsWritten() const { return events.load(std::memory_order_relaxed); }
+        uint64_t framesWritten() const { return written.load(std::memory_order_relaxed); }
+        uint64_t writeErrors() const { return errors.load(std::memory_order_relaxed); }
+
+    protected:
+        void run() override {
+            for (;;) {
+                WriteItem item;
+                {
+                    QMutexLocker locker(&mutex);
+                    busy = false;
+                    while (items.empty()) {
+                        if (isInterruptionRequested()) {
+                            file.close();
+                            return;
+                        }
+                        wake.wait(&mutex, 100);
+                    }
+                    item = std::move(items.front());
+                    items.pop_front();
+                    busy = true;
+                }
+                write(item);
+            }
+        }
+
+    private:
+        void write(WriteItem& item) {
+            if (!item.frame) {
+                if (file.isOpen()) {
+                    file.close();
+                    events.fetch_add(1, std::memory_order_relaxed);
+                }
+                failed = false;
+                return;
+            }
+            if (failed) {
+                return;
+            }
+            const uint64_t start = monotonicNs();
+            const FrameRef& frame = item.frame;
+            try {
+                if (!file.isOpen()) {
+                    file.open(item.path.toStdString(), frame->width, frame->height, frame->stride,
+                              rawcontainer::PixelMono8, 1, 0);
+                }
+                file.append(frame->frameNumber, frame->timestamp, frame->temp, frame->data,
+                            static_cast<size_t>(frame->stride) * frame->height,
+                            frame->corrected ? rawcontainer::kFlagCorrected : 0);
+                written.fetch_add(1, std::memory_order_relaxed);
+            } catch (const std::exception& e) {
+                // このイベントの残りは捨てる
+                std::cerr << "Event recording failed: " << e.what() << std::endl;
+                errors.fetch_add(1, std::memory_order_relaxed);
+                file.close();
+                failed = true;
+            }
+            writeStats.record(monotonicNs() - start);
+        }
+
+        StageStats& writeStats;
+        mutable QMutex mutex;
+        QWaitCondition wake;
+        std::deque<WriteItem> items;
+        bool busy = false;
+
+        rawcontainer::Writer file;
+        bool failed = false;
+
+        std::atomic<uint64_t> events{0};
+        std::atomic<uint64_t> written{0};
+        std::atomic<uint64_t> errors{0};
+    };
+
+    struct Event {
+        int trigger = 0;
+        int first = 0;
+        int last = -1;
+        QString path;
+    };
+
+    static constexpr size_t queueCapacity = 8;
+
+    void applySettings(const FrameRef& frame) {
+        {
+            QMutexLocker locker(&settingsMutex);
+            if (appliedGeneration != settingsGeneration) {
+                appliedGeneration = settingsGeneration;
+                active = settings;
+                resize = true;
+            }
+        }
+        if (!active.enabled) {
+            finishEvent();
+            ring.clear();
+            ringSize.store(0, std::memory_order_relaxed);
+            QMutexLocker locker(&triggerMutex);
+            triggers.clear();
+        }
+        // 書き出し中のフレームもプールのバッファなので、全部戻ってからプールを作り直す
+        if (active.enabled && resize && frame && !event && writer.idle()) {
+            ring.clear();
+            pool.reset();
+            const size_t frameBytes = static_cast<size_t>(frame->stride) * frame->height;
+            const size_t count = std::max<size_t>(4, static_cast<size_t>(active.rule.memoryMB) * (1ull << 20) / frameBytes);
+            pool = std::make_unique<FramePool>(count, frame->width, frame->height, frame->stride);
+            // 残りはトリガー後のフレームと書き出し待ちに使う
+            const size_t pre = static_cast<size_t>(std::ceil(active.rule.preSeconds * frameRate));
+            const size_t wanted = pre + 1 + maxStatsLag;
+            const size_t limit = std::min(wanted, count / 2);
+            if (limit < wanted) {
+                std::cerr << "Event memory (mem=" << active.rule.memoryMB << " MB, " << count << " frames) is too small for pre="
+                          << active.rule.preSeconds << " s: keeping " << limit << " of " << wanted
+                          << " frames, so events start up to " << (wanted - limit) / frameRate
+                          << " s late. Increase mem or reduce pre." << std::endl;
+            }
+            ringLimit.store(limit, std::memory_order_relaxed);
+            resize = false;
+        }
+    }
+
+    void store(const FrameRef& frame) {
+        if (!pool) {
+            return;
+        }
+        FrameRef copy = pool->acquire();
+        if (!copy) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (copy->width != frame->width || copy->height != frame->height || copy->stride != frame->stride) {
+            resize = true;
+            return;
+        }
+        std::memcpy(copy->data, frame->data, static_cast<size_t>(frame->stride) * frame->height);
+        copy->frameNumber = frame->frameNumber;
+        copy->timestamp = frame->timestamp;
+        copy->temp = frame->temp;
+        copy->captureTimeNs = frame->captureTimeNs;
+        copy->corrected = frame->corrected;
+
+        if (event) {
+            if (copy->frameNumber >= event->first && copy->frameNumber <= event->last) {
+                writer.push(WriteItem{copy, event->path});
+            }
+            if (copy->frameNumber >= event->last) {
+                finishEvent();
+            }
+        }
+
+        ring.push_back(std::move(copy));
+        while (ring.size() > ringLimit.load(std::memory_order_relaxed)) {
+            ring.pop_front();
+        }
+        ringSize.store(ring.size(), std::memory_order_relaxed);
+    }
+
+    void handleTriggers() {
+        std::vector<int> pending;
+        {
+            QMutexLocker locker(&triggerMutex);
+            pending.swap(triggers);
+        }
+        for (int trigger : pending) {
+            // 記録中のイベントの範囲内で再び発火したものは同じイベントに含める
+            if (event) {
+                continue;
+            }
+            triggered.fetch_add(1, std::memory_order_relaxed);
+            event = std::make_unique<Event>();
+            event->trigger = trigger;
+            event->first = trigger - static_cast<int>(std::ceil(active.rule.preSeconds * frameRate));
+            event->last = trigger + static_cast<int>(std::ceil(active.rule.postSeconds * frameRate));
+            event->path = QDir(active.directory).filePath(
+                QString("event_%1_%2.jcr").arg(QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss")).arg(trigger));
+
+            bool reachedLast = false;
+            for (const FrameRef& frame : ring) {
+                if (frame->frameNumber >= event->first && frame->frameNumber <= event->last) {
+                    writer.push(WriteItem{frame, event->path});
+                    reachedLast = frame->frameNumber >= event->last;
+                }
+            }
+            if (reachedLast) {
+                finishEvent();
+            }
+        }
+    }
+
+    void finishEvent() {
+        if (event) {
+            writer.push(WriteItem{FrameRef(), event->path});
+            event.reset();
+        }
+    }
+
+    const double frameRate;
+    const size_t maxStatsLag; // 統計がリングに入ったフレームから遅れうる最大のフレーム数
+    FrameQueue frames;
+    Writer writer;
+
+    QMutex settingsMutex;
+    Settings settings;
+    uint64_t settingsGeneration = 0;
+
+    // onStats を呼ぶスレッドだけが触る
+    FrameStats previous;
+    bool hasPrevious = false;
+    bool lastMatch = false;
+
+    QMutex triggerMutex;
+    std::vector<int> triggers;
+
+    // 以下はリングのスレッドだけが触る
+    Settings active;
+    uint64_t appliedGeneration = 0;
+    bool resize = true;
+    std::unique_ptr<FramePool> pool;
+    std::deque<FrameRef> ring;
+    std::unique_ptr<Event> event;
+
+    std::atomic<uint64_t> triggered{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<size_t> ringSize{0};
+    std::atomic<size_t> ringLimit{0};
+};
+
+#endif // EVENTRECORDER_H
@@ -0,0 +1,494 @@
+#ifndef FRAMECORRECTOR_H
+#define FRAMECORRECTOR_H
+
+#include "framepool.h"
+#include "rawcontainer.h"
+#include "reductionpool.h"
+
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QString>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define FRAMECORRECTOR_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FRAMECORRECTOR_NEON 1
+#endif
+
+// 暗電流 (ダーク) とシェーディング (フラット) の補正、および指数移動平均の背景差分。
+// 補正は取得スレッドでプールのバッファをその場で書き換えるので、統計・プレビュー・記録には
+// 追加のコピーなしで補正済みのフレームが渡る。
+//
+// 画素ごとの補正は固定小数点: out = min(255, ((max(raw - dark, 0) * 16 + 8) * gain) >> 16)。
+// gain は Q4.12 (4096 = 1.0) で、フラットの平均 / (flat - dark)。+8 は四捨五入のため。
+// 背景は Q8.7 の int16 で持ち、bg += ((x << 7) - bg) >> shift (α = 2^-shift) で更新する。
+// 背景差分の出力は x - bg + pedestal (負の値を切り捨てないように pedestal を足す)。
+namespace framecorrector_detail {
+
+inline void correctRowScalar(uint8_t* pixels, const uint8_t* dark, const uint16_t* gain, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        const uint32_t net = pixels[i] > dark[i] ? pixels[i] - dark[i] : 0;
+        const uint32_t value = (((net << 4) | 8) * gain[i]) >> 16;
+        pixels[i] = static_cast<uint8_t>(value > 255 ? 255 : value);
+    }
+}
+
+inline void backgroundRowScalar(uint8_t* pixels, int16_t* background, size_t size, int shift, int pedestal) {
+    for (size_t i = 0; i < size; ++i) {
+        const int x = pixels[i];
+        const int bg = background[i];
+        const int value = x - ((bg + 64) >> 7) + pedestal;
+        pixels[i] = static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+        background[i] = static_cast<int16_t>(bg + (((x << 7) - bg) >> shift));
+    }
+}
+
+#ifdef FRAMECORRECTOR_X86
+__attribute__((target("avx2")))
+inline void correctRowAvx2(uint8_t* pixels, const uint8_t* dark, const uint16_t* gain, size_t size) {
+    const __m256i eight = _mm256_set1_epi16(8);
+    const __m256i max255 = _mm256_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dark + i));
+        const __m256i net = _mm256_subs_epu8(raw, d);
+        __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(net));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(net, 1));
+        lo = _mm256_or_si256(_mm256_slli_epi16(lo, 4), eight);
+        hi = _mm256_or_si256(_mm256_slli_epi16(hi, 4), eight);
+        lo = _mm256_mulhi_epu16(lo, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gain + i)));
+        hi = _mm256_mulhi_epu16(hi, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gain + i + 16)));
+        lo = _mm256_min_epu16(lo, max255);
+        hi = _mm256_min_epu16(hi, max255);
+        // packus は128bitレーンごとに詰めるので並びを戻す
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), packed);
+    }
+    correctRowScalar(pixels + i, dark + i, gain + i, size - i);
+}
+
+__attribute__((target("avx2")))
+inline void backgroundRowAvx2(uint8_t* pixels, int16_t* background, size_t size, int shift, int pedestal) {
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i offset = _mm256_set1_epi16(static_cast<int16_t>(pedestal));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+        __m256i* bgPtr = reinterpret_cast<__m256i*>(background + i);
+        const __m256i x[2] = {_mm256_cvtepu8_epi16(_mm256_castsi256_si128(raw)),
+                              _mm256_cvtepu8_epi16(_mm256_extracti128_si256(raw, 1))};
+        __m256i out[2];
+        for (int h = 0; h < 2; ++h) {
+            const __m256i bg = _mm256_loadu_si256(bgPtr + h);
+            // (bg + 64) >> 7 を16bitで溢れないように計算する
+            const __m256i rounded = _mm256_srai_epi16(_mm256_add_epi16(_mm256_srai_epi16(bg, 6), one), 1);
+            out[h] = _mm256_add_epi16(_mm256_sub_epi16(x[h], rounded), offset);
+            const __m256i diff = _mm256_sub_epi16(_mm256_slli_epi16(x[h], 7), bg);
+            _mm256_storeu_si256(bgPtr + h, _mm256_add_epi16(bg, _mm256_sra_epi16(diff, count)));
+        }
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(out[0], out[1]), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), packed);
+    }
+    backgroundRowScalar(pixels + i, background + i, size - i, shift, pedestal);
+}
+#endif // FRAMECORRECTOR_X86
+
+#ifdef FRAMECORRECTOR_NEON
+inline void correctRowNeon(uint8_t* pixels, const uint8_t* dark, const uint16_t* gain, size_t size) {
+    const uint16x8_t eight = vdupq_n_u16(8);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const uint8x16_t net = vqsubq_u8(vld1q_u8(pixels + i), vld1q_u8(dark + i));
+        const uint16x8_t lo = vorrq_u16(vshlq_n_u16(vmovl_u8(vget_low_u8(net)), 4), eight);
+        const uint16x8_t hi = vorrq_u16(vshlq_n_u16(vmovl_u8(vget_high_u8(net)), 4), eight);
+        const uint16x8_t g0 = vld1q_u16(gain + i);
+        const uint16x8_t g1 = vld1q_u16(gain + i + 8);
+        // 上位16bitを取る (x86 の mulhi_epu16 に相当)
+        const uint16x8_t p0 = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), vget_low_u16(g0)), 16),
+                                           vshrn_n_u32(vmull_u16(vget_high_u16(lo), vget_high_u16(g0)), 16));
+        const uint16x8_t p1 = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), vget_low_u16(g1)), 16),
+                                           vshrn_n_u32(vmull_u16(vget_high_u16(hi), vget_high_u16(g1)), 16));
+        vst1q_u8(pixels + i, vcombine_u8(vqmovn_u16(p0), vqmovn_u16(p1)));
+    }
+    correctRowScalar(pixels + i, dark + i, gain + i, size - i);
+}
+
+inline void backgroundRowNeon(uint8_t* pixels, int16_t* background, size_t size, int shift, int pedestal) {
+    const int16x8_t offset = vdupq_n_s16(static_cast<int16_t>(pedestal));
+    const int16x8_t count = vdupq_n_s16(static_cast<int16_t>(-shift));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const uint8x16_t raw = vld1q_u8(pixels + i);
+        const int16x8_t x[2] = {vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(raw))),
+                                vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(raw)))};
+        uint8x8_t out[2];
+        for (int h = 0; h < 2; ++h) {
+            const int16x8_t bg = vld1q_s16(background + i + 8 * h);
+            out[h] = vqmovun_s16(vaddq_s16(vsubq_s16(x[h], vrshrq_n_s16(bg, 7)), offset));
+            const int16x8_t diff = vsubq_s16(vshlq_n_s16(x[h], 7), bg);
+            vst1q_s16(background + i + 8 * h, vaddq_s16(bg, vshlq_s16(diff, count)));
+        }
+        vst1q_u8(pixels + i, vcombine_u8(out[0], out[1]));
+    }
+    backgroundRowScalar(pixels + i, background + i, size - i, shift, pedestal);
+}
+#endif // FRAMECORRECTOR_NEON
+
+using CorrectRowKernel = void (*)(uint8_t*, const uint8_t*, const uint16_t*, size_t);
+using BackgroundRowKernel = void (*)(uint8_t*, int16_t*, size_t, int, int);
+
+struct CorrectionKernels {
+    CorrectRowKernel correct;
+    BackgroundRowKernel background;
+    const char* name;
+};
+
+inline CorrectionKernels selectCorrectionKernels() {
+#ifdef FRAMECORRECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {correctRowAvx2, backgroundRowAvx2, "avx2"};
+    }
+#endif
+#ifdef FRAMECORRECTOR_NEON
+    return {correctRowNeon, backgroundRowNeon, "neon"};
+#endif
+    return {correctRowScalar, backgroundRowScalar, "scalar"};
+}
+
+inline const CorrectionKernels& correctionKernels() {
+    static const CorrectionKernels kernels = selectCorrectionKernels();
+    return kernels;
+}
+
+} // namespace framecorrector_detail
+
+class FrameCorrector {
+public:
+    enum class Mode {
+        Off,
+        Flat,           // ダーク/フラット補正 (撮ってある参照だけを使う)
+        FlatBackground, // ダーク/フラット補正のあとに背景差分
+    };
+
+    enum class Reference {
+        Dark,
+        Flat,
+    };
+
+    FrameCorrector(int width, int height) : width(width), height(height) {}
+
+    void setMode(Mode value) {
+        mode.store(value, std::memory_order_relaxed);
+    }
+
+    Mode currentMode() const {
+        return mode.load(std::memory_order_relaxed);
+    }
+
+    // 背景の追従の速さ α = 2^-shift (1〜12)
+    void setBackgroundShift(int shift) {
+        backgroundShift.store(std::clamp(shift, 1, 12), std::memory_order_relaxed);
+    }
+
+    void setPedestal(int value) {
+        pedestal.store(std::clamp(value, 0, 255), std::memory_order_relaxed);
+    }
+
+    // 次の frames フレーム (補正前) を平均して参照にする。終わると参照ファイルがあれば書き出す
+    void captureReference(Reference kind, int frames = 32) {
+        QMutexLocker locker(&mutex);
+        capture.kind = kind;
+        capture.target = std::clamp(frames, 1, 65535);
+        capture.requested = true;
+        capturing.store(true, std::memory_order_release);
+    }
+
+    // 参照を撮っている最中なら撮り終えたフレーム数、そうでなければ -1
+    int captureProgress() const {
+        return capturing.load(std::memory_order_acquire) ? captured.load(std::memory_order_relaxed) : -1;
+    }
+
+    bool hasReference(Reference kind) const {
+        QMutexLocker locker(&mutex);
+        return !(kind == Reference::Dark ? references.dark : references.flat).empty();
+    }
+
+    // 参照の保存先。既にあれば読み込む
+    void setCalibrationFile(const QString& path) {
+        {
+            QMutexLocker locker(&mutex);
+            calibrationPath = path;
+        }
+        if (!path.isEmpty() && QFileInfo(path).isFile()) {
+            load(path);
+        }
+    }
+
+    // ダーク (frameNumber 0) とフラット (1) を Mono16 (階調値 × 256) の記録コンテナから読む
+    bool load(const QString& path) {
+        try {
+            rawcontainer::Reader reader(path.toStdString());
+            const rawcontainer::ContainerHeader& header = reader.header();
+            if (header.pixelFormat != rawcontainer::PixelMono16 || static_cast<int>(header.width) != width
+                || static_cast<int>(header.height) != height) {
+                std::cerr << "Calibration " << path.toStdString() << " does not match the camera" << std::endl;
+                return false;
+            }
+            References loaded;
+            for (size_t i = 0; i < reader.frameCount(); ++i) {
+                const rawcontainer::Reader::Frame record = reader.frame(i);
+                if (record.header->payloadSize < pixelCount() * sizeof(uint16_t)) {
+                    continue;
+                }
+                std::vector<uint16_t>& target = record.header->frameNumber == 0 ? loaded.dark : loaded.flat;
+                target.resize(pixelCount());
+                std::memcpy(target.data(), record.data, pixelCount() * sizeof(uint16_t));
+            }
+            QMutexLocker locker(&mutex);
+            references = std::move(loaded);
+            tables = buildTables(references);
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load calibration: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // 取得スレッドから呼ぶ。補正したら true (frame.corrected も立てる)。10〜16bitの形式でも8bitの面を補正する
+    bool apply(FrameBuffer& frame, ReductionPool& pool) {
+        if (frame.width != width || frame.height != height) {
+            return false;
+        }
+        if (capturing.load(std::memory_order_acquire)) {
+            accumulateReference(frame, pool);
+        }
+
+        const Mode current = mode.load(std::memory_order_relaxed);
+        std::shared_ptr<const Tables> active;
+        {
+            QMutexLocker locker(&mutex);
+            active = tables;
+        }
+        const bool subtractBackground = current == Mode::FlatBackground;
+        if (!subtractBackground) {
+            backgroundValid = false;
+        }
+        if (current == Mode::Off || (!active && !subtractBackground)) {
+            return false;
+        }
+
+        if (subtractBackground && background.size() != pixelCount()) {
+            background.assign(pixelCount(), 0);
+        }
+        const bool initBackground = subtractBackground && !backgroundValid;
+        const int shift = backgroundShift.load(std::memory_order_relaxed);
+        const int offset = pedestal.load(std::memory_order_relaxed);
+        const framecorrector_detail::CorrectionKernels& kernels = framecorrector_detail::correctionKernels();
+        const int stripes = stripeCount(pool);
+        pool.parallelFor(stripes, [&](int stripe) {
+            for (int y = stripe * height / stripes; y < (stripe + 1) * height / stripes; ++y) {
+                uint8_t* row = frame.data + static_cast<size_t>(y) * frame.stride;
+                const size_t offsetInFrame = static_cast<size_t>(y) * width;
+                if (active) {
+                    kernels.correct(row, active->dark.data() + offsetInFrame, active->gain.data() + offsetInFrame, width);
+                }
+                if (subtractBackground) {
+                    int16_t* bg = background.data() + offsetInFrame;
+                    if (initBackground) {
+                        for (int x = 0; x < width; ++x) {
+                            bg[x] = static_cast<int16_t>(row[x] << 7);
+                        }
+                    }
+                    kernels.background(row, bg, width, shift, offset);
+                }
+            }
+        });
+        backgroundValid = subtractBackground;
+        frame.corrected = true;
+        // 補正するのは8bitの面だけなので、10〜16bitの面は以後の統計と記録に使わない
+        frame.bitDepth = 8;
+        return true;
+    }
+
+    static const char* kernelName() {
+        return framecorrector_detail::correctionKernels().name;
+    }
+
+private:
+    // 参照画像。階調値 × 256 (Q8.8) で持つ。撮っていなければ空
+    struct References {
+        std::vector<uint16_t> dark;
+        std::vector<uint16_t> flat;
+    };
+
+    // 補正に使う表
+    struct Tables {
+        std::vector<uint8_t> dark;
+        std::vector<uint16_t> gain; // Q4.12
+    };
+
+    struct CaptureRequest {
+        Reference kind = Reference::Dark;
+        int target = 0;
+        bool requested = false;
+    };
+
+    size_t pixelCount() const {
+        return static_cast<size_t>(width) * height;
+    }
+
+    // 1本あたり16行以上になるように、同時に動けるスレッド数だけ分ける
+    int stripeCount(const ReductionPool& pool) const {
+        return std::max(1, std::min(pool.threadCount(), height / 16));
+    }
+
+    static std::shared_ptr<const Tables> buildTables(const References& refs) {
+        if (refs.dark.empty() && refs.flat.empty()) {
+            return nullptr;
+        }
+        const size_t count = std::max(refs.dark.size(), refs.flat.size());
+        auto built = std::make_shared<Tables>();
+        built->dark.assign(count, 0);
+        built->gain.assign(count, 4096);
+        if (!refs.dark.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                built->dark[i] = static_cast<uint8_t>((refs.dark[i] + 128) >> 8);
+            }
+        }
+        if (!refs.flat.empty()) {
+            // 補正後の平均がフラットの平均 (ダークを引いたもの) になるように正規化する
+            double total = 0.0;
+            std::vector<double> net(count);
+            for (size_t i = 0; i < count; ++i) {
+                net[i] = refs.flat[i] - (refs.dark.empty() ? 0.0 : refs.dark[i]);
+                total += std::max(net[i], 0.0);
+            }
+            const double target = total / count;
+            for (size_t i = 0; i < count; ++i) {
+                // 0.5階調に満たない画素 (欠陥画素など) は補正しない
+                if (net[i] >= 128.0) {
+                    built->gain[i] = static_cast<uint16_t>(std::min(65535.0, std::round(target / net[i] * 4096.0)));
+                }
+            }
+        }
+        return built;
+    }
+
+    // 補正前の画素を足し込み、目標の枚数に達したら参照と補正表を作り直す
+    void accumulateReference(const FrameBuffer& frame, ReductionPool& pool) {
+        CaptureRequest request;
+        {
+            QMutexLocker locker(&mutex);
+            request = capture;
+            capture.requested = false;
+        }
+        if (request.requested) {
+            accumulator.assign(pixelCount(), 0);
+            captured.store(0, std::memory_order_relaxed);
+            captureKind = request.kind;
+            captureTarget = request.target;
+        }
+        const int stripes = stripeCount(pool);
+        pool.parallelFor(stripes, [&](int stripe) {
+            for (int y = stripe * height / stripes; y < (stripe + 1) * height / stripes; ++y) {
+                const uint8_t* row = frame.data + static_cast<size_t>(y) * frame.stride;
+                uint32_t* sums = accumulator.data() + static_cast<size_t>(y) * width;
+                for (int x = 0; x < width; ++x) {
+                    sums[x] += row[x];
+                }
+            }
+        });
+        const int count = captured.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (count < captureTarget) {
+            return;
+        }
+
+        std::vector<uint16_t> reference(pixelCount());
+        for (size_t i = 0; i < reference.size(); ++i) {
+            reference[i] = static_cast<uint16_t>(std::min<uint64_t>(65535, (static_cast<uint64_t>(accumulator[i]) * 256 + count / 2) / count));
+        }
+        accumulator.clear();
+        accumulator.shrink_to_fit();
+
+        QString path;
+        References snapshot;
+        {
+            QMutexLocker locker(&mutex);
+            (captureKind == Reference::Dark ? references.dark : references.flat) = std::move(reference);
+            tables = buildTables(references);
+            path = calibrationPath;
+            if (!path.isEmpty()) {
+                snapshot = references;
+            }
+            // 撮影中に新しい要求が来ていたら続けて撮る
+            if (!capture.requested) {
+                capturing.store(false, std::memory_order_release);
+            }
+        }
+        std::cout << "Captured " << (captureKind == Reference::Dark ? "dark" : "flat") << " reference from "
+                  << count << " frames" << std::endl;
+        if (!path.isEmpty()) {
+            // 取得スレッドを止めないように書き出しは別スレッドで行う
+            const int w = width;
+            const int h = height;
+            QtConcurrent::run([path, snapshot, w, h]() { save(path, w, h, snapshot); });
+        }
+    }
+
+    static void save(const QString& path, int width, int height, const References& refs) {
+        try {
+            rawcontainer::Writer writer;
+            writer.open(path.toStdString(), width, height, width * sizeof(uint16_t), rawcontainer::PixelMono16,
+                        sizeof(uint16_t), 0);
+            if (!refs.dark.empty()) {
+                writer.append(0, 0.0, 0.0, refs.dark.data(), refs.dark.size() * sizeof(uint16_t));
+            }
+            if (!refs.flat.empty()) {
+                writer.append(1, 0.0, 0.0, refs.flat.data(), refs.flat.size() * sizeof(uint16_t));
+            }
+            writer.close();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to save calibration: " << e.what() << std::endl;
+        }
+    }
+
+    const int width;
+    const int height;
+    std::atomic<Mode> mode{Mode::Off};
+    std::atomic<int> backgroundShift{6};
+    std::atomic<int> pedestal{32};
+
+    mutable QMutex mutex; // references, tables, capture, calibrationPath を保護
+    References references;
+    std::shared_ptr<const Tables> tables;
+    CaptureRequest capture;
+    QString calibrationPath;
+
+    // 以下は取得スレッドだけが触る
+    std::atomic<bool> capturing{false};
+    std::atomic<int> captured{0};
+    Reference captureKind = Reference::Dark;
+    int captureTarget = 0;
+    std::vector<uint32_t> accumulator;
+    std::vector<int16_t> background;
+    bool backgroundValid = false;
+};
+
+#endif // FRAMECORRECTOR_H
@@ -0,0 +1,424 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include "framesource.h"
+#include "acquisitionthread.h"
+#include "framecorrector.h"
+#include "stagestats.h"
+#include "frameworker.h"
+#include "framerecorder.h"
+#include "eventrecorder.h"
+#include "telemetrylogger.h"
+#include "resultsequencer.h"
+#include "previewrenderer.h"
+#include "framequeue.h"
+#include "framestats.h"
+#include "shmpublisher.h"
+#include "statsplan.h"
+#include "temporalstats.h"
+#include "tilestats.h"
+
+#include <QObject>
+#include <QtConcurrent>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QMetaType>
+#include <QSemaphore>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+Q_DECLARE_METATYPE(FrameStats)
+Q_DECLARE_METATYPE(TileMap)
+
+// 取得→統計→記録→ログのパイプライン。GUIには依存せず、結果はシグナルで通知する。
+// 取得スレッドが表示・統計・記録それぞれのキューへフレームを配り、各コンシューマは独立に消費する。
+// 統計処理は同時に maxInFlight フレームまで並列に行い、結果はフレーム順に並べ直してからグラフとログへ渡す。
+// 1フレームの集計も行ストライプに分けて常駐スレッド群 (ReductionPool) で並列に行う。分け方は起動時に実測して選ぶ。
+// ダーク/フラット補正・背景差分 (FrameCorrector) は取得スレッドで配る前にバッファをその場で書き換える。
+// 共有メモリへの書き出し (ShmPublisher) を有効にすると、フレームと統計を同じ機械の別プロセスへ渡す。
+// カメラ1台につき1つ作る。複数台のときはログ (TelemetryLogger) を共有し、行にカメラ番号を付ける。
+class FramePipeline : public QObject {
+    Q_OBJECT
+
+public:
+    // 統計処理が maxInFlight に達しているときの扱い
+    enum class OverloadPolicy {
+        Drop,  // 新しいフレームを捨てる
+        Block, // 空くまで待つ (その間に統計キューがあふれた分は取得スレッド側で捨てられる)
+    };
+
+    // 記録の形式。Event はトリガー前後のフレームだけを書き出す
+    enum class RecordFormat {
+        Container, // 全フレームを .jcr に
+        Lossless,  // 全フレームを可逆圧縮して .jcr に
+        Bmp,       // saveImageInterval ごとに連番BMP
+        Event,     // トリガー条件を満たしたときだけ前後のフレームを .jcr に
+    };
+
+    // sharedLogger を渡すとそれに書き込む (開始/停止は持ち主が行う)。nullptr なら自前のログを使う
+    explicit FramePipeline(FrameSource& source, TelemetryLogger* sharedLogger = nullptr, int camera = 0,
+                           QObject *parent = nullptr)
+        : QObject(parent),
+          source(source),
+          camera(camera),
+          displayFrames(displayQueueCapacity),
+          statsFrames(statsQueueCapacity),
+          acquisitionThread(source, stageTimings),
+          statsWorker(statsFrames, [this](const FrameRef& frame) { dispatchProcessing(frame); }),
+          previewRenderer(displayFrames, stageTimings.preview),
+          temporalFrames(temporalQueueCapacity),
+          temporalStats(temporalFrames, stageTimings.temporal),
+          frameRecorder(source, stageTimings.record),
+          shmPublisher(stageTimings.publish),
+          eventRecorder(source.getFrameRate(), static_cast<int>(statsQueueCapacity) + maxInFlight, stageTimings.record),
+          ownLogger(stageTimings.log),
+          telemetryLogger(sharedLogger ? *sharedLogger : ownLogger),
+          sequencer([this](ProcessedFrame& result) { deliverResult(result); }) {
+        qRegisterMetaType<FrameStats>("FrameStats");
+        qRegisterMetaType<TileMap>("TileMap");
+        acquisitionThread.addQueue(&displayFrames);
+        acquisitionThread.addQueue(&statsFrames);
+        acquisitionThread.addQueue(&frameRecorder.queue());
+        acquisitionThread.addQueue(&eventRecorder.queue());
+        acquisitionThread.addQueue(&temporalFrames);
+        acquisitionThread.setCorrector(&frameCorrector, &ReductionPool::global());
+    }
+
+    ~FramePipeline() override {
+        stop();
+    }
+
+    void start() {
+        statsWorker.start();
+        if (previewEnabled) {
+            previewRenderer.start();
+        }
+        frameRecorder.start();
+        eventRecorder.start();
+        temporalStats.start();
+        if (sharedMemory) {
+            shmPublisher.start();
+        }
+        if (ownsLogger()) {
+            telemetryLogger.start();
+        }
+        startAcquisition();
+    }
+
+    void stop() {
+        stopAcquisition();
+        statsWorker.requestInterruption();
+        previewRenderer.requestInterruption();
+        frameRecorder.requestInterruption();
+        temporalStats.requestInterruption();
+        shmPublisher.requestInterruption();
+        statsWorker.wait();
+        previewRenderer.wait();
+        frameRecorder.wait();
+        temporalStats.wait();
+        shmPublisher.wait();
+        // このパイプラインの統計処理が全部終わって行を積み終えてからログを閉じる
+        // (スレッドプールは他のカメラと共有しているので、プール全体の完了は待たない)
+        inFlightSlots.acquire(maxInFlight);
+        inFlightSlots.release(maxInFlight);
+        eventRecorder.requestInterruption();
+        eventRecorder.wait();
+        if (ownsLogger()) {
+            telemetryLogger.requestInterruption();
+            telemetryLogger.wait();
+        }
+    }
+
+    // 取得スレッドだけを止める/再開する (コンシューマは溜まった分を処理し続ける)
+    void stopAcquisition() {
+        acquisitionThread.requestInterruption();
+        acquisitionThread.wait();
+    }
+
+    void startAcquisition() {
+        acquisitionThread.start(QThread::TimeCriticalPriority);
+    }
+
+    // プレビューを作らない (画面のないヘッドレス動作用)。start() より前に呼ぶ
+    void disablePreview() {
+        previewEnabled = false;
+        acquisitionThread.removeQueue(&displayFrames);
+    }
+
+    // フレームと統計を共有メモリ name (/dev/shm/<name>) に slots フレーム分のリングで書き出す。
+    // start() より前に呼ぶ。作れなかったらstd::runtime_errorを投げる
+    void enableSharedMemory(const QString& name, int slots) {
+        shmPublisher.open(name, Width, Height, sensorBitDepth(source.sensorFormat()), slots);
+        if (!sharedMemory) {
+            acquisitionThread.addQueue(&shmPublisher.queue());
+        }
+        sharedMemory = true;
+    }
+
+    // BMP記録で何フレームごとに保存するか
+    void setSaveImageInterval(int interval) {
+        QMutexLocker locker(&settingsMutex);
+        saveImageInterval = std::max(1, interval);
+        applyRecordSettings();
+    }
+
+    // 取得スレッドを固定するコア (負なら固定しない)。start() より前に呼ぶ
+    void setCaptureCore(int core) {
+        acquisitionThread.setCpuCore(core);
+    }
+
+    int cameraIndex() const {
+        return camera;
+    }
+
+    FrameSource& frameSource() {
+        return source;
+    }
+
+    const FrameSource& frameSource() const {
+        return source;
+    }
+
+    void setRecording(bool enabled, const QString& directory) {
+        QMutexLocker locker(&settingsMutex);
+        recording = enabled;
+        recordDirectory = directory;
+        applyRecordSettings();
+    }
+
+    void setRecordFormat(RecordFormat format) {
+        QMutexLocker locker(&settingsMutex);
+        recordFormat = format;
+        applyRecordSettings();
+    }
+
+    // 解析結果のログ (graph_data.jtl / tile_data.jtl) の保存先。空ならログを書かない
+    void setGraphDirectory(const QString& directory) {
+        telemetryLogger.setDirectory(directory);
+    }
+
+    void setEventRule(const EventRule& rule) {
+        eventRecorder.setRule(rule);
+    }
+
+    void setTileLayout(std::shared_ptr<const TileLayout> layout) {
+        QMutexLocker locker(&settingsMutex);
+        tileLayout = std::move(layout);
+    }
+
+    void setOverloadPolicy(OverloadPolicy policy) {
+        overloadPolicy.store(policy, std::memory_order_relaxed);
+    }
+
+    OverloadPolicy overload() const {
+        return overloadPolicy.load(std::memory_order_relaxed);
+    }
+
+    const FrameQueue& displayQueue() const { return displayFrames; }
+    PreviewRenderer& preview() { return previewRenderer; }
+    const FrameQueue& statsQueue() const { return statsFrames; }
+    const FrameQueue& recordQueue() const { return frameRecorder.queue(); }
+    const FrameRecorder& recorder() const { return frameRecorder; }
+    const FrameQueue& temporalQueue() const { return temporalFrames; }
+    TemporalStats& temporal() { return temporalStats; }
+    bool sharedMemoryEnabled() const { return sharedMemory; }
+    const ShmPublisher& publisher() const { return shmPublisher; }
+    const TemporalStats& temporal() const { return temporalStats; }
+    const EventRecorder& events() const { return eventRecorder; }
+    const TelemetryLogger& logger() const { return telemetryLogger; }
+    const AcquisitionThread& acquisition() const { return acquisitionThread; }
+    const PipelineTimings& timings() const { return stageTimings; }
+    const StatsPlan& plan() const { return statsPlan; }
+    FrameCorrector& corrector() { return frameCorrector; }
+    const FrameCorrector& corrector() const { return frameCorrector; }
+
+    // GUIスレッドがプレビューを貼るのにかかった時間
+    void recordDisplayTime(uint64_t ns) {
+        stageTimings.display.record(ns);
+    }
+
+    uint64_t processedCount() const {
+        return processed.load(std::memory_order_relaxed);
+    }
+
+    // 処理中 (並べ替え待ちを含む) のフレーム数
+    int inFlightCount() const {
+        return maxInFlight - inFlightSlots.available();
+    }
+
+    int inFlightCapacity() const {
+        return maxInFlight;
+    }
+
+    // Dropポリシーで捨てたフレーム数
+    uint64_t overloadDroppedCount() const {
+        return overloadDropped.load(std::memory_order_relaxed);
+    }
+
+    size_t reorderOccupancy() const {
+        return sequencer.windowOccupancy();
+    }
+
+    size_t reorderPeak() const {
+        return sequencer.peakOccupancy();
+    }
+
+signals:
+    void graphDataReady(const FrameStats& stats);
+    void tileDataReady(const TileMap& map);
+    void errorOccurred(const QString& message);
+
+private:
+    static constexpr size_t displayQueueCapacity = 2;
+    static constexpr size_t statsQueueCapacity = 8;
+    static constexpr size_t temporalQueueCapacity = 4;
+    static constexpr int maxInFlight = 8;
+
+    // 1フレーム分の処理結果。例外で失敗したフレームも順番を詰めるために valid = false で流す
+    struct ProcessedFrame {
+        bool valid = false;
+        bool hasTiles = false;
+        FrameStats stats;
+        TileMap map;
+    };
+
+    int saveImageInterval = 600; // settingsMutex で保護
+    bool previewEnabled = true;
+    bool sharedMemory = false;
+
+    FrameSource& source;
+    const int camera;
+    int Width = source.getWidth();
+    int Height = source.getHeight();
+    const StatsPlan statsPlan = tuneStatsPlan(Width, Height);
+    FrameCorrector frameCorrector{Width, Height}; // 取得スレッドより先に作り、後に壊す
+
+    PipelineTimings stageTimings;
+
+    FrameQueue displayFrames;
+    FrameQueue statsFrames;
+    AcquisitionThread acquisitionThread;
+    FrameWorker statsWorker;
+    PreviewRenderer previewRenderer;
+    FrameQueue temporalFrames;
+    TemporalStats temporalStats;
+    FrameRecorder frameRecorder;
+    ShmPublisher shmPublisher;
+    EventRecorder eventRecorder;
+    TelemetryLogger ownLogger;
+    TelemetryLogger& telemetryLogger;
+
+    QMutex settingsMutex; // GUIスレッドから変更される設定の保護用
+    bool recording = false;
+    QString recordDirectory;
+    RecordFormat recordFormat = RecordFormat::Container;
+    std::shared_ptr<const TileLayout> tileLayout;
+
+    std::atomic<OverloadPolicy> overloadPolicy{OverloadPolicy::Block};
+    QSemaphore inFlightSlots{maxInFlight};
+    ResultSequencer<ProcessedFrame> sequencer;
+    uint64_t nextSequence = 0; // 統計スレッドだけが触る
+
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> overloadDropped{0};
+
+    // 統計スレッドから呼ばれる
+    void dispatchProcessing(const FrameRef& frame) {
+        if (overloadPolicy.load(std::memory_order_relaxed) == OverloadPolicy::Block) {
+            while (!inFlightSlots.tryAcquire(1, 100)) {
+                if (QThread::currentThread()->isInterruptionRequested()) {
+                    return;
+                }
+            }
+        } else if (!inFlightSlots.tryAcquire()) {
+            overloadDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::shared_ptr<const TileLayout> layout;
+        {
+            QMutexLocker locker(&settingsMutex);
+            layout = tileLayout;
+        }
+        // バッファはコピーせず参照だけを渡す。最後の参照が外れるとプールへ戻る
+        QtConcurrent::run(this, &FramePipeline::resultProcessing, frame, layout, nextSequence++);
+    }
+
+    // 並べ替えが済んだ結果をフレーム順にログとGUIへ渡す (sequencer のロック内で呼ばれる)
+    void deliverResult(ProcessedFrame& result) {
+        if (!result.valid) {
+            return;
+        }
+        telemetryLogger.append(result.stats, camera);
+        eventRecorder.onStats(result.stats);
+        if (sharedMemory) {
+            shmPublisher.publishFrameStats(result.stats);
+        }
+        if (result.hasTiles) {
+            telemetryLogger.append(result.map, camera);
+        }
+        emit graphDataReady(result.stats);
+        if (result.hasTiles) {
+            emit tileDataReady(result.map);
+        }
+    }
+
+    bool ownsLogger() const {
+        return &telemetryLogger == &ownLogger;
+    }
+
+    // settingsMutex を保持した状態で呼ぶ
+    void applyRecordSettings() {
+        const bool bmp = recordFormat == RecordFormat::Bmp;
+        FrameRecorder::Format format = FrameRecorder::Format::Container;
+        if (bmp) {
+            format = FrameRecorder::Format::Bmp;
+        } else if (recordFormat == RecordFormat::Lossless) {
+            format = FrameRecorder::Format::Lossless;
+        }
+        frameRecorder.setRecording(recording && recordFormat != RecordFormat::Event, recordDirectory, format,
+                                   bmp ? saveImageInterval : 1);
+        eventRecorder.setRecording(recording && recordFormat == RecordFormat::Event, recordDirectory);
+    }
+
+    void resultProcessing(FrameRef frame, std::shared_ptr<const TileLayout> layout, uint64_t sequence) {
+        ProcessedFrame result;
+        try {
+            const uint64_t start = monotonicNs();
+            stageTimings.queueWait.record(start - frame->captureTimeNs);
+            FrameStats& stats = result.stats;
+            stats.frameNumber = frame->frameNumber;
+            stats.timestamp = frame->timestamp;
+            stats.temp = frame->temp;
+            // 10〜16bitの形式は階調値そのままの面から求める (補正済みのフレームは8bitの面だけが有効)
+            if (frame->bitDepth > 8) {
+                result.hasTiles = analyzeFrame(frame->data16, Width, Height, frame->stride16, frame->bitDepth,
+                                               layout.get(), statsPlan, ReductionPool::global(), stats, result.map);
+            } else {
+                result.hasTiles = analyzeFrame(frame->data, Width, Height, frame->stride, layout.get(), statsPlan,
+                                               ReductionPool::global(), stats, result.map);
+            }
+
+            // 解析が終わったらバッファを早めにプールへ返す
+            frame.reset();
+            stageTimings.stats.record(monotonicNs() - start);
+            processed.fetch_add(1, std::memory_order_relaxed);
+            result.valid = true;
+        } catch(const std::exception& e) {
+            // ワーカースレッドから直接GUI要素を操作しない
+            std::cerr << e.what() << std::endl;
+        }
+
+        // 失敗しても番号は必ず埋める (後続の結果が窓に留まり続けないように)
+        frame.reset();
+        sequencer.complete(sequence, std::move(result));
+        inFlightSlots.release();
+    }
+};
+
+#endif // FRAMEPIPELINE_H
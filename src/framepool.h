@@ -0,0 +1,189 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QImage>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+class FramePool;
+
+// プールが所有する1フレーム分のバッファとメタデータ
+struct FrameBuffer {
+    uint8_t* data = nullptr;    // 8bitの面。10〜16bitの形式ではトーンマップした表示・補正・圧縮用の画像
+    size_t capacity = 0;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    uint16_t* data16 = nullptr; // 10〜16bitの形式のときだけ確保する。階調値そのまま (下位ビット詰め)
+    int stride16 = 0;           // data16 の1行の画素数
+    int bitDepth = 8;           // 8 なら data だけが有効。10〜16 なら統計と記録は data16 を使う
+    int frameNumber = 0;
+    double timestamp = 0.0;
+    double temp = 0.0;
+    uint64_t captureTimeNs = 0; // 取得完了時刻 (monotonicNs)
+    uint64_t copyNs = 0;        // captureImage がこのバッファへ書き込むのにかかった時間
+    bool corrected = false;     // FrameCorrector でダーク/フラット補正・背景差分をした
+
+    std::atomic<int> refs{0};
+    FramePool* pool = nullptr;
+};
+
+// FrameBufferへの参照カウント付きハンドル。最後の参照が外れたときにバッファがプールへ戻る。
+// 参照カウントはバッファ側に持つので、コピーしてもヒープ確保は発生しない。
+class FrameRef {
+public:
+    FrameRef() = default;
+
+    explicit FrameRef(FrameBuffer* buffer) : buffer(buffer) {
+        if (buffer) {
+            buffer->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    FrameRef(const FrameRef& other) : FrameRef(other.buffer) {}
+
+    FrameRef(FrameRef&& other) noexcept : buffer(other.buffer) {
+        other.buffer = nullptr;
+    }
+
+    FrameRef& operator=(FrameRef other) noexcept {
+        std::swap(buffer, other.buffer);
+        return *this;
+    }
+
+    ~FrameRef() {
+        reset();
+    }
+
+    inline void reset();
+
+    FrameBuffer* get() const { return buffer; }
+    FrameBuffer* operator->() const { return buffer; }
+    FrameBuffer& operator*() const { return *buffer; }
+    explicit operator bool() const { return buffer != nullptr; }
+
+private:
+    FrameBuffer* buffer = nullptr;
+};
+
+// 起動時に固定枚数のバッファを確保し、以後はそれを使い回すフレームプール。
+// 空きがないときは acquire() が空のFrameRefを返し、exhaustedCount() が増える。
+// bitDepth が8より大きければ、8bitの面に加えて16bitの面も確保する。
+class FramePool {
+public:
+    FramePool(size_t count, int width, int height, int stride, int bitDepth = 8)
+        : buffers(count), depth(bitDepth) {
+        // 行単位のSIMD処理のために64バイト境界に揃える
+        const size_t frameBytes = (static_cast<size_t>(stride) * height + 63) & ~static_cast<size_t>(63);
+        const int stride16 = (width + 31) & ~31;
+        const size_t frameBytes16 = static_cast<size_t>(stride16) * height * sizeof(uint16_t);
+        freeList.reserve(count);
+        for (FrameBuffer& buffer : buffers) {
+            buffer.data = static_cast<uint8_t*>(std::aligned_alloc(64, frameBytes));
+            if (bitDepth > 8) {
+                buffer.data16 = static_cast<uint16_t*>(std::aligned_alloc(64, frameBytes16));
+                buffer.stride16 = stride16;
+            }
+            if (!buffer.data || (bitDepth > 8 && !buffer.data16)) {
+                releaseAll();
+                throw std::runtime_error("Failed to allocate frame buffer pool.");
+            }
+            buffer.capacity = frameBytes;
+            buffer.width = width;
+            buffer.height = height;
+            buffer.stride = stride;
+            buffer.bitDepth = bitDepth;
+            buffer.pool = this;
+            freeList.push_back(&buffer);
+        }
+    }
+
+    ~FramePool() {
+        releaseAll();
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    FrameRef acquire() {
+        FrameBuffer* buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!freeList.empty()) {
+                buffer = freeList.back();
+                freeList.pop_back();
+            }
+        }
+        if (!buffer) {
+            exhausted.fetch_add(1, std::memory_order_relaxed);
+            return FrameRef();
+        }
+        buffer->copyNs = 0;
+        buffer->corrected = false;
+        buffer->bitDepth = depth;
+        return FrameRef(buffer);
+    }
+
+    size_t size() const {
+        return buffers.size();
+    }
+
+    int bitDepth() const {
+        return depth;
+    }
+
+    size_t available() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return freeList.size();
+    }
+
+    uint64_t exhaustedCount() const {
+        return exhausted.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class FrameRef;
+
+    void recycle(FrameBuffer* buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeList.push_back(buffer);
+    }
+
+    void releaseAll() {
+        for (FrameBuffer& buffer : buffers) {
+            std::free(buffer.data);
+            std::free(buffer.data16);
+            buffer.data = nullptr;
+            buffer.data16 = nullptr;
+        }
+    }
+
+    std::vector<FrameBuffer> buffers;
+    const int depth;
+    std::vector<FrameBuffer*> freeList;
+    mutable std::mutex mutex;
+    std::atomic<uint64_t> exhausted{0};
+};
+
+inline void FrameRef::reset() {
+    if (buffer && buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        buffer->pool->recycle(buffer);
+    }
+    buffer = nullptr;
+}
+
+// プールのバッファをコピーせずに参照するQImage。FrameRefが生きている間だけ有効。
+inline QImage frameImage(const FrameRef& frame) {
+    if (!frame) {
+        return QImage();
+    }
+    return QImage(frame->data, frame->width, frame->height, frame->stride, QImage::Format_Grayscale8);
+}
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,106 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include "framepool.h"
+#include "ringbuffer.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+// 取得スレッドから1つのコンシューマへフレームを渡す有界キュー。
+// 満杯のときは新しいフレームを捨てて数える (取得側は決して待たない)。
+// コンシューマが待っているときだけ futex で起こすので、待っていなければ push はロックもシステムコールもしない。
+class FrameQueue {
+public:
+    explicit FrameQueue(size_t capacity) : ring(capacity) {}
+
+    bool push(const FrameRef& frame) {
+        if (!ring.tryPush(frame)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        const size_t depth = ring.size();
+        size_t peak = peakDepth.load(std::memory_order_relaxed);
+        while (depth > peak && !peakDepth.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+        }
+        // リングに積んでから sequence を進め、待っているコンシューマがいれば起こす
+        sequence.fetch_add(1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) > 0) {
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&sequence), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+        return true;
+    }
+
+    // timeoutMsだけ待って取り出す
+    bool pop(FrameRef& frame, int timeoutMs) {
+        if (ring.tryPop(frame)) {
+            return true;
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (;;) {
+            // 待つことを先に知らせてから sequence を読み、もう一度リングを見る (間に積まれたら futex はすぐ戻る)
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            const uint32_t seen = sequence.load(std::memory_order_seq_cst);
+            if (ring.tryPop(frame)) {
+                waiters.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            const auto remaining = deadline - std::chrono::steady_clock::now();
+            if (remaining <= std::chrono::steady_clock::duration::zero()) {
+                waiters.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+            timespec timeout;
+            timeout.tv_sec = static_cast<time_t>(ns / 1000000000);
+            timeout.tv_nsec = static_cast<long>(ns % 1000000000);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&sequence), FUTEX_WAIT_PRIVATE, seen, &timeout, nullptr, 0);
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (ring.tryPop(frame)) {
+                return true;
+            }
+        }
+    }
+
+    bool tryPop(FrameRef& frame) {
+        return ring.tryPop(frame);
+    }
+
+    size_t depth() const {
+        return ring.size();
+    }
+
+    size_t capacity() const {
+        return ring.capacity();
+    }
+
+    uint64_t droppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    uint64_t pushedCount() const {
+        return pushed.load(std::memory_order_relaxed);
+    }
+
+    size_t peak() const {
+        return peakDepth.load(std::memory_order_relaxed);
+    }
+
+private:
+    SpscRing<FrameRef> ring;
+    alignas(64) std::atomic<uint32_t> sequence{0}; // push のたびに増やす (futex で待つ値)
+    std::atomic<uint32_t> waiters{0};
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<size_t> peakDepth{0};
+};
+
+#endif // FRAMEQUEUE_H
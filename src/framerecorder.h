@@ -0,0 +1,243 @@
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include "framesource.h"
+#include "framequeue.h"
+#include "losslesscodec.h"
+#include "rawcontainer.h"
+#include "stagestats.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// 記録専用の書き込みスレッド。取得スレッドから有界キューで受け取り、
+// 大きな事前確保済みコンテナ (.jcr) に生フレームを追記する。キューがあふれた分は捨てて数える。
+// 従来の連番BMP保存 (間引き) も選べる。
+// Lossless では各フレームをストライプに分けて専用のスレッドプールで並列に可逆圧縮してから追記する。
+// 10〜16bitの形式はコンテナ/Lossless とも階調値そのまま (Mono16) で記録する。BMPはトーンマップした8bitの面。
+class FrameRecorder : public QThread {
+public:
+    enum class Format {
+        Container,
+        Bmp,
+        Lossless,
+    };
+
+    FrameRecorder(FrameSource& source, StageStats& writeStats, QObject *parent = nullptr)
+        : QThread(parent), source(source), writeStats(writeStats), frames(queueCapacity) {
+        // 統計処理のグローバルプールとは分けて、圧縮がそちらの空きを奪わないようにする
+        codecPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    }
+
+    ~FrameRecorder() override {
+        requestInterruption();
+        wait();
+    }
+
+    FrameQueue& queue() {
+        return frames;
+    }
+
+    const FrameQueue& queue() const {
+        return frames;
+    }
+
+    // interval フレームごとに1枚記録する (1なら全フレーム)
+    void setRecording(bool enabled, const QString& directory, Format format, int interval) {
+        QMutexLocker locker(&settingsMutex);
+        settings.enabled = enabled;
+        settings.directory = directory;
+        settings.format = format;
+        settings.interval = interval > 0 ? interval : 1;
+        ++settingsGeneration;
+    }
+
+    uint64_t framesWritten() const {
+        return written.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bytesWritten() const {
+        return bytes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t writeErrors() const {
+        return errors.load(std::memory_order_relaxed);
+    }
+
+    // 圧縮前の画素データ量と圧縮後の量 (Lossless のみ)
+    uint64_t rawBytesCompressed() const {
+        return rawBytes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t encodedBytesCompressed() const {
+        return encodedBytes.load(std::memory_order_relaxed);
+    }
+
+    // 全ストライプの圧縮にかかった時間の合計 (コア1つあたりのスループットの計算用)
+    uint64_t encodeCpuNs() const {
+        return encodeNs.load(std::memory_order_relaxed);
+    }
+
+    int codecThreads() const {
+        return codecPool.maxThreadCount();
+    }
+
+protected:
+    void run() override {
+        while (!isInterruptionRequested()) {
+            FrameRef frame;
+            const bool popped = frames.pop(frame, 100);
+            applySettings();
+            if (!popped || !frame || !active.enabled || frame->frameNumber % active.interval != 0) {
+                continue;
+            }
+
+            const uint64_t start = monotonicNs();
+            if (active.format == Format::Bmp) {
+                source.saveImage(frameImage(frame), active.directory, frame->frameNumber);
+                written.fetch_add(1, std::memory_order_relaxed);
+            } else if (active.format == Format::Lossless) {
+                writeLossless(frame);
+            } else {
+                writeContainer(frame);
+            }
+            writeStats.record(monotonicNs() - start);
+        }
+        writer.close();
+    }
+
+private:
+    struct Settings {
+        bool enabled = false;
+        QString directory;
+        Format format = Format::Container;
+        int interval = 1;
+    };
+
+    static constexpr size_t queueCapacity = 12;
+    static constexpr int stripesPerThread = 2; // ストライプの大きさのばらつきを吸収する
+    static constexpr uint64_t segmentSize = 4ull << 30;
+
+    // GUIスレッドで変わった設定を書き込みスレッド側に反映する。記録の開始/停止やフォルダ変更でファイルを切り替える。
+    void applySettings() {
+        QMutexLocker locker(&settingsMutex);
+        if (appliedGeneration == settingsGeneration) {
+            return;
+        }
+        appliedGeneration = settingsGeneration;
+        active = settings;
+        locker.unlock();
+
+        writer.close();
+        segment = 0;
+        sessionName = QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss");
+    }
+
+    static bool highBitDepth(const FrameRef& frame) {
+        return frame->bitDepth > 8;
+    }
+
+    // 記録する面の1行のバイト数
+    static size_t rowBytes(const FrameRef& frame) {
+        return highBitDepth(frame) ? static_cast<size_t>(frame->stride16) * sizeof(uint16_t)
+                                   : static_cast<size_t>(frame->stride);
+    }
+
+    void writeContainer(const FrameRef& frame) {
+        const size_t payloadSize = rowBytes(frame) * frame->height;
+        append(frame, highBitDepth(frame) ? static_cast<const void*>(frame->data16) : frame->data, payloadSize, 0);
+    }
+
+    void writeLossless(const FrameRef& frame) {
+        const int stripeCount = codecPool.maxThreadCount() * stripesPerThread;
+        const bool wide = highBitDepth(frame);
+        const std::vector<uint8_t>& encoded = encoder.encode(
+            wide ? static_cast<const void*>(frame->data16) : frame->data, frame->width, frame->height,
+            rowBytes(frame), frame->bitDepth, stripeCount,
+            [this](int count, const std::function<void(int)>& encodeStripe) {
+                std::vector<QFuture<void>> futures;
+                futures.reserve(count);
+                for (int i = 0; i < count; ++i) {
+                    futures.push_back(QtConcurrent::run(&codecPool, [this, i, &encodeStripe]() {
+                        const uint64_t start = monotonicNs();
+                        encodeStripe(i);
+                        encodeNs.fetch_add(monotonicNs() - start, std::memory_order_relaxed);
+                    }));
+                }
+                for (QFuture<void>& future : futures) {
+                    future.waitForFinished();
+                }
+            });
+        rawBytes.fetch_add(static_cast<uint64_t>(frame->width) * frame->height * (wide ? 2 : 1), std::memory_order_relaxed);
+        encodedBytes.fetch_add(encoded.size(), std::memory_order_relaxed);
+        append(frame, encoded.data(), encoded.size(), rawcontainer::kFlagLossless);
+    }
+
+    void append(const FrameRef& frame, const void* payload, size_t payloadSize, uint32_t flags) {
+        try {
+            // 圧縮後のサイズはフレームごとに違うので、最悪の場合 (無圧縮の大きさ) で収まるかを見る
+            const size_t worstSize = std::max(payloadSize, rowBytes(frame) * frame->height);
+            // 補正の入り切りで8bitと16bitが入れ替わったら、形式ごとにファイルを分ける
+            if (!writer.isOpen() || !writer.fits(worstSize) || frame->bitDepth != writerBitDepth) {
+                const QString path = QDir(active.directory).filePath(
+                    QString("rec_%1_%2.jcr").arg(sessionName).arg(segment++, 3, 10, QLatin1Char('0')));
+                const bool wide = highBitDepth(frame);
+                writer.open(path.toStdString(), frame->width, frame->height, static_cast<uint32_t>(rowBytes(frame)),
+                            wide ? rawcontainer::PixelMono16 : rawcontainer::PixelMono8, wide ? 2 : 1, segmentSize,
+                            static_cast<uint32_t>(frame->bitDepth));
+                writerBitDepth = frame->bitDepth;
+            }
+            if (frame->corrected) {
+                flags |= rawcontainer::kFlagCorrected;
+            }
+            bytes.fetch_add(writer.append(frame->frameNumber, frame->timestamp, frame->temp, payload, payloadSize, flags),
+                            std::memory_order_relaxed);
+            written.fetch_add(1, std::memory_order_relaxed);
+        } catch (const std::exception& e) {
+            // 書き込みに失敗したら、設定が変わるまで記録を止める (ディスクフルなどでログがあふれないように)
+            std::cerr << "Recording stopped: " << e.what() << std::endl;
+            errors.fetch_add(1, std::memory_order_relaxed);
+            writer.close();
+            active.enabled = false;
+        }
+    }
+
+    FrameSource& source;
+    StageStats& writeStats;
+    FrameQueue frames;
+
+    QMutex settingsMutex;
+    Settings settings;
+    uint64_t settingsGeneration = 0;
+
+    // 以下は書き込みスレッドだけが触る
+    Settings active;
+    uint64_t appliedGeneration = 0;
+    rawcontainer::Writer writer;
+    int writerBitDepth = 0;
+    QString sessionName;
+    int segment = 0;
+    losslesscodec::FrameEncoder encoder;
+    QThreadPool codecPool;
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> rawBytes{0};
+    std::atomic<uint64_t> encodedBytes{0};
+    std::atomic<uint64_t> encodeNs{0};
+};
+
+#endif // FRAMERECORDER_H
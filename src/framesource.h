@@ -0,0 +1,96 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include "devicetelemetry.h"
+#include "framepool.h"
+#include "pixelformat.h"
+#include "stagestats.h"
+
+#include <QImage>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+
+// フレームの供給元。Spinnakerカメラ、合成画像、保存済み画像の再生を同じパイプラインで扱うための共通インターフェース。
+// captureImage() は取得スレッドからのみ呼ばれる。失敗やタイムアウトのときは空のFrameRefを返す。
+// Frame::timestamp は共通の基準時刻 (setEpoch) からの秒で付ける。複数のフレーム源で同じ基準を使えば時刻がそろう。
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual FrameRef captureImage() = 0;
+
+    virtual double getFrameRate() = 0;
+    virtual int getWidth() = 0;
+    virtual int getHeight() = 0;
+
+    virtual void startAcquisition() {}
+    virtual void stopAcquisition() {}
+
+    virtual const FramePool& framePool() const = 0;
+
+    virtual uint64_t incompleteFrameCount() const {
+        return 0;
+    }
+
+    // 取得中か (カメラなら起動直後と再接続を待っている間は false)
+    virtual bool connected() const {
+        return true;
+    }
+
+    // 外れたカメラに再接続した回数
+    virtual uint64_t reconnectCount() const {
+        return 0;
+    }
+
+    // デバイスの状態を読むサンプラー (なければnullptr)
+    virtual const DeviceTelemetry* deviceTelemetry() const {
+        return nullptr;
+    }
+
+    // 送ってくる画素形式 (10〜16bitなら framePool() のバッファに16bitの面がある)
+    virtual SensorFormat sensorFormat() const {
+        return SensorFormat::Mono8;
+    }
+
+    // 10〜16bitの形式を8bitの面に落とすときの範囲 (階調値)。取得中に変えてよい
+    void setToneMap(const ToneMap& tone) {
+        toneBlack.store(tone.black, std::memory_order_relaxed);
+        toneWhite.store(tone.white, std::memory_order_relaxed);
+    }
+
+    ToneMap toneMap() const {
+        return ToneMap{toneBlack.load(std::memory_order_relaxed), toneWhite.load(std::memory_order_relaxed)};
+    }
+
+    void saveImage(const QImage& image, const QString& directory, int imageCount) {
+        QString filename = QString("%1/%2.bmp").arg(directory).arg(imageCount, 6, 10, QLatin1Char('0'));
+        image.save(filename);
+    }
+
+    // タイムスタンプの基準時刻 (monotonicNs)。取得を始める前に設定する
+    void setEpoch(uint64_t ns) {
+        epochNs.store(ns, std::memory_order_relaxed);
+    }
+
+    uint64_t epoch() const {
+        return epochNs.load(std::memory_order_relaxed);
+    }
+
+protected:
+    // ホストの時刻 (monotonicNs) を基準時刻からの秒に直す
+    double secondsSinceEpoch(uint64_t hostNs) const {
+        return static_cast<int64_t>(hostNs - epoch()) / 1e9;
+    }
+
+    // 10〜16bitの展開を分けるストライプ数 (取得スレッドの1コアだけだとフレームレートに追いつかない)
+    static constexpr int unpackStripes = 4;
+
+private:
+    std::atomic<uint64_t> epochNs{monotonicNs()};
+    std::atomic<int> toneBlack{0};
+    std::atomic<int> toneWhite{-1};
+};
+
+#endif // FRAMESOURCE_H
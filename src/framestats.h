@@ -0,0 +1,70 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "histogram.h"
+
+#include <cmath>
+#include <cstdint>
+
+// 1フレーム分の解析結果 (グラフとログの1行)
+struct FrameStats {
+    int frameNumber = 0;
+    double timestamp = 0.0;
+    double temp = 0.0;
+    float mean = 0.0f;
+    float stddev = 0.0f;
+    float cv = 0.0f;
+    float p01 = 0.0f;
+    float p50 = 0.0f;
+    float p99 = 0.0f;
+    float saturatedFraction = 0.0f;
+    float darkFraction = 0.0f;
+};
+
+// 暗画素とみなす上限値と飽和とみなす下限値
+constexpr int kDarkLevel = 10;
+constexpr int kSaturationLevel = 255;
+
+// ヒストグラム1パスから全統計量を求める
+inline void fillFrameStats(const Histogram256& histogram, FrameStats& stats) {
+    float mean, stddev, cv;
+    std::tie(mean, stddev, cv) = momentsToMeanStdDevK(histogram.moments());
+    stats.mean = mean;
+    stats.stddev = stddev;
+    stats.cv = cv;
+    stats.p01 = static_cast<float>(histogram.percentile(0.01));
+    stats.p50 = static_cast<float>(histogram.percentile(0.50));
+    stats.p99 = static_cast<float>(histogram.percentile(0.99));
+    stats.saturatedFraction = static_cast<float>(histogram.fractionAtOrAbove(kSaturationLevel));
+    stats.darkFraction = static_cast<float>(histogram.fractionAtOrBelow(kDarkLevel));
+}
+
+// 10〜16bitの階調値を8bitと同じ0〜255のスケールに直す係数 (フルスケールが255になる)
+inline double eightBitScale(int bitDepth) {
+    return 255.0 / ((1 << bitDepth) - 1);
+}
+
+// 10〜16bitのフレーム。値は8bitと同じ0〜255のスケールで表す (小数部に8bitより細かい階調が残る)。
+// ログ・グラフ・イベントの閾値は形式によらずそのまま使える。暗画素は0〜255に直して kDarkLevel 以下、
+// 飽和はフルスケールの画素 (16bitはビンが16階調単位なので 65520 以上)
+inline void fillFrameStats(const Histogram16& histogram, FrameStats& stats) {
+    const double scale = eightBitScale(histogram.bitDepth);
+    float mean, stddev, cv;
+    std::tie(mean, stddev, cv) = momentsToMeanStdDevK(histogram.moments(), scale);
+    stats.mean = mean;
+    stats.stddev = stddev;
+    stats.cv = cv;
+    stats.p01 = static_cast<float>(histogram.percentile(0.01) * scale);
+    stats.p50 = static_cast<float>(histogram.percentile(0.50) * scale);
+    stats.p99 = static_cast<float>(histogram.percentile(0.99) * scale);
+    stats.saturatedFraction = static_cast<float>(histogram.fractionAtOrAbove(histogram.maxValue()));
+    stats.darkFraction = static_cast<float>(histogram.fractionAtOrBelow(static_cast<int>(kDarkLevel / scale)));
+}
+
+inline FrameStats calculateFrameStats(const uint8_t* data, size_t size) {
+    FrameStats stats;
+    fillFrameStats(calculateHistogram(data, size), stats);
+    return stats;
+}
+
+#endif // FRAMESTATS_H
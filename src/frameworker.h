@@ -0,0 +1,36 @@
+#ifndef FRAMEWORKER_H
+#define FRAMEWORKER_H
+
+#include "framequeue.h"
+
+#include <QThread>
+
+#include <functional>
+
+// 1つのFrameQueueを消費し、フレームごとにhandlerを呼ぶスレッド
+class FrameWorker : public QThread {
+public:
+    FrameWorker(FrameQueue& queue, std::function<void(const FrameRef&)> handler, QObject *parent = nullptr)
+        : QThread(parent), queue(queue), handler(std::move(handler)) {}
+
+    ~FrameWorker() override {
+        requestInterruption();
+        wait();
+    }
+
+protected:
+    void run() override {
+        while (!isInterruptionRequested()) {
+            FrameRef frame;
+            if (queue.pop(frame, 100) && frame) {
+                handler(frame);
+            }
+        }
+    }
+
+private:
+    FrameQueue& queue;
+    std::function<void(const FrameRef&)> handler;
+};
+
+#endif // FRAMEWORKER_H
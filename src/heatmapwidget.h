@@ -0,0 +1,93 @@
+#ifndef HEATMAPWIDGET_H
+#define HEATMAPWIDGET_H
+
+#include "tilestats.h"
+
+#include <QWidget>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QColor>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// タイルごとのCVをヒートマップで表示する。色の範囲は表示中のフレームの最小/最大に合わせる。
+class HeatmapWidget : public QWidget {
+public:
+    explicit HeatmapWidget(QWidget *parent = nullptr) : QWidget(parent) {
+        setMinimumSize(300, 300);
+    }
+
+    void setTileMap(const TileMap& map) {
+        columns = map.columns;
+        rows = map.rows;
+        values.resize(map.tiles.size());
+        for (size_t i = 0; i < map.tiles.size(); ++i) {
+            values[i] = map.tiles[i].cv;
+        }
+        update();
+    }
+
+    void clear() {
+        columns = 0;
+        rows = 0;
+        values.clear();
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override {
+        QPainter painter(this);
+        painter.fillRect(rect(), Qt::white);
+        if (columns <= 0 || rows <= 0 || values.size() != static_cast<size_t>(columns * rows)) {
+            painter.drawText(rect(), Qt::AlignCenter, "Tile map disabled");
+            return;
+        }
+
+        float minValue = 0.0f;
+        float maxValue = 0.0f;
+        bool first = true;
+        for (float v : values) {
+            if (!std::isfinite(v)) {
+                continue;
+            }
+            if (first) {
+                minValue = maxValue = v;
+                first = false;
+            } else {
+                minValue = std::min(minValue, v);
+                maxValue = std::max(maxValue, v);
+            }
+        }
+        const float range = maxValue - minValue > 1e-6f ? maxValue - minValue : 1.0f;
+
+        const int legendHeight = 20;
+        const double cellWidth = static_cast<double>(width()) / columns;
+        const double cellHeight = static_cast<double>(height() - legendHeight) / rows;
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < columns; ++c) {
+                const float v = values[r * columns + c];
+                const QRectF cell(c * cellWidth, r * cellHeight, cellWidth, cellHeight);
+                if (!std::isfinite(v)) {
+                    painter.fillRect(cell, Qt::gray);
+                    continue;
+                }
+                // 青(小)→赤(大)
+                const float t = (v - minValue) / range;
+                painter.fillRect(cell, QColor::fromHsvF((1.0f - t) * 0.66f, 1.0, 1.0));
+            }
+        }
+
+        painter.setPen(Qt::black);
+        painter.drawText(QRect(0, height() - legendHeight, width(), legendHeight), Qt::AlignCenter,
+                         QString("CV  min %1  max %2").arg(minValue, 0, 'f', 4).arg(maxValue, 0, 'f', 4));
+    }
+
+private:
+    int columns = 0;
+    int rows = 0;
+    std::vector<float> values;
+};
+
+#endif // HEATMAPWIDGET_H
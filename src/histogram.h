@@ -0,0 +1,235 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "cpu_process.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Mono8フレームの256ビンヒストグラム。平均・標準偏差・パーセンタイル・飽和率をすべてここから求める。
+struct Histogram256 {
+    std::array<uint32_t, 256> bins{};
+    uint64_t total = 0;
+
+    PixelMoments moments() const {
+        PixelMoments m;
+        for (uint32_t v = 0; v < 256; ++v) {
+            m.sum += static_cast<uint64_t>(bins[v]) * v;
+            m.sumSq += static_cast<uint64_t>(bins[v]) * v * v;
+        }
+        m.count = total;
+        return m;
+    }
+
+    // 最近傍順位法: 累積度数が p*total 以上になる最小の画素値
+    int percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        if (rank < 1) {
+            rank = 1;
+        }
+        uint64_t cumulative = 0;
+        for (int v = 0; v < 256; ++v) {
+            cumulative += bins[v];
+            if (cumulative >= rank) {
+                return v;
+            }
+        }
+        return 255;
+    }
+
+    // level以下の画素の割合
+    double fractionAtOrBelow(int level) const {
+        if (total == 0) {
+            return 0.0;
+        }
+        uint64_t count = 0;
+        for (int v = 0; v <= level && v < 256; ++v) {
+            count += bins[v];
+        }
+        return static_cast<double>(count) / static_cast<double>(total);
+    }
+
+    // level以上の画素の割合
+    double fractionAtOrAbove(int level) const {
+        if (total == 0) {
+            return 0.0;
+        }
+        uint64_t count = 0;
+        for (int v = level < 0 ? 0 : level; v < 256; ++v) {
+            count += bins[v];
+        }
+        return static_cast<double>(count) / static_cast<double>(total);
+    }
+};
+
+// 4枚のサブヒストグラムに振り分けて同じビンへの連続書き込み (store-to-load の依存) を避け、最後に合算する。
+// 行単位で何度もaddしてから一度だけmergeIntoすれば、行ごとの初期化と合算のコストがかからない。
+struct SubHistogram {
+    uint32_t sub[4][256];
+    uint64_t total = 0;
+
+    SubHistogram() {
+        std::memset(sub, 0, sizeof(sub));
+    }
+
+    void add(const uint8_t* data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            ++sub[0][word & 0xff];
+            ++sub[1][(word >> 8) & 0xff];
+            ++sub[2][(word >> 16) & 0xff];
+            ++sub[3][(word >> 24) & 0xff];
+            ++sub[0][(word >> 32) & 0xff];
+            ++sub[1][(word >> 40) & 0xff];
+            ++sub[2][(word >> 48) & 0xff];
+            ++sub[3][word >> 56];
+        }
+        for (; i < size; ++i) {
+            ++sub[0][data[i]];
+        }
+        total += size;
+    }
+
+    void mergeInto(Histogram256& histogram) const {
+        for (int v = 0; v < 256; ++v) {
+            histogram.bins[v] += sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+        }
+        histogram.total += total;
+    }
+};
+
+inline void accumulateHistogram(const uint8_t* data, size_t size, Histogram256& histogram) {
+    SubHistogram sub;
+    sub.add(data, size);
+    sub.mergeInto(histogram);
+}
+
+inline Histogram256 calculateHistogram(const uint8_t* data, size_t size) {
+    Histogram256 histogram;
+    accumulateHistogram(data, size, histogram);
+    return histogram;
+}
+
+// 10〜16bitフレームのヒストグラム。ビンは最大 4096 (12bit) で、それより深い形式は下位ビットをまとめる。
+// 平均・分散はビンからではなく、同じパスで足した画素値の総和 (sums) から正確に求める。
+struct Histogram16 {
+    static constexpr int kMaxBinBits = 12;
+
+    int bitDepth;
+    int shift;                  // ビン = 階調値 >> shift
+    std::vector<uint32_t> bins;
+    uint64_t total = 0;
+    PixelMoments sums;
+
+    explicit Histogram16(int bitDepth = 12)
+        : bitDepth(bitDepth), shift(std::max(0, bitDepth - kMaxBinBits)),
+          bins(static_cast<size_t>(1) << (bitDepth - shift)) {}
+
+    int maxValue() const {
+        return (1 << bitDepth) - 1;
+    }
+
+    PixelMoments moments() const {
+        return sums;
+    }
+
+    // 最近傍順位法。返すのはビンの下端の階調値
+    int percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        if (rank < 1) {
+            rank = 1;
+        }
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < bins.size(); ++b) {
+            cumulative += bins[b];
+            if (cumulative >= rank) {
+                return static_cast<int>(b << shift);
+            }
+        }
+        return maxValue();
+    }
+
+    // level (階調値) を含むビン以下の画素の割合
+    double fractionAtOrBelow(int level) const {
+        if (total == 0 || level < 0) {
+            return 0.0;
+        }
+        const size_t last = std::min(static_cast<size_t>(level) >> shift, bins.size() - 1);
+        uint64_t count = 0;
+        for (size_t b = 0; b <= last; ++b) {
+            count += bins[b];
+        }
+        return static_cast<double>(count) / static_cast<double>(total);
+    }
+
+    // level (階調値) を含むビン以上の画素の割合
+    double fractionAtOrAbove(int level) const {
+        if (total == 0) {
+            return 0.0;
+        }
+        uint64_t count = 0;
+        for (size_t b = static_cast<size_t>(std::max(level, 0)) >> shift; b < bins.size(); ++b) {
+            count += bins[b];
+        }
+        return static_cast<double>(count) / static_cast<double>(total);
+    }
+};
+
+// SubHistogram の10〜16bit版。総和と二乗和は行ごとにSIMDで足す
+struct SubHistogram16 {
+    std::vector<uint32_t> sub; // 4枚 x ビン数
+    size_t binCount;
+    int shift;
+    uint64_t total = 0;
+    PixelMoments sums;
+
+    explicit SubHistogram16(int bitDepth = 12)
+        : binCount(static_cast<size_t>(1) << (bitDepth - std::max(0, bitDepth - Histogram16::kMaxBinBits))),
+          shift(std::max(0, bitDepth - Histogram16::kMaxBinBits)) {
+        sub.assign(binCount * 4, 0);
+    }
+
+    void add(const uint16_t* data, size_t size) {
+        sums += cpu_process_detail::moments16Kernel().kernel(data, size);
+        // 範囲外の値 (壊れた記録など) でも配列の外に書かないようにマスクする
+        const uint32_t mask = static_cast<uint32_t>(binCount - 1);
+        uint32_t* s0 = sub.data();
+        uint32_t* s1 = s0 + binCount;
+        uint32_t* s2 = s1 + binCount;
+        uint32_t* s3 = s2 + binCount;
+        size_t i = 0;
+        for (; i + 4 <= size; i += 4) {
+            ++s0[(data[i] >> shift) & mask];
+            ++s1[(data[i + 1] >> shift) & mask];
+            ++s2[(data[i + 2] >> shift) & mask];
+            ++s3[(data[i + 3] >> shift) & mask];
+        }
+        for (; i < size; ++i) {
+            ++s0[(data[i] >> shift) & mask];
+        }
+        total += size;
+    }
+
+    void mergeInto(Histogram16& histogram) const {
+        for (size_t b = 0; b < binCount; ++b) {
+            histogram.bins[b] += sub[b] + sub[binCount + b] + sub[2 * binCount + b] + sub[3 * binCount + b];
+        }
+        histogram.total += total;
+        histogram.sums += sums;
+    }
+};
+
+#endif // HISTOGRAM_H
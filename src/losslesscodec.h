@@ -0,0 +1,423 @@
+#ifndef LOSSLESSCODEC_H
+#define LOSSLESSCODEC_H
+
+// 記録用の可逆圧縮 (Mono8 / Mono16)。
+//
+// 画素ごとにMED予測 (LOCO-I) の残差を求め、32個ずつのブロックごとに最適なパラメータkを選んで
+// Rice符号化する。フレームは行方向のストライプに分け、ストライプごとに独立に符号化/復号できるので
+// 複数コアで並列に処理できる。
+//
+// フレームのデータ: [StreamHeader][uint32 stripeSizes[stripeCount]][ストライプ0]...[ストライプn-1]
+// ストライプ内: 行ごとに [k (5bit)][Rice符号 x 32] のブロックが続く (行末のブロックは短い)。
+// 予測に使うのはストライプ内の画素だけ (ストライプの先頭行は左の画素のみ)。
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace losslesscodec {
+
+constexpr uint32_t kMagic = 0x31434a4c; // "LJC1"
+constexpr int kBlockSize = 32;
+constexpr int kEscapeRun = 24; // これ以上長い1の並びは生の値で書く
+
+struct StreamHeader {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint16_t bitsPerSample;
+    uint16_t stripeCount;
+};
+static_assert(sizeof(StreamHeader) == 16, "StreamHeader must be 16 bytes");
+
+namespace detail {
+
+// 下位ビットから詰めていくビット列の書き込み
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t* out) : begin(out), out(out) {}
+
+    // count <= 32, value は count ビットに収まっていること
+    void put(uint32_t value, int count) {
+        acc |= static_cast<uint64_t>(value) << used;
+        used += count;
+        if (used >= 32) {
+            const uint32_t word = static_cast<uint32_t>(acc);
+            std::memcpy(out, &word, sizeof(word));
+            out += 4;
+            acc >>= 32;
+            used -= 32;
+        }
+    }
+
+    size_t finish() {
+        while (used > 0) {
+            *out++ = static_cast<uint8_t>(acc);
+            acc >>= 8;
+            used -= 8;
+        }
+        used = 0;
+        return static_cast<size_t>(out - begin);
+    }
+
+private:
+    uint8_t* begin;
+    uint8_t* out;
+    uint64_t acc = 0;
+    int used = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : p(data), end(data + size) {}
+
+    uint32_t get(int count) {
+        if (count == 0) {
+            return 0;
+        }
+        if (avail < count) {
+            refill();
+        }
+        const uint32_t value = static_cast<uint32_t>(acc & ((1ull << count) - 1));
+        acc >>= count;
+        avail -= count;
+        return value;
+    }
+
+    // 先頭から続く1の数 (limit で打ち切り)。1の並びは読み捨てない
+    int leadingOnes(int limit) {
+        if (avail < limit + 1) {
+            refill();
+        }
+        const int ones = __builtin_ctzll(~acc);
+        return ones < limit ? ones : limit;
+    }
+
+    void skip(int count) {
+        acc >>= count;
+        avail -= count;
+    }
+
+    // データの終わりを超えて読んだか (超えた分はゼロとして読んでいる)
+    bool overrun() const {
+        return padBits > avail;
+    }
+
+private:
+    void refill() {
+        if (end - p >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            acc |= word << avail;
+            const int bytes = (63 - avail) >> 3;
+            p += bytes;
+            avail += bytes * 8;
+            return;
+        }
+        while (avail <= 56) {
+            uint64_t byte = 0;
+            if (p < end) {
+                byte = *p++;
+            } else {
+                padBits += 8;
+            }
+            acc |= byte << avail;
+            avail += 8;
+        }
+    }
+
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t acc = 0;
+    int avail = 0;
+    int padBits = 0;
+};
+
+// LOCO-I の Median Edge Detector。a + b - c を a, b の範囲に収めたものと同じなので分岐なしで書ける
+inline int predictMed(int a, int b, int c) {
+    const int mn = a < b ? a : b;
+    const int mx = a < b ? b : a;
+    const int p = a + b - c;
+    return p < mn ? mn : (p > mx ? mx : p);
+}
+
+// row の予測残差を 0 以上の整数 (zigzag) にして residuals に書く。
+// 先頭行は左の画素 (行頭は中央値)、それ以外の行頭は上の画素から予測する。
+template <typename T>
+inline void rowResiduals(const T* row, const T* above, int width, int bits, uint32_t* residuals) {
+    const int shift = 32 - bits;
+    auto put = [&](int x, int pred) {
+        // bits ビットで折り返した差を符号付きに戻してから zigzag にする
+        const int d = static_cast<int>(static_cast<uint32_t>(row[x] - pred) << shift) >> shift;
+        residuals[x] = (static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31);
+    };
+    if (width <= 0) {
+        return;
+    }
+    if (!above) {
+        put(0, 1 << (bits - 1));
+        for (int x = 1; x < width; ++x) {
+            put(x, row[x - 1]);
+        }
+        return;
+    }
+    put(0, above[0]);
+    for (int x = 1; x < width; ++x) {
+        put(x, predictMed(row[x - 1], above[x], above[x - 1]));
+    }
+}
+
+template <typename T>
+inline void reconstructRow(T* row, const T* above, int width, int bits, const uint32_t* residuals) {
+    const int mask = (1 << bits) - 1;
+    auto set = [&](int x, int pred) {
+        const uint32_t u = residuals[x];
+        const int d = static_cast<int>(u >> 1) ^ -static_cast<int>(u & 1);
+        row[x] = static_cast<T>((pred + d) & mask);
+    };
+    if (width <= 0) {
+        return;
+    }
+    if (!above) {
+        set(0, 1 << (bits - 1));
+        for (int x = 1; x < width; ++x) {
+            set(x, row[x - 1]);
+        }
+        return;
+    }
+    set(0, above[0]);
+    for (int x = 1; x < width; ++x) {
+        set(x, predictMed(row[x - 1], above[x], above[x - 1]));
+    }
+}
+
+// 平均値に対して符号長が最小になるおおよそのk (N * 2^k >= 合計 となる最小のk)
+inline int chooseRiceParameter(const uint32_t* values, int count, int bits) {
+    uint32_t sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += values[i];
+    }
+    int k = 0;
+    while (k < bits && (static_cast<uint32_t>(count) << k) < sum) {
+        ++k;
+    }
+    return k;
+}
+
+inline void putRice(BitWriter& writer, uint32_t u, int k, int bits) {
+    const uint32_t q = u >> k;
+    if (q < static_cast<uint32_t>(kEscapeRun)) {
+        const int length = static_cast<int>(q) + 1 + k;
+        const uint32_t code = ((1u << q) - 1) | ((u & ((1u << k) - 1)) << (q + 1));
+        if (length <= 32) {
+            writer.put(code, length); // 1の並び、0、下位kビット
+        } else {
+            writer.put((1u << q) - 1, static_cast<int>(q) + 1);
+            writer.put(u & ((1u << k) - 1), k);
+        }
+    } else {
+        writer.put((1u << kEscapeRun) - 1, kEscapeRun);
+        writer.put(u, bits);
+    }
+}
+
+inline uint32_t getRice(BitReader& reader, int k, int bits) {
+    const int q = reader.leadingOnes(kEscapeRun);
+    if (q >= kEscapeRun) {
+        reader.skip(kEscapeRun);
+        return reader.get(bits);
+    }
+    reader.skip(q + 1);
+    return (static_cast<uint32_t>(q) << k) | reader.get(k);
+}
+
+template <typename T>
+inline size_t encodeStripe(const uint8_t* data, size_t strideBytes, int width, int rows, int bits,
+                           uint8_t* out, std::vector<uint32_t>& residuals) {
+    residuals.resize(width);
+    BitWriter writer(out);
+    const T* above = nullptr;
+    for (int y = 0; y < rows; ++y) {
+        const T* row = reinterpret_cast<const T*>(data + static_cast<size_t>(y) * strideBytes);
+        rowResiduals(row, above, width, bits, residuals.data());
+        for (int x = 0; x < width; x += kBlockSize) {
+            const int count = std::min(kBlockSize, width - x);
+            const int k = chooseRiceParameter(residuals.data() + x, count, bits);
+            writer.put(static_cast<uint32_t>(k), 5);
+            for (int i = 0; i < count; ++i) {
+                putRice(writer, residuals[x + i], k, bits);
+            }
+        }
+        above = row;
+    }
+    return writer.finish();
+}
+
+template <typename T>
+inline bool decodeStripe(const uint8_t* data, size_t size, uint8_t* out, size_t strideBytes, int width, int rows,
+                         int bits, std::vector<uint32_t>& residuals) {
+    residuals.resize(width);
+    BitReader reader(data, size);
+    const T* above = nullptr;
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < width; x += kBlockSize) {
+            const int count = std::min(kBlockSize, width - x);
+            const int k = static_cast<int>(reader.get(5));
+            if (k > bits) {
+                return false;
+            }
+            for (int i = 0; i < count; ++i) {
+                residuals[x + i] = getRice(reader, k, bits);
+            }
+        }
+        T* row = reinterpret_cast<T*>(out + static_cast<size_t>(y) * strideBytes);
+        reconstructRow(row, above, width, bits, residuals.data());
+        above = row;
+    }
+    return !reader.overrun();
+}
+
+// 最悪の場合 (すべてエスケープ) のストライプの符号長
+inline size_t maxStripeSize(int width, int rows, int bits) {
+    const size_t samples = static_cast<size_t>(width) * rows;
+    const size_t blocks = static_cast<size_t>(rows) * ((width + kBlockSize - 1) / kBlockSize);
+    return (samples * (kEscapeRun + bits) + blocks * 5) / 8 + 16;
+}
+
+inline int stripeRows(int height, int stripeCount, int stripe) {
+    const int base = height / stripeCount;
+    return base + (stripe < height % stripeCount ? 1 : 0);
+}
+
+inline int stripeFirstRow(int height, int stripeCount, int stripe) {
+    const int base = height / stripeCount;
+    return base * stripe + std::min(stripe, height % stripeCount);
+}
+
+} // namespace detail
+
+// 逐次実行 (並列にしない場合の forEach)
+struct Sequential {
+    template <typename Function>
+    void operator()(int count, Function function) const {
+        for (int i = 0; i < count; ++i) {
+            function(i);
+        }
+    }
+};
+
+// 1フレームを符号化する。作業領域を使い回すので、同時に使うのは1スレッドだけにすること。
+// forEach(count, f) は f(0)..f(count-1) を (並列に) 実行して全部終わるまで待つ関数。
+class FrameEncoder {
+public:
+    template <typename ForEach>
+    const std::vector<uint8_t>& encode(const void* data, int width, int height, size_t strideBytes,
+                                       int bitsPerSample, int stripeCount, ForEach forEach) {
+        stripeCount = std::max(1, std::min(stripeCount, std::min(height, 65535)));
+        if (static_cast<int>(stripes.size()) < stripeCount) {
+            stripes.resize(stripeCount);
+        }
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        forEach(stripeCount, [&](int s) {
+            Stripe& stripe = stripes[s];
+            const int first = detail::stripeFirstRow(height, stripeCount, s);
+            const int rows = detail::stripeRows(height, stripeCount, s);
+            stripe.buffer.resize(detail::maxStripeSize(width, rows, bitsPerSample));
+            const uint8_t* src = bytes + static_cast<size_t>(first) * strideBytes;
+            stripe.size = bitsPerSample <= 8
+                ? detail::encodeStripe<uint8_t>(src, strideBytes, width, rows, bitsPerSample, stripe.buffer.data(), stripe.residuals)
+                : detail::encodeStripe<uint16_t>(src, strideBytes, width, rows, bitsPerSample, stripe.buffer.data(), stripe.residuals);
+        });
+
+        StreamHeader header{kMagic, static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+                            static_cast<uint16_t>(bitsPerSample), static_cast<uint16_t>(stripeCount)};
+        size_t total = sizeof(header) + stripeCount * sizeof(uint32_t);
+        for (int s = 0; s < stripeCount; ++s) {
+            total += stripes[s].size;
+        }
+        output.resize(total);
+        uint8_t* p = output.data();
+        std::memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        for (int s = 0; s < stripeCount; ++s) {
+            const uint32_t size = static_cast<uint32_t>(stripes[s].size);
+            std::memcpy(p, &size, sizeof(size));
+            p += sizeof(size);
+        }
+        for (int s = 0; s < stripeCount; ++s) {
+            std::memcpy(p, stripes[s].buffer.data(), stripes[s].size);
+            p += stripes[s].size;
+        }
+        return output;
+    }
+
+private:
+    struct Stripe {
+        std::vector<uint8_t> buffer;
+        std::vector<uint32_t> residuals;
+        size_t size = 0;
+    };
+
+    std::vector<Stripe> stripes;
+    std::vector<uint8_t> output;
+};
+
+inline bool readStreamHeader(const void* data, size_t size, StreamHeader& header) {
+    if (size < sizeof(StreamHeader)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    return header.magic == kMagic && header.bitsPerSample >= 1 && header.bitsPerSample <= 16
+           && header.stripeCount >= 1 && header.stripeCount <= header.height
+           && size >= sizeof(StreamHeader) + header.stripeCount * sizeof(uint32_t);
+}
+
+// width x height、bitsPerSample の dst (strideBytes 間隔) に復号する。
+// ストリームの大きさ・深さが dst と合わないときは何も書かずにfalse。
+// 途中のストライプが壊れていたときもfalseだが、dst は途中まで書かれている (中身は不定なので使わずに捨てる)
+template <typename ForEach>
+inline bool decodeFrame(const void* data, size_t size, void* dst, size_t strideBytes, int width, int height,
+                        int bitsPerSample, ForEach forEach) {
+    StreamHeader header;
+    if (!readStreamHeader(data, size, header) || static_cast<int>(header.width) != width
+        || static_cast<int>(header.height) != height || static_cast<int>(header.bitsPerSample) != bitsPerSample
+        || strideBytes < static_cast<size_t>(width) * (bitsPerSample <= 8 ? 1 : 2)) {
+        return false;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    const int stripeCount = header.stripeCount;
+    std::vector<size_t> offsets(stripeCount + 1);
+    offsets[0] = sizeof(StreamHeader) + stripeCount * sizeof(uint32_t);
+    for (int s = 0; s < stripeCount; ++s) {
+        uint32_t stripeSize;
+        std::memcpy(&stripeSize, bytes + sizeof(StreamHeader) + s * sizeof(uint32_t), sizeof(stripeSize));
+        offsets[s + 1] = offsets[s] + stripeSize;
+    }
+    if (offsets[stripeCount] > size) {
+        return false;
+    }
+
+    std::vector<char> ok(stripeCount, 0);
+    forEach(stripeCount, [&](int s) {
+        thread_local std::vector<uint32_t> residuals;
+        const int first = detail::stripeFirstRow(header.height, stripeCount, s);
+        const int rows = detail::stripeRows(header.height, stripeCount, s);
+        uint8_t* out = static_cast<uint8_t*>(dst) + static_cast<size_t>(first) * strideBytes;
+        const uint8_t* src = bytes + offsets[s];
+        const size_t srcSize = offsets[s + 1] - offsets[s];
+        ok[s] = header.bitsPerSample <= 8
+            ? detail::decodeStripe<uint8_t>(src, srcSize, out, strideBytes, header.width, rows, header.bitsPerSample, residuals)
+            : detail::decodeStripe<uint16_t>(src, srcSize, out, strideBytes, header.width, rows, header.bitsPerSample, residuals);
+    });
+    return std::all_of(ok.begin(), ok.end(), [](char v) { return v != 0; });
+}
+
+inline bool decodeFrame(const void* data, size_t size, void* dst, size_t strideBytes, int width, int height,
+                        int bitsPerSample) {
+    return decodeFrame(data, size, dst, strideBytes, width, height, bitsPerSample, Sequential());
+}
+
+} // namespace losslesscodec
+
+#endif // LOSSLESSCODEC_H
@@ -1,14 +1,74 @@
 #include "appwindow.h"
-#include "camerahandler.h"
+#include "camerarig.h"
+#include "sourcefactory.h"
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QMessageBox>
 
+#include <algorithm>
+#include <vector>
+
+// コマンドラインからフレーム源を選ぶ。指定がなければSpinnakerカメラを使う。
+// --cameras 台の合成フレーム源/カメラ、または --replay で指定した数の再生を並べる。
+static SourceConfig sourceConfig(const QCommandLineParser& parser) {
+    SourceConfig config;
+    config.synthetic = parser.value("synthetic");
+    config.noise = parser.value("noise").toDouble();
+    config.drift = parser.value("drift").toDouble();
+    config.replay = parser.values("replay");
+    config.replayFps = parser.value("replay-fps").toDouble();
+    config.loop = parser.isSet("loop");
+    config.cameras = parser.value("cameras").toInt();
+    config.rates.temperatureMs = parser.value("temperature-interval").toInt();
+    config.rates.statusMs = parser.value("status-interval").toInt();
+    config.reconnect.maxAttempts = parser.value("reconnect-attempts").toInt();
+    if (!parseSensorFormat(parser.value("format"), config.format)) {
+        throw std::runtime_error("Invalid --format value.");
+    }
+    if (!parseToneMap(parser.value("tone-map"), config.toneMap)) {
+        throw std::runtime_error("Invalid --tone-map value. Use black,white.");
+    }
+    return config;
+}
+
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"synthetic", "Use a synthetic frame source instead of the camera.", "WxH[@fps]"});
+    parser.addOption({"noise", "Noise standard deviation of the synthetic source.", "sigma", "10"});
+    parser.addOption({"drift", "Mean drift of the synthetic source in gray levels per second.", "levels", "0"});
+    parser.addOption({"cameras", "Number of cameras or synthetic sources (0 = all connected cameras).", "n", "1"});
+    parser.addOption({"capture-cores", "Comma separated CPU cores to pin the capture thread of each camera to (-1 = not pinned).", "list"});
+    parser.addOption({"format", "Pixel format of the synthetic source (mono8, mono10, mono10p, mono10packed, mono12, mono12p, mono12packed, mono14, mono16).", "format", "mono8"});
+    parser.addOption({"tone-map", "Range of 10-16 bit pixel values mapped to 0-255 for display, correction and BMP (default: full range).", "black,white"});
+    parser.addOption({"replay", "Replay numbered BMP files from a directory or a .jcr recording (repeat for several cameras).", "path"});
+    parser.addOption({"replay-fps", "Replay frame rate (0 = as fast as possible).", "fps", "30"});
+    parser.addOption({"loop", "Restart the replay when the last file has been read."});
+    parser.addOption({"temperature-interval", "Camera temperature polling interval.", "ms", "1000"});
+    parser.addOption({"status-interval", "Camera link throughput, underrun and exposure polling interval.", "ms", "1000"});
+    parser.addOption({"reconnect-attempts", "Give up reconnecting a lost camera after this many failed attempts in a row (0 = never).", "n", "360"});
+    parser.addOption({"metrics-file", "Write pipeline metrics in Prometheus text format to this file every second.", "file"});
+    parser.addOption({"calibration-dir", "Load and save the dark/flat references of each camera in this directory.", "dir"});
+    parser.addOption({"shm", "Publish frames and statistics to this POSIX shared-memory ring (/dev/shm/<name>) for other processes.", "name"});
+    parser.addOption({"shm-slots", "Frames kept in the shared-memory ring.", "n", "8"});
+    parser.process(app);
+
+    std::vector<int> captureCores;
+    if (!parseCoreList(parser.value("capture-cores"), captureCores)) {
+        std::cerr << "Invalid --capture-cores value." << std::endl;
+        return 1;
+    }
+
     try {
-        CameraHandler cameraHandler;
-        AppWindow window(cameraHandler);
+        CameraRig rig(createFrameSources(sourceConfig(parser)), captureCores);
+        rig.setCalibrationDirectory(parser.value("calibration-dir"));
+        if (parser.isSet("shm")) {
+            rig.enableSharedMemory(parser.value("shm"), std::max(2, parser.value("shm-slots").toInt()));
+        }
+        AppWindow window(rig);
+        window.setMetricsFile(parser.value("metrics-file"));
         window.show();
         return app.exec();
     } catch (const std::runtime_error& e) {
@@ -24,4 +84,4 @@ int main(int argc, char *argv[]) {
         QMessageBox::critical(nullptr, "Error", "Unknown error.");
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,296 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include "camerarig.h"
+#include "framepipeline.h"
+#include "stagestats.h"
+
+#include <QSaveFile>
+#include <QString>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// パイプラインの計測値 (各段の処理時間の分布、捨てたフレーム数、キューの深さ) をまとめて出す。
+// update() を一定間隔で呼ぶと、前回からの区間の分位点を求め、ファイルが指定されていれば
+// Prometheus のテキスト形式で書き換える (node_exporter の textfile collector でそのまま読める)。
+// 画面のオーバーレイも同じ区間の値を使う。update() は1つのスレッドからだけ呼ぶこと。
+class MetricsExporter {
+public:
+    struct StageSummary {
+        const char* name = "";
+        uint64_t count = 0; // 区間内の回数
+        double p50Ms = 0.0;
+        double p90Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    explicit MetricsExporter(const CameraRig& rig)
+        : rig(rig), cameras(rig.size()), lastUpdateNs(monotonicNs()) {
+        for (CameraWindow& camera : cameras) {
+            camera.previous.resize(stageCount());
+            camera.summaries.resize(stageCount());
+        }
+    }
+
+    // 書き出し先。空なら書かない
+    void setFile(const QString& path) {
+        filePath = path;
+    }
+
+    QString file() const {
+        return filePath;
+    }
+
+    void update() {
+        const uint64_t now = monotonicNs();
+        intervalSeconds = std::max(1e-3, (now - lastUpdateNs) / 1e9);
+        lastUpdateNs = now;
+        for (int camera = 0; camera < rig.size(); ++camera) {
+            const PipelineTimings& timings = rig.pipeline(camera).timings();
+            CameraWindow& window = cameras[camera];
+            for (int i = 0; i < stageCount(); ++i) {
+                window.summaries[i] = advance(stageTable()[i].name, timings.*stageTable()[i].member, window.previous[i]);
+            }
+        }
+        logSummary = advance("log", rig.logTimings(), logPrevious);
+        if (!filePath.isEmpty()) {
+            write();
+        }
+    }
+
+    // 直近の update() の区間での各段の集計
+    const std::vector<StageSummary>& stages(int camera) const {
+        return cameras.at(camera).summaries;
+    }
+
+    uint64_t writeErrors() const {
+        return errors;
+    }
+
+    // 画面に重ねる表 (等幅フォント前提)
+    QString overlayText(int camera) const {
+        const FramePipeline& pipeline = rig.pipeline(camera);
+        QString text = QString("%1 %2 %3 %4 %5  [ms]\n").arg("stage", -12).arg("n/s", 7).arg("p50", 7).arg("p99", 7).arg("max", 7);
+        auto row = [&](const StageSummary& stage) {
+            text += QString("%1 %2 %3 %4 %5\n").arg(stage.name, -12)
+                        .arg(stage.count / intervalSeconds, 7, 'f', 1)
+                        .arg(stage.p50Ms, 7, 'f', 2).arg(stage.p99Ms, 7, 'f', 2).arg(stage.maxMs, 7, 'f', 2);
+        };
+        for (const StageSummary& stage : stages(camera)) {
+            row(stage);
+        }
+        row(logSummary);
+        text += QString("dropped: stats %1, overload %2, record %3, event %4, pool %5, incomplete %6\n")
+                    .arg(pipeline.statsQueue().droppedCount()).arg(pipeline.overloadDroppedCount())
+                    .arg(pipeline.recordQueue().droppedCount()).arg(pipeline.events().queue().droppedCount())
+                    .arg(pipeline.frameSource().framePool().exhaustedCount())
+                    .arg(pipeline.frameSource().incompleteFrameCount());
+        text += QString("queues: stats %1/%2 (peak %3), record %4/%5 (peak %6), in flight %7/%8")
+                    .arg(pipeline.statsQueue().depth()).arg(pipeline.statsQueue().capacity()).arg(pipeline.statsQueue().peak())
+                    .arg(pipeline.recordQueue().depth()).arg(pipeline.recordQueue().capacity()).arg(pipeline.recordQueue().peak())
+                    .arg(pipeline.inFlightCount()).arg(pipeline.inFlightCapacity());
+        return text;
+    }
+
+    // Prometheus のテキスト形式。分位点と最大は直近の区間、_sum と _count は起動からの累計
+    QString render() const {
+        QString out;
+        out += "# HELP jetsoncam_stage_latency_seconds Pipeline stage latency (quantiles over the last interval).\n"
+               "# TYPE jetsoncam_stage_latency_seconds summary\n";
+        auto summary = [&](const QString& labels, const StageSummary& stage, const StageStats& stats) {
+            const double quantiles[] = {0.5, 0.9, 0.99};
+            const double values[] = {stage.p50Ms, stage.p90Ms, stage.p99Ms};
+            for (int i = 0; i < 3; ++i) {
+                out += QString("jetsoncam_stage_latency_seconds{%1,quantile=\"%2\"} %3\n")
+                           .arg(labels).arg(quantiles[i]).arg(values[i] / 1e3, 0, 'g', 6);
+            }
+            out += QString("jetsoncam_stage_latency_seconds_sum{%1} %2\n")
+                       .arg(labels).arg(stats.totalNs.load(std::memory_order_relaxed) / 1e9, 0, 'g', 10);
+            out += QString("jetsoncam_stage_latency_seconds_count{%1} %2\n")
+                       .arg(labels).arg(stats.count.load(std::memory_order_relaxed));
+        };
+        for (int camera = 0; camera < rig.size(); ++camera) {
+            const PipelineTimings& timings = rig.pipeline(camera).timings();
+            for (int i = 0; i < stageCount(); ++i) {
+                summary(stageLabels(camera, stageTable()[i].name), cameras[camera].summaries[i], timings.*stageTable()[i].member);
+            }
+        }
+        summary("stage=\"log\"", logSummary, rig.logTimings());
+
+        out += "# HELP jetsoncam_stage_latency_max_seconds Longest stage latency in the last interval.\n"
+               "# TYPE jetsoncam_stage_latency_max_seconds gauge\n";
+        for (int camera = 0; camera < rig.size(); ++camera) {
+            for (const StageSummary& stage : cameras[camera].summaries) {
+                out += QString("jetsoncam_stage_latency_max_seconds{%1} %2\n")
+                           .arg(stageLabels(camera, stage.name)).arg(stage.maxMs / 1e3, 0, 'g', 6);
+            }
+        }
+        out += QString("jetsoncam_stage_latency_max_seconds{stage=\"log\"} %1\n").arg(logSummary.maxMs / 1e3, 0, 'g', 6);
+
+        family(out, "jetsoncam_frames_captured_total", "Frames delivered by the capture thread.", "counter",
+               [](const FramePipeline& p) { return p.acquisition().capturedCount(); });
+        family(out, "jetsoncam_frames_processed_total", "Frames whose statistics were computed.", "counter",
+               [](const FramePipeline& p) { return p.processedCount(); });
+        family(out, "jetsoncam_frames_incomplete_total", "Incomplete frames reported by the camera.", "counter",
+               [](const FramePipeline& p) { return p.frameSource().incompleteFrameCount(); });
+        family(out, "jetsoncam_capture_failed_total", "captureImage calls that returned no frame.", "counter",
+               [](const FramePipeline& p) { return p.acquisition().failedCount(); });
+        family(out, "jetsoncam_camera_connected", "1 while the frame source is acquiring, 0 while reconnecting.", "gauge",
+               [](const FramePipeline& p) { return static_cast<uint64_t>(p.frameSource().connected() ? 1 : 0); });
+        family(out, "jetsoncam_camera_reconnects_total", "Times a lost camera was reconnected.", "counter",
+               [](const FramePipeline& p) { return p.frameSource().reconnectCount(); });
+
+        out += "# HELP jetsoncam_frames_dropped_total Frames dropped, by where they were dropped.\n"
+               "# TYPE jetsoncam_frames_dropped_total counter\n";
+        for (int camera = 0; camera < rig.size(); ++camera) {
+            const FramePipeline& p = rig.pipeline(camera);
+            const std::pair<const char*, uint64_t> drops[] = {
+                {"display_queue", p.displayQueue().droppedCount()},
+                {"stats_queue", p.statsQueue().droppedCount()},
+                {"overload", p.overloadDroppedCount()},
+                {"record_queue", p.recordQueue().droppedCount()},
+                {"event_queue", p.events().queue().droppedCount()},
+                {"temporal_queue", p.temporalQueue().droppedCount()},
+                {"shm_queue", p.publisher().queue().droppedCount()},
+                {"event_ring", p.events().droppedFrames()},
+                {"buffer_pool", p.frameSource().framePool().exhaustedCount()},
+            };
+            for (const auto& drop : drops) {
+                out += QString("jetsoncam_frames_dropped_total{camera=\"%1\",reason=\"%2\"} %3\n")
+                           .arg(camera).arg(drop.first).arg(drop.second);
+            }
+        }
+
+        out += "# HELP jetsoncam_queue_depth Frames waiting in each queue.\n"
+               "# TYPE jetsoncam_queue_depth gauge\n";
+        queueFamily(out, "jetsoncam_queue_depth", [](const FrameQueue& q) { return static_cast<uint64_t>(q.depth()); });
+        out += "# HELP jetsoncam_queue_peak_depth Highest queue depth since start.\n"
+               "# TYPE jetsoncam_queue_peak_depth gauge\n";
+        queueFamily(out, "jetsoncam_queue_peak_depth", [](const FrameQueue& q) { return static_cast<uint64_t>(q.peak()); });
+        out += "# HELP jetsoncam_queue_capacity Capacity of each queue.\n"
+               "# TYPE jetsoncam_queue_capacity gauge\n";
+        queueFamily(out, "jetsoncam_queue_capacity", [](const FrameQueue& q) { return static_cast<uint64_t>(q.capacity()); });
+
+        family(out, "jetsoncam_stats_in_flight", "Frames being processed or waiting for reordering.", "gauge",
+               [](const FramePipeline& p) { return static_cast<uint64_t>(p.inFlightCount()); });
+        family(out, "jetsoncam_buffers_free", "Free buffers in the frame pool.", "gauge",
+               [](const FramePipeline& p) { return static_cast<uint64_t>(p.frameSource().framePool().available()); });
+        family(out, "jetsoncam_shm_frames_published_total", "Frames written to the shared-memory ring.", "counter",
+               [](const FramePipeline& p) { return p.publisher().publishedCount(); });
+        family(out, "jetsoncam_record_write_errors_total", "Recorder write errors.", "counter",
+               [](const FramePipeline& p) { return p.recorder().writeErrors() + p.events().writeErrors(); });
+
+        out += QString("# TYPE jetsoncam_log_records_total counter\njetsoncam_log_records_total %1\n")
+                   .arg(rig.logger().recordsWritten());
+        out += QString("# TYPE jetsoncam_log_records_dropped_total counter\njetsoncam_log_records_dropped_total %1\n")
+                   .arg(rig.logger().droppedRecords());
+        out += QString("# TYPE jetsoncam_log_write_errors_total counter\njetsoncam_log_write_errors_total %1\n")
+                   .arg(rig.logger().writeErrors());
+        return out;
+    }
+
+private:
+    struct StageEntry {
+        const char* name;
+        StageStats PipelineTimings::*member;
+    };
+
+    // 出力する段 (capture は captureWait + copy なので出さない)
+    static constexpr StageEntry stages[] = {
+        {"capture_wait", &PipelineTimings::captureWait},
+        {"copy", &PipelineTimings::copy},
+        {"correct", &PipelineTimings::correct},
+        {"queue_wait", &PipelineTimings::queueWait},
+        {"stats", &PipelineTimings::stats},
+        {"preview", &PipelineTimings::preview},
+        {"display", &PipelineTimings::display},
+        {"disk_write", &PipelineTimings::record},
+        {"temporal", &PipelineTimings::temporal},
+        {"shm_publish", &PipelineTimings::publish},
+    };
+
+    static const StageEntry* stageTable() {
+        return stages;
+    }
+
+    static constexpr int stageCount() {
+        return static_cast<int>(std::size(stages));
+    }
+
+    struct CameraWindow {
+        std::vector<LatencyHistogram::Snapshot> previous;
+        std::vector<StageSummary> summaries;
+    };
+
+    const CameraRig& rig;
+    std::vector<CameraWindow> cameras;
+    LatencyHistogram::Snapshot logPrevious{};
+    StageSummary logSummary;
+    QString filePath;
+    uint64_t lastUpdateNs;
+    double intervalSeconds = 1.0;
+    uint64_t errors = 0;
+
+    static StageSummary advance(const char* name, const StageStats& stats, LatencyHistogram::Snapshot& previous) {
+        const LatencyHistogram::Snapshot current = stats.histogram.snapshot();
+        const LatencyHistogram::Snapshot interval = LatencyHistogram::difference(current, previous);
+        previous = current;
+        StageSummary summary;
+        summary.name = name;
+        summary.count = LatencyHistogram::count(interval);
+        summary.p50Ms = LatencyHistogram::percentileNs(interval, 0.5) / 1e6;
+        summary.p90Ms = LatencyHistogram::percentileNs(interval, 0.9) / 1e6;
+        summary.p99Ms = LatencyHistogram::percentileNs(interval, 0.99) / 1e6;
+        summary.maxMs = LatencyHistogram::percentileNs(interval, 1.0) / 1e6;
+        return summary;
+    }
+
+    static QString stageLabels(int camera, const char* stage) {
+        return QString("camera=\"%1\",stage=\"%2\"").arg(camera).arg(stage);
+    }
+
+    template <typename Value>
+    void family(QString& out, const char* name, const char* help, const char* type, Value value) const {
+        out += QString("# HELP %1 %2\n# TYPE %1 %3\n").arg(name).arg(help).arg(type);
+        for (int camera = 0; camera < rig.size(); ++camera) {
+            out += QString("%1{camera=\"%2\"} %3\n").arg(name).arg(camera).arg(value(rig.pipeline(camera)));
+        }
+    }
+
+    template <typename Value>
+    void queueFamily(QString& out, const char* name, Value value) const {
+        for (int camera = 0; camera < rig.size(); ++camera) {
+            const FramePipeline& p = rig.pipeline(camera);
+            const std::pair<const char*, const FrameQueue*> queues[] = {
+                {"display", &p.displayQueue()},
+                {"stats", &p.statsQueue()},
+                {"record", &p.recordQueue()},
+                {"event", &p.events().queue()},
+                {"temporal", &p.temporalQueue()},
+                {"shm", &p.publisher().queue()},
+            };
+            for (const auto& queue : queues) {
+                out += QString("%1{camera=\"%2\",queue=\"%3\"} %4\n").arg(name).arg(camera).arg(queue.first).arg(value(*queue.second));
+            }
+        }
+    }
+
+    // 読み手が書きかけのファイルを見ないように、一時ファイルに書いてから置き換える
+    void write() {
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)
+            || file.write(render().toUtf8()) < 0 || !file.commit()) {
+            if (errors++ == 0) {
+                std::cerr << "Failed to write metrics file " << filePath.toStdString() << std::endl;
+            }
+        }
+    }
+};
+
+#endif // METRICSEXPORTER_H
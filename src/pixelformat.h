@@ -0,0 +1,99 @@
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include "framepool.h"
+#include "pixelunpack.h"
+#include "reductionpool.h"
+
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+inline bool parseSensorFormat(const QString& name, SensorFormat& format) {
+    const QString key = name.trimmed().toLower();
+    for (SensorFormat candidate : {SensorFormat::Mono8, SensorFormat::Mono10, SensorFormat::Mono10p,
+                                   SensorFormat::Mono10Packed, SensorFormat::Mono12, SensorFormat::Mono12p,
+                                   SensorFormat::Mono12Packed, SensorFormat::Mono14, SensorFormat::Mono16}) {
+        if (key == QString(sensorFormatName(candidate)).toLower()) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "black,white" (階調値)
+inline bool parseToneMap(const QString& text, ToneMap& tone) {
+    if (text.trimmed().isEmpty()) {
+        tone = ToneMap();
+        return true;
+    }
+    const QStringList parts = text.split(',');
+    bool okBlack = false;
+    bool okWhite = false;
+    if (parts.size() != 2) {
+        return false;
+    }
+    const int black = parts[0].trimmed().toInt(&okBlack);
+    const int white = parts[1].trimmed().toInt(&okWhite);
+    if (!okBlack || !okWhite || black < 0 || white <= black) {
+        return false;
+    }
+    tone.black = black;
+    tone.white = white;
+    return true;
+}
+
+// カメラの1フレームをプールのバッファへ展開する。Mono8 は行ごとのコピーだけ (従来どおりの速い経路)。
+// 10〜16bitは行を stripes 本に分けて pool で並列に展開し、展開と8bitへのトーンマップを1回の読み出しで済ませる。
+class PixelUnpacker {
+public:
+    explicit PixelUnpacker(SensorFormat format)
+        : format(format), entry(pixelformat_detail::selectUnpackKernel(format)) {}
+
+    SensorFormat sensorFormat() const {
+        return format;
+    }
+
+    int bitDepth() const {
+        return sensorBitDepth(format);
+    }
+
+    const char* kernelName() const {
+        return entry.name;
+    }
+
+    // src は1行 srcStride バイト。frame は bitDepth() の深さで確保したプールのバッファ。
+    // src が frame->data16 自身でもよい (読んだ分より先には書かない)
+    void unpack(const uint8_t* src, size_t srcStride, FrameBuffer& frame, const ToneMap& tone, int stripes,
+                ReductionPool& pool) const {
+        const int width = frame.width;
+        const int height = frame.height;
+        if (!entry.kernel) {
+            for (int y = 0; y < height; ++y) {
+                std::memcpy(frame.data + static_cast<size_t>(y) * frame.stride, src + y * srcStride, width);
+            }
+            return;
+        }
+        const pixelformat_detail::ToneParams params = pixelformat_detail::toneParams(bitDepth(), tone);
+        stripes = std::max(1, std::min(stripes, height));
+        pool.parallelFor(stripes, [&](int i) {
+            const int y0 = static_cast<int>(static_cast<int64_t>(i) * height / stripes);
+            const int y1 = static_cast<int>(static_cast<int64_t>(i + 1) * height / stripes);
+            for (int y = y0; y < y1; ++y) {
+                entry.kernel(src + y * srcStride, frame.data16 + static_cast<size_t>(y) * frame.stride16,
+                             frame.data + static_cast<size_t>(y) * frame.stride, width, params);
+            }
+        });
+    }
+
+private:
+    SensorFormat format;
+    pixelformat_detail::UnpackKernelEntry entry;
+};
+
+#endif // PIXELFORMAT_H
@@ -0,0 +1,391 @@
+#ifndef PIXELUNPACK_H
+#define PIXELUNPACK_H
+
+// 画素形式の定義と1行分の展開カーネル。Qt に依らないので、ツールやテストからそのまま使える。
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define PIXELFORMAT_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define PIXELFORMAT_NEON 1
+#endif
+
+// カメラが送ってくる画素形式。Mono8 以外 (10〜16bit) は取得時に、階調値そのままの16bitの面と
+// トーンマップした8bitの面 (表示・補正・圧縮・BMP用) に1パスで展開する。
+// 詰め方は GenICam PFNC (Mono10p/Mono12p: 下位ビットから順に詰める) と
+// GigE Vision (Mono10Packed/Mono12Packed: 2画素を3バイトに、中央のバイトに両方の下位ビット) に従う。
+enum class SensorFormat {
+    Mono8,
+    Mono10,
+    Mono10p,
+    Mono10Packed,
+    Mono12,
+    Mono12p,
+    Mono12Packed,
+    Mono14,
+    Mono16,
+};
+
+inline int sensorBitDepth(SensorFormat format) {
+    switch (format) {
+    case SensorFormat::Mono8:
+        return 8;
+    case SensorFormat::Mono10:
+    case SensorFormat::Mono10p:
+    case SensorFormat::Mono10Packed:
+        return 10;
+    case SensorFormat::Mono12:
+    case SensorFormat::Mono12p:
+    case SensorFormat::Mono12Packed:
+        return 12;
+    case SensorFormat::Mono14:
+        return 14;
+    case SensorFormat::Mono16:
+        return 16;
+    }
+    return 8;
+}
+
+// 1行分の画素が占めるバイト数 (行末の詰め物は含まない)
+inline size_t packedRowBytes(SensorFormat format, int width) {
+    const size_t w = static_cast<size_t>(width);
+    switch (format) {
+    case SensorFormat::Mono8:
+        return w;
+    case SensorFormat::Mono10p:
+        return (w * 10 + 7) / 8;
+    case SensorFormat::Mono12p:
+        return (w * 12 + 7) / 8;
+    case SensorFormat::Mono10Packed:
+    case SensorFormat::Mono12Packed:
+        return (w + 1) / 2 * 3;
+    default:
+        return w * 2;
+    }
+}
+
+// 16bitの入れ物に下位ビット詰めで入っている形式 (記録の再生などに使う)
+inline SensorFormat unpackedFormat(int bitDepth) {
+    if (bitDepth <= 8) {
+        return SensorFormat::Mono8;
+    }
+    if (bitDepth <= 10) {
+        return SensorFormat::Mono10;
+    }
+    if (bitDepth <= 12) {
+        return SensorFormat::Mono12;
+    }
+    return bitDepth <= 14 ? SensorFormat::Mono14 : SensorFormat::Mono16;
+}
+
+inline const char* sensorFormatName(SensorFormat format) {
+    switch (format) {
+    case SensorFormat::Mono8:
+        return "Mono8";
+    case SensorFormat::Mono10:
+        return "Mono10";
+    case SensorFormat::Mono10p:
+        return "Mono10p";
+    case SensorFormat::Mono10Packed:
+        return "Mono10Packed";
+    case SensorFormat::Mono12:
+        return "Mono12";
+    case SensorFormat::Mono12p:
+        return "Mono12p";
+    case SensorFormat::Mono12Packed:
+        return "Mono12Packed";
+    case SensorFormat::Mono14:
+        return "Mono14";
+    case SensorFormat::Mono16:
+        return "Mono16";
+    }
+    return "Unknown";
+}
+
+// 10〜16bitから8bitへの線形のトーンマップ。black 以下を0、white 以上を255にする。
+// white が負ならフルスケール (既定: 上位8bitをそのまま使うのと同じ)
+struct ToneMap {
+    int black = 0;
+    int white = -1;
+};
+
+namespace pixelformat_detail {
+
+// 8bit = min(255, ((v - black) * gain) >> 16)。フルスケールなら gain = 2^(24 - bitDepth) で上位8bitと一致する
+struct ToneParams {
+    uint16_t mask;
+    uint16_t black;
+    uint16_t gain;
+};
+
+inline ToneParams toneParams(int bitDepth, const ToneMap& tone) {
+    const int maxValue = (1 << bitDepth) - 1;
+    // 256階調より狭い窓は gain が16bitに収まらないので広げる
+    const int black = std::clamp(tone.black, 0, maxValue - 255);
+    const int white = std::clamp(tone.white < 0 ? maxValue : tone.white, black + 255, maxValue);
+    const uint32_t gain = std::min<uint32_t>(65535, (256u << 16) / static_cast<uint32_t>(white - black + 1));
+    return ToneParams{static_cast<uint16_t>(maxValue), static_cast<uint16_t>(black), static_cast<uint16_t>(gain)};
+}
+
+inline uint8_t toneScalar(uint32_t v, const ToneParams& p) {
+    const uint32_t d = v > p.black ? v - p.black : 0;
+    return static_cast<uint8_t>(std::min<uint32_t>(255, (d * p.gain) >> 16));
+}
+
+// src は1行分の詰めた画素。dst16 に階調値、dst8 にトーンマップした値を書く
+using UnpackKernel = void (*)(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p);
+
+// Mono10/12/14/16: リトルエンディアンの16bit
+inline void unpack16Scalar(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    for (int x = 0; x < width; ++x) {
+        const uint16_t v = static_cast<uint16_t>((src[2 * x] | (src[2 * x + 1] << 8)) & p.mask);
+        dst16[x] = v;
+        dst8[x] = toneScalar(v, p);
+    }
+}
+
+// Mono10p/Mono12p: 画素 x は先頭から Bits*x ビット目から Bits ビット (下位から)
+template <int Bits>
+inline void unpackLsbScalar(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    int x = 0;
+    // 8画素 (Bits バイト) ずつ64bitにまとめて読むと、画素ごとのバイト読み出しより速い
+    for (; x + 8 <= width; x += 8) {
+        const uint8_t* b = src + static_cast<size_t>(x) * Bits / 8;
+        uint64_t lo;
+        std::memcpy(&lo, b, sizeof(lo));
+        const uint64_t hi = Bits == 12 ? static_cast<uint64_t>(b[8]) | (static_cast<uint64_t>(b[9]) << 8)
+                                                    | (static_cast<uint64_t>(b[10]) << 16) | (static_cast<uint64_t>(b[11]) << 24)
+                                       : static_cast<uint64_t>(b[8]) | (static_cast<uint64_t>(b[9]) << 8);
+        for (int i = 0; i < 8; ++i) {
+            const int bit = i * Bits;
+            const uint64_t word = bit < 64 ? (lo >> bit) | (bit + Bits > 64 ? hi << (64 - bit) : 0) : hi >> (bit - 64);
+            const uint16_t v = static_cast<uint16_t>(word & ((1u << Bits) - 1));
+            dst16[x + i] = v;
+            dst8[x + i] = toneScalar(v, p);
+        }
+    }
+    for (; x < width; ++x) {
+        const size_t bit = static_cast<size_t>(x) * Bits;
+        const uint32_t word = src[bit / 8] | (static_cast<uint32_t>(src[bit / 8 + 1]) << 8);
+        const uint16_t v = static_cast<uint16_t>((word >> (bit % 8)) & ((1u << Bits) - 1));
+        dst16[x] = v;
+        dst8[x] = toneScalar(v, p);
+    }
+}
+
+// Mono10Packed/Mono12Packed: [画素0の上位8bit][画素0の下位 (下の4bit) と画素1の下位 (上の4bit)][画素1の上位8bit]
+template <int Bits>
+inline void unpackGigeScalar(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    constexpr uint32_t low = (1u << (Bits - 8)) - 1;
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* b = src + static_cast<size_t>(x / 2) * 3;
+        const uint16_t v = static_cast<uint16_t>(x % 2 == 0 ? (b[0] << (Bits - 8)) | (b[1] & low)
+                                                              : (b[2] << (Bits - 8)) | ((b[1] >> 4) & low));
+        dst16[x] = v;
+        dst8[x] = toneScalar(v, p);
+    }
+}
+
+#ifdef PIXELFORMAT_X86
+// 16画素分の階調値を8bitにする
+__attribute__((target("avx2")))
+inline __m128i toneAvx2(__m256i v, __m256i black, __m256i gain) {
+    __m256i t = _mm256_mulhi_epu16(_mm256_subs_epu16(v, black), gain);
+    t = _mm256_min_epu16(t, _mm256_set1_epi16(255));
+    t = _mm256_packus_epi16(t, t);
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(t, 0x08));
+}
+
+__attribute__((target("avx2")))
+inline void unpack16Avx2(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    const __m256i mask = _mm256_set1_epi16(static_cast<short>(p.mask));
+    const __m256i black = _mm256_set1_epi16(static_cast<short>(p.black));
+    const __m256i gain = _mm256_set1_epi16(static_cast<short>(p.gain));
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * x)), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst16 + x), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst8 + x), toneAvx2(v, black, gain));
+    }
+    unpack16Scalar(src + 2 * x, dst16 + x, dst8 + x, width - x, p);
+}
+
+// 2画素3バイトの形式。各128bitレーンで12バイト (8画素) を、偶数画素はバイト (3k, 3k+1)、
+// 奇数画素はバイト (3k+1, 3k+2) の16bitに並べ替えてから、偶数と奇数で別のシフトをして混ぜる
+template <bool Gige>
+__attribute__((target("avx2")))
+inline void unpack12Avx2(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    // Mono12p は下位バイトが先、Mono12Packed は上位8bitが先なので並べる順を変える
+    const __m256i shuffle = Gige ? _mm256_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11,
+                                                    1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11)
+                                 : _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+                                                    0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    const __m256i black = _mm256_set1_epi16(static_cast<short>(p.black));
+    const __m256i gain = _mm256_set1_epi16(static_cast<short>(p.gain));
+    const size_t rowBytes = Gige ? (static_cast<size_t>(width) + 1) / 2 * 3 : (static_cast<size_t>(width) * 12 + 7) / 8;
+    int x = 0;
+    // 後半のレーンは12バイト目から16バイト読むので、行末の4バイト手前までで止める
+    for (; x + 16 <= width && static_cast<size_t>(x) / 2 * 3 + 28 <= rowBytes; x += 16) {
+        const uint8_t* s = src + static_cast<size_t>(x) / 2 * 3;
+        const __m256i bytes = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 12)), 1);
+        const __m256i w = _mm256_shuffle_epi8(bytes, shuffle);
+        const __m256i odd = _mm256_srli_epi16(w, 4);
+        const __m256i even = Gige ? _mm256_or_si256(_mm256_and_si256(odd, _mm256_set1_epi16(0x0ff0)),
+                                                    _mm256_and_si256(w, _mm256_set1_epi16(0x000f)))
+                                  : _mm256_and_si256(w, _mm256_set1_epi16(0x0fff));
+        const __m256i v = _mm256_blend_epi16(even, odd, 0xaa);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst16 + x), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst8 + x), toneAvx2(v, black, gain));
+    }
+    const uint8_t* rest = src + static_cast<size_t>(x) / 2 * 3;
+    if (Gige) {
+        unpackGigeScalar<12>(rest, dst16 + x, dst8 + x, width - x, p);
+    } else {
+        unpackLsbScalar<12>(rest, dst16 + x, dst8 + x, width - x, p);
+    }
+}
+#endif // PIXELFORMAT_X86
+
+#ifdef PIXELFORMAT_NEON
+inline uint8x8_t toneNeon(uint16x8_t v, uint16x8_t black, uint16x4_t gain) {
+    const uint16x8_t d = vqsubq_u16(v, black);
+    const uint16x8_t t = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(d), gain), 16),
+                                      vshrn_n_u32(vmull_u16(vget_high_u16(d), gain), 16));
+    return vqmovn_u16(t);
+}
+
+inline void unpack16Neon(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    const uint16x8_t mask = vdupq_n_u16(p.mask);
+    const uint16x8_t black = vdupq_n_u16(p.black);
+    const uint16x4_t gain = vdup_n_u16(p.gain);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint16x8_t v = vandq_u16(vreinterpretq_u16_u8(vld1q_u8(src + 2 * x)), mask);
+        vst1q_u16(dst16 + x, v);
+        vst1_u8(dst8 + x, toneNeon(v, black, gain));
+    }
+    unpack16Scalar(src + 2 * x, dst16 + x, dst8 + x, width - x, p);
+}
+
+// 3バイトずつ振り分けて読み (vld3)、偶数画素と奇数画素を組み立ててから交互に書く (vst2)
+template <bool Gige>
+inline void unpack12Neon(const uint8_t* src, uint16_t* dst16, uint8_t* dst8, int width, const ToneParams& p) {
+    const uint16x8_t black = vdupq_n_u16(p.black);
+    const uint16x4_t gain = vdup_n_u16(p.gain);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x8x3_t b = vld3_u8(src + static_cast<size_t>(x) / 2 * 3);
+        const uint16x8_t b0 = vmovl_u8(b.val[0]);
+        const uint16x8_t b1 = vmovl_u8(b.val[1]);
+        const uint16x8_t b2 = vmovl_u8(b.val[2]);
+        uint16x8x2_t v;
+        if (Gige) {
+            v.val[0] = vorrq_u16(vshlq_n_u16(b0, 4), vandq_u16(b1, vdupq_n_u16(0x0f)));
+            v.val[1] = vorrq_u16(vshlq_n_u16(b2, 4), vshrq_n_u16(b1, 4));
+        } else {
+            v.val[0] = vorrq_u16(b0, vshlq_n_u16(vandq_u16(b1, vdupq_n_u16(0x0f)), 8));
+            v.val[1] = vorrq_u16(vshrq_n_u16(b1, 4), vshlq_n_u16(b2, 4));
+        }
+        vst2q_u16(dst16 + x, v);
+        uint8x8x2_t t;
+        t.val[0] = toneNeon(v.val[0], black, gain);
+        t.val[1] = toneNeon(v.val[1], black, gain);
+        vst2_u8(dst8 + x, t);
+    }
+    const uint8_t* rest = src + static_cast<size_t>(x) / 2 * 3;
+    if (Gige) {
+        unpackGigeScalar<12>(rest, dst16 + x, dst8 + x, width - x, p);
+    } else {
+        unpackLsbScalar<12>(rest, dst16 + x, dst8 + x, width - x, p);
+    }
+}
+#endif // PIXELFORMAT_NEON
+
+struct UnpackKernelEntry {
+    UnpackKernel kernel;
+    const char* name;
+};
+
+// Mono8 は展開しない (kernel は nullptr)。10bitの詰めた形式は使われることが少ないのでスカラーのみ
+inline UnpackKernelEntry selectUnpackKernel(SensorFormat format) {
+    switch (format) {
+    case SensorFormat::Mono8:
+        return {nullptr, "copy"};
+    case SensorFormat::Mono10p:
+        return {unpackLsbScalar<10>, "scalar"};
+    case SensorFormat::Mono10Packed:
+        return {unpackGigeScalar<10>, "scalar"};
+    default:
+        break;
+    }
+    const bool packed12 = format == SensorFormat::Mono12p || format == SensorFormat::Mono12Packed;
+#ifdef PIXELFORMAT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        if (!packed12) {
+            return {unpack16Avx2, "avx2"};
+        }
+        return {format == SensorFormat::Mono12p ? unpack12Avx2<false> : unpack12Avx2<true>, "avx2"};
+    }
+#endif
+#ifdef PIXELFORMAT_NEON
+    if (!packed12) {
+        return {unpack16Neon, "neon"};
+    }
+    return {format == SensorFormat::Mono12p ? unpack12Neon<false> : unpack12Neon<true>, "neon"};
+#endif
+    if (!packed12) {
+        return {unpack16Scalar, "scalar"};
+    }
+    return {format == SensorFormat::Mono12p ? unpackLsbScalar<12> : unpackGigeScalar<12>, "scalar"};
+}
+
+// 階調値の並びを形式どおりに詰める (合成フレーム源がカメラと同じデータを作るのに使う)
+inline void packRow(SensorFormat format, const uint16_t* src, uint8_t* dst, int width) {
+    const int bits = sensorBitDepth(format);
+    switch (format) {
+    case SensorFormat::Mono8:
+        for (int x = 0; x < width; ++x) {
+            dst[x] = static_cast<uint8_t>(src[x]);
+        }
+        break;
+    case SensorFormat::Mono10p:
+    case SensorFormat::Mono12p:
+        std::memset(dst, 0, packedRowBytes(format, width));
+        for (int x = 0; x < width; ++x) {
+            const size_t bit = static_cast<size_t>(x) * bits;
+            const uint32_t word = static_cast<uint32_t>(src[x]) << (bit % 8);
+            dst[bit / 8] |= static_cast<uint8_t>(word);
+            dst[bit / 8 + 1] |= static_cast<uint8_t>(word >> 8);
+        }
+        break;
+    case SensorFormat::Mono10Packed:
+    case SensorFormat::Mono12Packed:
+        std::memset(dst, 0, packedRowBytes(format, width));
+        for (int x = 0; x < width; ++x) {
+            uint8_t* b = dst + static_cast<size_t>(x / 2) * 3;
+            const uint32_t low = src[x] & ((1u << (bits - 8)) - 1);
+            b[x % 2 == 0 ? 0 : 2] = static_cast<uint8_t>(src[x] >> (bits - 8));
+            b[1] |= static_cast<uint8_t>(x % 2 == 0 ? low : low << 4);
+        }
+        break;
+    default:
+        for (int x = 0; x < width; ++x) {
+            dst[2 * x] = static_cast<uint8_t>(src[x]);
+            dst[2 * x + 1] = static_cast<uint8_t>(src[x] >> 8);
+        }
+        break;
+    }
+}
+
+} // namespace pixelformat_detail
+
+#endif // PIXELUNPACK_H
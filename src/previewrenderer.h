@@ -0,0 +1,182 @@
+#ifndef PREVIEWRENDERER_H
+#define PREVIEWRENDERER_H
+
+#include "downsample.h"
+#include "framequeue.h"
+#include "stagestats.h"
+
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// GUIに渡す縮小済みのプレビュー1枚分
+struct PreviewFrame {
+    QImage image;
+    int frameNumber = 0;
+    double timestamp = 0.0;
+    double temp = 0.0;
+    QRect sourceRect; // 元画像のどの範囲か (フル解像度の座標)
+    int factor = 1;   // sourceRect からの縮小率
+};
+
+// 表示用キューを消費してプレビューを作るスレッド。GUIスレッドは出来上がった小さな画像を受け取るだけ。
+// interval ごとに最新のフレームだけを縮小し、それより古いフレームは読み飛ばす。
+// ズームを有効にすると、指定した点を中心に表示サイズ分をフル解像度のまま切り出す。
+class PreviewRenderer : public QThread {
+public:
+    PreviewRenderer(FrameQueue& frames, StageStats& renderStats, QObject *parent = nullptr)
+        : QThread(parent), frames(frames), renderStats(renderStats) {}
+
+    ~PreviewRenderer() override {
+        requestInterruption();
+        wait();
+    }
+
+    void setInterval(int milliseconds) {
+        QMutexLocker locker(&settingsMutex);
+        intervalMs = std::max(1, milliseconds);
+    }
+
+    // プレビューを収める表示サイズ
+    void setTargetSize(const QSize& size) {
+        QMutexLocker locker(&settingsMutex);
+        targetSize = size;
+    }
+
+    // center はフル解像度の座標。範囲外なら画像の中心
+    void setZoom(bool enabled, const QPoint& center) {
+        QMutexLocker locker(&settingsMutex);
+        zoomEnabled = enabled;
+        zoomCenter = center;
+    }
+
+    // 前回取り出してから新しいプレビューができていれば取り出す
+    bool takeLatest(PreviewFrame& preview) {
+        QMutexLocker locker(&latestMutex);
+        if (!fresh) {
+            return false;
+        }
+        preview = latest;
+        fresh = false;
+        return true;
+    }
+
+    uint64_t renderedCount() const {
+        return rendered.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void run() override {
+        while (!isInterruptionRequested()) {
+            FrameRef frame;
+            if (!frames.pop(frame, 100)) {
+                continue;
+            }
+            // 溜まっているものは捨てて最新だけを使う
+            FrameRef newer;
+            while (frames.tryPop(newer)) {
+                frame = std::move(newer);
+            }
+            if (!frame) {
+                continue;
+            }
+
+            const uint64_t start = monotonicNs();
+            PreviewFrame preview = render(frame);
+            frame.reset();
+            renderStats.record(monotonicNs() - start);
+            {
+                QMutexLocker locker(&latestMutex);
+                latest = std::move(preview);
+                fresh = true;
+            }
+            rendered.fetch_add(1, std::memory_order_relaxed);
+
+            // 表示の更新間隔より速くは作らない (その間に来たフレームは取得スレッド側で捨てられる)
+            int interval;
+            {
+                QMutexLocker locker(&settingsMutex);
+                interval = intervalMs;
+            }
+            const uint64_t nextDueNs = start + interval * 1000000ull;
+            const uint64_t now = monotonicNs();
+            if (nextDueNs > now) {
+                QThread::usleep((nextDueNs - now) / 1000);
+            }
+        }
+    }
+
+private:
+    PreviewFrame render(const FrameRef& frame) {
+        QSize target;
+        bool zoom;
+        QPoint center;
+        {
+            QMutexLocker locker(&settingsMutex);
+            target = targetSize;
+            zoom = zoomEnabled;
+            center = zoomCenter;
+        }
+        if (target.isEmpty()) {
+            target = QSize(frame->width, frame->height);
+        }
+
+        PreviewFrame preview;
+        preview.frameNumber = frame->frameNumber;
+        preview.timestamp = frame->timestamp;
+        preview.temp = frame->temp;
+
+        if (zoom) {
+            // 表示サイズ分をそのまま切り出す
+            const int w = std::min(target.width(), frame->width);
+            const int h = std::min(target.height(), frame->height);
+            if (center.x() < 0 || center.y() < 0 || center.x() >= frame->width || center.y() >= frame->height) {
+                center = QPoint(frame->width / 2, frame->height / 2);
+            }
+            const int x = std::clamp(center.x() - w / 2, 0, frame->width - w);
+            const int y = std::clamp(center.y() - h / 2, 0, frame->height - h);
+            preview.sourceRect = QRect(x, y, w, h);
+            preview.factor = 1;
+        } else {
+            preview.factor = downsampleFactor(frame->width, frame->height, target.width(), target.height());
+            preview.sourceRect = QRect(0, 0, frame->width / preview.factor * preview.factor,
+                                       frame->height / preview.factor * preview.factor);
+        }
+
+        const int dstWidth = preview.sourceRect.width() / preview.factor;
+        const int dstHeight = preview.sourceRect.height() / preview.factor;
+        preview.image = QImage(dstWidth, dstHeight, QImage::Format_Grayscale8);
+        const uint8_t* src = frame->data + static_cast<size_t>(preview.sourceRect.y()) * frame->stride
+                             + preview.sourceRect.x();
+        boxDownsample(src, frame->stride, preview.factor, preview.image.bits(), dstWidth, dstHeight,
+                      preview.image.bytesPerLine(), scratch);
+        return preview;
+    }
+
+    FrameQueue& frames;
+    StageStats& renderStats;
+
+    QMutex settingsMutex;
+    int intervalMs = 33;
+    QSize targetSize;
+    bool zoomEnabled = false;
+    QPoint zoomCenter{-1, -1};
+
+    QMutex latestMutex;
+    PreviewFrame latest;
+    bool fresh = false;
+
+    std::vector<uint16_t> scratch; // 描画スレッドだけが触る
+    std::atomic<uint64_t> rendered{0};
+};
+
+#endif // PREVIEWRENDERER_H
@@ -0,0 +1,409 @@
+#ifndef RAWCONTAINER_H
+#define RAWCONTAINER_H
+
+// 生フレームを追記していくコンテナ形式 (.jcr) とその索引 (.jci)。
+//
+// .jcr: [ContainerHeader][FrameRecordHeader][payload][pad] [FrameRecordHeader][payload][pad] ...
+//       各レコードは64バイト境界に揃える。ファイルは作成時に segmentSize だけ確保 (posix_fallocate) し、
+//       閉じるときに実際の長さへ切り詰める。
+// .jci: IndexEntry の固定長配列。フレーム番号順に並ぶので二分探索でシークできる。
+//       索引が壊れていても .jcr はレコードヘッダをたどって読める。
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rawcontainer {
+
+constexpr char kMagic[8] = {'J', 'C', 'A', 'M', 'R', 'A', 'W', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kRecordMagic = 0x304d5246; // "FRM0"
+constexpr size_t kAlignment = 64;
+
+enum PixelFormat : uint32_t {
+    PixelMono8 = 0,
+    PixelMono16 = 1,   // 10〜16bitの階調値 (下位ビット詰め、有効ビット数は ContainerHeader::bitDepth)
+    PixelFloat32 = 2, // 解析結果のマップ (TemporalStats::exportMaps)
+};
+
+// FrameRecordHeader::flags
+constexpr uint32_t kFlagLossless = 1;  // 画素データは losslesscodec で圧縮されている
+constexpr uint32_t kFlagCorrected = 2; // 画素データはダーク/フラット補正・背景差分済み
+
+struct ContainerHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t pixelFormat;
+    uint32_t bytesPerPixel;
+    uint32_t bitDepth; // PixelMono16 の有効ビット数 (10〜16)。0 なら bytesPerPixel * 8
+    uint32_t reserved[6];
+};
+static_assert(sizeof(ContainerHeader) == 64, "ContainerHeader must be 64 bytes");
+
+struct FrameRecordHeader {
+    uint32_t magic;
+    uint32_t headerSize;
+    int64_t frameNumber;
+    double timestamp;
+    double temp;
+    uint64_t payloadSize;
+    uint32_t flags;
+    uint32_t reserved[5];
+};
+static_assert(sizeof(FrameRecordHeader) == 64, "FrameRecordHeader must be 64 bytes");
+
+struct IndexEntry {
+    int64_t frameNumber;
+    uint64_t offset;
+    double timestamp;
+};
+static_assert(sizeof(IndexEntry) == 24, "IndexEntry must be 24 bytes");
+
+// 画素の有効ビット数 (古いファイルは bitDepth が0)
+inline int bitDepth(const ContainerHeader& header) {
+    return header.bitDepth ? static_cast<int>(header.bitDepth) : static_cast<int>(header.bytesPerPixel * 8);
+}
+
+inline size_t alignUp(size_t value) {
+    return (value + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+inline std::string indexPathFor(const std::string& containerPath) {
+    const size_t dot = containerPath.rfind('.');
+    return (dot == std::string::npos ? containerPath : containerPath.substr(0, dot)) + ".jci";
+}
+
+// 1ファイル分の書き込み。スレッドセーフではない (書き込みスレッドからのみ使う)。
+class Writer {
+public:
+    Writer() = default;
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer() {
+        close();
+    }
+
+    // 失敗したらstd::runtime_errorを投げる
+    void open(const std::string& path, uint32_t width, uint32_t height, uint32_t stride,
+              uint32_t pixelFormat, uint32_t bytesPerPixel, uint64_t segmentSize, uint32_t bitDepth = 0) {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create " + path + ": " + std::strerror(errno));
+        }
+        indexFd = ::open(indexPathFor(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (indexFd < 0) {
+            const int err = errno;
+            ::close(fd);
+            fd = -1;
+            throw std::runtime_error("Failed to create index for " + path + ": " + std::strerror(err));
+        }
+
+        capacity = segmentSize;
+        // 先に領域を確保してファイルシステムの断片化とメタデータ更新を減らす (未対応なら無視)
+        if (segmentSize > 0) {
+            posix_fallocate(fd, 0, static_cast<off_t>(segmentSize));
+        }
+
+        ContainerHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.headerSize = sizeof(ContainerHeader);
+        header.width = width;
+        header.height = height;
+        header.stride = stride;
+        header.pixelFormat = pixelFormat;
+        header.bytesPerPixel = bytesPerPixel;
+        header.bitDepth = bitDepth;
+        writeAll(&header, sizeof(header));
+        offset = sizeof(header);
+        syncedOffset = 0;
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    // 次のレコードがセグメントに収まるか
+    bool fits(size_t payloadSize) const {
+        return capacity == 0 || offset + alignUp(sizeof(FrameRecordHeader) + payloadSize) <= capacity;
+    }
+
+    // ヘッダと画素データを1回のwritevで追記する。書き込んだバイト数を返す。
+    size_t append(int64_t frameNumber, double timestamp, double temp, const void* payload, size_t payloadSize,
+                  uint32_t flags = 0) {
+        FrameRecordHeader header{};
+        header.magic = kRecordMagic;
+        header.headerSize = sizeof(FrameRecordHeader);
+        header.frameNumber = frameNumber;
+        header.timestamp = timestamp;
+        header.temp = temp;
+        header.payloadSize = payloadSize;
+        header.flags = flags;
+
+        static const uint8_t padding[kAlignment] = {};
+        const size_t recordSize = alignUp(sizeof(header) + payloadSize);
+        iovec iov[3];
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = const_cast<void*>(payload);
+        iov[1].iov_len = payloadSize;
+        iov[2].iov_base = const_cast<uint8_t*>(padding);
+        iov[2].iov_len = recordSize - sizeof(header) - payloadSize;
+        writevAll(iov, 3);
+
+        IndexEntry entry{frameNumber, offset, timestamp};
+        if (::write(indexFd, &entry, sizeof(entry)) != static_cast<ssize_t>(sizeof(entry))) {
+            throw std::runtime_error(std::string("Failed to write index: ") + std::strerror(errno));
+        }
+
+        offset += recordSize;
+        // 書き出し済みの範囲はページキャッシュから追い出し、長時間記録でメモリを圧迫しないようにする
+        if (offset - syncedOffset >= kWritebackChunk) {
+            sync_file_range(fd, static_cast<off_t>(syncedOffset), static_cast<off_t>(offset - syncedOffset),
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd, static_cast<off_t>(syncedOffset), static_cast<off_t>(offset - syncedOffset),
+                          POSIX_FADV_DONTNEED);
+            syncedOffset = offset;
+        }
+        return recordSize;
+    }
+
+    // 余分に確保した領域を切り詰めて閉じる
+    void close() {
+        if (fd >= 0) {
+            if (ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+                // 切り詰めに失敗しても末尾はゼロ埋めなので読み出しには影響しない
+            }
+            fdatasync(fd);
+            ::close(fd);
+            fd = -1;
+        }
+        if (indexFd >= 0) {
+            fdatasync(indexFd);
+            ::close(indexFd);
+            indexFd = -1;
+        }
+        offset = 0;
+    }
+
+private:
+    static constexpr uint64_t kWritebackChunk = 64ull << 20;
+
+    void writeAll(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            const ssize_t written = ::write(fd, p, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to write frame: ") + std::strerror(errno));
+            }
+            p += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    void writevAll(iovec* iov, int count) {
+        while (count > 0) {
+            const ssize_t written = ::writev(fd, iov, count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to write frame: ") + std::strerror(errno));
+            }
+            size_t remaining = static_cast<size_t>(written);
+            while (count > 0 && remaining >= iov->iov_len) {
+                remaining -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + remaining;
+                iov->iov_len -= remaining;
+            }
+        }
+    }
+
+    int fd = -1;
+    int indexFd = -1;
+    uint64_t offset = 0;
+    uint64_t syncedOffset = 0;
+    uint64_t capacity = 0;
+};
+
+// mmapで開いて読む。索引 (.jci) があれば使い、なければレコードヘッダをたどって作る。
+// frame() で返すのはファイルに収まっていて、非圧縮なら1フレーム分の画素が揃ったレコードだけ
+// (クラッシュした記録の書きかけの末尾や、壊れた索引の指す先は含めない)。
+class Reader {
+public:
+    struct Frame {
+        const FrameRecordHeader* header;
+        const uint8_t* data;
+    };
+
+    explicit Reader(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ContainerHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Not a frame container: " + path);
+        }
+        mappedSize = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map " + path + ": " + std::strerror(errno));
+        }
+        base = static_cast<const uint8_t*>(mapped);
+        madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+
+        std::memcpy(&fileHeader, base, sizeof(fileHeader));
+        if (std::memcmp(fileHeader.magic, kMagic, sizeof(kMagic)) != 0 || fileHeader.version != kVersion) {
+            unmap();
+            throw std::runtime_error("Not a frame container: " + path);
+        }
+
+        if (!loadIndex(indexPathFor(path))) {
+            scanRecords();
+        }
+    }
+
+    ~Reader() {
+        unmap();
+    }
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    const ContainerHeader& header() const {
+        return fileHeader;
+    }
+
+    size_t frameCount() const {
+        return entries.size();
+    }
+
+    const std::vector<IndexEntry>& index() const {
+        return entries;
+    }
+
+    Frame frame(size_t i) const {
+        const uint8_t* record = base + entries[i].offset;
+        const FrameRecordHeader* header = reinterpret_cast<const FrameRecordHeader*>(record);
+        return Frame{header, record + header->headerSize};
+    }
+
+    // frameNumber以上の最初のフレームの位置 (二分探索)
+    size_t seek(int64_t frameNumber) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), frameNumber,
+                                   [](const IndexEntry& e, int64_t n) { return e.frameNumber < n; });
+        return static_cast<size_t>(it - entries.begin());
+    }
+
+private:
+    // 壊れた値で足し算があふれないように、残りの長さからの引き算で比べる
+    bool validRecord(uint64_t offset) const {
+        if (offset < sizeof(ContainerHeader) || offset % kAlignment != 0 || offset > mappedSize
+            || mappedSize - offset < sizeof(FrameRecordHeader)) {
+            return false;
+        }
+        const FrameRecordHeader* header = reinterpret_cast<const FrameRecordHeader*>(base + offset);
+        if (header->magic != kRecordMagic || header->headerSize < sizeof(FrameRecordHeader)
+            || header->headerSize > mappedSize - offset
+            || header->payloadSize > mappedSize - offset - header->headerSize) {
+            return false;
+        }
+        return (header->flags & kFlagLossless) || header->payloadSize >= uncompressedFrameBytes();
+    }
+
+    // 非圧縮の1フレームの大きさ (行は stride 間隔で、少なくとも width 画素分)
+    uint64_t uncompressedFrameBytes() const {
+        const uint64_t rowBytes = std::max<uint64_t>(fileHeader.stride,
+                                                     static_cast<uint64_t>(fileHeader.width) * fileHeader.bytesPerPixel);
+        return rowBytes * fileHeader.height;
+    }
+
+    bool loadIndex(const std::string& path) {
+        const int indexFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (indexFd < 0) {
+            return false;
+        }
+        struct stat st;
+        bool ok = fstat(indexFd, &st) == 0;
+        if (ok) {
+            entries.resize(static_cast<size_t>(st.st_size) / sizeof(IndexEntry));
+            const size_t bytes = entries.size() * sizeof(IndexEntry);
+            ok = ::pread(indexFd, entries.data(), bytes, 0) == static_cast<ssize_t>(bytes);
+        }
+        ::close(indexFd);
+        // 途中で落ちた記録では索引の末尾が本体より先に進んでいることがあるので、指す先を確かめる
+        while (ok && !entries.empty() && !validRecord(entries.back().offset)) {
+            entries.pop_back();
+        }
+        // 途中の項目が壊れていれば索引は使わずにレコードヘッダをたどる
+        for (size_t i = 0; ok && i < entries.size(); ++i) {
+            ok = validRecord(entries[i].offset);
+        }
+        if (!ok) {
+            entries.clear();
+        }
+        return ok;
+    }
+
+    void scanRecords() {
+        entries.clear();
+        uint64_t offset = sizeof(ContainerHeader);
+        while (validRecord(offset)) {
+            const FrameRecordHeader* header = reinterpret_cast<const FrameRecordHeader*>(base + offset);
+            entries.push_back(IndexEntry{header->frameNumber, offset, header->timestamp});
+            // validRecord でファイルに収まることは確かめてあるが、壊れた値で止まらなくならないように念を押す
+            const uint64_t advance = alignUp(header->headerSize + header->payloadSize);
+            if (advance == 0 || advance > mappedSize - offset) {
+                break;
+            }
+            offset += advance;
+        }
+    }
+
+    void unmap() {
+        if (base) {
+            munmap(const_cast<uint8_t*>(base), mappedSize);
+            base = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    int fd = -1;
+    const uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+    ContainerHeader fileHeader{};
+    std::vector<IndexEntry> entries;
+};
+
+} // namespace rawcontainer
+
+#endif // RAWCONTAINER_H
@@ -0,0 +1,179 @@
+#ifndef REDUCTIONPOOL_H
+#define REDUCTIONPOOL_H
+
+#include "cpuaffinity.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// 1フレームの集計を行ストライプに分けて並列に行うための常駐スレッド群。
+// スレッドは起動時に作って指定したコアに固定し、以後は使い回す (フレームごとのスレッド生成やタスク確保はない)。
+// parallelFor() を呼んだスレッドも自分でストライプを取って処理するので、全ワーカーが他の
+// フレームで埋まっていても処理は進む。複数のスレッドから同時に parallelFor() を呼んでよい。
+class ReductionPool {
+public:
+    // cores[i] にワーカー i を固定する (負なら固定しない)
+    explicit ReductionPool(const std::vector<int>& cores) {
+        for (int core : cores) {
+            workers.push_back(std::make_unique<Worker>(*this, core));
+        }
+        for (auto& worker : workers) {
+            worker->start(QThread::HighPriority);
+        }
+    }
+
+    ~ReductionPool() {
+        {
+            QMutexLocker locker(&mutex);
+            stopping = true;
+            workAvailable.wakeAll();
+        }
+        for (auto& worker : workers) {
+            worker->wait();
+        }
+    }
+
+    ReductionPool(const ReductionPool&) = delete;
+    ReductionPool& operator=(const ReductionPool&) = delete;
+
+    // 同時に処理できるストライプ数 (ワーカー + 呼び出し元)
+    int threadCount() const {
+        return static_cast<int>(workers.size()) + 1;
+    }
+
+    // job(0) 〜 job(count - 1) を並列に実行し、全部終わるまで待つ
+    void parallelFor(int count, const std::function<void(int)>& job) {
+        if (count <= 0) {
+            return;
+        }
+        if (count == 1 || workers.empty()) {
+            for (int i = 0; i < count; ++i) {
+                job(i);
+            }
+            return;
+        }
+        Batch batch{&job, count};
+        QMutexLocker locker(&mutex);
+        pending.push_back(&batch);
+        workAvailable.wakeAll();
+        int index;
+        while ((index = claim(batch)) >= 0) {
+            locker.unlock();
+            job(index);
+            locker.relock();
+            ++batch.done;
+        }
+        // 他のスレッドが取ったストライプの完了を待つ
+        while (batch.done < batch.count) {
+            batchFinished.wait(&mutex);
+        }
+    }
+
+    // 全パイプラインで共有するプール。最初に使う前に configureGlobal() で使うコアを決められる
+    static ReductionPool& global() {
+        static ReductionPool pool(globalCores().empty() ? defaultCores(std::vector<int>()) : globalCores());
+        return pool;
+    }
+
+    static void configureGlobal(const std::vector<int>& cores) {
+        globalCores() = cores;
+    }
+
+    // reserved (取得スレッドなど) を除いたコアに1つずつ。除くと残らない場合は固定しない1スレッド
+    static std::vector<int> defaultCores(const std::vector<int>& reserved) {
+        std::vector<int> cores;
+        const int count = std::max(1, QThread::idealThreadCount());
+        for (int core = 0; core < count; ++core) {
+            if (std::find(reserved.begin(), reserved.end(), core) == reserved.end()) {
+                cores.push_back(core);
+            }
+        }
+        if (cores.empty()) {
+            cores.push_back(-1);
+        }
+        return cores;
+    }
+
+    const std::vector<int>& pinnedCores() const {
+        return coreList;
+    }
+
+private:
+    // 1回の parallelFor() 分。呼び出し元のスタックにあり、全部の done が数えられるまで破棄されない
+    struct Batch {
+        const std::function<void(int)>* job;
+        int count;
+        int next = 0;
+        int done = 0;
+    };
+
+    class Worker : public QThread {
+    public:
+        Worker(ReductionPool& pool, int core) : pool(pool), core(core) {
+            pool.coreList.push_back(core);
+        }
+
+    protected:
+        void run() override {
+            pinCurrentThread(core);
+            pool.workerLoop();
+        }
+
+    private:
+        ReductionPool& pool;
+        int core;
+    };
+
+    static std::vector<int>& globalCores() {
+        static std::vector<int> cores;
+        return cores;
+    }
+
+    // mutex を保持した状態で呼ぶ。取り尽くしたバッチは待ち行列から外す
+    int claim(Batch& batch) {
+        if (batch.next < batch.count) {
+            const int index = batch.next++;
+            if (batch.next == batch.count) {
+                pending.erase(std::find(pending.begin(), pending.end(), &batch));
+            }
+            return index;
+        }
+        return -1;
+    }
+
+    void workerLoop() {
+        QMutexLocker locker(&mutex);
+        while (!stopping) {
+            if (pending.empty()) {
+                workAvailable.wait(&mutex);
+                continue;
+            }
+            Batch* batch = pending.front();
+            const int index = claim(*batch);
+            locker.unlock();
+            (*batch->job)(index);
+            locker.relock();
+            if (++batch->done == batch->count) {
+                batchFinished.wakeAll();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<int> coreList;
+    QMutex mutex;
+    QWaitCondition workAvailable;
+    QWaitCondition batchFinished;
+    std::deque<Batch*> pending; // mutex で保護
+    bool stopping = false;
+};
+
+#endif // REDUCTIONPOOL_H
@@ -0,0 +1,181 @@
+#ifndef REPLAYSOURCE_H
+#define REPLAYSOURCE_H
+
+#include "framesource.h"
+#include "losslesscodec.h"
+#include "pixelformat.h"
+#include "rawcontainer.h"
+#include "reductionpool.h"
+#include "stagestats.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QStringList>
+#include <QThread>
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+// 保存済みの連番BMP (saveImage の出力) のフォルダ、または記録コンテナ (.jcr) を順に読み出すフレーム源。
+// frameRate が0以下なら待たずに最大速度で読み出す。loop が真なら最後まで読んだら先頭に戻る。
+// タイムスタンプは連番BMPなら共通の基準時刻 (setEpoch) からの秒、コンテナなら記録時の値をそのまま使う。
+// Mono16 で記録したコンテナは記録時の深さの16bitの面に読み、トーンマップで8bitの面を作る。
+class ReplaySource : public FrameSource {
+public:
+    ReplaySource(const QString& directory, double frameRate, bool loop)
+        : directory(directory), frameRate(frameRate), loop(loop) {
+        if (QFileInfo(directory).isFile()) {
+            openContainer(directory);
+            return;
+        }
+        files = QDir(directory).entryList(QStringList() << "*.bmp", QDir::Files, QDir::Name);
+        if (files.isEmpty()) {
+            throw std::runtime_error("No BMP files found in replay directory.");
+        }
+        QImage first(QDir(directory).filePath(files.first()));
+        if (first.isNull()) {
+            throw std::runtime_error("Failed to read the first replay image.");
+        }
+        width = first.width();
+        height = first.height();
+        pool = std::make_unique<FramePool>(framePoolSize, width, height, width);
+    }
+
+    FrameRef captureImage() override {
+        const int count = container ? static_cast<int>(container->frameCount()) : files.size();
+        if (nextIndex >= count) {
+            if (!loop) {
+                // 再生終了。取得スレッドを空回りさせない
+                QThread::msleep(100);
+                return FrameRef();
+            }
+            nextIndex = 0;
+        }
+
+        const uint64_t now = monotonicNs();
+        if (startNs == 0) {
+            startNs = now;
+        }
+        if (frameRate > 0.0) {
+            const uint64_t due = startNs + static_cast<uint64_t>(frameIndex * 1e9 / frameRate);
+            if (due > now) {
+                QThread::usleep((due - now) / 1000);
+            }
+        }
+
+        if (container) {
+            return readContainerFrame(nextIndex++);
+        }
+
+        const QString fileName = files[nextIndex++];
+        QImage image(QDir(directory).filePath(fileName));
+        if (image.isNull() || image.width() != width || image.height() != height) {
+            std::cerr << "Skipping unreadable replay image " << fileName.toStdString() << std::endl;
+            return FrameRef();
+        }
+        if (image.format() != QImage::Format_Grayscale8) {
+            image = image.convertToFormat(QImage::Format_Grayscale8);
+        }
+
+        FrameRef frame = pool->acquire();
+        if (!frame) {
+            return FrameRef();
+        }
+        const uint64_t copyStart = monotonicNs();
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(frame->data + static_cast<size_t>(y) * frame->stride, image.constScanLine(y), width);
+        }
+        frame->copyNs = monotonicNs() - copyStart;
+        // 他のフレーム源と同じ共通の基準時刻からの秒。最大速度なら読んだ時刻
+        frame->timestamp = frameRate > 0.0 ? secondsSinceEpoch(startNs) + frameIndex / frameRate
+                                           : secondsSinceEpoch(monotonicNs());
+        frame->temp = 0.0;
+        ++frameIndex;
+        return frame;
+    }
+
+    double getFrameRate() override {
+        return frameRate > 0.0 ? frameRate : 1000.0;
+    }
+
+    int getWidth() override {
+        return width;
+    }
+
+    int getHeight() override {
+        return height;
+    }
+
+    const FramePool& framePool() const override {
+        return *pool;
+    }
+
+    SensorFormat sensorFormat() const override {
+        return unpacker ? unpacker->sensorFormat() : SensorFormat::Mono8;
+    }
+
+private:
+    static constexpr size_t framePoolSize = 24;
+
+    void openContainer(const QString& path) {
+        container = std::make_unique<rawcontainer::Reader>(path.toStdString());
+        const rawcontainer::ContainerHeader& header = container->header();
+        if ((header.pixelFormat != rawcontainer::PixelMono8 && header.pixelFormat != rawcontainer::PixelMono16)
+            || container->frameCount() == 0) {
+            throw std::runtime_error("Replay container is empty or not Mono8/Mono16.");
+        }
+        width = static_cast<int>(header.width);
+        height = static_cast<int>(header.height);
+        unpacker = std::make_unique<PixelUnpacker>(unpackedFormat(rawcontainer::bitDepth(header)));
+        pool = std::make_unique<FramePool>(framePoolSize, width, height, width, unpacker->bitDepth());
+    }
+
+    FrameRef readContainerFrame(int index) {
+        FrameRef frame = pool->acquire();
+        if (!frame) {
+            return FrameRef();
+        }
+        const rawcontainer::Reader::Frame record = container->frame(index);
+        const uint64_t copyStart = monotonicNs();
+        const int bitDepth = unpacker->bitDepth();
+        if (record.header->flags & rawcontainer::kFlagLossless) {
+            // 16bitなら data16 に復号してから、その場でトーンマップする
+            uint8_t* out = bitDepth > 8 ? reinterpret_cast<uint8_t*>(frame->data16) : frame->data;
+            const size_t outStride = bitDepth > 8 ? frame->stride16 * sizeof(uint16_t) : frame->stride;
+            if (!losslesscodec::decodeFrame(record.data, record.header->payloadSize, out, outStride, width, height,
+                                            bitDepth)) {
+                std::cerr << "Skipping corrupted compressed frame " << record.header->frameNumber << std::endl;
+                return FrameRef();
+            }
+            if (bitDepth > 8) {
+                unpacker->unpack(out, outStride, *frame, toneMap(), unpackStripes, ReductionPool::global());
+            }
+        } else {
+            unpacker->unpack(record.data, container->header().stride, *frame, toneMap(), unpackStripes,
+                             ReductionPool::global());
+        }
+        frame->copyNs = monotonicNs() - copyStart;
+        frame->timestamp = record.header->timestamp;
+        frame->temp = record.header->temp;
+        ++frameIndex;
+        return frame;
+    }
+
+    QString directory;
+    double frameRate;
+    bool loop;
+    QStringList files;
+    int nextIndex = 0;
+    int width = 0;
+    int height = 0;
+    std::unique_ptr<FramePool> pool;
+    std::unique_ptr<rawcontainer::Reader> container;
+    std::unique_ptr<PixelUnpacker> unpacker;
+    uint64_t frameIndex = 0;
+    uint64_t startNs = 0;
+};
+
+#endif // REPLAYSOURCE_H
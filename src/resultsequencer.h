@@ -0,0 +1,61 @@
+#ifndef RESULTSEQUENCER_H
+#define RESULTSEQUENCER_H
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+// 並列に処理された結果を投入順 (sequence) に並べ直して渡す。
+// sequence は0から欠番なしで振ること。先に終わった結果は前の番号がそろうまで窓に留める。
+// deliver は内部のロックを保持したまま呼ぶので、順序はスレッドをまたいでも保たれる。
+template <typename T>
+class ResultSequencer {
+public:
+    explicit ResultSequencer(std::function<void(T&)> deliver) : deliver(std::move(deliver)) {}
+
+    void complete(uint64_t sequence, T result) {
+        QMutexLocker locker(&mutex);
+        window.emplace(sequence, std::move(result));
+        const size_t held = window.size();
+        occupancy.store(held, std::memory_order_relaxed);
+        if (held > peak.load(std::memory_order_relaxed)) {
+            peak.store(held, std::memory_order_relaxed);
+        }
+
+        while (!window.empty() && window.begin()->first == next) {
+            deliver(window.begin()->second);
+            window.erase(window.begin());
+            ++next;
+            delivered.fetch_add(1, std::memory_order_relaxed);
+        }
+        occupancy.store(window.size(), std::memory_order_relaxed);
+    }
+
+    // 並べ替え待ちで留めている結果の数 (次に渡す番号の結果を含む)
+    size_t windowOccupancy() const {
+        return occupancy.load(std::memory_order_relaxed);
+    }
+
+    size_t peakOccupancy() const {
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    uint64_t deliveredCount() const {
+        return delivered.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::function<void(T&)> deliver;
+    QMutex mutex;
+    std::map<uint64_t, T> window;
+    uint64_t next = 0;
+    std::atomic<size_t> occupancy{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<uint64_t> delivered{0};
+};
+
+#endif // RESULTSEQUENCER_H
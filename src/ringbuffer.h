@@ -0,0 +1,66 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// 単一プロデューサ/単一コンシューマのロックフリーリングバッファ。容量は2のべき乗に切り上げる。
+// head/tailは別のキャッシュラインに置き、プロデューサとコンシューマが互いの書き込みで待たされないようにする。
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        slots.resize(rounded);
+        mask = rounded - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // プロデューサ側。満杯ならfalseを返し、valueは変更しない。
+    bool tryPush(const T& value) {
+        const size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[tail & mask] = value;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // コンシューマ側。空ならfalseを返す。取り出したスロットは空の値に戻して参照を残さない。
+    bool tryPop(T& value) {
+        const size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots[head & mask]);
+        slots[head & mask] = T();
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        const size_t tail = tailIndex.load(std::memory_order_acquire);
+        const size_t head = headIndex.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> headIndex{0};
+    alignas(64) std::atomic<size_t> tailIndex{0};
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,482 @@
+#ifndef SHMFRAMES_H
+#define SHMFRAMES_H
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+// 取得したフレームを同じ機械の別プロセスへ渡す POSIX 共有メモリのリング (/dev/shm/<name>)。
+// 書き手は1つ (ShmPublisher)、読み手はいくつでもよい。読み手は何も書かないので書き手を待たせない。
+// フレームのスロットと統計のエントリは seqlock で守る。書き手は書く前に sequence を奇数にし、書き終えたら
+// 偶数にする。読み手は偶数の sequence を見てから読み、読み終えても同じなら上書きされていない。
+// 書き手はフレームを書くたびに wake を増やして futex で起こすので、読み手はポーリングせずに待てる。
+// このヘッダは Qt に依存しないので、読み手のプロセスはこれだけを include すればよい。
+namespace shmframes {
+
+constexpr uint32_t kMagic = 0x4d48534a; // "JSHM"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kAlignment = 64;
+constexpr uint32_t kFlagCorrected = 2; // 補正済みのフレーム (rawcontainer::kFlagCorrected と同じ値)
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+// 共有メモリの先頭。ここから後ろの配置は作ったときから変わらない
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel; // スロットの画素の最大バイト数 (10〜16bitの形式なら2)
+    uint32_t slotCount;
+    uint32_t statsCount;
+    uint32_t writerPid;
+    uint64_t slotSize;    // スロット1つ (SlotHeader + 画素) のバイト数
+    uint64_t slotsOffset; // 先頭から最初のスロットまで
+    uint64_t statsOffset; // 先頭から最初の StatsEntry まで
+    uint64_t totalSize;
+    std::atomic<uint32_t> state;     // 1 = 書き手が動いている、0 = 閉じた
+    std::atomic<uint32_t> wake;      // フレームを書くたびに増やす (futex で待つ値)
+    std::atomic<uint64_t> published; // 書き終えたフレームの数。n 番目のフレームはスロット n % slotCount
+    uint8_t reserved[48];
+};
+static_assert(sizeof(Header) == 128, "Header must be 128 bytes");
+
+// フレームのスロット。画素は直後に stride バイトの行が height 行続く
+struct SlotHeader {
+    std::atomic<uint64_t> sequence;
+    uint64_t index;       // 何番目に書いたフレームか (Header::published の数え方)
+    int64_t frameNumber;  // 取得スレッドが振った通し番号 (キューで捨てた分は飛ぶ)
+    double timestamp;     // 共通の基準時刻からの秒
+    double temp;
+    uint64_t captureNs;   // 取得した時刻 (CLOCK_MONOTONIC [ns])。読み手の遅れを測るのに使う
+    uint32_t stride;      // 1行のバイト数
+    uint32_t bitDepth;    // 8 なら1バイト、10〜16 なら2バイト (下位詰め、リトルエンディアン) の画素
+    uint32_t flags;
+    uint32_t reserved;
+};
+static_assert(sizeof(SlotHeader) == 64, "SlotHeader must be 64 bytes");
+
+// フレームの統計 (FrameStats と同じ値)。統計はフレームより後に届くので別のリングに frameNumber で置く
+struct StatsEntry {
+    std::atomic<uint64_t> sequence;
+    int64_t frameNumber;
+    double timestamp;
+    double temp;
+    float mean;
+    float stddev;
+    float cv;
+    float p01;
+    float p50;
+    float p99;
+    float saturatedFraction;
+    float darkFraction;
+};
+static_assert(sizeof(StatsEntry) == 64, "StatsEntry must be 64 bytes");
+
+// 読み手がコピーして受け取る統計
+struct Stats {
+    int64_t frameNumber = -1;
+    double timestamp = 0.0;
+    double temp = 0.0;
+    float mean = 0.0f;
+    float stddev = 0.0f;
+    float cv = 0.0f;
+    float p01 = 0.0f;
+    float p50 = 0.0f;
+    float p99 = 0.0f;
+    float saturatedFraction = 0.0f;
+    float darkFraction = 0.0f;
+};
+
+namespace detail {
+
+inline size_t alignUp(size_t value) {
+    return (value + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+inline std::string shmName(const std::string& name) {
+    return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+inline uint64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 別プロセスと共有するので FUTEX_PRIVATE_FLAG は付けない
+inline void futexWakeAll(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+inline void futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs) {
+    timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = static_cast<long>(timeoutMs % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+// 名前の共有メモリを開いて全体を map する。writable なら読み書き。失敗したら nullptr
+inline Header* mapExisting(const std::string& name, bool writable, size_t& mappedSize) {
+    const int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    void* address = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+        mappedSize = static_cast<size_t>(st.st_size);
+        address = mmap(nullptr, mappedSize, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+    Header* header = static_cast<Header*>(address);
+    if (header->magic != kMagic || header->version != kVersion || header->totalSize > mappedSize) {
+        munmap(address, mappedSize);
+        return nullptr;
+    }
+    return header;
+}
+
+} // namespace detail
+
+// 書き手。フレームを書くスレッドと統計を書くスレッドは別でよいが、それぞれ同時に1つだけにすること
+class Writer {
+public:
+    Writer() = default;
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer() {
+        close();
+    }
+
+    // 同じ名前の古いリングは閉じたことにして読み手に知らせてから作り直す。失敗したらstd::runtime_errorを投げる
+    void create(const std::string& name, int width, int height, int bytesPerPixel, int slotCount, int statsCount) {
+        close();
+        shmName = detail::shmName(name);
+        retire(shmName);
+        const int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create shared memory " + shmName + ": " + std::strerror(errno));
+        }
+        const size_t stride = static_cast<size_t>(width) * bytesPerPixel;
+        const size_t slotSize = detail::alignUp(sizeof(SlotHeader) + stride * height);
+        const size_t slotsOffset = detail::alignUp(sizeof(Header));
+        const size_t statsOffset = slotsOffset + slotSize * slotCount;
+        mappedSize = statsOffset + sizeof(StatsEntry) * statsCount;
+        void* address = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(mappedSize)) == 0) {
+            // 最初のフレームでページフォールトが続かないように、先に全ページを割り当てる
+            address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        }
+        const int error = errno;
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            shm_unlink(shmName.c_str());
+            throw std::runtime_error("Failed to map shared memory " + shmName + ": " + std::strerror(error));
+        }
+
+        // ftruncate した領域は0で埋まっている (sequence も0 = 書き込み前)
+        header = static_cast<Header*>(address);
+        base = static_cast<uint8_t*>(address);
+        header->width = static_cast<uint32_t>(width);
+        header->height = static_cast<uint32_t>(height);
+        header->bytesPerPixel = static_cast<uint32_t>(bytesPerPixel);
+        header->slotCount = static_cast<uint32_t>(slotCount);
+        header->statsCount = static_cast<uint32_t>(statsCount);
+        header->writerPid = static_cast<uint32_t>(getpid());
+        header->slotSize = slotSize;
+        header->slotsOffset = slotsOffset;
+        header->statsOffset = statsOffset;
+        header->totalSize = mappedSize;
+        header->state.store(1, std::memory_order_relaxed);
+        header->version = kVersion;
+        // magic を最後に書く (読み手は magic を見てから残りを読む)
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kMagic;
+    }
+
+    // 読み手に閉じたことを知らせ、名前を消す (map 済みの読み手はそのまま読み終えられる)
+    void close() {
+        if (!header) {
+            return;
+        }
+        header->state.store(0, std::memory_order_release);
+        header->wake.fetch_add(1, std::memory_order_release);
+        detail::futexWakeAll(&header->wake);
+        munmap(base, mappedSize);
+        shm_unlink(shmName.c_str());
+        header = nullptr;
+        base = nullptr;
+    }
+
+    bool isOpen() const {
+        return header != nullptr;
+    }
+
+    const std::string& name() const {
+        return shmName;
+    }
+
+    // 1フレームを次のスロットに書く。src は1行 srcStride バイトで、各行の先頭 width × (bitDepth > 8 ? 2 : 1) バイトを使う
+    void publish(const uint8_t* src, size_t srcStride, int bitDepth, int64_t frameNumber, double timestamp,
+                 double temp, uint64_t captureNs, uint32_t flags) {
+        const uint64_t index = header->published.load(std::memory_order_relaxed);
+        SlotHeader* slot = reinterpret_cast<SlotHeader*>(base + header->slotsOffset + (index % header->slotCount) * header->slotSize);
+        const size_t rowBytes = static_cast<size_t>(header->width) * (bitDepth > 8 ? 2 : 1);
+
+        const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->index = index;
+        slot->frameNumber = frameNumber;
+        slot->timestamp = timestamp;
+        slot->temp = temp;
+        slot->captureNs = captureNs;
+        slot->stride = static_cast<uint32_t>(rowBytes);
+        slot->bitDepth = static_cast<uint32_t>(bitDepth);
+        slot->flags = flags;
+        uint8_t* dst = reinterpret_cast<uint8_t*>(slot + 1);
+        if (srcStride == rowBytes) {
+            std::memcpy(dst, src, rowBytes * header->height);
+        } else {
+            for (uint32_t y = 0; y < header->height; ++y) {
+                std::memcpy(dst + y * rowBytes, src + y * srcStride, rowBytes);
+            }
+        }
+        slot->sequence.store(sequence + 2, std::memory_order_release);
+
+        header->published.store(index + 1, std::memory_order_release);
+        header->wake.fetch_add(1, std::memory_order_release);
+        detail::futexWakeAll(&header->wake);
+    }
+
+    void publishStats(const Stats& stats) {
+        StatsEntry* entry = reinterpret_cast<StatsEntry*>(base + header->statsOffset)
+                            + static_cast<uint64_t>(stats.frameNumber) % header->statsCount;
+        const uint64_t sequence = entry->sequence.load(std::memory_order_relaxed);
+        entry->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry->frameNumber = stats.frameNumber;
+        entry->timestamp = stats.timestamp;
+        entry->temp = stats.temp;
+        entry->mean = stats.mean;
+        entry->stddev = stats.stddev;
+        entry->cv = stats.cv;
+        entry->p01 = stats.p01;
+        entry->p50 = stats.p50;
+        entry->p99 = stats.p99;
+        entry->saturatedFraction = stats.saturatedFraction;
+        entry->darkFraction = stats.darkFraction;
+        entry->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+private:
+    // 前に落ちた書き手が残したリングを、読み手が待ち続けないように閉じてから消す
+    static void retire(const std::string& name) {
+        size_t size = 0;
+        Header* old = detail::mapExisting(name, true, size);
+        if (old) {
+            old->state.store(0, std::memory_order_release);
+            old->wake.fetch_add(1, std::memory_order_release);
+            detail::futexWakeAll(&old->wake);
+            munmap(old, size);
+        }
+        shm_unlink(name.c_str());
+    }
+
+    std::string shmName;
+    Header* header = nullptr;
+    uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+};
+
+// 読み手。共有メモリを読むだけで何も書かないので、遅れても書き手は待たない。
+// 追いつけずに上書きされたフレームは飛ばして missedCount() に数える
+class Reader {
+public:
+    // data は共有メモリの中を直接指す。使い終わったら valid() で上書きされていないか確かめること
+    struct Frame {
+        uint64_t index = 0;
+        int64_t frameNumber = 0;
+        double timestamp = 0.0;
+        double temp = 0.0;
+        uint64_t captureNs = 0;
+        int width = 0;
+        int height = 0;
+        int stride = 0;
+        int bitDepth = 8;
+        uint32_t flags = 0;
+        const uint8_t* data = nullptr;
+        const SlotHeader* slot = nullptr;
+        uint64_t sequence = 0;
+    };
+
+    enum class Result {
+        Frame,   // frame に次のフレーム
+        Timeout, // timeoutMs の間に新しいフレームがなかった
+        Closed,  // 書き手が閉じた (開き直すと新しいリングを読める)
+    };
+
+    Reader() = default;
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    ~Reader() {
+        close();
+    }
+
+    // まだ作られていなければ false。開いた時点より後に書かれたフレームから読む
+    bool open(const std::string& name) {
+        close();
+        header = detail::mapExisting(detail::shmName(name), false, mappedSize);
+        if (!header) {
+            return false;
+        }
+        base = reinterpret_cast<const uint8_t*>(header);
+        nextIndex = header->published.load(std::memory_order_acquire);
+        missed = 0;
+        return true;
+    }
+
+    void close() {
+        if (header) {
+            munmap(const_cast<Header*>(header), mappedSize);
+            header = nullptr;
+            base = nullptr;
+        }
+    }
+
+    bool isOpen() const {
+        return header != nullptr;
+    }
+
+    const Header& info() const {
+        return *header;
+    }
+
+    bool writerAlive() const {
+        return header->state.load(std::memory_order_acquire) == 1;
+    }
+
+    uint64_t missedCount() const {
+        return missed;
+    }
+
+    // 次のフレームを待つ。timeoutMs が0なら待たない
+    Result next(Frame& frame, int timeoutMs) {
+        const uint64_t deadline = detail::monotonicNs() + static_cast<uint64_t>(timeoutMs) * 1000000ull;
+        const uint64_t slotCount = header->slotCount;
+        for (;;) {
+            // wake を published より先に読む (間に書かれたら futexWait はすぐ戻る)
+            const uint32_t wake = header->wake.load(std::memory_order_acquire);
+            const uint64_t published = header->published.load(std::memory_order_acquire);
+            if (nextIndex < published) {
+                // 書き手が次に書くスロットは published - slotCount 番目のフレームのもの。それより新しいものだけ読める
+                if (published - nextIndex >= slotCount) {
+                    missed += published - slotCount + 1 - nextIndex;
+                    nextIndex = published - slotCount + 1;
+                }
+                if (readSlot(nextIndex++, frame)) {
+                    return Result::Frame;
+                }
+                ++missed;
+                continue;
+            }
+            if (header->state.load(std::memory_order_acquire) != 1) {
+                return Result::Closed;
+            }
+            const uint64_t now = detail::monotonicNs();
+            if (now >= deadline) {
+                return Result::Timeout;
+            }
+            detail::futexWait(const_cast<std::atomic<uint32_t>*>(&header->wake), wake,
+                              static_cast<int>((deadline - now + 999999) / 1000000));
+        }
+    }
+
+    // frame.data を読み終えた時点で、まだ上書きされていなければ true
+    bool valid(const Frame& frame) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return frame.slot->sequence.load(std::memory_order_relaxed) == frame.sequence;
+    }
+
+    // 画素を dst (1行 frame.stride バイト) にコピーする。途中で上書きされたら false
+    bool copy(const Frame& frame, void* dst) const {
+        std::memcpy(dst, frame.data, static_cast<size_t>(frame.stride) * frame.height);
+        return valid(frame);
+    }
+
+    // frameNumber の統計。まだ届いていないか、もう上書きされていれば false
+    bool stats(int64_t frameNumber, Stats& out) const {
+        const StatsEntry* entry = reinterpret_cast<const StatsEntry*>(base + header->statsOffset)
+                                  + static_cast<uint64_t>(frameNumber) % header->statsCount;
+        const uint64_t sequence = entry->sequence.load(std::memory_order_acquire);
+        if (sequence == 0 || (sequence & 1)) {
+            return false;
+        }
+        out.frameNumber = entry->frameNumber;
+        out.timestamp = entry->timestamp;
+        out.temp = entry->temp;
+        out.mean = entry->mean;
+        out.stddev = entry->stddev;
+        out.cv = entry->cv;
+        out.p01 = entry->p01;
+        out.p50 = entry->p50;
+        out.p99 = entry->p99;
+        out.saturatedFraction = entry->saturatedFraction;
+        out.darkFraction = entry->darkFraction;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return entry->sequence.load(std::memory_order_relaxed) == sequence && out.frameNumber == frameNumber;
+    }
+
+private:
+    bool readSlot(uint64_t index, Frame& frame) const {
+        const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(
+            base + header->slotsOffset + (index % header->slotCount) * header->slotSize);
+        const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            return false;
+        }
+        frame.index = slot->index;
+        frame.frameNumber = slot->frameNumber;
+        frame.timestamp = slot->timestamp;
+        frame.temp = slot->temp;
+        frame.captureNs = slot->captureNs;
+        frame.width = static_cast<int>(header->width);
+        frame.height = static_cast<int>(header->height);
+        frame.stride = static_cast<int>(slot->stride);
+        frame.bitDepth = static_cast<int>(slot->bitDepth);
+        frame.flags = slot->flags;
+        frame.data = reinterpret_cast<const uint8_t*>(slot + 1);
+        frame.slot = slot;
+        frame.sequence = sequence;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot->sequence.load(std::memory_order_relaxed) == sequence && frame.index == index;
+    }
+
+    const Header* header = nullptr;
+    const uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+    uint64_t nextIndex = 0;
+    uint64_t missed = 0;
+};
+
+} // namespace shmframes
+
+#endif // SHMFRAMES_H
@@ -0,0 +1,108 @@
+#ifndef SHMPUBLISHER_H
+#define SHMPUBLISHER_H
+
+#include "framequeue.h"
+#include "framestats.h"
+#include "shmframes.h"
+#include "stagestats.h"
+
+#include <QString>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// 取得したフレームを共有メモリのリング (shmframes) に書き出すスレッド。同じ機械の別プロセスが読む。
+// 取得スレッドから有界キューで受け取るので、書き出しが遅れても取得は待たない (あふれた分は捨てて数える)。
+// 読み手は共有メモリを読むだけなので、読み手が遅くてもこちらも待たない。
+// 10〜16bitの形式は階調値そのまま (2バイト) を、補正済みのフレームは補正した8bitの面を書く。
+class ShmPublisher : public QThread {
+public:
+    explicit ShmPublisher(StageStats& publishStats, QObject *parent = nullptr)
+        : QThread(parent), publishStats(publishStats), frames(queueCapacity) {}
+
+    ~ShmPublisher() override {
+        requestInterruption();
+        wait();
+        writer.close();
+    }
+
+    // 共有メモリを作る。start() より前に呼ぶ。失敗したらstd::runtime_errorを投げる
+    void open(const QString& name, int width, int height, int bitDepth, int slots) {
+        writer.create(name.toStdString(), width, height, bitDepth > 8 ? 2 : 1, std::max(2, slots), statsCapacity);
+    }
+
+    bool isOpen() const {
+        return writer.isOpen();
+    }
+
+    QString name() const {
+        return QString::fromStdString(writer.name());
+    }
+
+    FrameQueue& queue() {
+        return frames;
+    }
+
+    const FrameQueue& queue() const {
+        return frames;
+    }
+
+    // フレーム順に並べ直した統計 (FramePipeline::deliverResult から直列に呼ばれる)
+    void publishFrameStats(const FrameStats& stats) {
+        if (!writer.isOpen()) {
+            return;
+        }
+        shmframes::Stats out;
+        out.frameNumber = stats.frameNumber;
+        out.timestamp = stats.timestamp;
+        out.temp = stats.temp;
+        out.mean = stats.mean;
+        out.stddev = stats.stddev;
+        out.cv = stats.cv;
+        out.p01 = stats.p01;
+        out.p50 = stats.p50;
+        out.p99 = stats.p99;
+        out.saturatedFraction = stats.saturatedFraction;
+        out.darkFraction = stats.darkFraction;
+        writer.publishStats(out);
+    }
+
+    uint64_t publishedCount() const {
+        return published.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void run() override {
+        while (!isInterruptionRequested()) {
+            FrameRef frame;
+            if (!frames.pop(frame, 100) || !frame || !writer.isOpen()) {
+                continue;
+            }
+
+            const uint64_t start = monotonicNs();
+            // 補正済みのフレームは8bitの面だけが有効
+            const bool wide = frame->bitDepth > 8 && !frame->corrected;
+            const uint8_t* data = wide ? reinterpret_cast<const uint8_t*>(frame->data16) : frame->data;
+            const size_t stride = wide ? static_cast<size_t>(frame->stride16) * 2 : static_cast<size_t>(frame->stride);
+            writer.publish(data, stride, wide ? frame->bitDepth : 8, frame->frameNumber, frame->timestamp, frame->temp,
+                           frame->captureTimeNs, frame->corrected ? shmframes::kFlagCorrected : 0);
+            frame.reset();
+            publishStats.record(monotonicNs() - start);
+            published.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static constexpr size_t queueCapacity = 4;
+    static constexpr int statsCapacity = 256; // 統計は数十フレーム遅れて届くので、スロットより多めに持つ
+
+    StageStats& publishStats;
+    FrameQueue frames;
+    shmframes::Writer writer;
+    std::atomic<uint64_t> published{0};
+};
+
+#endif // SHMPUBLISHER_H
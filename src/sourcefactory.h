@@ -0,0 +1,65 @@
+#ifndef SOURCEFACTORY_H
+#define SOURCEFACTORY_H
+
+#include "camerahandler.h"
+#include "framesource.h"
+#include "replaysource.h"
+#include "syntheticsource.h"
+
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// フレーム源の選び方。GUIはコマンドラインから、デーモンは設定ファイルから埋める。
+// synthetic も replay も空ならSpinnakerカメラを使う。
+struct SourceConfig {
+    QString synthetic;         // WxH[@fps]
+    double noise = 10.0;
+    double drift = 0.0;
+    SensorFormat format = SensorFormat::Mono8; // 合成フレーム源の画素形式 (カメラは SpinView の設定に従う)
+    QStringList replay;        // 1つにつき1台
+    double replayFps = 30.0;
+    bool loop = false;
+    int cameras = 1;           // 0 = 接続されている全カメラ
+    CameraHandler::TelemetryRates rates;
+    CameraHandler::ReconnectPolicy reconnect;
+    ToneMap toneMap;           // 10〜16bitの形式を8bitの面にする範囲
+};
+
+inline std::vector<std::unique_ptr<FrameSource>> createFrameSources(const SourceConfig& config) {
+    std::vector<std::unique_ptr<FrameSource>> sources;
+    if (!config.synthetic.isEmpty()) {
+        SyntheticSource::Settings settings;
+        if (!parseSyntheticSpec(config.synthetic, settings)) {
+            throw std::runtime_error("Invalid synthetic source. Use WxH or WxH@fps.");
+        }
+        settings.noise = config.noise;
+        settings.drift = config.drift;
+        settings.format = config.format;
+        for (int i = 0; i < std::max(1, config.cameras); ++i) {
+            settings.seed = static_cast<unsigned>(2 * i + 1); // カメラごとに別の雑音にする
+            sources.push_back(std::make_unique<SyntheticSource>(settings));
+            sources.back()->setToneMap(config.toneMap);
+        }
+        return sources;
+    }
+    if (!config.replay.isEmpty()) {
+        for (const QString& path : config.replay) {
+            sources.push_back(std::make_unique<ReplaySource>(path, config.replayFps, config.loop));
+            sources.back()->setToneMap(config.toneMap);
+        }
+        return sources;
+    }
+    const int count = config.cameras > 0 ? config.cameras : std::max(1, CameraHandler::cameraCount());
+    for (int i = 0; i < count; ++i) {
+        sources.push_back(std::make_unique<CameraHandler>(i, config.rates, config.reconnect));
+        sources.back()->setToneMap(config.toneMap);
+    }
+    return sources;
+}
+
+#endif // SOURCEFACTORY_H
@@ -0,0 +1,160 @@
+#ifndef STAGESTATS_H
+#define STAGESTATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+inline uint64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 処理時間 [ns] の分布を対数-線形のバケットで数えるヒストグラム。
+// 2の冪ごとの区間を kSubBuckets 等分するので、どの値でも相対誤差は 1/kSubBuckets 以下。
+// カウンタはスレッドごとの区画 (シャード) に分け、ロックなし・relaxed の加算だけで記録する。
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxExponent = 40; // 2^40 ns (約18分) 以上は最後のバケットに入れる
+    static constexpr int kBucketCount = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+    static constexpr int kShards = 4;
+
+    using Snapshot = std::array<uint64_t, kBucketCount>;
+
+    static int bucketIndex(uint64_t ns) {
+        if (ns < static_cast<uint64_t>(kSubBuckets)) {
+            return static_cast<int>(ns);
+        }
+        int exponent = 63 - __builtin_clzll(ns);
+        if (exponent > kMaxExponent) {
+            return kBucketCount - 1;
+        }
+        const int shift = exponent - kSubBucketBits;
+        return (shift + 1) * kSubBuckets + static_cast<int>((ns >> shift) & (kSubBuckets - 1));
+    }
+
+    // バケットに入る値の上限 [ns]
+    static uint64_t bucketUpperBound(int index) {
+        if (index < kSubBuckets) {
+            return static_cast<uint64_t>(index);
+        }
+        const int shift = index / kSubBuckets - 1;
+        const uint64_t lower = static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+
+    void record(uint64_t ns) {
+        shards[shardIndex()].counts[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 全シャードの合計。記録と並行して読んでよい (数件のずれは許容する)
+    Snapshot snapshot() const {
+        Snapshot total{};
+        for (const Shard& shard : shards) {
+            for (int i = 0; i < kBucketCount; ++i) {
+                total[i] += shard.counts[i].load(std::memory_order_relaxed);
+            }
+        }
+        return total;
+    }
+
+    // later - earlier (区間内の分布)
+    static Snapshot difference(const Snapshot& later, const Snapshot& earlier) {
+        Snapshot result;
+        for (int i = 0; i < kBucketCount; ++i) {
+            result[i] = later[i] >= earlier[i] ? later[i] - earlier[i] : 0;
+        }
+        return result;
+    }
+
+    static uint64_t count(const Snapshot& counts) {
+        uint64_t n = 0;
+        for (uint64_t c : counts) {
+            n += c;
+        }
+        return n;
+    }
+
+    // q (0〜1) 分位点 [ns]。バケットの上限で返すので実際より最大 1/kSubBuckets だけ大きい
+    static uint64_t percentileNs(const Snapshot& counts, double q) {
+        const uint64_t n = count(counts);
+        if (n == 0) {
+            return 0;
+        }
+        const uint64_t rank = static_cast<uint64_t>(q * (n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBucketCount; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return bucketUpperBound(i);
+            }
+        }
+        return bucketUpperBound(kBucketCount - 1);
+    }
+
+private:
+    // 同じキャッシュラインを複数スレッドで奪い合わないように区画を分ける
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kBucketCount> counts{};
+    };
+
+    // スレッドごとに最初の記録時に区画を割り当てる
+    static int shardIndex() {
+        static std::atomic<unsigned> nextShard{0};
+        thread_local const int index = static_cast<int>(nextShard.fetch_add(1, std::memory_order_relaxed) % kShards);
+        return index;
+    }
+
+    std::array<Shard, kShards> shards;
+};
+
+// パイプラインの1段分の処理時間の集計 (回数・合計・最大と分布)
+struct StageStats {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+    LatencyHistogram histogram;
+
+    void record(uint64_t ns) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalNs.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t current = maxNs.load(std::memory_order_relaxed);
+        while (ns > current && !maxNs.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+        }
+        histogram.record(ns);
+    }
+
+    double meanMs() const {
+        const uint64_t n = count.load(std::memory_order_relaxed);
+        return n ? totalNs.load(std::memory_order_relaxed) / 1e6 / n : 0.0;
+    }
+
+    double maxMs() const {
+        return maxNs.load(std::memory_order_relaxed) / 1e6;
+    }
+
+    // 起動からの q 分位点 [ms]
+    double percentileMs(double q) const {
+        return LatencyHistogram::percentileNs(histogram.snapshot(), q) / 1e6;
+    }
+};
+
+struct PipelineTimings {
+    StageStats capture;     // captureImage 全体
+    StageStats captureWait; // captureImage のうちフレームが届くまでの待ち
+    StageStats copy;        // captureImage のうちプールのバッファへの書き込み
+    StageStats correct;     // ダーク/フラット補正・背景差分 (取得スレッド)
+    StageStats queueWait;   // 取得から統計処理開始まで
+    StageStats stats;       // 統計計算
+    StageStats preview;     // プレビューの縮小
+    StageStats display;     // GUIスレッドでのプレビューの貼り付け
+    StageStats record;      // 画像保存 (ディスクへの書き込み)
+    StageStats temporal;    // 画素ごとの時間方向の統計の更新
+    StageStats publish;     // 共有メモリへの書き出し
+    StageStats log;         // グラフデータの書き出し
+};
+
+#endif // STAGESTATS_H
@@ -0,0 +1,229 @@
+#ifndef STATSPLAN_H
+#define STATSPLAN_H
+
+#include "cpu_process.h"
+#include "framestats.h"
+#include "histogram.h"
+#include "reductionpool.h"
+#include "stagestats.h"
+#include "tilestats.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+// フレーム全体のヒストグラムを stripes 本の行ストライプに分けて pool で並列に数える
+inline void calculateFrameHistogram(const uint8_t* data, int width, int height, int stride,
+                                    int stripes, ReductionPool& pool, Histogram256& histogram) {
+    stripes = std::max(1, std::min(stripes, height));
+    if (stripes == 1 && stride == width) {
+        accumulateHistogram(data, static_cast<size_t>(width) * height, histogram);
+        return;
+    }
+    std::vector<SubHistogram> partial(stripes);
+    pool.parallelFor(stripes, [&](int i) {
+        const int y0 = static_cast<int>(static_cast<int64_t>(i) * height / stripes);
+        const int y1 = static_cast<int>(static_cast<int64_t>(i + 1) * height / stripes);
+        if (stride == width) {
+            partial[i].add(data + static_cast<size_t>(y0) * stride, static_cast<size_t>(y1 - y0) * width);
+            return;
+        }
+        for (int y = y0; y < y1; ++y) {
+            partial[i].add(data + static_cast<size_t>(y) * stride, width);
+        }
+    });
+    for (const SubHistogram& sub : partial) {
+        sub.mergeInto(histogram);
+    }
+}
+
+// 10〜16bitのフレーム (stride は画素数)
+inline void calculateFrameHistogram(const uint16_t* data, int width, int height, int stride,
+                                    int stripes, ReductionPool& pool, Histogram16& histogram) {
+    stripes = std::max(1, std::min(stripes, height));
+    std::vector<SubHistogram16> partial(stripes, SubHistogram16(histogram.bitDepth));
+    pool.parallelFor(stripes, [&](int i) {
+        const int y0 = static_cast<int>(static_cast<int64_t>(i) * height / stripes);
+        const int y1 = static_cast<int>(static_cast<int64_t>(i + 1) * height / stripes);
+        if (stride == width) {
+            partial[i].add(data + static_cast<size_t>(y0) * stride, static_cast<size_t>(y1 - y0) * width);
+            return;
+        }
+        for (int y = y0; y < y1; ++y) {
+            partial[i].add(data + static_cast<size_t>(y) * stride, width);
+        }
+    });
+    for (const SubHistogram16& sub : partial) {
+        sub.mergeInto(histogram);
+    }
+}
+
+// 解像度ごとに選んだ統計処理の分け方。起動時に実測して決める (tuneStatsPlan)
+struct StatsPlan {
+    int frameStripes = 1;     // 全体統計のストライプ数 (1 = 呼び出したスレッドだけで処理)
+    int tileStripes = 1;      // タイル/ROI統計のストライプ数
+    bool simdTiles = true;    // タイル/ROIの総和にSIMDカーネルを使うか
+    double frameMs = 0.0;     // 選んだ分け方での1フレームの処理時間
+    double tileMs = 0.0;
+    double frameSerialMs = 0.0; // 1スレッドのときの処理時間 (比較用)
+    double tileSerialMs = 0.0;
+
+    cpu_process_detail::MomentsKernel tileKernel() const {
+        return simdTiles ? cpu_process_detail::momentsKernel().kernel : cpu_process_detail::momentsScalar;
+    }
+};
+
+namespace statsplan_detail {
+
+// 関数を数回動かして中央値 [ms] を返す (最初の1回は捨てる)
+template <typename Function>
+double measureMs(Function function, int repeats) {
+    function();
+    std::vector<double> times;
+    for (int i = 0; i < repeats; ++i) {
+        const uint64_t start = monotonicNs();
+        function();
+        times.push_back((monotonicNs() - start) / 1e6);
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// 試すストライプ数: 1, 2, 4, ... 同時に動けるスレッド数の2倍まで
+inline std::vector<int> stripeCandidates(int threads, int height) {
+    std::vector<int> candidates;
+    for (int stripes = 1; stripes <= std::max(1, threads * 2) && stripes <= height; stripes *= 2) {
+        candidates.push_back(stripes);
+    }
+    return candidates;
+}
+
+} // namespace statsplan_detail
+
+// width x height のフレームについて、1スレッド/行ストライプの並列、スカラー/SIMD の組み合わせを
+// 合成画像で実測し、最も速いものを返す。同じ解像度は一度だけ測る。選んだ結果は標準出力に出す。
+inline StatsPlan tuneStatsPlan(int width, int height, ReductionPool& pool = ReductionPool::global()) {
+    static QMutex mutex;
+    static std::map<std::pair<int, int>, StatsPlan> plans;
+    QMutexLocker locker(&mutex);
+    const auto found = plans.find({width, height});
+    if (found != plans.end()) {
+        return found->second;
+    }
+
+    // 実際の画像に近い、中間調に雑音をのせた画像
+    std::vector<uint8_t> frame(static_cast<size_t>(width) * height);
+    std::minstd_rand rng(1);
+    std::normal_distribution<double> noise(128.0, 20.0);
+    for (uint8_t& v : frame) {
+        v = static_cast<uint8_t>(std::clamp(noise(rng), 0.0, 255.0));
+    }
+    TileLayout layout;
+    layout.columns = 16;
+    layout.rows = 16;
+
+    const int repeats = 5;
+    StatsPlan plan;
+    plan.frameMs = plan.tileMs = 1e300;
+    const std::vector<int> candidates = statsplan_detail::stripeCandidates(pool.threadCount(), height);
+    for (int stripes : candidates) {
+        const double ms = statsplan_detail::measureMs([&]() {
+            Histogram256 histogram;
+            calculateFrameHistogram(frame.data(), width, height, width, stripes, pool, histogram);
+        }, repeats);
+        if (stripes == 1) {
+            plan.frameSerialMs = ms;
+        }
+        if (ms < plan.frameMs) {
+            plan.frameMs = ms;
+            plan.frameStripes = stripes;
+        }
+    }
+    const bool simdAvailable = cpu_process_detail::momentsKernel().kernel != cpu_process_detail::momentsScalar;
+    for (int simd = simdAvailable ? 1 : 0; simd >= 0; --simd) {
+        for (int stripes : candidates) {
+            StatsPlan variant;
+            variant.simdTiles = simd != 0;
+            const double ms = statsplan_detail::measureMs([&]() {
+                Histogram256 histogram;
+                TileMap map;
+                calculateTileMap(frame.data(), width, height, width, layout, histogram, map, stripes, pool,
+                                 variant.tileKernel());
+            }, repeats);
+            if (stripes == 1 && !variant.simdTiles) {
+                plan.tileSerialMs = ms;
+            }
+            if (ms < plan.tileMs) {
+                plan.tileMs = ms;
+                plan.tileStripes = stripes;
+                plan.simdTiles = variant.simdTiles;
+            }
+        }
+    }
+
+    std::cout << "Statistics plan " << width << "x" << height << " (" << pool.threadCount() << " threads): "
+              << "frame " << plan.frameStripes << " stripes " << plan.frameMs << " ms (1 thread "
+              << plan.frameSerialMs << " ms), tiles " << plan.tileStripes << " stripes "
+              << (plan.simdTiles ? momentsKernelName() : "scalar") << " " << plan.tileMs
+              << " ms (1 thread scalar " << plan.tileSerialMs << " ms)" << std::endl;
+    plans[{width, height}] = plan;
+    return plan;
+}
+
+namespace statsplan_detail {
+
+inline void checkFinite(FrameStats& stats) {
+    if (!std::isfinite(stats.mean) || !std::isfinite(stats.stddev) || !std::isfinite(stats.cv)) {
+        stats.mean = 0.0f;
+        stats.stddev = 0.0f;
+        stats.cv = 0.0f;
+        std::cerr << "Invalid value detected at frame " << stats.frameNumber << std::endl;
+    }
+}
+
+} // namespace statsplan_detail
+
+// 1フレーム分の統計 (resultProcessing とオフラインの再処理で共通)。layout があればタイル/ROI統計も
+// 全体ヒストグラムと同じ1パスで求めて map に入れ、true を返す。stats.frameNumber などは呼び出し側で入れる。
+// 集計は整数なので、ストライプの分け方やSIMDの有無によらず結果は同じになる。
+inline bool analyzeFrame(const uint8_t* data, int width, int height, int stride, const TileLayout* layout,
+                         const StatsPlan& plan, ReductionPool& pool, FrameStats& stats, TileMap& map) {
+    Histogram256 histogram;
+    if (layout) {
+        calculateTileMap(data, width, height, stride, *layout, histogram, map, plan.tileStripes, pool,
+                         plan.tileKernel());
+        map.frameNumber = stats.frameNumber;
+    } else {
+        calculateFrameHistogram(data, width, height, stride, plan.frameStripes, pool, histogram);
+    }
+    fillFrameStats(histogram, stats);
+    statsplan_detail::checkFinite(stats);
+    return layout != nullptr;
+}
+
+// 10〜16bitのフレーム (stride は画素数)。ストライプ数は Mono8 で選んだものを使い、総和は常にSIMD
+inline bool analyzeFrame(const uint16_t* data, int width, int height, int stride, int bitDepth,
+                         const TileLayout* layout, const StatsPlan& plan, ReductionPool& pool, FrameStats& stats,
+                         TileMap& map) {
+    Histogram16 histogram(bitDepth);
+    if (layout) {
+        calculateTileMap(data, width, height, stride, *layout, histogram, map, plan.tileStripes, pool);
+        map.frameNumber = stats.frameNumber;
+    } else {
+        calculateFrameHistogram(data, width, height, stride, plan.frameStripes, pool, histogram);
+    }
+    fillFrameStats(histogram, stats);
+    statsplan_detail::checkFinite(stats);
+    return layout != nullptr;
+}
+
+#endif // STATSPLAN_H
@@ -0,0 +1,190 @@
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include "framesource.h"
+#include "pixelformat.h"
+#include "reductionpool.h"
+#include "stagestats.h"
+
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+// カメラなしでパイプラインを動かすための合成フレーム源。
+// 平均輝度 level にガウス雑音 (標準偏差 noise) を加え、平均は drift [階調/秒] で時間とともに変化させる。
+// frameRate が0以下なら待たずに最大速度で生成する。
+// format が Mono8 以外なら、カメラと同じ詰め方のフレームを起動時に数枚作っておき、毎フレームそれを展開する
+// (展開の負荷をカメラなしで測るため。level と noise は8bitの階調で指定し、drift は効かない)。
+class SyntheticSource : public FrameSource {
+public:
+    struct Settings {
+        int width = 2448;
+        int height = 2048;
+        double frameRate = 60.0;
+        double level = 128.0;
+        double noise = 10.0;
+        double drift = 0.0;
+        unsigned seed = 1;
+        SensorFormat format = SensorFormat::Mono8;
+    };
+
+    explicit SyntheticSource(const Settings& settings)
+        : settings(settings),
+          unpacker(settings.format),
+          pool(std::make_unique<FramePool>(framePoolSize, settings.width, settings.height, settings.width,
+                                           unpacker.bitDepth())) {
+        // 雑音は起動時にまとめて作り、フレームごとに読み出し位置をずらして使う。noise が0以下なら雑音なし
+        // (normal_distribution は標準偏差が正でないと使えない)
+        const size_t frameSize = static_cast<size_t>(settings.width) * settings.height;
+        noiseTable.assign(frameSize + noiseWindow, 0);
+        if (settings.noise > 0.0) {
+            std::mt19937 rng(settings.seed);
+            std::normal_distribution<double> gaussian(0.0, settings.noise);
+            for (int16_t& v : noiseTable) {
+                v = static_cast<int16_t>(std::lround(std::clamp(gaussian(rng), -255.0, 255.0)));
+            }
+        }
+        offsetRng.seed(settings.seed + 1);
+        if (settings.format != SensorFormat::Mono8) {
+            makePackedFrames();
+        }
+    }
+
+    FrameRef captureImage() override {
+        if (settings.frameRate > 0.0) {
+            // 目標時刻まで待つ
+            const uint64_t due = startNs + static_cast<uint64_t>(frameIndex * 1e9 / settings.frameRate);
+            const uint64_t now = monotonicNs();
+            if (startNs == 0) {
+                startNs = now;
+            } else if (due > now) {
+                QThread::usleep((due - now) / 1000);
+            }
+        } else if (startNs == 0) {
+            startNs = monotonicNs();
+        }
+
+        FrameRef frame = pool->acquire();
+        if (!frame) {
+            ++frameIndex;
+            return FrameRef();
+        }
+
+        const double seconds = settings.frameRate > 0.0 ? frameIndex / settings.frameRate
+                                                        : (monotonicNs() - startNs) / 1e9;
+        if (!packedFrames.empty()) {
+            const std::vector<uint8_t>& packed = packedFrames[frameIndex % packedFrames.size()];
+            const uint64_t copyStart = monotonicNs();
+            unpacker.unpack(packed.data(), packedStride, *frame, toneMap(), unpackStripes, ReductionPool::global());
+            frame->copyNs = monotonicNs() - copyStart;
+            frame->timestamp = secondsSinceEpoch(startNs) + seconds;
+            frame->temp = 40.0 + 0.001 * seconds;
+            ++frameIndex;
+            return frame;
+        }
+        const int level = static_cast<int>(std::lround(settings.level + settings.drift * seconds));
+        const int16_t* noise = noiseTable.data() + offsetRng() % noiseWindow;
+        const size_t frameSize = static_cast<size_t>(frame->width) * frame->height;
+        uint8_t* out = frame->data;
+        const uint64_t copyStart = monotonicNs();
+        for (size_t i = 0; i < frameSize; ++i) {
+            const int v = level + noise[i];
+            out[i] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+        frame->copyNs = monotonicNs() - copyStart;
+
+        frame->timestamp = secondsSinceEpoch(startNs) + seconds;
+        frame->temp = 40.0 + 0.001 * seconds;
+        ++frameIndex;
+        return frame;
+    }
+
+    double getFrameRate() override {
+        return settings.frameRate > 0.0 ? settings.frameRate : 1000.0;
+    }
+
+    int getWidth() override {
+        return settings.width;
+    }
+
+    int getHeight() override {
+        return settings.height;
+    }
+
+    const FramePool& framePool() const override {
+        return *pool;
+    }
+
+    SensorFormat sensorFormat() const override {
+        return settings.format;
+    }
+
+    const char* unpackKernelName() const {
+        return unpacker.kernelName();
+    }
+
+private:
+    // 8bitの level と noise を形式の最大値に合わせて広げ、雑音表の別々の位置から数枚作る
+    void makePackedFrames() {
+        const int maxValue = (1 << unpacker.bitDepth()) - 1;
+        const double scale = maxValue / 255.0;
+        packedStride = packedRowBytes(settings.format, settings.width);
+        std::vector<uint16_t> row(settings.width);
+        packedFrames.resize(packedFrameCount);
+        for (size_t i = 0; i < packedFrameCount; ++i) {
+            std::vector<uint8_t>& packed = packedFrames[i];
+            packed.resize(packedStride * settings.height);
+            const int16_t* noise = noiseTable.data() + offsetRng() % noiseWindow;
+            for (int y = 0; y < settings.height; ++y) {
+                for (int x = 0; x < settings.width; ++x) {
+                    const double v = (settings.level + noise[static_cast<size_t>(y) * settings.width + x]) * scale;
+                    row[x] = static_cast<uint16_t>(std::clamp(std::lround(v), 0L, static_cast<long>(maxValue)));
+                }
+                pixelformat_detail::packRow(settings.format, row.data(), packed.data() + y * packedStride,
+                                            settings.width);
+            }
+        }
+    }
+
+    static constexpr size_t framePoolSize = 24;
+    static constexpr size_t noiseWindow = 65536;
+    static constexpr size_t packedFrameCount = 4;
+
+    Settings settings;
+    PixelUnpacker unpacker;
+    std::unique_ptr<FramePool> pool;
+    std::vector<int16_t> noiseTable;
+    std::minstd_rand offsetRng;
+    std::vector<std::vector<uint8_t>> packedFrames;
+    size_t packedStride = 0;
+    uint64_t frameIndex = 0;
+    uint64_t startNs = 0;
+};
+
+// "WxH" または "WxH@fps" 形式の指定を解釈する
+inline bool parseSyntheticSpec(const QString& spec, SyntheticSource::Settings& settings) {
+    const QStringList rateParts = spec.split('@');
+    const QStringList sizeParts = rateParts[0].split('x');
+    if (sizeParts.size() != 2 || rateParts.size() > 2) {
+        return false;
+    }
+    bool okWidth, okHeight, okRate = true;
+    const int width = sizeParts[0].toInt(&okWidth);
+    const int height = sizeParts[1].toInt(&okHeight);
+    const double rate = rateParts.size() == 2 ? rateParts[1].toDouble(&okRate) : settings.frameRate;
+    if (!okWidth || !okHeight || !okRate || width <= 0 || height <= 0) {
+        return false;
+    }
+    settings.width = width;
+    settings.height = height;
+    settings.frameRate = rate;
+    return true;
+}
+
+#endif // SYNTHETICSOURCE_H
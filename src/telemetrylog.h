@@ -0,0 +1,333 @@
+#ifndef TELEMETRYLOG_H
+#define TELEMETRYLOG_H
+
+// 解析結果の追記専用バイナリログ (.jtl)。
+//
+// [LogHeader][Record][Record]...
+// レコードは型ごとに固定長で、末尾に自身のチェックサムを持つ。途中で落ちたときに残る
+// 書きかけ/ゼロ埋めの末尾はチェックサムで見分け、読み出しでは無視し、追記再開時には切り詰める。
+// 複数カメラの結果は1つのログにまとめ、各レコードの camera で見分ける (1台のときは常に0)。
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace telemetrylog {
+
+constexpr char kMagic[8] = {'J', 'C', 'A', 'M', 'L', 'O', 'G', '1'};
+constexpr uint32_t kVersion = 1;
+
+enum RecordType : uint32_t {
+    GraphRecordType = 1,
+    TileRecordType = 2,
+};
+
+struct LogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordType;
+    uint32_t recordSize;
+    uint32_t reserved[10];
+};
+static_assert(sizeof(LogHeader) == 64, "LogHeader must be 64 bytes");
+
+// フレーム全体の統計 (graph_data)。mean/stddev/パーセンタイルは階調値のまま保存する。
+struct GraphRecord {
+    static constexpr uint32_t kType = GraphRecordType;
+
+    int64_t frameNumber;
+    double timestamp;
+    double temp;
+    float mean;
+    float stddev;
+    float cv;
+    float p01;
+    float p50;
+    float p99;
+    float saturatedFraction;
+    float darkFraction;
+    uint32_t camera;
+    uint32_t checksum;
+};
+static_assert(sizeof(GraphRecord) == 64, "GraphRecord must be 64 bytes");
+
+// タイル/ROIごとの統計 (tile_data)。タイルは index = 行 * columns + 列。
+struct TileRecord {
+    static constexpr uint32_t kType = TileRecordType;
+
+    enum Kind : uint8_t {
+        Tile = 0,
+        Roi = 1,
+    };
+
+    int64_t frameNumber;
+    int32_t index;
+    uint8_t kind;
+    uint8_t camera;
+    uint16_t columns;
+    float mean;
+    float stddev;
+    float cv;
+    uint32_t checksum;
+};
+static_assert(sizeof(TileRecord) == 32, "TileRecord must be 32 bytes");
+
+// checksum 以外のバイトに対するFNV-1a。全ゼロのレコードは通らないように初期値を混ぜる。
+template <typename Record>
+inline uint32_t recordChecksum(const Record& record) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&record);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(Record, checksum); ++i) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash ^ 0xa5a5a5a5u;
+}
+
+template <typename Record>
+inline bool validRecord(const Record& record) {
+    return record.checksum == recordChecksum(record);
+}
+
+inline bool validHeader(const LogHeader& header) {
+    return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion
+           && header.headerSize == sizeof(LogHeader);
+}
+
+// ファイル先頭のヘッダを読む (レコード型の判別用)。失敗したらstd::runtime_errorを投げる。
+inline LogHeader readHeader(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+    }
+    LogHeader header{};
+    const bool ok = ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ::close(fd);
+    if (!ok || !validHeader(header)) {
+        throw std::runtime_error("Not a telemetry log: " + path);
+    }
+    return header;
+}
+
+// 1ファイル分の追記。スレッドセーフではない (ログ書き込みスレッドからのみ使う)。
+template <typename Record>
+class Writer {
+public:
+    Writer() = default;
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer() {
+        close();
+    }
+
+    // 既存のファイルなら壊れた末尾を切り詰めてから続きに追記する。失敗したらstd::runtime_errorを投げる。
+    void open(const std::string& path) {
+        close();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+        }
+        try {
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                throw std::runtime_error("Failed to stat " + path + ": " + std::strerror(errno));
+            }
+            // ヘッダも書き終わらないうちに止まったファイルは空のファイルと同じに扱い、ヘッダから書き直す
+            if (static_cast<uint64_t>(st.st_size) < sizeof(LogHeader)) {
+                if (st.st_size != 0 && ftruncate(fd, 0) != 0) {
+                    throw std::runtime_error("Failed to truncate " + path + ": " + std::strerror(errno));
+                }
+                LogHeader header{};
+                std::memcpy(header.magic, kMagic, sizeof(kMagic));
+                header.version = kVersion;
+                header.headerSize = sizeof(LogHeader);
+                header.recordType = Record::kType;
+                header.recordSize = sizeof(Record);
+                offset = 0;
+                writeAll(&header, sizeof(header));
+                fdatasync(fd);
+            } else {
+                LogHeader header{};
+                if (::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))
+                    || !validHeader(header) || header.recordType != Record::kType
+                    || header.recordSize != sizeof(Record)) {
+                    throw std::runtime_error("Existing file is not a compatible telemetry log: " + path);
+                }
+                offset = sizeof(LogHeader) + validRecordCount(static_cast<uint64_t>(st.st_size)) * sizeof(Record);
+                if (offset != static_cast<uint64_t>(st.st_size) && ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+                    throw std::runtime_error("Failed to truncate " + path + ": " + std::strerror(errno));
+                }
+            }
+        } catch (...) {
+            ::close(fd);
+            fd = -1;
+            throw;
+        }
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    // チェックサムを付けてまとめて1回で書き込む
+    void append(Record* records, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            records[i].checksum = recordChecksum(records[i]);
+        }
+        writeAll(records, count * sizeof(Record));
+    }
+
+    void sync() {
+        if (fd >= 0 && fdatasync(fd) != 0) {
+            throw std::runtime_error(std::string("Failed to sync telemetry log: ") + std::strerror(errno));
+        }
+    }
+
+    void close() {
+        if (fd >= 0) {
+            fdatasync(fd);
+            ::close(fd);
+            fd = -1;
+        }
+        offset = 0;
+    }
+
+private:
+    // 先頭から最初の壊れたレコードの手前まで数える (Reader と同じ規則。その先はReaderから見えないので切り捨てる)
+    uint64_t validRecordCount(uint64_t fileSize) const {
+        const uint64_t available = (fileSize - sizeof(LogHeader)) / sizeof(Record);
+        std::vector<Record> chunk(std::min<uint64_t>(available, 4096));
+        uint64_t count = 0;
+        while (count < available) {
+            const size_t want = static_cast<size_t>(std::min<uint64_t>(available - count, chunk.size()));
+            const off_t position = static_cast<off_t>(sizeof(LogHeader) + count * sizeof(Record));
+            const ssize_t got = ::pread(fd, chunk.data(), want * sizeof(Record), position);
+            if (got <= 0) {
+                break;
+            }
+            const size_t records = static_cast<size_t>(got) / sizeof(Record);
+            for (size_t i = 0; i < records; ++i) {
+                if (!validRecord(chunk[i])) {
+                    return count + i;
+                }
+            }
+            if (records == 0) {
+                break;
+            }
+            count += records;
+        }
+        return count;
+    }
+
+    void writeAll(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            const ssize_t written = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to write telemetry log: ") + std::strerror(errno));
+            }
+            p += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+    }
+
+    int fd = -1;
+    uint64_t offset = 0;
+};
+
+// mmapで開いて読む。先頭から正しいレコードが続く範囲だけを見せる。
+template <typename Record>
+class Reader {
+public:
+    explicit Reader(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(LogHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Not a telemetry log: " + path);
+        }
+        mappedSize = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map " + path + ": " + std::strerror(errno));
+        }
+        base = static_cast<const uint8_t*>(mapped);
+        madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+
+        const LogHeader* header = reinterpret_cast<const LogHeader*>(base);
+        if (!validHeader(*header) || header->recordType != Record::kType || header->recordSize != sizeof(Record)) {
+            unmap();
+            throw std::runtime_error("Unexpected telemetry log type: " + path);
+        }
+
+        records = reinterpret_cast<const Record*>(base + sizeof(LogHeader));
+        const size_t available = (mappedSize - sizeof(LogHeader)) / sizeof(Record);
+        while (recordCount < available && validRecord(records[recordCount])) {
+            ++recordCount;
+        }
+    }
+
+    ~Reader() {
+        unmap();
+    }
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    size_t size() const {
+        return recordCount;
+    }
+
+    const Record& operator[](size_t i) const {
+        return records[i];
+    }
+
+    const Record* begin() const {
+        return records;
+    }
+
+    const Record* end() const {
+        return records + recordCount;
+    }
+
+private:
+    void unmap() {
+        if (base) {
+            munmap(const_cast<uint8_t*>(base), mappedSize);
+            base = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    int fd = -1;
+    const uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+    const Record* records = nullptr;
+    size_t recordCount = 0;
+};
+
+} // namespace telemetrylog
+
+#endif // TELEMETRYLOG_H
@@ -0,0 +1,222 @@
+#ifndef TELEMETRYLOGGER_H
+#define TELEMETRYLOGGER_H
+
+#include "framestats.h"
+#include "stagestats.h"
+#include "telemetrylog.h"
+#include "tilestats.h"
+
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// 解析結果をバイナリログ (graph_data.jtl / tile_data.jtl) へ書き込む専用スレッド。
+// 統計スレッドは短いロックで行を積むだけで、書き込みは commitIntervalMs ごとにまとめて行い、
+// 同期間隔 (既定1秒) ごとにfdatasyncする。落ちても失うのは最後の同期以降の分だけ。
+// 複数カメラのパイプラインで1つを共有でき、行にはカメラ番号を付ける。
+class TelemetryLogger : public QThread {
+public:
+    explicit TelemetryLogger(StageStats& writeStats, QObject *parent = nullptr)
+        : QThread(parent), writeStats(writeStats) {}
+
+    ~TelemetryLogger() override {
+        requestInterruption();
+        wake.wakeAll();
+        wait();
+    }
+
+    // 空ならログを書かない
+    void setDirectory(const QString& directory) {
+        QMutexLocker locker(&pendingMutex);
+        pendingDirectory = directory;
+        ++directoryGeneration;
+    }
+
+    // ディスクへ同期する間隔。短いほど異常終了で失う行が減る
+    void setSyncInterval(int milliseconds) {
+        syncIntervalMs.store(static_cast<uint64_t>(std::max(1, milliseconds)), std::memory_order_relaxed);
+    }
+
+    void append(const FrameStats& stats, int camera = 0) {
+        const telemetrylog::GraphRecord record = graphRecord(stats, camera);
+        QMutexLocker locker(&pendingMutex);
+        if (pendingGraph.size() >= maxPendingRecords) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        pendingGraph.push_back(record);
+    }
+
+    void append(const TileMap& map, int camera = 0) {
+        QMutexLocker locker(&pendingMutex);
+        if (pendingTiles.size() + map.tiles.size() + map.rois.size() > maxPendingRecords) {
+            dropped.fetch_add(map.tiles.size() + map.rois.size(), std::memory_order_relaxed);
+            return;
+        }
+        for (size_t i = 0; i < map.tiles.size(); ++i) {
+            pendingTiles.push_back(tileRecord(map, camera, telemetrylog::TileRecord::Tile, i, map.tiles[i]));
+        }
+        for (size_t i = 0; i < map.rois.size(); ++i) {
+            pendingTiles.push_back(tileRecord(map, camera, telemetrylog::TileRecord::Roi, i, map.rois[i]));
+        }
+    }
+
+    // ログの1行。オフラインの再処理 (jetsonCamReprocess) も同じ関数で作るので、同じ統計からは同じバイト列になる
+    static telemetrylog::GraphRecord graphRecord(const FrameStats& stats, int camera) {
+        telemetrylog::GraphRecord record{};
+        record.camera = static_cast<uint32_t>(camera);
+        record.frameNumber = stats.frameNumber;
+        record.timestamp = stats.timestamp;
+        record.temp = stats.temp;
+        record.mean = stats.mean;
+        record.stddev = stats.stddev;
+        record.cv = stats.cv;
+        record.p01 = stats.p01;
+        record.p50 = stats.p50;
+        record.p99 = stats.p99;
+        record.saturatedFraction = stats.saturatedFraction;
+        record.darkFraction = stats.darkFraction;
+        return record;
+    }
+
+    static telemetrylog::TileRecord tileRecord(const TileMap& map, int camera, telemetrylog::TileRecord::Kind kind,
+                                               size_t index, const RegionStats& region) {
+        telemetrylog::TileRecord record{};
+        record.camera = static_cast<uint8_t>(camera);
+        record.frameNumber = map.frameNumber;
+        record.index = static_cast<int32_t>(index);
+        record.kind = kind;
+        record.columns = static_cast<uint16_t>(map.columns);
+        record.mean = region.mean;
+        record.stddev = region.stddev;
+        record.cv = region.cv;
+        return record;
+    }
+
+    uint64_t recordsWritten() const {
+        return written.load(std::memory_order_relaxed);
+    }
+
+    uint64_t droppedRecords() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    uint64_t writeErrors() const {
+        return errors.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void run() override {
+        uint64_t lastSyncNs = monotonicNs();
+        bool stopping = false;
+        while (!stopping) {
+            {
+                QMutexLocker locker(&pendingMutex);
+                stopping = isInterruptionRequested();
+                if (!stopping) {
+                    wake.wait(&pendingMutex, commitIntervalMs);
+                }
+                // バッファを入れ替えて、書き込み中は統計スレッドを待たせない
+                graphBatch.swap(pendingGraph);
+                tileBatch.swap(pendingTiles);
+                if (appliedGeneration != directoryGeneration) {
+                    appliedGeneration = directoryGeneration;
+                    directory = pendingDirectory;
+                    reopen = true;
+                }
+            }
+
+            if (reopen) {
+                reopen = false;
+                closeFiles();
+                openFiles();
+            }
+            if (graphBatch.empty() && tileBatch.empty()) {
+                continue;
+            }
+
+            const uint64_t start = monotonicNs();
+            try {
+                if (graph.isOpen()) {
+                    graph.append(graphBatch.data(), graphBatch.size());
+                    written.fetch_add(graphBatch.size(), std::memory_order_relaxed);
+                }
+                if (tiles.isOpen()) {
+                    tiles.append(tileBatch.data(), tileBatch.size());
+                    written.fetch_add(tileBatch.size(), std::memory_order_relaxed);
+                }
+                if (stopping || start - lastSyncNs >= syncIntervalMs.load(std::memory_order_relaxed) * 1000000ull) {
+                    graph.sync();
+                    tiles.sync();
+                    lastSyncNs = start;
+                }
+            } catch (const std::exception& e) {
+                // 書き込みに失敗したら、フォルダが変わるまでログを止める
+                std::cerr << "Telemetry log stopped: " << e.what() << std::endl;
+                errors.fetch_add(1, std::memory_order_relaxed);
+                closeFiles();
+            }
+            writeStats.record(monotonicNs() - start);
+            graphBatch.clear();
+            tileBatch.clear();
+        }
+        closeFiles();
+    }
+
+private:
+    static constexpr unsigned long commitIntervalMs = 200;
+    static constexpr size_t maxPendingRecords = 1 << 20;
+
+    void openFiles() {
+        if (directory.isEmpty()) {
+            return;
+        }
+        const QDir dir(directory);
+        try {
+            graph.open(dir.filePath("graph_data.jtl").toStdString());
+            tiles.open(dir.filePath("tile_data.jtl").toStdString());
+        } catch (const std::exception& e) {
+            std::cerr << "Telemetry log disabled: " << e.what() << std::endl;
+            errors.fetch_add(1, std::memory_order_relaxed);
+            closeFiles();
+        }
+    }
+
+    void closeFiles() {
+        graph.close();
+        tiles.close();
+    }
+
+    StageStats& writeStats;
+
+    QMutex pendingMutex;
+    QWaitCondition wake;
+    std::vector<telemetrylog::GraphRecord> pendingGraph;
+    std::vector<telemetrylog::TileRecord> pendingTiles;
+    QString pendingDirectory;
+    uint64_t directoryGeneration = 0;
+
+    // 以下は書き込みスレッドだけが触る
+    std::vector<telemetrylog::GraphRecord> graphBatch;
+    std::vector<telemetrylog::TileRecord> tileBatch;
+    QString directory;
+    uint64_t appliedGeneration = 0;
+    bool reopen = false;
+    telemetrylog::Writer<telemetrylog::GraphRecord> graph;
+    telemetrylog::Writer<telemetrylog::TileRecord> tiles;
+
+    std::atomic<uint64_t> syncIntervalMs{1000};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+#endif // TELEMETRYLOGGER_H
@@ -0,0 +1,451 @@
+#ifndef TEMPORALSTATS_H
+#define TEMPORALSTATS_H
+
+#include "downsample.h"
+#include "framequeue.h"
+#include "rawcontainer.h"
+#include "reductionpool.h"
+#include "stagestats.h"
+
+#include <QColor>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSize>
+#include <QString>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TEMPORALSTATS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TEMPORALSTATS_NEON 1
+#endif
+
+// 画素ごとの時間方向の統計 (直近 N フレームの平均・分散・CV)。
+// 画素ごとに総和 (16bit) と二乗和 (32bit) を持ち、フレームが窓に入るたびに足し、窓から出るフレームを引く。
+// 出ていくフレームは窓と同じ長さの履歴リングから読み、同じ位置に新しいフレームを書くので、1フレームの
+// 更新は入力・履歴・総和・二乗和を1回なめるだけで終わる。メモリは画素あたり 6 + N バイト。
+namespace temporalstats_detail {
+
+// slot の古い画素を窓から引き、in を足して slot に書く
+inline void updateRowScalar(const uint8_t* in, uint8_t* slot, uint16_t* sum, uint32_t* sumSq, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        const uint32_t x = in[i];
+        const uint32_t old = slot[i];
+        slot[i] = in[i];
+        sum[i] = static_cast<uint16_t>(sum[i] + x - old);
+        sumSq[i] += x * x - old * old;
+    }
+}
+
+#ifdef TEMPORALSTATS_X86
+__attribute__((target("avx2")))
+inline void updateRowAvx2(const uint8_t* in, uint8_t* slot, uint16_t* sum, uint32_t* sumSq, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i x8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i old8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(slot + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(slot + i), x8);
+        const __m256i x = _mm256_cvtepu8_epi16(x8);
+        const __m256i old = _mm256_cvtepu8_epi16(old8);
+        __m256i* s = reinterpret_cast<__m256i*>(sum + i);
+        _mm256_storeu_si256(s, _mm256_add_epi16(_mm256_loadu_si256(s), _mm256_sub_epi16(x, old)));
+        // 255^2 は16bitに収まる。差は32bitに広げてから足す
+        const __m256i sq = _mm256_mullo_epi16(x, x);
+        const __m256i oldSq = _mm256_mullo_epi16(old, old);
+        const __m256i diffLo = _mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(sq)),
+                                                _mm256_cvtepu16_epi32(_mm256_castsi256_si128(oldSq)));
+        const __m256i diffHi = _mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(sq, 1)),
+                                                _mm256_cvtepu16_epi32(_mm256_extracti128_si256(oldSq, 1)));
+        __m256i* q = reinterpret_cast<__m256i*>(sumSq + i);
+        _mm256_storeu_si256(q, _mm256_add_epi32(_mm256_loadu_si256(q), diffLo));
+        _mm256_storeu_si256(q + 1, _mm256_add_epi32(_mm256_loadu_si256(q + 1), diffHi));
+    }
+    updateRowScalar(in + i, slot + i, sum + i, sumSq + i, size - i);
+}
+#endif // TEMPORALSTATS_X86
+
+#ifdef TEMPORALSTATS_NEON
+inline void updateRowNeon(const uint8_t* in, uint8_t* slot, uint16_t* sum, uint32_t* sumSq, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const uint8x8_t x = vld1_u8(in + i);
+        const uint8x8_t old = vld1_u8(slot + i);
+        vst1_u8(slot + i, x);
+        vst1q_u16(sum + i, vsubq_u16(vaddw_u8(vld1q_u16(sum + i), x), vmovl_u8(old)));
+        const uint16x8_t sq = vmull_u8(x, x);
+        const uint16x8_t oldSq = vmull_u8(old, old);
+        uint32x4_t lo = vld1q_u32(sumSq + i);
+        uint32x4_t hi = vld1q_u32(sumSq + i + 4);
+        lo = vsubw_u16(vaddw_u16(lo, vget_low_u16(sq)), vget_low_u16(oldSq));
+        hi = vsubw_u16(vaddw_u16(hi, vget_high_u16(sq)), vget_high_u16(oldSq));
+        vst1q_u32(sumSq + i, lo);
+        vst1q_u32(sumSq + i + 4, hi);
+    }
+    updateRowScalar(in + i, slot + i, sum + i, sumSq + i, size - i);
+}
+#endif // TEMPORALSTATS_NEON
+
+using UpdateRowKernel = void (*)(const uint8_t*, uint8_t*, uint16_t*, uint32_t*, size_t);
+
+struct UpdateKernelEntry {
+    UpdateRowKernel kernel;
+    const char* name;
+};
+
+inline UpdateKernelEntry selectUpdateKernel() {
+#ifdef TEMPORALSTATS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {updateRowAvx2, "avx2"};
+    }
+#endif
+#ifdef TEMPORALSTATS_NEON
+    return {updateRowNeon, "neon"};
+#endif
+    return {updateRowScalar, "scalar"};
+}
+
+inline const UpdateKernelEntry& updateKernel() {
+    static const UpdateKernelEntry entry = selectUpdateKernel();
+    return entry;
+}
+
+// 青 (小) → 赤 (大)。HeatmapWidget と同じ色
+inline const std::vector<QRgb>& colorTable() {
+    static const std::vector<QRgb> table = []() {
+        std::vector<QRgb> colors(256);
+        for (int i = 0; i < 256; ++i) {
+            colors[i] = QColor::fromHsvF((1.0 - i / 255.0) * 0.66, 1.0, 1.0).rgb();
+        }
+        return colors;
+    }();
+    return table;
+}
+
+} // namespace temporalstats_detail
+
+// 書き出し用の平均・分散・CVのマップ (画素ごと、行の詰め物なし)
+struct TemporalMaps {
+    int width = 0;
+    int height = 0;
+    int frames = 0;          // 窓に入っているフレーム数
+    int lastFrameNumber = 0; // 窓の最後のフレーム
+    double timestamp = 0.0;
+    double temp = 0.0;
+    std::vector<float> mean;
+    std::vector<float> variance;
+    std::vector<float> cv;
+};
+
+// 表示用に縮小した時間方向のCVのマップ
+struct TemporalMapImage {
+    QImage image;
+    int frames = 0;
+    float maxCv = 0.0f; // 色の上端 (縮小後の値の99パーセンタイル)
+};
+
+// 専用のキューを消費して時間方向の統計を更新するスレッド。窓の長さが0の間はフレームを読み捨てる。
+// 1フレームの更新は行ストライプに分けて pool で並列に行い、時間は updateStats に記録する。
+class TemporalStats : public QThread {
+public:
+    static constexpr int kMaxWindow = 256; // 総和を16bitで持てる上限 (255 × 257 < 65536)
+
+    TemporalStats(FrameQueue& frames, StageStats& updateStats, ReductionPool& pool = ReductionPool::global(),
+                  QObject *parent = nullptr)
+        : QThread(parent), frames(frames), updateStats(updateStats), pool(pool) {}
+
+    ~TemporalStats() override {
+        requestInterruption();
+        wait();
+    }
+
+    // 窓の長さ [フレーム]。0 で止めてメモリを返す。変えると窓は空からやり直す
+    void setWindow(int frameCount) {
+        QMutexLocker locker(&settingsMutex);
+        windowSetting = std::clamp(frameCount, 0, kMaxWindow);
+        resetRequested = true;
+    }
+
+    int window() const {
+        QMutexLocker locker(&settingsMutex);
+        return windowSetting;
+    }
+
+    // every フレームに1枚だけ窓に入れる (窓が覆う時間を延ばす)
+    void setDecimation(int every) {
+        QMutexLocker locker(&settingsMutex);
+        decimationSetting = std::max(1, every);
+        resetRequested = true;
+    }
+
+    // CVマップを描く間隔と、収める表示サイズ (空なら描かない)
+    void setMapInterval(int milliseconds) {
+        QMutexLocker locker(&settingsMutex);
+        mapIntervalMs = std::max(1, milliseconds);
+    }
+
+    void setMapTargetSize(const QSize& size) {
+        QMutexLocker locker(&settingsMutex);
+        mapTargetSize = size;
+    }
+
+    // 窓に入っているフレーム数
+    int filledFrames() const {
+        return filled.load(std::memory_order_relaxed);
+    }
+
+    size_t memoryBytes() const {
+        return allocatedBytes.load(std::memory_order_relaxed);
+    }
+
+    static const char* kernelName() {
+        return temporalstats_detail::updateKernel().name;
+    }
+
+    // 前回取り出してから新しいマップが描かれていれば取り出す
+    bool takeLatestMap(TemporalMapImage& map) {
+        QMutexLocker locker(&mapMutex);
+        if (!mapFresh) {
+            return false;
+        }
+        map = latestMap;
+        mapFresh = false;
+        return true;
+    }
+
+    // 現在の窓の平均・分散 (母分散)・CV を計算する。窓が空なら false
+    bool snapshot(TemporalMaps& maps) const {
+        std::vector<uint16_t> sumCopy;
+        std::vector<uint32_t> sumSqCopy;
+        {
+            QMutexLocker locker(&stateMutex);
+            if (count == 0) {
+                return false;
+            }
+            maps.width = width;
+            maps.height = height;
+            maps.frames = count;
+            maps.lastFrameNumber = lastFrameNumber;
+            maps.timestamp = lastTimestamp;
+            maps.temp = lastTemp;
+            sumCopy = sum;
+            sumSqCopy = sumSq;
+        }
+        const size_t pixels = sumCopy.size();
+        const int n = maps.frames;
+        maps.mean.resize(pixels);
+        maps.variance.resize(pixels);
+        maps.cv.resize(pixels);
+        for (size_t i = 0; i < pixels; ++i) {
+            // n·Σx² - (Σx)² は整数で正確に求める
+            const int64_t s = sumCopy[i];
+            const int64_t spread = std::max<int64_t>(0, static_cast<int64_t>(n) * sumSqCopy[i] - s * s);
+            maps.mean[i] = static_cast<float>(static_cast<double>(s) / n);
+            maps.variance[i] = static_cast<float>(static_cast<double>(spread) / (static_cast<double>(n) * n));
+            maps.cv[i] = s > 0 ? static_cast<float>(std::sqrt(static_cast<double>(spread)) / s) : 0.0f;
+        }
+        return true;
+    }
+
+    // 平均 (frameNumber 0)・分散 (1)・CV (2) を float の記録コンテナに書く。時刻と温度は窓の最後のフレームのもの
+    static bool exportMaps(const TemporalMaps& maps, const QString& path) {
+        try {
+            rawcontainer::Writer writer;
+            writer.open(path.toStdString(), maps.width, maps.height, maps.width * sizeof(float),
+                        rawcontainer::PixelFloat32, sizeof(float), 0);
+            const std::vector<float>* planes[] = {&maps.mean, &maps.variance, &maps.cv};
+            for (int i = 0; i < 3; ++i) {
+                writer.append(i, maps.timestamp, maps.temp, planes[i]->data(), planes[i]->size() * sizeof(float));
+            }
+            writer.close();
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to export temporal maps: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+protected:
+    void run() override {
+        uint64_t nextMapNs = 0;
+        while (!isInterruptionRequested()) {
+            FrameRef frame;
+            if (!frames.pop(frame, 100) || !frame) {
+                continue;
+            }
+            int windowFrames;
+            int decimation;
+            bool reset;
+            int interval;
+            QSize target;
+            {
+                QMutexLocker locker(&settingsMutex);
+                windowFrames = windowSetting;
+                decimation = decimationSetting;
+                reset = resetRequested;
+                resetRequested = false;
+                interval = mapIntervalMs;
+                target = mapTargetSize;
+            }
+            if (reset || frame->width != width || frame->height != height || windowLength != windowFrames) {
+                allocate(frame->width, frame->height, windowFrames);
+            }
+            if (windowFrames == 0 || skipped++ % decimation != 0) {
+                continue;
+            }
+
+            const uint64_t start = monotonicNs();
+            {
+                QMutexLocker locker(&stateMutex);
+                update(*frame);
+            }
+            updateStats.record(monotonicNs() - start);
+            frame.reset();
+
+            if (!target.isEmpty() && start >= nextMapNs && renderMap(target)) {
+                nextMapNs = start + interval * 1000000ull;
+            }
+        }
+    }
+
+private:
+    size_t pixelCount() const {
+        return static_cast<size_t>(width) * height;
+    }
+
+    // 取得しなおすときも窓は空から始める (履歴を0で埋めておけば、満ちるまでは引く値が0になる)
+    void allocate(int frameWidth, int frameHeight, int windowFrames) {
+        QMutexLocker locker(&stateMutex);
+        width = frameWidth;
+        height = frameHeight;
+        const size_t pixels = windowFrames > 0 ? pixelCount() : 0;
+        std::vector<uint16_t>(pixels, 0).swap(sum);
+        std::vector<uint32_t>(pixels, 0).swap(sumSq);
+        std::vector<uint8_t>(pixels * windowFrames, 0).swap(history);
+        windowLength = windowFrames;
+        head = 0;
+        count = 0;
+        skipped = 0;
+        filled.store(0, std::memory_order_relaxed);
+        allocatedBytes.store(pixels * (sizeof(uint16_t) + sizeof(uint32_t) + windowFrames), std::memory_order_relaxed);
+    }
+
+    // stateMutex を保持して呼ぶ
+    void update(const FrameBuffer& frame) {
+        uint8_t* slot = history.data() + head * pixelCount();
+        const temporalstats_detail::UpdateRowKernel kernel = temporalstats_detail::updateKernel().kernel;
+        const int stripes = std::max(1, std::min(pool.threadCount(), height / 16));
+        pool.parallelFor(stripes, [&](int stripe) {
+            for (int y = stripe * height / stripes; y < (stripe + 1) * height / stripes; ++y) {
+                const size_t offset = static_cast<size_t>(y) * width;
+                kernel(frame.data + static_cast<size_t>(y) * frame.stride, slot + offset, sum.data() + offset,
+                       sumSq.data() + offset, width);
+            }
+        });
+        head = (head + 1) % windowLength;
+        count = std::min(count + 1, windowLength);
+        lastFrameNumber = frame.frameNumber;
+        lastTimestamp = frame.timestamp;
+        lastTemp = frame.temp;
+        filled.store(count, std::memory_order_relaxed);
+    }
+
+    // factor × factor 画素のCVの平均を1画素にして色を付ける。色の上端は99パーセンタイル。窓が2枚未満なら描かない
+    bool renderMap(const QSize& target) {
+        TemporalMapImage map;
+        {
+            QMutexLocker locker(&stateMutex);
+            if (count < 2) {
+                return false;
+            }
+            const int factor = downsampleFactor(width, height, target.width(), target.height());
+            const int mapWidth = width / factor;
+            const int mapHeight = height / factor;
+            const int64_t n = count;
+            cvScratch.assign(static_cast<size_t>(mapWidth) * mapHeight, 0.0f);
+            for (int y = 0; y < mapHeight * factor; ++y) {
+                float* row = cvScratch.data() + static_cast<size_t>(y / factor) * mapWidth;
+                const size_t base = static_cast<size_t>(y) * width;
+                for (int x = 0; x < mapWidth * factor; ++x) {
+                    const int64_t s = sum[base + x];
+                    if (s > 0) {
+                        const int64_t spread = std::max<int64_t>(0, n * sumSq[base + x] - s * s);
+                        row[x / factor] += std::sqrt(static_cast<float>(spread)) / s;
+                    }
+                }
+            }
+            const float scale = 1.0f / (factor * factor);
+            for (float& v : cvScratch) {
+                v *= scale;
+            }
+            map.frames = count;
+            map.image = QImage(mapWidth, mapHeight, QImage::Format_RGB32);
+        }
+
+        sortedScratch = cvScratch;
+        const size_t p99 = sortedScratch.size() * 99 / 100;
+        std::nth_element(sortedScratch.begin(), sortedScratch.begin() + p99, sortedScratch.end());
+        map.maxCv = sortedScratch.empty() ? 0.0f : sortedScratch[p99];
+        const float toIndex = map.maxCv > 0.0f ? 255.0f / map.maxCv : 0.0f;
+        const std::vector<QRgb>& colors = temporalstats_detail::colorTable();
+        for (int y = 0; y < map.image.height(); ++y) {
+            QRgb* line = reinterpret_cast<QRgb*>(map.image.scanLine(y));
+            const float* values = cvScratch.data() + static_cast<size_t>(y) * map.image.width();
+            for (int x = 0; x < map.image.width(); ++x) {
+                line[x] = colors[static_cast<int>(std::min(255.0f, values[x] * toIndex))];
+            }
+        }
+        QMutexLocker locker(&mapMutex);
+        latestMap = std::move(map);
+        mapFresh = true;
+        return true;
+    }
+
+    FrameQueue& frames;
+    StageStats& updateStats;
+    ReductionPool& pool;
+
+    mutable QMutex settingsMutex;
+    int windowSetting = 0;
+    int decimationSetting = 1;
+    bool resetRequested = false;
+    int mapIntervalMs = 500;
+    QSize mapTargetSize;
+
+    mutable QMutex stateMutex; // 以下の窓の状態を保護 (書くのは統計スレッドだけ)
+    int width = 0;
+    int height = 0;
+    int windowLength = 0;
+    int head = 0;  // 次に上書きする履歴の位置
+    int count = 0; // 窓に入っているフレーム数
+    int lastFrameNumber = 0;
+    double lastTimestamp = 0.0;
+    double lastTemp = 0.0;
+    std::vector<uint16_t> sum;
+    std::vector<uint32_t> sumSq;
+    std::vector<uint8_t> history; // windowLength 枚分のリング
+
+    uint64_t skipped = 0; // 間引き用 (統計スレッドだけが触る)
+    std::vector<float> cvScratch;
+    std::vector<float> sortedScratch;
+    std::atomic<int> filled{0};
+    std::atomic<size_t> allocatedBytes{0};
+
+    QMutex mapMutex;
+    TemporalMapImage latestMap;
+    bool mapFresh = false;
+};
+
+#endif // TEMPORALSTATS_H
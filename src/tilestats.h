@@ -0,0 +1,202 @@
+#ifndef TILESTATS_H
+#define TILESTATS_H
+
+#include "cpu_process.h"
+#include "framestats.h"
+#include "histogram.h"
+#include "reductionpool.h"
+
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct TileRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct RegionStats {
+    float mean = 0.0f;
+    float stddev = 0.0f;
+    float cv = 0.0f;
+};
+
+// グリッド分割 (columns x rows) とユーザー定義ROIの設定
+struct TileLayout {
+    int columns = 0;
+    int rows = 0;
+    std::vector<TileRect> rois;
+
+    bool gridEnabled() const {
+        return columns > 0 && rows > 0;
+    }
+
+    bool enabled() const {
+        return gridEnabled() || !rois.empty();
+    }
+};
+
+// 1フレーム分のタイル統計 (行優先で columns*rows 個) とROI統計
+struct TileMap {
+    int frameNumber = 0;
+    int columns = 0;
+    int rows = 0;
+    std::vector<RegionStats> tiles;
+    std::vector<RegionStats> rois;
+};
+
+// "x,y,w,h; x,y,w,h" 形式のROI指定を解釈する。不正な項目は無視する。
+inline std::vector<TileRect> parseRoiList(const QString& text) {
+    std::vector<TileRect> rois;
+    const QStringList entries = text.split(';', QString::SkipEmptyParts);
+    for (const QString& entry : entries) {
+        const QStringList fields = entry.split(',', QString::SkipEmptyParts);
+        if (fields.size() != 4) {
+            continue;
+        }
+        bool ok[4];
+        TileRect rect;
+        rect.x = fields[0].trimmed().toInt(&ok[0]);
+        rect.y = fields[1].trimmed().toInt(&ok[1]);
+        rect.width = fields[2].trimmed().toInt(&ok[2]);
+        rect.height = fields[3].trimmed().toInt(&ok[3]);
+        if (ok[0] && ok[1] && ok[2] && ok[3] && rect.width > 0 && rect.height > 0) {
+            rois.push_back(rect);
+        }
+    }
+    return rois;
+}
+
+inline RegionStats momentsToRegionStats(const PixelMoments& moments, double scale = 1.0) {
+    RegionStats stats;
+    std::tie(stats.mean, stats.stddev, stats.cv) = momentsToMeanStdDevK(moments, scale);
+    return stats;
+}
+
+namespace tilestats_detail {
+
+// 横長のストライプ1本分の部分和。各画素行を一度だけ読み、その行が跨るタイルとROIに振り分ける。
+template <typename Sub>
+struct StripeResult {
+    Sub histogram;
+    std::vector<PixelMoments> tiles; // 行優先で columns*rows 個
+    std::vector<PixelMoments> rois;
+};
+
+// Pixel は uint8_t (Mono8) か uint16_t (10〜16bit)。stride は画素数
+template <typename Pixel, typename Sub, typename Kernel>
+inline void accumulateStripe(const Pixel* data, int width, int height, int stride, int y0, int y1,
+                             const TileLayout& layout, const std::vector<TileRect>& rois,
+                             Kernel moments, StripeResult<Sub>& result) {
+    const int columns = layout.gridEnabled() ? layout.columns : 0;
+    const int rows = layout.gridEnabled() ? layout.rows : 0;
+    result.tiles.assign(static_cast<size_t>(columns) * rows, PixelMoments());
+    result.rois.assign(rois.size(), PixelMoments());
+
+    // ストライプの境界はタイルの境界と揃っていなくてよい。行ごとにタイル行を進める
+    int tileRow = rows ? static_cast<int>(static_cast<int64_t>(y0) * rows / height) : 0;
+    for (int y = y0; y < y1; ++y) {
+        const Pixel* row = data + static_cast<size_t>(y) * stride;
+        result.histogram.add(row, width);
+
+        if (columns) {
+            while (static_cast<int64_t>(tileRow + 1) * height / rows <= y) {
+                ++tileRow;
+            }
+            PixelMoments* tiles = result.tiles.data() + static_cast<size_t>(tileRow) * columns;
+            for (int c = 0; c < columns; ++c) {
+                const int x0 = c * width / columns;
+                const int x1 = (c + 1) * width / columns;
+                tiles[c] += moments(row + x0, x1 - x0);
+            }
+        }
+
+        for (size_t r = 0; r < rois.size(); ++r) {
+            const TileRect& roi = rois[r];
+            if (y >= roi.y && y < roi.y + roi.height) {
+                result.rois[r] += moments(row + roi.x, roi.width);
+            }
+        }
+    }
+}
+
+// フレームを stripes 本の横ストライプに分けて pool で並列に処理し、部分和を足し合わせる。
+// emptySub は各ストライプのヒストグラムの初期値、scale はタイル/ROIの平均と標準偏差に掛ける係数
+template <typename Pixel, typename Histogram, typename Sub, typename Kernel>
+inline void calculateTileMap(const Pixel* data, int width, int height, int stride, const TileLayout& layout,
+                             Histogram& histogram, TileMap& map, int stripes, ReductionPool& pool, Kernel moments,
+                             const Sub& emptySub, double scale) {
+    // 画像外にはみ出したROIは画像内に切り詰める
+    std::vector<TileRect> rois;
+    rois.reserve(layout.rois.size());
+    for (TileRect roi : layout.rois) {
+        const int x1 = std::min(roi.x + roi.width, width);
+        const int y1 = std::min(roi.y + roi.height, height);
+        roi.x = std::max(roi.x, 0);
+        roi.y = std::max(roi.y, 0);
+        roi.width = std::max(x1 - roi.x, 0);
+        roi.height = std::max(y1 - roi.y, 0);
+        rois.push_back(roi);
+    }
+
+    stripes = std::max(1, std::min(stripes, height));
+    std::vector<StripeResult<Sub>> results(stripes, StripeResult<Sub>{emptySub, {}, {}});
+    pool.parallelFor(stripes, [&](int i) {
+        const int y0 = static_cast<int>(static_cast<int64_t>(i) * height / stripes);
+        const int y1 = static_cast<int>(static_cast<int64_t>(i + 1) * height / stripes);
+        accumulateStripe(data, width, height, stride, y0, y1, layout, rois, moments, results[i]);
+    });
+
+    map.columns = layout.gridEnabled() ? layout.columns : 0;
+    map.rows = layout.gridEnabled() ? layout.rows : 0;
+    std::vector<PixelMoments> tileMoments(static_cast<size_t>(map.columns) * map.rows);
+    std::vector<PixelMoments> roiMoments(rois.size());
+    for (const auto& result : results) {
+        result.histogram.mergeInto(histogram);
+        for (size_t t = 0; t < tileMoments.size(); ++t) {
+            tileMoments[t] += result.tiles[t];
+        }
+        for (size_t r = 0; r < rois.size(); ++r) {
+            roiMoments[r] += result.rois[r];
+        }
+    }
+    map.tiles.clear();
+    map.tiles.reserve(tileMoments.size());
+    for (const PixelMoments& tile : tileMoments) {
+        map.tiles.push_back(momentsToRegionStats(tile, scale));
+    }
+    map.rois.clear();
+    for (const PixelMoments& roi : roiMoments) {
+        map.rois.push_back(momentsToRegionStats(roi, scale));
+    }
+}
+
+} // namespace tilestats_detail
+
+// 全体のヒストグラムとタイル/ROI統計を1パスで求める。
+// フレームを stripes 本の横ストライプに分けて pool で並列に処理し、部分和を足し合わせる。
+// moments はタイル/ROIの総和に使うカーネル (既定は実行時に選んだSIMD)。
+inline void calculateTileMap(const uint8_t* data, int width, int height, int stride,
+                             const TileLayout& layout, Histogram256& histogram, TileMap& map,
+                             int stripes, ReductionPool& pool,
+                             cpu_process_detail::MomentsKernel moments = cpu_process_detail::momentsKernel().kernel) {
+    tilestats_detail::calculateTileMap(data, width, height, stride, layout, histogram, map, stripes, pool, moments,
+                                       SubHistogram(), 1.0);
+}
+
+// 10〜16bitのフレーム (stride は画素数)。タイル/ROIの値は0〜255のスケールに直す
+inline void calculateTileMap(const uint16_t* data, int width, int height, int stride,
+                             const TileLayout& layout, Histogram16& histogram, TileMap& map,
+                             int stripes, ReductionPool& pool) {
+    tilestats_detail::calculateTileMap(data, width, height, stride, layout, histogram, map, stripes, pool,
+                                       cpu_process_detail::moments16Kernel().kernel,
+                                       SubHistogram16(histogram.bitDepth), eightBitScale(histogram.bitDepth));
+}
+
+#endif // TILESTATS_H
@@ -0,0 +1,196 @@
+#ifndef TRENDSTORE_H
+#define TRENDSTORE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// 統計の長期トレンドを、粒度の異なる数段の固定長リングに集約して持つ。
+// 各段 (既定は1秒・1分・1時間) は区間ごとの件数・最小・最大・平均・標準偏差を持つ。
+// add() は各段の開いている区間に足し込むだけなので段数に比例する一定時間で終わり、
+// メモリは起動時に確保したリングから増えない (古い区間は上書きされる)。
+class TrendStore {
+public:
+    static constexpr int kChannels = 3; // 平均, 標準偏差, K (いずれも呼び出し側で正規化した値)
+
+    // 1区間分の集計
+    struct Bucket {
+        double start = 0.0; // 区間の開始時刻 [s]
+        uint32_t count = 0;
+        std::array<float, kChannels> min{};
+        std::array<float, kChannels> max{};
+        std::array<double, kChannels> sum{};
+        std::array<double, kChannels> sumSq{};
+
+        void add(const std::array<float, kChannels>& values) {
+            for (int c = 0; c < kChannels; ++c) {
+                const float v = values[c];
+                min[c] = count ? std::min(min[c], v) : v;
+                max[c] = count ? std::max(max[c], v) : v;
+                sum[c] += v;
+                sumSq[c] += static_cast<double>(v) * v;
+            }
+            ++count;
+        }
+
+        // 隣り合う区間をまとめる (表示の間引き用)
+        void merge(const Bucket& other) {
+            if (other.count == 0) {
+                return;
+            }
+            for (int c = 0; c < kChannels; ++c) {
+                min[c] = count ? std::min(min[c], other.min[c]) : other.min[c];
+                max[c] = count ? std::max(max[c], other.max[c]) : other.max[c];
+                sum[c] += other.sum[c];
+                sumSq[c] += other.sumSq[c];
+            }
+            if (count == 0) {
+                start = other.start;
+            }
+            count += other.count;
+        }
+
+        double mean(int c) const {
+            return count ? sum[c] / count : 0.0;
+        }
+
+        double stddev(int c) const {
+            if (count < 2) {
+                return 0.0;
+            }
+            const double m = mean(c);
+            return std::sqrt(std::max(0.0, sumSq[c] / count - m * m));
+        }
+    };
+
+    // 1段分: width 秒ごとの区間を最大 capacity 個 (それより古いものは上書き)
+    class Tier {
+    public:
+        Tier(double width, size_t capacity) : width(width), ring(capacity) {}
+
+        double bucketWidth() const {
+            return width;
+        }
+
+        // 保持できる時間 [s]
+        double span() const {
+            return width * ring.size();
+        }
+
+        // 閉じた区間と集計中の区間を合わせた数
+        size_t size() const {
+            return count + (current.count ? 1 : 0);
+        }
+
+        // i = 0 が最も古い。最後は集計中の区間
+        const Bucket& at(size_t i) const {
+            if (i == count) {
+                return current;
+            }
+            return ring[(head + ring.size() - count + i) % ring.size()];
+        }
+
+        void add(double t, const std::array<float, kChannels>& values) {
+            const double start = std::floor(t / width) * width;
+            // 時刻が戻った場合は集計中の区間に入れる
+            if (current.count && start > current.start) {
+                close();
+            }
+            if (current.count == 0) {
+                current.start = start;
+            }
+            current.add(values);
+        }
+
+        void clear() {
+            head = 0;
+            count = 0;
+            current = Bucket();
+        }
+
+    private:
+        void close() {
+            ring[head] = current;
+            head = (head + 1) % ring.size();
+            count = std::min(count + 1, ring.size());
+            current = Bucket();
+        }
+
+        double width;
+        std::vector<Bucket> ring;
+        size_t head = 0;
+        size_t count = 0;
+        Bucket current;
+    };
+
+    struct TierSpec {
+        double width;    // 区間の長さ [s]
+        size_t capacity; // 区間の数
+    };
+
+    // 1秒 × 1時間、1分 × 1日、1時間 × 30日
+    static std::vector<TierSpec> defaultTiers() {
+        return {{1.0, 3600}, {60.0, 1440}, {3600.0, 720}};
+    }
+
+    explicit TrendStore(const std::vector<TierSpec>& specs = defaultTiers()) {
+        tiers.reserve(specs.size());
+        for (const TierSpec& spec : specs) {
+            tiers.emplace_back(spec.width, spec.capacity);
+        }
+    }
+
+    void add(double t, const std::array<float, kChannels>& values) {
+        for (Tier& tier : tiers) {
+            tier.add(t, values);
+        }
+        ++samples;
+    }
+
+    int tierCount() const {
+        return static_cast<int>(tiers.size());
+    }
+
+    const Tier& tier(int index) const {
+        return tiers.at(index);
+    }
+
+    // これまでに add() した数 (再描画の要否の判定用)
+    uint64_t sampleCount() const {
+        return samples;
+    }
+
+    void clear() {
+        for (Tier& tier : tiers) {
+            tier.clear();
+        }
+        samples = 0;
+    }
+
+    // tier の区間を、隣り合うものをまとめて最大 maxPoints 個にして out に詰める
+    static void decimate(const Tier& tier, size_t maxPoints, std::vector<Bucket>& out) {
+        out.clear();
+        const size_t n = tier.size();
+        if (n == 0) {
+            return;
+        }
+        const size_t group = maxPoints > 0 ? (n + maxPoints - 1) / maxPoints : n;
+        for (size_t begin = 0; begin < n; begin += group) {
+            Bucket merged;
+            for (size_t i = begin; i < std::min(begin + group, n); ++i) {
+                merged.merge(tier.at(i));
+            }
+            out.push_back(merged);
+        }
+    }
+
+private:
+    std::vector<Tier> tiers;
+    uint64_t samples = 0;
+};
+
+#endif // TRENDSTORE_H
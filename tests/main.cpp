@@ -0,0 +1,351 @@
+// Qt も Spinnaker も使わずに確かめられるヘッダだけの部分の回帰テスト。
+// 可逆圧縮の往復、画素形式の展開カーネル (SIMD とスカラーの一致)、
+// クラッシュした記録 (.jcr/.jci) とテレメトリログ (.jtl) の読み直し・追記の再開を確かめる。
+// 失敗した項目を表示し、1つでも失敗すれば終了コード1を返す。
+//   ./jetsonCamTests
+#include "losslesscodec.h"
+#include "pixelunpack.h"
+#include "rawcontainer.h"
+#include "telemetrylog.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures;                                                               \
+        }                                                                             \
+    } while (0)
+
+// テストごとの作業フォルダ (/tmp の下に作り、終わったら消す)
+class TempDir {
+public:
+    TempDir() {
+        char pattern[] = "/tmp/jetsoncam_tests_XXXXXX";
+        if (!mkdtemp(pattern)) {
+            std::perror("mkdtemp");
+            std::exit(1);
+        }
+        path = pattern;
+    }
+
+    ~TempDir() {
+        for (const std::string& file : files) {
+            unlink(file.c_str());
+        }
+        rmdir(path.c_str());
+    }
+
+    std::string file(const std::string& name) {
+        files.push_back(path + "/" + name);
+        return files.back();
+    }
+
+private:
+    std::string path;
+    std::vector<std::string> files;
+};
+
+off_t fileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+void writeAt(const std::string& path, off_t offset, const void* data, size_t size) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    CHECK(fd >= 0 && pwrite(fd, data, size, offset) == static_cast<ssize_t>(size));
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// 平らな部分、勾配、雑音を混ぜた画像 (行末に stride - width 画素の詰め物)
+std::vector<uint16_t> testImage(int width, int height, int stride, int bits, unsigned seed) {
+    std::mt19937 rng(seed);
+    const int maxValue = (1 << bits) - 1;
+    std::vector<uint16_t> image(static_cast<size_t>(stride) * height, 0xabcd & maxValue);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int v;
+            if (y < height / 3) {
+                v = maxValue / 2;
+            } else if (y < 2 * height / 3) {
+                v = (x * maxValue) / std::max(1, width - 1);
+            } else {
+                v = static_cast<int>(rng() % (maxValue + 1));
+            }
+            image[static_cast<size_t>(y) * stride + x] = static_cast<uint16_t>(v);
+        }
+    }
+    return image;
+}
+
+void testLosslessRoundTrip() {
+    losslesscodec::FrameEncoder encoder;
+    const int sizes[][2] = {{1, 1}, {7, 3}, {33, 17}, {640, 48}};
+    for (int bits : {8, 10, 12, 16}) {
+        for (const auto& size : sizes) {
+            const int width = size[0];
+            const int height = size[1];
+            const int stride = width + 5;
+            const size_t bytesPerPixel = bits <= 8 ? 1 : 2;
+            const std::vector<uint16_t> image = testImage(width, height, stride, bits, width * 31 + bits);
+            std::vector<uint8_t> src(static_cast<size_t>(stride) * height * bytesPerPixel);
+            for (size_t i = 0; i < image.size(); ++i) {
+                if (bytesPerPixel == 1) {
+                    src[i] = static_cast<uint8_t>(image[i]);
+                } else {
+                    std::memcpy(&src[i * 2], &image[i], 2);
+                }
+            }
+            const size_t strideBytes = stride * bytesPerPixel;
+            for (int stripes : {1, 4}) {
+                const std::vector<uint8_t> encoded = encoder.encode(src.data(), width, height, strideBytes, bits,
+                                                                    stripes, losslesscodec::Sequential());
+                std::vector<uint8_t> decoded(src.size());
+                CHECK(losslesscodec::decodeFrame(encoded.data(), encoded.size(), decoded.data(), strideBytes, width,
+                                                 height, bits));
+                bool same = true;
+                for (int y = 0; y < height; ++y) {
+                    same = same && std::memcmp(&src[y * strideBytes], &decoded[y * strideBytes],
+                                               width * bytesPerPixel) == 0;
+                }
+                CHECK(same);
+
+                // 大きさ・深さ・行の間隔が合わないときと、途中で切れたときは失敗する
+                CHECK(!losslesscodec::decodeFrame(encoded.data(), encoded.size(), decoded.data(), strideBytes,
+                                                  width + 1, height, bits));
+                CHECK(!losslesscodec::decodeFrame(encoded.data(), encoded.size(), decoded.data(), strideBytes, width,
+                                                  height + 1, bits));
+                CHECK(!losslesscodec::decodeFrame(encoded.data(), encoded.size(), decoded.data(), strideBytes, width,
+                                                  height, bits == 16 ? 12 : bits + 2));
+                CHECK(!losslesscodec::decodeFrame(encoded.data(), encoded.size(), decoded.data(),
+                                                  width * bytesPerPixel - 1, width, height, bits));
+                CHECK(!losslesscodec::decodeFrame(encoded.data(), encoded.size() / 2, decoded.data(), strideBytes,
+                                                  width, height, bits));
+            }
+        }
+    }
+}
+
+// 選ばれた (SIMD の) カーネルがスカラーの実装と、スカラーの実装が詰める前の値と一致するか
+void testUnpackKernels() {
+    namespace detail = pixelformat_detail;
+    const SensorFormat formats[] = {SensorFormat::Mono10,       SensorFormat::Mono10p, SensorFormat::Mono10Packed,
+                                    SensorFormat::Mono12,       SensorFormat::Mono12p, SensorFormat::Mono12Packed,
+                                    SensorFormat::Mono14,       SensorFormat::Mono16};
+    const ToneMap tones[] = {ToneMap(), ToneMap{64, 900}};
+    std::mt19937 rng(7);
+    for (SensorFormat format : formats) {
+        const int bits = sensorBitDepth(format);
+        detail::UnpackKernel scalar = detail::unpack16Scalar;
+        if (format == SensorFormat::Mono10p) {
+            scalar = detail::unpackLsbScalar<10>;
+        } else if (format == SensorFormat::Mono12p) {
+            scalar = detail::unpackLsbScalar<12>;
+        } else if (format == SensorFormat::Mono10Packed) {
+            scalar = detail::unpackGigeScalar<10>;
+        } else if (format == SensorFormat::Mono12Packed) {
+            scalar = detail::unpackGigeScalar<12>;
+        }
+        const detail::UnpackKernelEntry entry = detail::selectUnpackKernel(format);
+        CHECK(entry.kernel != nullptr);
+        for (int width : {1, 2, 15, 16, 17, 31, 32, 33, 47, 64, 67, 2448}) {
+            std::vector<uint16_t> values(width);
+            for (uint16_t& v : values) {
+                v = static_cast<uint16_t>(rng() & ((1u << bits) - 1));
+            }
+            values[0] = static_cast<uint16_t>((1u << bits) - 1);
+            // カーネルは行末を越えて読むことがあるので、実際の行と同じく余裕を持たせる
+            std::vector<uint8_t> packed(packedRowBytes(format, width) + 64);
+            detail::packRow(format, values.data(), packed.data(), width);
+            for (const ToneMap& tone : tones) {
+                const detail::ToneParams params = detail::toneParams(bits, tone);
+                std::vector<uint16_t> wide(width + 16);
+                std::vector<uint8_t> narrow(width + 16);
+                std::vector<uint16_t> expectedWide(width + 16);
+                std::vector<uint8_t> expectedNarrow(width + 16);
+                scalar(packed.data(), expectedWide.data(), expectedNarrow.data(), width, params);
+                entry.kernel(packed.data(), wide.data(), narrow.data(), width, params);
+                bool same = true;
+                bool roundTrip = true;
+                for (int x = 0; x < width; ++x) {
+                    same = same && wide[x] == expectedWide[x] && narrow[x] == expectedNarrow[x];
+                    roundTrip = roundTrip && expectedWide[x] == values[x]
+                                && expectedNarrow[x] == detail::toneScalar(values[x], params);
+                }
+                if (!same || !roundTrip) {
+                    std::fprintf(stderr, "%s (%s) width %d\n", sensorFormatName(format), entry.name, width);
+                }
+                CHECK(same);
+                CHECK(roundTrip);
+            }
+        }
+    }
+}
+
+void writeContainer(const std::string& path, int frames, std::vector<uint8_t>& image) {
+    rawcontainer::Writer writer;
+    writer.open(path, 64, 10, 64, rawcontainer::PixelMono8, 1, 0);
+    image.assign(64 * 10, 7);
+    for (int i = 0; i < frames; ++i) {
+        writer.append(i, i * 0.5, 30.0, image.data(), image.size());
+    }
+    writer.close();
+}
+
+void testContainerRecovery() {
+    TempDir dir;
+    const std::string path = dir.file("rec.jcr");
+    const std::string index = dir.file("rec.jci");
+    std::vector<uint8_t> image;
+
+    writeContainer(path, 5, image);
+    {
+        rawcontainer::Reader reader(path);
+        CHECK(reader.frameCount() == 5);
+        CHECK(reader.frame(4).header->frameNumber == 4);
+        CHECK(std::memcmp(reader.frame(2).data, image.data(), image.size()) == 0);
+    }
+
+    // 書きかけの最後のレコードは、索引があってもなくても含めない
+    CHECK(truncate(path.c_str(), fileSize(path) - 100) == 0);
+    {
+        rawcontainer::Reader reader(path);
+        CHECK(reader.frameCount() == 4);
+    }
+    unlink(index.c_str());
+    {
+        rawcontainer::Reader reader(path);
+        CHECK(reader.frameCount() == 4);
+        CHECK(reader.seek(3) == 3);
+    }
+
+    // 索引の途中の項目が壊れていたら索引を捨ててレコードをたどる
+    writeContainer(path, 5, image);
+    const rawcontainer::IndexEntry bad{2, 12345, 1.0};
+    writeAt(index, 2 * sizeof(rawcontainer::IndexEntry), &bad, sizeof(bad));
+    {
+        rawcontainer::Reader reader(path);
+        CHECK(reader.frameCount() == 5);
+        CHECK(reader.frame(2).header->frameNumber == 2);
+    }
+
+    // 溢れるほど大きい payloadSize のレコードの手前で止まる
+    uint64_t offset = 0;
+    {
+        rawcontainer::Reader reader(path);
+        offset = reader.index()[2].offset;
+    }
+    const uint64_t huge = ~0ull - 50;
+    writeAt(path, static_cast<off_t>(offset + offsetof(rawcontainer::FrameRecordHeader, payloadSize)), &huge,
+            sizeof(huge));
+    unlink(index.c_str());
+    {
+        rawcontainer::Reader reader(path);
+        CHECK(reader.frameCount() == 2);
+    }
+}
+
+void appendGraph(const std::string& path, int64_t first, int count) {
+    telemetrylog::Writer<telemetrylog::GraphRecord> writer;
+    writer.open(path);
+    std::vector<telemetrylog::GraphRecord> records(count);
+    for (int i = 0; i < count; ++i) {
+        records[i] = telemetrylog::GraphRecord{};
+        records[i].frameNumber = first + i;
+        records[i].mean = static_cast<float>(i);
+    }
+    writer.append(records.data(), records.size());
+}
+
+void testTelemetryRecovery() {
+    TempDir dir;
+    const std::string path = dir.file("graph_data.jtl");
+    const size_t headerSize = sizeof(telemetrylog::LogHeader);
+    const size_t recordSize = sizeof(telemetrylog::GraphRecord);
+
+    appendGraph(path, 0, 10);
+    {
+        telemetrylog::Reader<telemetrylog::GraphRecord> reader(path);
+        CHECK(reader.size() == 10);
+    }
+
+    // 書きかけの末尾は切り詰めてから追記する
+    CHECK(truncate(path.c_str(), static_cast<off_t>(headerSize + 9 * recordSize + 10)) == 0);
+    appendGraph(path, 100, 2);
+    {
+        telemetrylog::Reader<telemetrylog::GraphRecord> reader(path);
+        CHECK(reader.size() == 11);
+        CHECK(reader.size() == 11 && reader[8].frameNumber == 8 && reader[9].frameNumber == 100);
+    }
+
+    // 途中の壊れたレコードから先は読み手から見えないので、そこで切り詰めて続きを書く
+    const telemetrylog::GraphRecord torn{};
+    writeAt(path, static_cast<off_t>(headerSize + 3 * recordSize), &torn, sizeof(torn));
+    appendGraph(path, 200, 2);
+    {
+        telemetrylog::Reader<telemetrylog::GraphRecord> reader(path);
+        CHECK(reader.size() == 5);
+        CHECK(reader.size() == 5 && reader[2].frameNumber == 2 && reader[3].frameNumber == 200);
+        CHECK(fileSize(path) == static_cast<off_t>(headerSize + 5 * recordSize));
+    }
+
+    // ヘッダを書き終える前に止まったファイルは空のファイルと同じに扱う
+    CHECK(truncate(path.c_str(), 20) == 0);
+    appendGraph(path, 300, 3);
+    {
+        telemetrylog::Reader<telemetrylog::GraphRecord> reader(path);
+        CHECK(reader.size() == 3);
+        CHECK(reader.size() == 3 && reader[0].frameNumber == 300);
+    }
+
+    // 別の種類のログには追記しない
+    bool rejected = false;
+    try {
+        telemetrylog::Writer<telemetrylog::TileRecord> tiles;
+        tiles.open(path);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    CHECK(rejected);
+}
+
+} // namespace
+
+int main() {
+    const struct {
+        const char* name;
+        void (*run)();
+    } tests[] = {
+        {"lossless round trip", testLosslessRoundTrip},
+        {"unpack kernels", testUnpackKernels},
+        {"container recovery", testContainerRecovery},
+        {"telemetry log recovery", testTelemetryRecovery},
+    };
+    for (const auto& test : tests) {
+        const int before = failures;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s: unexpected exception: %s\n", test.name, e.what());
+            ++failures;
+        }
+        std::printf("%s: %s\n", failures == before ? "PASS" : "FAIL", test.name);
+    }
+    return failures == 0 ? 0 : 1;
+}
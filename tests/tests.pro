@@ -0,0 +1,6 @@
+TEMPLATE = app
+TARGET = jetsonCamTests
+QT -= core gui
+CONFIG += console testcase
+include(../common.pri)
+SOURCES += main.cpp
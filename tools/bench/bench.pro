@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = jetsonCamBench
+QT += concurrent gui
+QT -= widgets
+CONFIG += console
+include(../../common.pri)
+SOURCES += main.cpp
+HEADERS += $$PWD/../../src/framepipeline.h
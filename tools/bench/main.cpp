@@ -0,0 +1,240 @@
+// 合成フレームをパイプライン全体 (取得→統計→記録→ログ) に最大速度で流し、
+// 解像度ごとの持続fps、各段のレイテンシ、CPU使用率を表示するヘッドレスベンチマーク。
+// --cameras で複数の合成フレーム源を同時に動かし、カメラごとのfpsと時刻のずれも表示する。
+// --formats で10〜16bitの画素形式も流し、展開 (copy の段) と16bitの統計の負荷を比べられる。
+#include "camerarig.h"
+#include "framepipeline.h"
+#include "syntheticsource.h"
+#include "stagestats.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+static double cpuSeconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void printStage(const char* name, const StageStats& stage) {
+    const LatencyHistogram::Snapshot counts = stage.histogram.snapshot();
+    std::printf("  %-12s n=%-8llu mean=%8.3f ms  p50=%8.3f ms  p99=%8.3f ms  max=%8.3f ms\n", name,
+                static_cast<unsigned long long>(stage.count.load()), stage.meanMs(),
+                LatencyHistogram::percentileNs(counts, 0.5) / 1e6, LatencyHistogram::percentileNs(counts, 0.99) / 1e6,
+                stage.maxMs());
+}
+
+struct BenchOptions {
+    double seconds = 10.0;
+    int grid = 0;
+    int cameras = 1;
+    std::vector<int> captureCores;
+    bool record = false;
+    bool lossless = false;
+    FramePipeline::OverloadPolicy overload = FramePipeline::OverloadPolicy::Block;
+};
+
+static void runBenchmark(const SyntheticSource::Settings& settings, const BenchOptions& options) {
+    QTemporaryDir outputDir;
+
+    std::printf("=== %dx%d %s (%s, %d camera%s, grid %d, record %s, overload %s) ===\n", settings.width,
+                settings.height, sensorFormatName(settings.format),
+                settings.frameRate > 0.0 ? QByteArray::number(settings.frameRate).constData() : "max",
+                options.cameras, options.cameras > 1 ? "s" : "", options.grid,
+                options.record ? (options.lossless ? "lossless" : "raw") : "off",
+                options.overload == FramePipeline::OverloadPolicy::Drop ? "drop" : "block");
+
+    std::vector<std::unique_ptr<FrameSource>> sources;
+    for (int i = 0; i < options.cameras; ++i) {
+        SyntheticSource::Settings cameraSettings = settings;
+        cameraSettings.seed = static_cast<unsigned>(2 * i + 1);
+        sources.push_back(std::make_unique<SyntheticSource>(cameraSettings));
+    }
+    if (settings.format != SensorFormat::Mono8) {
+        std::printf("  unpack    %s\n", static_cast<const SyntheticSource&>(*sources.front()).unpackKernelName());
+    }
+
+    const double cpuStart = cpuSeconds();
+    QElapsedTimer wall;
+    {
+        CameraRig rig(std::move(sources), options.captureCores);
+        rig.setGraphDirectory(outputDir.path());
+        rig.setRecordFormat(options.lossless ? FramePipeline::RecordFormat::Lossless : FramePipeline::RecordFormat::Container);
+        rig.setRecording(options.record, outputDir.path());
+        rig.setOverloadPolicy(options.overload);
+        if (options.grid > 0) {
+            auto layout = std::make_shared<TileLayout>();
+            layout->columns = options.grid;
+            layout->rows = options.grid;
+            rig.setTileLayout(layout);
+        }
+
+        // 表示の代わりに、GUIと同じ間隔で各カメラのプレビューを受け取る
+        // カメラごとの最新のタイムスタンプ (共通の基準からの秒) も見ておき、ずれを測る
+        std::vector<double> latestTimestamp(rig.size(), 0.0);
+        double maxSkew = 0.0;
+        for (int i = 0; i < rig.size(); ++i) {
+            rig.pipeline(i).preview().setTargetSize(QSize(640, 480));
+            QObject::connect(&rig.pipeline(i), &FramePipeline::graphDataReady, [&, i](const FrameStats& stats) {
+                latestTimestamp[i] = stats.timestamp;
+            });
+        }
+        QTimer displayTimer;
+        QObject::connect(&displayTimer, &QTimer::timeout, [&]() {
+            for (int i = 0; i < rig.size(); ++i) {
+                PreviewFrame preview;
+                rig.pipeline(i).preview().takeLatest(preview);
+            }
+            const auto range = std::minmax_element(latestTimestamp.begin(), latestTimestamp.end());
+            if (*range.first > 0.0) {
+                maxSkew = std::max(maxSkew, *range.second - *range.first);
+            }
+        });
+
+        wall.start();
+        rig.start();
+        displayTimer.start(33);
+
+        QEventLoop loop;
+        QTimer::singleShot(static_cast<int>(options.seconds * 1000), &loop, &QEventLoop::quit);
+        loop.exec();
+
+        displayTimer.stop();
+        for (int i = 0; i < rig.size(); ++i) {
+            rig.pipeline(i).stopAcquisition();
+        }
+        const double elapsed = wall.nsecsElapsed() / 1e9;
+        const double cpu = cpuSeconds() - cpuStart;
+
+        uint64_t capturedTotal = 0;
+        uint64_t processedTotal = 0;
+        for (int i = 0; i < rig.size(); ++i) {
+            capturedTotal += rig.pipeline(i).acquisition().capturedCount();
+            processedTotal += rig.pipeline(i).processedCount();
+        }
+        std::printf("  captured  %8.1f fps\n", capturedTotal / elapsed);
+        std::printf("  processed %8.1f fps (sustained)\n", processedTotal / elapsed);
+        std::printf("  cpu       %.2f cores of %ld\n", cpu / elapsed, sysconf(_SC_NPROCESSORS_ONLN));
+        if (rig.size() > 1) {
+            std::printf("  skew      %.3f s max between the latest results of the cameras\n", maxSkew);
+        }
+        for (int i = 0; i < rig.size(); ++i) {
+            const FramePipeline& pipeline = rig.pipeline(i);
+            const PipelineTimings& timings = pipeline.timings();
+            const FramePool& pool = rig.source(i).framePool();
+            if (rig.size() > 1) {
+                std::printf("  -- camera %d: captured %.1f fps, processed %.1f fps\n", i,
+                            pipeline.acquisition().capturedCount() / elapsed, pipeline.processedCount() / elapsed);
+            }
+            std::printf("  dropped   stats %llu, overload %llu, record %llu, pool exhausted %llu\n",
+                        static_cast<unsigned long long>(pipeline.statsQueue().droppedCount()),
+                        static_cast<unsigned long long>(pipeline.overloadDroppedCount()),
+                        static_cast<unsigned long long>(pipeline.recordQueue().droppedCount()),
+                        static_cast<unsigned long long>(pool.exhaustedCount()));
+            std::printf("  reorder   peak %zu of %d in flight\n", pipeline.reorderPeak(), pipeline.inFlightCapacity());
+            const FrameRecorder& recorder = pipeline.recorder();
+            if (recorder.encodedBytesCompressed() > 0) {
+                std::printf("  lossless  ratio %.2f, %.1f MB/s per core, written %.1f MB/s\n",
+                            static_cast<double>(recorder.rawBytesCompressed()) / recorder.encodedBytesCompressed(),
+                            recorder.rawBytesCompressed() / (recorder.encodeCpuNs() / 1e9) / 1e6,
+                            recorder.bytesWritten() / elapsed / 1e6);
+            }
+            printStage("capture wait", timings.captureWait);
+            printStage("copy", timings.copy);
+            printStage("queue wait", timings.queueWait);
+            printStage("stats", timings.stats);
+            printStage("preview", timings.preview);
+            printStage("record", timings.record);
+        }
+        printStage("log", rig.logTimings());
+    }
+    std::printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless throughput benchmark of the acquisition pipeline.");
+    parser.addHelpOption();
+    parser.addOption({"resolutions", "Comma separated list of WxH[@fps] (no fps = as fast as possible).", "list",
+                      "640x480,1440x1080,2048x1536,2448x2048"});
+    parser.addOption({"formats", "Comma separated pixel formats (mono8, mono10, mono10p, mono10packed, mono12, mono12p, "
+                                 "mono12packed, mono14, mono16).", "list", "mono8"});
+    parser.addOption({"seconds", "Duration per resolution and format.", "seconds", "10"});
+    parser.addOption({"grid", "Tile grid size (0 = off).", "n", "0"});
+    parser.addOption({"noise", "Noise standard deviation.", "sigma", "10"});
+    parser.addOption({"cameras", "Number of synthetic cameras running at the same time.", "n", "1"});
+    parser.addOption({"capture-cores", "Comma separated CPU cores for the capture thread of each camera.", "list"});
+    parser.addOption({"record", "Save images while benchmarking."});
+    parser.addOption({"record-format", "Recording format with --record: raw or lossless.", "format", "raw"});
+    parser.addOption({"overload", "What to do when statistics fall behind: block or drop.", "policy", "block"});
+    parser.process(app);
+
+    const QString overloadName = parser.value("overload");
+    if (overloadName != "block" && overloadName != "drop") {
+        std::cerr << "Invalid --overload value. Use block or drop." << std::endl;
+        return 1;
+    }
+    BenchOptions options;
+    options.overload = overloadName == "drop" ? FramePipeline::OverloadPolicy::Drop : FramePipeline::OverloadPolicy::Block;
+
+    const QString recordFormat = parser.value("record-format");
+    if (recordFormat != "raw" && recordFormat != "lossless") {
+        std::cerr << "Invalid --record-format value. Use raw or lossless." << std::endl;
+        return 1;
+    }
+    options.seconds = parser.value("seconds").toDouble();
+    options.grid = parser.value("grid").toInt();
+    options.cameras = std::max(1, parser.value("cameras").toInt());
+    options.record = parser.isSet("record");
+    options.lossless = recordFormat == "lossless";
+    if (!parseCoreList(parser.value("capture-cores"), options.captureCores)) {
+        std::cerr << "Invalid --capture-cores value." << std::endl;
+        return 1;
+    }
+
+    std::vector<SensorFormat> formats;
+    for (const QString& name : parser.value("formats").split(',', QString::SkipEmptyParts)) {
+        SensorFormat format;
+        if (!parseSensorFormat(name, format)) {
+            std::cerr << "Invalid pixel format: " << name.toStdString() << std::endl;
+            return 1;
+        }
+        formats.push_back(format);
+    }
+
+    QThreadPool::globalInstance()->setMaxThreadCount(4);
+    std::cout << "Statistics kernel: " << momentsKernelName() << " (16-bit: " << moments16KernelName() << ")"
+              << std::endl;
+    std::cout << "Preview kernel: " << downsampleKernelName() << std::endl << std::endl;
+
+    const QStringList specs = parser.value("resolutions").split(',', QString::SkipEmptyParts);
+    for (const QString& spec : specs) {
+        SyntheticSource::Settings settings;
+        settings.frameRate = 0.0;
+        settings.noise = parser.value("noise").toDouble();
+        if (!parseSyntheticSpec(spec.trimmed(), settings)) {
+            std::cerr << "Invalid resolution: " << spec.toStdString() << std::endl;
+            return 1;
+        }
+        for (SensorFormat format : formats) {
+            settings.format = format;
+            runBenchmark(settings, options);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = jetsonCamCodecCheck
+QT += concurrent gui
+QT -= widgets
+CONFIG += console
+include(../../common.pri)
+SOURCES += main.cpp
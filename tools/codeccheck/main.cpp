@@ -0,0 +1,183 @@
+// 可逆圧縮 (losslesscodec) の往復検証と速度測定。
+// 記録コンテナ (.jcr) のフレーム、または合成フレームを圧縮→復号して元と一致するかを確かめ、
+// 圧縮率、圧縮/復号のスループット、コア1つあたりのスループットを表示する。
+#include "losslesscodec.h"
+#include "rawcontainer.h"
+#include "syntheticsource.h"
+#include "stagestats.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct Totals {
+    uint64_t frames = 0;
+    uint64_t mismatches = 0;
+    uint64_t rawBytes = 0;
+    uint64_t encodedBytes = 0;
+    uint64_t encodeWallNs = 0;
+    uint64_t decodeWallNs = 0;
+    std::atomic<uint64_t> encodeCpuNs{0};
+    std::atomic<uint64_t> decodeCpuNs{0};
+};
+
+class Checker {
+public:
+    Checker(int threads, int stripesPerThread) : stripeCount(threads * stripesPerThread) {
+        pool.setMaxThreadCount(threads);
+    }
+
+    // 1フレームを圧縮→復号して比較する
+    void check(const uint8_t* data, int width, int height, size_t stride, int bits) {
+        const int bytesPerPixel = bits <= 8 ? 1 : 2;
+        const size_t rowBytes = static_cast<size_t>(width) * bytesPerPixel;
+
+        uint64_t start = monotonicNs();
+        const std::vector<uint8_t>& encoded = encoder.encode(data, width, height, stride, bits, stripeCount,
+                                                             parallel(totals.encodeCpuNs));
+        totals.encodeWallNs += monotonicNs() - start;
+
+        decoded.resize(rowBytes * height);
+        start = monotonicNs();
+        const bool ok = losslesscodec::decodeFrame(encoded.data(), encoded.size(), decoded.data(), rowBytes, width,
+                                                   height, bits, parallel(totals.decodeCpuNs));
+        totals.decodeWallNs += monotonicNs() - start;
+
+        bool same = ok;
+        for (int y = 0; same && y < height; ++y) {
+            same = std::memcmp(data + static_cast<size_t>(y) * stride, decoded.data() + y * rowBytes, rowBytes) == 0;
+        }
+        ++totals.frames;
+        totals.mismatches += same ? 0 : 1;
+        totals.rawBytes += rowBytes * height;
+        totals.encodedBytes += encoded.size();
+    }
+
+    const Totals& result() const {
+        return totals;
+    }
+
+private:
+    // ストライプを専用プールで並列に処理し、ストライプごとの処理時間を cpuNs に足す
+    std::function<void(int, const std::function<void(int)>&)> parallel(std::atomic<uint64_t>& cpuNs) {
+        return [this, &cpuNs](int count, const std::function<void(int)>& function) {
+            std::vector<QFuture<void>> futures;
+            futures.reserve(count);
+            for (int i = 0; i < count; ++i) {
+                futures.push_back(QtConcurrent::run(&pool, [i, &function, &cpuNs]() {
+                    const uint64_t start = monotonicNs();
+                    function(i);
+                    cpuNs.fetch_add(monotonicNs() - start, std::memory_order_relaxed);
+                }));
+            }
+            for (QFuture<void>& future : futures) {
+                future.waitForFinished();
+            }
+        };
+    }
+
+    const int stripeCount;
+    QThreadPool pool;
+    losslesscodec::FrameEncoder encoder;
+    std::vector<uint8_t> decoded;
+    Totals totals;
+};
+
+bool checkContainer(const QString& path, Checker& checker, int maxFrames) {
+    try {
+        rawcontainer::Reader reader(path.toStdString());
+        const rawcontainer::ContainerHeader& header = reader.header();
+        const int bits = rawcontainer::bitDepth(header);
+        std::vector<uint8_t> plain;
+        for (size_t f = 0; f < reader.frameCount() && (maxFrames <= 0 || checker.result().frames < static_cast<uint64_t>(maxFrames)); ++f) {
+            const rawcontainer::Reader::Frame frame = reader.frame(f);
+            const uint8_t* data = frame.data;
+            size_t stride = header.stride;
+            if (frame.header->flags & rawcontainer::kFlagLossless) {
+                // 圧縮済みのフレームは一度復号してから往復させる
+                stride = static_cast<size_t>(header.width) * header.bytesPerPixel;
+                plain.resize(stride * header.height);
+                if (!losslesscodec::decodeFrame(frame.data, frame.header->payloadSize, plain.data(), stride,
+                                                header.width, header.height, bits)) {
+                    std::cerr << path.toStdString() << ": frame " << frame.header->frameNumber << " is corrupted" << std::endl;
+                    return false;
+                }
+                data = plain.data();
+            }
+            checker.check(data, header.width, header.height, stride, bits);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Round-trip check and throughput of the lossless recording codec.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("recordings", "Optional .jcr files (default: synthetic frames).", "[file.jcr...]");
+    parser.addOption({"synthetic", "Synthetic frame size WxH.", "size", "2448x2048"});
+    parser.addOption({"noise", "Noise standard deviation of synthetic frames.", "sigma", "4"});
+    parser.addOption({"frames", "Number of frames to check (0 = all frames of the recordings).", "n", "100"});
+    parser.addOption({"threads", "Encoder/decoder threads.", "n", QString::number(QThread::idealThreadCount())});
+    parser.process(app);
+
+    const int threads = std::max(1, parser.value("threads").toInt());
+    const int maxFrames = parser.value("frames").toInt();
+    Checker checker(threads, 2);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty()) {
+        SyntheticSource::Settings settings;
+        settings.frameRate = 0.0;
+        settings.noise = parser.value("noise").toDouble();
+        if (!parseSyntheticSpec(parser.value("synthetic"), settings)) {
+            std::cerr << "Invalid --synthetic value." << std::endl;
+            return 1;
+        }
+        SyntheticSource source(settings);
+        for (int i = 0; i < std::max(1, maxFrames); ++i) {
+            const FrameRef frame = source.captureImage();
+            checker.check(frame->data, frame->width, frame->height, frame->stride, 8);
+        }
+    } else {
+        for (const QString& file : files) {
+            if (!checkContainer(file, checker, maxFrames)) {
+                return 1;
+            }
+        }
+    }
+
+    const Totals& totals = checker.result();
+    if (totals.frames == 0) {
+        std::cerr << "No frames." << std::endl;
+        return 1;
+    }
+    const double mb = totals.rawBytes / 1e6;
+    std::printf("frames        %llu (%d threads)\n", static_cast<unsigned long long>(totals.frames), threads);
+    std::printf("ratio         %.3f (%.1f%% of raw)\n", static_cast<double>(totals.rawBytes) / totals.encodedBytes,
+                100.0 * totals.encodedBytes / totals.rawBytes);
+    std::printf("encode        %8.1f MB/s, %8.1f MB/s per core\n", mb / (totals.encodeWallNs / 1e9),
+                mb / (totals.encodeCpuNs.load() / 1e9));
+    std::printf("decode        %8.1f MB/s, %8.1f MB/s per core\n", mb / (totals.decodeWallNs / 1e9),
+                mb / (totals.decodeCpuNs.load() / 1e9));
+    std::printf("round trip    %s (%llu mismatches)\n", totals.mismatches == 0 ? "OK" : "FAILED",
+                static_cast<unsigned long long>(totals.mismatches));
+    return totals.mismatches == 0 ? 0 : 2;
+}
@@ -0,0 +1,6 @@
+TEMPLATE = app
+TARGET = jetsonCamLog2Csv
+QT -= gui
+CONFIG += console
+include(../../common.pri)
+SOURCES += main.cpp
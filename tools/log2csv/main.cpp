@@ -0,0 +1,110 @@
+// 解析結果のバイナリログ (.jtl) を従来と同じ形式のCSVに変換する。
+// graph_data.jtl → Frame,TimeStamp,Temperature,Mean,StdDev,CV,P01,P50,P99,Saturated,Dark
+// tile_data.jtl  → Frame,Region,Mean,StdDev,CV (Region は T<行>_<列> または ROI<番号>)
+// 複数カメラのログでは先頭に Camera 列を付ける。
+#include "telemetrylog.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+
+// 2台目以降のカメラのレコードがあるか
+template <typename Record>
+static bool hasMultipleCameras(const telemetrylog::Reader<Record>& reader) {
+    for (const Record& row : reader) {
+        if (row.camera != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void writeGraph(const std::string& path, FILE* out) {
+    telemetrylog::Reader<telemetrylog::GraphRecord> reader(path);
+    const bool cameraColumn = hasMultipleCameras(reader);
+    std::fprintf(out, "%sFrame,TimeStamp,Temperature,Mean,StdDev,CV,P01,P50,P99,Saturated,Dark\n", cameraColumn ? "Camera," : "");
+    for (const telemetrylog::GraphRecord& row : reader) {
+        if (cameraColumn) {
+            std::fprintf(out, "%u,", row.camera);
+        }
+        std::fprintf(out, "%lld,%.15g,%.15g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                     static_cast<long long>(row.frameNumber), row.timestamp, row.temp,
+                     row.mean / 255.0f, row.stddev / 255.0f, row.cv, row.p01, row.p50, row.p99,
+                     row.saturatedFraction, row.darkFraction);
+    }
+}
+
+static void writeTiles(const std::string& path, FILE* out) {
+    telemetrylog::Reader<telemetrylog::TileRecord> reader(path);
+    const bool cameraColumn = hasMultipleCameras(reader);
+    std::fprintf(out, "%sFrame,Region,Mean,StdDev,CV\n", cameraColumn ? "Camera," : "");
+    for (const telemetrylog::TileRecord& row : reader) {
+        if (cameraColumn) {
+            std::fprintf(out, "%u,", static_cast<unsigned>(row.camera));
+        }
+        if (row.kind == telemetrylog::TileRecord::Roi) {
+            std::fprintf(out, "%lld,ROI%d,", static_cast<long long>(row.frameNumber), row.index);
+        } else {
+            const int columns = row.columns > 0 ? row.columns : 1;
+            std::fprintf(out, "%lld,T%d_%d,", static_cast<long long>(row.frameNumber), row.index / columns,
+                         row.index % columns);
+        }
+        std::fprintf(out, "%.9g,%.9g,%.9g\n", row.mean / 255.0f, row.stddev / 255.0f, row.cv);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Convert a telemetry log (.jtl) to CSV.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("log", "graph_data.jtl or tile_data.jtl.");
+    parser.addPositionalArgument("output", "Output CSV (default: same name with .csv, '-' = stdout).", "[output]");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty() || args.size() > 2) {
+        parser.showHelp(1);
+    }
+    const std::string input = args[0].toStdString();
+    const QFileInfo info(args[0]);
+    const QString output = args.size() == 2 ? args[1] : info.dir().filePath(info.completeBaseName() + ".csv");
+
+    try {
+        const telemetrylog::LogHeader header = telemetrylog::readHeader(input);
+        std::unique_ptr<FILE, int (*)(FILE*)> file(nullptr, std::fclose);
+        FILE* out = stdout;
+        if (output != "-") {
+            file.reset(std::fopen(output.toLocal8Bit().constData(), "w"));
+            if (!file) {
+                std::cerr << "Failed to create " << output.toStdString() << std::endl;
+                return 1;
+            }
+            out = file.get();
+        }
+        switch (header.recordType) {
+        case telemetrylog::GraphRecordType:
+            writeGraph(input, out);
+            break;
+        case telemetrylog::TileRecordType:
+            writeTiles(input, out);
+            break;
+        default:
+            std::cerr << "Unknown record type " << header.recordType << std::endl;
+            return 1;
+        }
+        if (std::fflush(out) != 0) {
+            std::cerr << "Failed to write " << output.toStdString() << std::endl;
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
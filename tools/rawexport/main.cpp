@@ -0,0 +1,129 @@
+// 記録コンテナ (.jcr) から連番BMPを書き出す。ファイル名は saveImage と同じ <フレーム番号6桁>.bmp。
+// Mono16 の記録は --tone-map (既定は全範囲) で8bitにしてから書き出す。
+#include "losslesscodec.h"
+#include "pixelformat.h"
+#include "rawcontainer.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QImage>
+#include <QtConcurrent>
+
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// ストライプを QThreadPool::globalInstance() で並列に処理して全部終わるまで待つ
+static void parallelStripes(int count, const std::function<void(int)>& function) {
+    std::vector<QFuture<void>> futures;
+    futures.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        futures.push_back(QtConcurrent::run([i, &function]() { function(i); }));
+    }
+    for (QFuture<void>& future : futures) {
+        future.waitForFinished();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Export frames of .jcr recordings as numbered BMP files.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("output", "Output directory.");
+    parser.addPositionalArgument("recordings", "One or more .jcr files.", "<file.jcr...>");
+    parser.addOption({"every", "Export every n-th frame number.", "n", "1"});
+    parser.addOption({"from", "First frame number to export.", "frame", "0"});
+    parser.addOption({"to", "Last frame number to export (-1 = until the end).", "frame", "-1"});
+    parser.addOption({"tone-map", "Window mapped to 0-255 for Mono16 recordings (default: full range).", "black,white"});
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 2) {
+        parser.showHelp(1);
+    }
+    const QDir output(args[0]);
+    if (!output.exists() && !QDir().mkpath(output.path())) {
+        std::cerr << "Failed to create " << output.path().toStdString() << std::endl;
+        return 1;
+    }
+    const int every = std::max(1, parser.value("every").toInt());
+    const int64_t from = parser.value("from").toLongLong();
+    const int64_t to = parser.value("to").toLongLong();
+    ToneMap toneMap;
+    if (!parseToneMap(parser.value("tone-map"), toneMap)) {
+        std::cerr << "Invalid --tone-map " << parser.value("tone-map").toStdString() << std::endl;
+        return 1;
+    }
+
+    size_t exported = 0;
+    for (int i = 1; i < args.size(); ++i) {
+        try {
+            rawcontainer::Reader reader(args[i].toStdString());
+            const rawcontainer::ContainerHeader& header = reader.header();
+            if (header.pixelFormat != rawcontainer::PixelMono8 && header.pixelFormat != rawcontainer::PixelMono16) {
+                std::cerr << args[i].toStdString() << ": unsupported pixel format" << std::endl;
+                continue;
+            }
+            const int bitDepth = rawcontainer::bitDepth(header);
+            const pixelformat_detail::UnpackKernelEntry toneKernel =
+                pixelformat_detail::selectUnpackKernel(unpackedFormat(bitDepth));
+            const pixelformat_detail::ToneParams toneParams = pixelformat_detail::toneParams(bitDepth, toneMap);
+            std::vector<uint16_t> wide;
+            std::vector<uint16_t> rowScratch(header.width);
+            for (size_t f = reader.seek(from); f < reader.frameCount(); ++f) {
+                const rawcontainer::Reader::Frame frame = reader.frame(f);
+                const int64_t frameNumber = frame.header->frameNumber;
+                if (to >= 0 && frameNumber > to) {
+                    break;
+                }
+                if (frameNumber % every != 0) {
+                    continue;
+                }
+                QImage image(frame.data, header.width, header.height, header.stride, QImage::Format_Grayscale8);
+                if (bitDepth > 8) {
+                    const uint8_t* src = frame.data;
+                    size_t srcStride = header.stride;
+                    if (frame.header->flags & rawcontainer::kFlagLossless) {
+                        wide.resize(static_cast<size_t>(header.width) * header.height);
+                        srcStride = static_cast<size_t>(header.width) * sizeof(uint16_t);
+                        if (!losslesscodec::decodeFrame(frame.data, frame.header->payloadSize, wide.data(), srcStride,
+                                                        header.width, header.height, bitDepth, parallelStripes)) {
+                            std::cerr << "Skipping corrupted frame " << frameNumber << std::endl;
+                            continue;
+                        }
+                        src = reinterpret_cast<const uint8_t*>(wide.data());
+                    }
+                    image = QImage(header.width, header.height, QImage::Format_Grayscale8);
+                    for (uint32_t y = 0; y < header.height; ++y) {
+                        toneKernel.kernel(src + y * srcStride, rowScratch.data(), image.scanLine(y), header.width,
+                                          toneParams);
+                    }
+                } else if (frame.header->flags & rawcontainer::kFlagLossless) {
+                    // 圧縮されたフレームはストライプを並列に復号する
+                    image = QImage(header.width, header.height, QImage::Format_Grayscale8);
+                    const bool decoded = losslesscodec::decodeFrame(
+                        frame.data, frame.header->payloadSize, image.bits(), image.bytesPerLine(), header.width,
+                        header.height, bitDepth, parallelStripes);
+                    if (!decoded) {
+                        std::cerr << "Skipping corrupted frame " << frameNumber << std::endl;
+                        continue;
+                    }
+                }
+                const QString filename = output.filePath(QString("%1.bmp").arg(frameNumber, 6, 10, QLatin1Char('0')));
+                if (!image.save(filename)) {
+                    std::cerr << "Failed to write " << filename.toStdString() << std::endl;
+                    return 1;
+                }
+                ++exported;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Exported " << exported << " frames." << std::endl;
+    return 0;
+}
@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = jetsonCamRawExport
+QT += gui concurrent
+QT -= widgets
+CONFIG += console
+include(../../common.pri)
+SOURCES += main.cpp
@@ -0,0 +1,483 @@
+// 記録済みのフレームをライブと同じ統計のコード (analyzeFrame) で解析し直し、graph_data.jtl / tile_data.jtl を書き出す。
+// 入力は saveImage の連番BMP (<フレーム番号>.bmp) のフォルダ、記録コンテナ (.jcr)、または .jcr を含むフォルダ。
+// ファイルは mmap で読み、フレーム単位で全コアに分けて解析し、フレーム順に書き出す。
+// .jcr の記録からはライブのログとバイト単位で同じレコードになる (--verify で確かめられる)。
+// Mono16 の記録は記録時の深さのままライブの16bitの経路で解析する。
+// BMP にはタイムスタンプと温度がないので、それらは 0 になる。
+#include "losslesscodec.h"
+#include "rawcontainer.h"
+#include "reductionpool.h"
+#include "statsplan.h"
+#include "telemetrylog.h"
+#include "telemetrylogger.h"
+#include "tilestats.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QThread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// 一度に解析するフレーム数。結果はこの単位でフレーム順に書き出す
+constexpr int kChunkFrames = 256;
+
+// 読み取り専用で mmap したファイル
+class MappedFile {
+public:
+    explicit MappedFile(const QString& path) {
+        const int fd = ::open(path.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return;
+        }
+        size = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            size = 0;
+            return;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const uint8_t*>(mapped);
+    }
+
+    ~MappedFile() {
+        if (data) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+template <typename T>
+T readLe(const uint8_t* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+// 無圧縮8bitのBMP (QImage が Grayscale8 を保存した形式) を mmap のまま読み、上の行から順に dst に詰める。
+// パレットが階調そのものでなければ、QImage と同じく qGray で階調値に直す。対応しない形式なら false
+bool readBmp8(const MappedFile& file, int width, int height, std::vector<uint8_t>& dst) {
+    const uint8_t* p = file.data;
+    if (!p || file.size < 54 || p[0] != 'B' || p[1] != 'M') {
+        return false;
+    }
+    const uint32_t pixelOffset = readLe<uint32_t>(p + 10);
+    const uint32_t dibSize = readLe<uint32_t>(p + 14);
+    const int32_t bmpWidth = readLe<int32_t>(p + 18);
+    const int32_t bmpHeight = readLe<int32_t>(p + 22);
+    const uint16_t bitCount = readLe<uint16_t>(p + 28);
+    const uint32_t compression = readLe<uint32_t>(p + 30);
+    uint32_t colors = readLe<uint32_t>(p + 46);
+    if (bitCount != 8 || compression != 0 || bmpWidth != width || std::abs(bmpHeight) != height) {
+        return false;
+    }
+    colors = colors == 0 ? 256 : std::min<uint32_t>(colors, 256);
+    const size_t stride = (static_cast<size_t>(width) + 3) & ~static_cast<size_t>(3);
+    if (14 + static_cast<size_t>(dibSize) + colors * 4 > file.size
+        || pixelOffset + stride * height > file.size) {
+        return false;
+    }
+
+    uint8_t lut[256] = {};
+    bool identity = true;
+    const uint8_t* palette = p + 14 + dibSize;
+    for (uint32_t i = 0; i < colors; ++i) {
+        const uint8_t b = palette[i * 4];
+        const uint8_t g = palette[i * 4 + 1];
+        const uint8_t r = palette[i * 4 + 2];
+        lut[i] = static_cast<uint8_t>(qGray(r, g, b));
+        identity = identity && r == i && g == i && b == i;
+    }
+
+    dst.resize(static_cast<size_t>(width) * height);
+    const bool bottomUp = bmpHeight > 0;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = p + pixelOffset + stride * (bottomUp ? height - 1 - y : y);
+        uint8_t* out = dst.data() + static_cast<size_t>(y) * width;
+        if (identity) {
+            std::memcpy(out, row, width);
+        } else {
+            for (int x = 0; x < width; ++x) {
+                out[x] = lut[row[x]];
+            }
+        }
+    }
+    return true;
+}
+
+// 1つの入力 (連番BMPのフォルダ1つ、または .jcr 1つ)
+struct Source {
+    QString path;
+    bool container = false;
+    std::vector<std::pair<int64_t, QString>> bmpFiles; // フレーム番号順
+};
+
+// 引数のファイル/フォルダを入力の並びにする。フォルダ内の .jcr は名前順 (= 記録の順)
+std::vector<Source> collectSources(const QStringList& paths) {
+    std::vector<Source> sources;
+    for (const QString& path : paths) {
+        const QFileInfo info(path);
+        if (info.isFile()) {
+            Source source;
+            source.path = path;
+            source.container = true;
+            sources.push_back(source);
+            continue;
+        }
+        if (!info.isDir()) {
+            throw std::runtime_error("No such file or directory: " + path.toStdString());
+        }
+        const QDir directory(path);
+        for (const QString& name : directory.entryList(QStringList() << "*.jcr", QDir::Files, QDir::Name)) {
+            Source source;
+            source.path = directory.filePath(name);
+            source.container = true;
+            sources.push_back(source);
+        }
+        Source bmp;
+        bmp.path = path;
+        for (const QString& name : directory.entryList(QStringList() << "*.bmp", QDir::Files)) {
+            bool ok = false;
+            const int64_t frameNumber = QFileInfo(name).completeBaseName().toLongLong(&ok);
+            if (ok) {
+                bmp.bmpFiles.emplace_back(frameNumber, directory.filePath(name));
+            }
+        }
+        // 6桁を超えるとファイル名の順とフレーム番号の順が変わるので数値で並べる
+        std::sort(bmp.bmpFiles.begin(), bmp.bmpFiles.end());
+        if (!bmp.bmpFiles.empty()) {
+            sources.push_back(bmp);
+        }
+    }
+    return sources;
+}
+
+struct FrameResult {
+    bool valid = false;
+    bool hasTiles = false;
+    FrameStats stats;
+    TileMap map;
+};
+
+class Reprocessor {
+public:
+    Reprocessor(ReductionPool& pool, const TileLayout* layout, int camera)
+        : pool(pool), layout(layout), camera(camera) {
+        // 並列はフレーム単位で行うので、1フレームの中は分けない
+        plan.frameStripes = 1;
+        plan.tileStripes = 1;
+        plan.simdTiles = true;
+    }
+
+    void open(const QString& directory) {
+        graph.open(QDir(directory).filePath("graph_data.jtl").toStdString());
+        if (layout) {
+            tiles.open(QDir(directory).filePath("tile_data.jtl").toStdString());
+        }
+    }
+
+    void close() {
+        graph.close();
+        tiles.close();
+    }
+
+    // 1つの入力を解析して書き出す。解析したフレーム数を返す
+    size_t process(const Source& source) {
+        return source.container ? processContainer(source.path) : processBmp(source);
+    }
+
+    uint64_t skippedFrames() const {
+        return skipped;
+    }
+
+private:
+    size_t processContainer(const QString& path) {
+        const rawcontainer::Reader reader(path.toStdString());
+        const rawcontainer::ContainerHeader& header = reader.header();
+        if (header.pixelFormat != rawcontainer::PixelMono8 && header.pixelFormat != rawcontainer::PixelMono16) {
+            std::cerr << path.toStdString() << ": unsupported pixel format, skipped" << std::endl;
+            return 0;
+        }
+        const int width = static_cast<int>(header.width);
+        const int height = static_cast<int>(header.height);
+        const int stride = static_cast<int>(header.stride);
+        const int bitDepth = rawcontainer::bitDepth(header);
+        const int bytesPerPixel = bitDepth > 8 ? 2 : 1;
+        return processFrames(reader.frameCount(), [&](size_t i, FrameResult& result) {
+            const rawcontainer::Reader::Frame frame = reader.frame(i);
+            result.stats.frameNumber = static_cast<int>(frame.header->frameNumber);
+            result.stats.timestamp = frame.header->timestamp;
+            result.stats.temp = frame.header->temp;
+            const uint8_t* data = frame.data;
+            int dataStride = stride;
+            if (frame.header->flags & rawcontainer::kFlagLossless) {
+                std::vector<uint8_t>& decoded = scratch();
+                decoded.resize(static_cast<size_t>(width) * height * bytesPerPixel);
+                if (!losslesscodec::decodeFrame(frame.data, frame.header->payloadSize, decoded.data(),
+                                                static_cast<size_t>(width) * bytesPerPixel, width, height, bitDepth)) {
+                    std::cerr << "Skipping corrupted frame " << frame.header->frameNumber << std::endl;
+                    return;
+                }
+                data = decoded.data();
+                dataStride = width * bytesPerPixel;
+            }
+            if (bitDepth > 8) {
+                // Mono16 は記録時の深さのまま解析する (ライブの16bitの経路と同じ)
+                analyze16(reinterpret_cast<const uint16_t*>(data), width, height, dataStride / 2, bitDepth, result);
+            } else {
+                analyze(data, width, height, dataStride, result);
+            }
+        });
+    }
+
+    size_t processBmp(const Source& source) {
+        const QImage first(source.bmpFiles.front().second);
+        if (first.isNull()) {
+            std::cerr << source.bmpFiles.front().second.toStdString() << ": unreadable, skipped" << std::endl;
+            return 0;
+        }
+        const int width = first.width();
+        const int height = first.height();
+        return processFrames(source.bmpFiles.size(), [&](size_t i, FrameResult& result) {
+            const QString& path = source.bmpFiles[i].second;
+            result.stats.frameNumber = static_cast<int>(source.bmpFiles[i].first);
+            std::vector<uint8_t>& pixels = scratch();
+            if (!readBmp8(MappedFile(path), width, height, pixels)) {
+                // 8bitでないBMPなどは QImage で読む (再生と同じ変換)
+                QImage image(path);
+                if (image.isNull() || image.width() != width || image.height() != height) {
+                    std::cerr << "Skipping unreadable image " << path.toStdString() << std::endl;
+                    return;
+                }
+                image = image.convertToFormat(QImage::Format_Grayscale8);
+                pixels.resize(static_cast<size_t>(width) * height);
+                for (int y = 0; y < height; ++y) {
+                    std::memcpy(pixels.data() + static_cast<size_t>(y) * width, image.constScanLine(y), width);
+                }
+            }
+            analyze(pixels.data(), width, height, width, result);
+        });
+    }
+
+    // スレッドごとの作業領域 (復号・BMPの行の並べ替え用)
+    static std::vector<uint8_t>& scratch() {
+        thread_local std::vector<uint8_t> buffer;
+        return buffer;
+    }
+
+    void analyze(const uint8_t* data, int width, int height, int stride, FrameResult& result) {
+        result.hasTiles = analyzeFrame(data, width, height, stride, layout, plan, pool, result.stats, result.map);
+        result.valid = true;
+    }
+
+    void analyze16(const uint16_t* data, int width, int height, int stride, int bitDepth, FrameResult& result) {
+        result.hasTiles =
+            analyzeFrame(data, width, height, stride, bitDepth, layout, plan, pool, result.stats, result.map);
+        result.valid = true;
+    }
+
+    // count フレームを kChunkFrames ずつ全スレッドで解析し、チャンクごとにフレーム順に書き出す
+    template <typename Load>
+    size_t processFrames(size_t count, Load load) {
+        size_t analyzed = 0;
+        std::vector<FrameResult> results;
+        for (size_t begin = 0; begin < count; begin += kChunkFrames) {
+            const int chunk = static_cast<int>(std::min<size_t>(kChunkFrames, count - begin));
+            results.assign(chunk, FrameResult());
+            pool.parallelFor(chunk, [&](int i) {
+                try {
+                    load(begin + i, results[i]);
+                } catch (const std::exception& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            });
+
+            graphBatch.clear();
+            tileBatch.clear();
+            for (const FrameResult& result : results) {
+                if (!result.valid) {
+                    ++skipped;
+                    continue;
+                }
+                graphBatch.push_back(TelemetryLogger::graphRecord(result.stats, camera));
+                if (result.hasTiles) {
+                    for (size_t t = 0; t < result.map.tiles.size(); ++t) {
+                        tileBatch.push_back(TelemetryLogger::tileRecord(result.map, camera, telemetrylog::TileRecord::Tile,
+                                                                        t, result.map.tiles[t]));
+                    }
+                    for (size_t r = 0; r < result.map.rois.size(); ++r) {
+                        tileBatch.push_back(TelemetryLogger::tileRecord(result.map, camera, telemetrylog::TileRecord::Roi,
+                                                                        r, result.map.rois[r]));
+                    }
+                }
+                ++analyzed;
+            }
+            graph.append(graphBatch.data(), graphBatch.size());
+            if (!tileBatch.empty()) {
+                tiles.append(tileBatch.data(), tileBatch.size());
+            }
+        }
+        return analyzed;
+    }
+
+    ReductionPool& pool;
+    const TileLayout* layout;
+    const int camera;
+    StatsPlan plan;
+    telemetrylog::Writer<telemetrylog::GraphRecord> graph;
+    telemetrylog::Writer<telemetrylog::TileRecord> tiles;
+    std::vector<telemetrylog::GraphRecord> graphBatch;
+    std::vector<telemetrylog::TileRecord> tileBatch;
+    uint64_t skipped = 0;
+};
+
+// 書き出したログとライブのログを同じフレーム番号どうしで比べる。全部同じなら true
+bool verifyLog(const QString& output, const QString& reference, int camera) {
+    const telemetrylog::Reader<telemetrylog::GraphRecord> ours(output.toStdString());
+    const telemetrylog::Reader<telemetrylog::GraphRecord> live(reference.toStdString());
+    std::map<int64_t, const telemetrylog::GraphRecord*> byFrame;
+    for (const telemetrylog::GraphRecord& row : live) {
+        if (static_cast<int>(row.camera) == camera) {
+            byFrame[row.frameNumber] = &row;
+        }
+    }
+    size_t identical = 0;
+    size_t different = 0;
+    size_t missing = 0;
+    for (const telemetrylog::GraphRecord& row : ours) {
+        const auto found = byFrame.find(row.frameNumber);
+        if (found == byFrame.end()) {
+            ++missing;
+        } else if (std::memcmp(found->second, &row, sizeof(row)) == 0) {
+            ++identical;
+        } else {
+            if (different++ < 10) {
+                std::cerr << "Frame " << row.frameNumber << " differs from the live log" << std::endl;
+            }
+        }
+    }
+    std::cout << "Verify: " << identical << " identical, " << different << " different, " << missing
+              << " not in " << reference.toStdString() << std::endl;
+    return different == 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Recompute graph_data.jtl / tile_data.jtl from recorded frames with the live statistics code.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("output", "Output directory for graph_data.jtl (and tile_data.jtl).");
+    parser.addPositionalArgument("inputs", "BMP directories (saveImage output), .jcr files or directories with .jcr files.",
+                                 "<input...>");
+    parser.addOption({"grid", "Tile grid size (0 = off).", "n", "0"});
+    parser.addOption({"rois", "ROIs as \"x,y,w,h; x,y,w,h\".", "list"});
+    parser.addOption({"camera", "Camera number written into the records.", "n", "0"});
+    parser.addOption({"threads", "Analysis threads (0 = all cores).", "n", "0"});
+    parser.addOption({"force", "Overwrite existing logs in the output directory."});
+    parser.addOption({"verify", "Compare the result with a live graph_data.jtl, frame by frame.", "file"});
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 2) {
+        parser.showHelp(1);
+    }
+    const QDir output(args[0]);
+    if (!output.exists() && !QDir().mkpath(output.path())) {
+        std::cerr << "Failed to create " << output.path().toStdString() << std::endl;
+        return 1;
+    }
+
+    TileLayout tileLayout;
+    tileLayout.columns = parser.value("grid").toInt();
+    tileLayout.rows = tileLayout.columns;
+    tileLayout.rois = parseRoiList(parser.value("rois"));
+    const TileLayout* layout = tileLayout.enabled() ? &tileLayout : nullptr;
+
+    // 追記して混ざらないように、既存のログは --force のときだけ消して作り直す
+    for (const char* name : {"graph_data.jtl", "tile_data.jtl"}) {
+        if (!output.exists(name)) {
+            continue;
+        }
+        if (!parser.isSet("force")) {
+            std::cerr << output.filePath(name).toStdString() << " already exists (use --force to overwrite)." << std::endl;
+            return 1;
+        }
+        QFile::remove(output.filePath(name));
+    }
+
+    int threads = parser.value("threads").toInt();
+    if (threads <= 0) {
+        threads = std::max(1, QThread::idealThreadCount());
+    }
+    // 呼び出し元のスレッドも解析するので、ワーカーは1つ少なくてよい
+    ReductionPool pool(std::vector<int>(threads - 1, -1));
+
+    try {
+        const std::vector<Source> sources = collectSources(args.mid(1));
+        if (sources.empty()) {
+            std::cerr << "No .jcr or .bmp files found." << std::endl;
+            return 1;
+        }
+        const int camera = parser.value("camera").toInt();
+        Reprocessor reprocessor(pool, layout, camera);
+        reprocessor.open(output.path());
+
+        const uint64_t start = monotonicNs();
+        size_t total = 0;
+        for (const Source& source : sources) {
+            const uint64_t sourceStart = monotonicNs();
+            const size_t frames = reprocessor.process(source);
+            const double seconds = (monotonicNs() - sourceStart) / 1e9;
+            std::printf("%s: %zu frames, %.1f fps\n", source.path.toLocal8Bit().constData(), frames,
+                        seconds > 0 ? frames / seconds : 0.0);
+            std::fflush(stdout);
+            total += frames;
+        }
+        reprocessor.close();
+        const double seconds = (monotonicNs() - start) / 1e9;
+        std::printf("%zu frames in %.1f s (%.1f fps, %d threads), %llu skipped\n", total, seconds,
+                    seconds > 0 ? total / seconds : 0.0, threads,
+                    static_cast<unsigned long long>(reprocessor.skippedFrames()));
+
+        if (parser.isSet("verify")
+            && !verifyLog(output.filePath("graph_data.jtl"), parser.value("verify"), camera)) {
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = jetsonCamReprocess
+QT += gui
+QT -= widgets
+CONFIG += console
+include(../../common.pri)
+SOURCES += main.cpp
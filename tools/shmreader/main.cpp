@@ -0,0 +1,177 @@
+// 共有メモリのリング (jetsonCamApp/jetsonCamDaemon の --shm) を読む最小の例。Qt を使わず shmframes.h だけで読む。
+// フレームは共有メモリの中をそのまま読み (コピーしない)、読み終えてから上書きされていないか確かめる。
+// 1秒ごとに受け取ったfps、追いつけずに飛ばした数、読んでいる途中に上書きされた数、取得からの遅れ、
+// 前回表示したときの最後のフレームの平均 (自前で計算) と書き手が出した統計の平均を表示する
+// (統計はフレームより後に届くので1回遅らせて比べる)。
+//   ./jetsonCamShmReader jetsoncam
+//   ./jetsonCamShmReader jetsoncam --delay 50 --seconds 10   (遅い読み手の真似)
+#include "shmframes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr,
+                 "Usage: jetsonCamShmReader <name> [--seconds n] [--delay ms] [--copy]\n"
+                 "  name       shared memory name given to --shm (/dev/shm/<name>)\n"
+                 "  --seconds  stop after n seconds (0 = never)\n"
+                 "  --delay    sleep ms after each frame to simulate a slow consumer\n"
+                 "  --copy     copy each frame out of the ring instead of reading it in place\n");
+}
+
+// 0〜255のスケールの平均 (FrameStats::mean と同じ)
+double frameMean(const uint8_t* data, int width, int height, int stride, int bitDepth) {
+    uint64_t sum = 0;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = data + static_cast<size_t>(y) * stride;
+        if (bitDepth > 8) {
+            const uint16_t* row16 = reinterpret_cast<const uint16_t*>(row);
+            for (int x = 0; x < width; ++x) {
+                sum += row16[x];
+            }
+        } else {
+            for (int x = 0; x < width; ++x) {
+                sum += row[x];
+            }
+        }
+    }
+    const double mean = static_cast<double>(sum) / (static_cast<double>(width) * height);
+    return bitDepth > 8 ? mean * 255.0 / ((1 << bitDepth) - 1) : mean;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+    const std::string name = argv[1];
+    double seconds = 0.0;
+    int delayMs = 0;
+    bool copy = false;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else if (arg == "--delay" && i + 1 < argc) {
+            delayMs = std::atoi(argv[++i]);
+        } else if (arg == "--copy") {
+            copy = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point begin = Clock::now();
+    auto expired = [&]() {
+        return seconds > 0 && std::chrono::duration<double>(Clock::now() - begin).count() >= seconds;
+    };
+
+    shmframes::Reader reader;
+    std::vector<uint8_t> buffer;
+    uint64_t received = 0;
+    uint64_t torn = 0;
+    uint64_t lastMissed = 0;  // 今の読み手で前回表示したときの missedCount()
+    uint64_t totalMissed = 0;
+    std::vector<double> latencies;
+    int64_t lastFrameNumber = -1;
+    double lastMean = 0.0;
+    int64_t comparedFrameNumber = -1;
+    double comparedMean = 0.0;
+    Clock::time_point reportTime = Clock::now();
+
+    while (!expired()) {
+        if (!reader.isOpen()) {
+            // 書き手がまだ動いていないか、作り直している
+            if (!reader.open(name)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                continue;
+            }
+            const shmframes::Header& info = reader.info();
+            std::printf("Opened %s: %ux%u, %u bytes/pixel, %u slots, writer pid %u\n", name.c_str(), info.width,
+                        info.height, info.bytesPerPixel, info.slotCount, info.writerPid);
+            std::fflush(stdout);
+            lastMissed = 0;
+        }
+
+        shmframes::Reader::Frame frame;
+        const shmframes::Reader::Result result = reader.next(frame, 200);
+        if (result == shmframes::Reader::Result::Closed) {
+            std::printf("Writer closed %s\n", name.c_str());
+            std::fflush(stdout);
+            totalMissed += reader.missedCount() - lastMissed;
+            lastMissed = 0;
+            reader.close();
+            continue;
+        }
+        if (result == shmframes::Reader::Result::Frame) {
+            bool intact;
+            double mean;
+            if (copy) {
+                buffer.resize(static_cast<size_t>(frame.stride) * frame.height);
+                intact = reader.copy(frame, buffer.data());
+                mean = frameMean(buffer.data(), frame.width, frame.height, frame.stride, frame.bitDepth);
+            } else {
+                // 共有メモリの中をそのまま読み、読み終えてから確かめる
+                mean = frameMean(frame.data, frame.width, frame.height, frame.stride, frame.bitDepth);
+                intact = reader.valid(frame);
+            }
+            if (intact) {
+                ++received;
+                latencies.push_back((shmframes::detail::monotonicNs() - frame.captureNs) / 1e6);
+                lastFrameNumber = frame.frameNumber;
+                lastMean = mean;
+            } else {
+                // 読んでいる間に書き手が1周して上書きした
+                ++torn;
+            }
+            if (delayMs > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+            }
+        }
+
+        const double elapsed = std::chrono::duration<double>(Clock::now() - reportTime).count();
+        if (elapsed < 1.0) {
+            continue;
+        }
+        double p50 = 0.0;
+        double maxLatency = 0.0;
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            p50 = latencies[latencies.size() / 2];
+            maxLatency = latencies.back();
+        }
+        const uint64_t missed = reader.isOpen() ? reader.missedCount() : lastMissed;
+        totalMissed += missed - lastMissed;
+        std::printf("%.1f fps, missed %llu, torn %llu, latency p50 %.2f ms max %.2f ms",
+                    latencies.size() / elapsed, static_cast<unsigned long long>(missed - lastMissed),
+                    static_cast<unsigned long long>(torn), p50, maxLatency);
+        shmframes::Stats stats;
+        if (comparedFrameNumber >= 0 && reader.isOpen() && reader.stats(comparedFrameNumber, stats)) {
+            std::printf(", frame %lld mean %.2f (published %.2f, cv %.4f)", static_cast<long long>(comparedFrameNumber),
+                        comparedMean, stats.mean, stats.cv);
+        }
+        std::printf("\n");
+        comparedFrameNumber = lastFrameNumber;
+        comparedMean = lastMean;
+        std::fflush(stdout);
+        lastMissed = missed;
+        latencies.clear();
+        reportTime = Clock::now();
+    }
+    std::printf("Received %llu frames, missed %llu, torn %llu\n", static_cast<unsigned long long>(received),
+                static_cast<unsigned long long>(totalMissed + (reader.isOpen() ? reader.missedCount() - lastMissed : 0)),
+                static_cast<unsigned long long>(torn));
+    return 0;
+}
@@ -0,0 +1,6 @@
+TEMPLATE = app
+TARGET = jetsonCamShmReader
+QT -= core gui
+CONFIG += console
+include(../../common.pri)
+SOURCES += main.cpp